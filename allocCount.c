@@ -0,0 +1,64 @@
+/* allocCount: count the heap allocations made by our own code, so we can check that the parts that run
+   over and over (e.g. each step of an MCMC chain) don't allocate anything
+
+   Only done if this file is compiled with ALLOC_COUNT defined, and the program is linked with -Wl,--wrap=malloc
+   (and the same for calloc, realloc and posix_memalign): the linker then sends every call to malloc in our code
+   to __wrap_malloc, which counts it and calls the real malloc
+   (--wrap is a GNU ld option, so this is off unless asked for: see ALLOC_COUNT in the Makefile)
+
+   Creation date: 10/18/26
+*/
+
+#include <stdlib.h>
+#include "allocCount.h"
+
+#ifdef ALLOC_COUNT
+
+static long numAllocations = 0; // only changed atomically, since any thread can allocate
+
+
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t num, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+int __real_posix_memalign(void **ptr, size_t alignment, size_t size);
+
+
+void *__wrap_malloc(size_t size) {
+  __atomic_add_fetch(&numAllocations, 1, __ATOMIC_RELAXED);
+  return __real_malloc(size);
+}
+
+
+void *__wrap_calloc(size_t num, size_t size) {
+  __atomic_add_fetch(&numAllocations, 1, __ATOMIC_RELAXED);
+  return __real_calloc(num, size);
+}
+
+
+void *__wrap_realloc(void *ptr, size_t size) {
+  __atomic_add_fetch(&numAllocations, 1, __ATOMIC_RELAXED);
+  return __real_realloc(ptr, size);
+}
+
+
+int __wrap_posix_memalign(void **ptr, size_t alignment, size_t size) {
+  __atomic_add_fetch(&numAllocations, 1, __ATOMIC_RELAXED);
+  return __real_posix_memalign(ptr, alignment, size);
+}
+
+
+/* return the number of heap allocations (calls to malloc, calloc, realloc and posix_memalign from our own code)
+   made so far, by all threads
+*/
+long getNumAllocations(void) {
+  return __atomic_load_n(&numAllocations, __ATOMIC_RELAXED);
+}
+
+#else
+
+// allocations aren't being counted
+long getNumAllocations(void) {
+  return -1;
+}
+
+#endif
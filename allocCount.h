@@ -0,0 +1,14 @@
+// header file for allocCount.c
+// counts the heap allocations made by our own code
+
+#ifndef ALLOC_COUNT_H
+#define ALLOC_COUNT_H
+
+/* return the number of heap allocations (calls to malloc, calloc, realloc and posix_memalign from our own code)
+   made so far, by all threads; or -1 if allocations aren't being counted
+   They're only counted in programs built with ALLOC_COUNT=1 (see the Makefile), which links with -Wl,--wrap for each of
+   these functions; calls made from inside the C library (e.g. by fopen) aren't counted
+*/
+long getNumAllocations(void);
+
+#endif
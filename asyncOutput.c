@@ -0,0 +1,194 @@
+/* asyncOutput: a queue of output records, written out by a background thread
+
+   The producer (e.g. a model run) fills in fixed-size records and pushes them; a writer thread takes them
+   in order and formats and writes them, so the producer doesn't spend its time in stdio
+   The queue is a ring buffer with a single producer and a single consumer: each side only ever advances its own
+   counter, so neither needs a lock while there's room (producer) or something to write (writer).
+   Only when the ring is full or empty does a side take the lock and wait for the other to signal it,
+   and then only once there's a batch of records (or free space) for it, so the two threads don't wake each other
+   for every record (which is slow, especially if they share a processor)
+
+   Creation date: 10/18/26
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include "asyncOutput.h"
+
+
+struct AsyncOutputStruct {
+  char *records; // capacity records, each recordSize bytes
+  int recordSize; // (rounded up to a multiple of sizeof(double))
+  long capacity;
+  long wakeBatch; // a waiting side isn't woken until there are this many records to write or this much free space
+
+  void (*writeRecord)(void *, void *);
+  void *writeInfo;
+  pthread_t writer;
+
+  // records numbered 0, 1, 2, ... are stored at (number % capacity): record i has been pushed if i < numPushed,
+  // and written if i < numWritten (so the ring is full when numPushed - numWritten == capacity, and empty when they're equal)
+  atomic_long numPushed; // only changed by the producer
+  atomic_long numWritten; // only changed by the writer
+  atomic_int finished; // set by finishAsyncOutput: no more records will be pushed
+
+  // for waiting when the ring is full (producer) or empty (writer):
+  pthread_mutex_t lock;
+  pthread_cond_t spaceFree; // signalled by the writer if producerWaiting is set
+  pthread_cond_t recordPushed; // signalled by the producer (or finishAsyncOutput) if writerWaiting is set
+  atomic_int producerWaiting;
+  atomic_int writerWaiting;
+};
+
+
+/* Wait on cond until done(asyncOut) is true, having first set *waiting
+   (the other side checks *waiting after changing what done looks at, and if it's set, signals cond while holding the lock:
+    since we set *waiting before our last check of done, and all these atomics are sequentially consistent,
+    either we see the change or the other side sees *waiting, so we never wait for a signal that has already been sent)
+*/
+void waitUntil(AsyncOutput *asyncOut, int (*done)(AsyncOutput *), pthread_cond_t *cond, atomic_int *waiting) {
+  pthread_mutex_lock(&(asyncOut->lock));
+  atomic_store(waiting, 1);
+  while (!(*done)(asyncOut))
+    pthread_cond_wait(cond, &(asyncOut->lock));
+  atomic_store(waiting, 0);
+  pthread_mutex_unlock(&(asyncOut->lock));
+}
+
+
+// if the other side is waiting on cond (i.e. *waiting is set) for done(asyncOut) to be true, and it is, wake it up
+void wakeUp(AsyncOutput *asyncOut, int (*done)(AsyncOutput *), pthread_cond_t *cond, atomic_int *waiting) {
+  if (atomic_load(waiting) && (*done)(asyncOut)) {
+    pthread_mutex_lock(&(asyncOut->lock));
+    pthread_cond_signal(cond);
+    pthread_mutex_unlock(&(asyncOut->lock));
+  }
+}
+
+
+// return the number of records pushed but not yet written
+long numWaiting(AsyncOutput *asyncOut) {
+  return atomic_load(&(asyncOut->numPushed)) - atomic_load(&(asyncOut->numWritten));
+}
+
+
+// return 1 if there's room in the ring for another record
+int haveSpace(AsyncOutput *asyncOut) {
+  return (numWaiting(asyncOut) < asyncOut->capacity);
+}
+
+
+// return 1 if there's room in the ring for a batch of records (so it's worth waking the producer)
+int haveSpaceBatch(AsyncOutput *asyncOut) {
+  return (asyncOut->capacity - numWaiting(asyncOut) >= asyncOut->wakeBatch);
+}
+
+
+// return 1 if there's a record for the writer to write, or if no more records are coming
+int haveRecordOrFinished(AsyncOutput *asyncOut) {
+  return (numWaiting(asyncOut) > 0 || atomic_load(&(asyncOut->finished)));
+}
+
+
+// return 1 if there's a batch of records for the writer to write (so it's worth waking the writer), or if no more records are coming
+int haveRecordBatchOrFinished(AsyncOutput *asyncOut) {
+  return (numWaiting(asyncOut) >= asyncOut->wakeBatch || atomic_load(&(asyncOut->finished)));
+}
+
+
+// main loop of the writer thread: write each record as it's pushed, until finished and there are no more
+void *asyncWriterMain(void *arg) {
+  AsyncOutput *asyncOut = (AsyncOutput *)arg;
+  long i;
+
+  while (1) {
+    if (!haveRecordOrFinished(asyncOut))
+      waitUntil(asyncOut, haveRecordBatchOrFinished, &(asyncOut->recordPushed), &(asyncOut->writerWaiting));
+
+    i = atomic_load(&(asyncOut->numWritten));
+    if (i == atomic_load(&(asyncOut->numPushed))) // nothing left to write, so we must be finished
+      break;
+
+    (*(asyncOut->writeRecord))(asyncOut->records + (i % asyncOut->capacity) * asyncOut->recordSize, asyncOut->writeInfo);
+    atomic_store(&(asyncOut->numWritten), i + 1);
+    wakeUp(asyncOut, haveSpaceBatch, &(asyncOut->spaceFree), &(asyncOut->producerWaiting));
+  }
+
+  return NULL;
+}
+
+
+/* PRE: recordSize >= 1, capacity >= 1
+   allocate and return a new queue holding up to capacity records of recordSize bytes each,
+   and start a writer thread that calls writeRecord(record, writeInfo) for each record pushed, in the order they were pushed
+*/
+AsyncOutput *newAsyncOutput(int recordSize, int capacity, void (*writeRecord)(void *, void *), void *writeInfo) {
+  AsyncOutput *asyncOut;
+
+  if (recordSize < 1 || capacity < 1) {
+    printf("Error in newAsyncOutput: recordSize = %d, capacity = %d: both must be >= 1\n", recordSize, capacity);
+    exit(1);
+  }
+
+  asyncOut = (AsyncOutput *)malloc(sizeof(AsyncOutput));
+  asyncOut->recordSize = ((recordSize + sizeof(double) - 1)/sizeof(double)) * sizeof(double);
+  asyncOut->capacity = capacity;
+  asyncOut->wakeBatch = (capacity + 1)/2;
+  asyncOut->records = (char *)malloc((size_t)asyncOut->capacity * asyncOut->recordSize);
+  if (asyncOut->records == NULL) {
+    printf("Error in newAsyncOutput: couldn't allocate space for %d records of %d bytes\n", capacity, recordSize);
+    exit(1);
+  }
+  asyncOut->writeRecord = writeRecord;
+  asyncOut->writeInfo = writeInfo;
+
+  atomic_init(&(asyncOut->numPushed), 0);
+  atomic_init(&(asyncOut->numWritten), 0);
+  atomic_init(&(asyncOut->finished), 0);
+  atomic_init(&(asyncOut->producerWaiting), 0);
+  atomic_init(&(asyncOut->writerWaiting), 0);
+  pthread_mutex_init(&(asyncOut->lock), NULL);
+  pthread_cond_init(&(asyncOut->spaceFree), NULL);
+  pthread_cond_init(&(asyncOut->recordPushed), NULL);
+
+  if (pthread_create(&(asyncOut->writer), NULL, asyncWriterMain, asyncOut) != 0) {
+    printf("Error in newAsyncOutput: couldn't create writer thread\n");
+    exit(1);
+  }
+
+  return asyncOut;
+}
+
+
+/* Return a pointer to the space for the next record, to be filled in and then pushed with pushAsyncOutput
+   If the queue is full, waits until the writer has emptied half of it
+*/
+void *nextAsyncOutputRecord(AsyncOutput *asyncOut) {
+  if (!haveSpace(asyncOut))
+    waitUntil(asyncOut, haveSpaceBatch, &(asyncOut->spaceFree), &(asyncOut->producerWaiting));
+
+  return asyncOut->records + (atomic_load(&(asyncOut->numPushed)) % asyncOut->capacity) * asyncOut->recordSize;
+}
+
+
+// hand the record filled in since the last call to nextAsyncOutputRecord to the writer thread
+void pushAsyncOutput(AsyncOutput *asyncOut) {
+  atomic_fetch_add(&(asyncOut->numPushed), 1);
+  wakeUp(asyncOut, haveRecordBatchOrFinished, &(asyncOut->recordPushed), &(asyncOut->writerWaiting));
+}
+
+
+// wait until every record pushed so far has been written, stop the writer thread, and free all space used by asyncOut
+void finishAsyncOutput(AsyncOutput *asyncOut) {
+  atomic_store(&(asyncOut->finished), 1);
+  wakeUp(asyncOut, haveRecordBatchOrFinished, &(asyncOut->recordPushed), &(asyncOut->writerWaiting));
+  pthread_join(asyncOut->writer, NULL);
+
+  pthread_mutex_destroy(&(asyncOut->lock));
+  pthread_cond_destroy(&(asyncOut->spaceFree));
+  pthread_cond_destroy(&(asyncOut->recordPushed));
+  free(asyncOut->records);
+  free(asyncOut);
+}
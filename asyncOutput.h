@@ -0,0 +1,34 @@
+// header file for asyncOutput.c
+// a queue of output records, written out by a background thread so the thread producing them doesn't wait for the writing
+
+#ifndef ASYNC_OUTPUT_H
+#define ASYNC_OUTPUT_H
+
+typedef struct AsyncOutputStruct AsyncOutput;
+
+
+/* PRE: recordSize >= 1, capacity >= 1
+   allocate and return a new queue holding up to capacity records of recordSize bytes each,
+   and start a writer thread that calls writeRecord(record, writeInfo) for each record pushed, in the order they were pushed
+   (writeRecord is only ever called on the writer thread, so it can use writeInfo without any locking,
+    as long as nothing else touches what writeInfo refers to until finishAsyncOutput returns)
+*/
+AsyncOutput *newAsyncOutput(int recordSize, int capacity, void (*writeRecord)(void *, void *), void *writeInfo);
+
+
+/* Return a pointer to the space for the next record (recordSize bytes, aligned for doubles), to be filled in and then pushed
+   with pushAsyncOutput
+   If the queue is full (i.e. the writer is capacity records behind), waits until the writer has emptied half of it
+   (this is the only way the producer is slowed down by the writer: so capacity sets how far behind the writer can get)
+*/
+void *nextAsyncOutputRecord(AsyncOutput *asyncOut);
+
+
+// hand the record filled in since the last call to nextAsyncOutputRecord to the writer thread
+void pushAsyncOutput(AsyncOutput *asyncOut);
+
+
+// wait until every record pushed so far has been written, stop the writer thread, and free all space used by asyncOut
+void finishAsyncOutput(AsyncOutput *asyncOut);
+
+#endif
@@ -0,0 +1,431 @@
+/* benchmark: A stand-alone program to time model runs
+   Usage: benchmark [-h] [-n numRuns] [-l loc] [-d numDataTypes] [-o optIndicesExt] [-t numThreads] [-e ensembleSize] fileName
+
+   Reads fileName.param, fileName.param-spatial and fileName.clim,
+   then runs the model numRuns times (without outputting to file),
+   and prints the time taken to read the inputs and the number of model time steps run per second
+   With -d, also reads the data (fileName.dat, .valid, .sigma and .spd, as estimate does), and times numRuns evaluations
+   of the difference (costFunction 1) against the first numDataTypes data types with fusedDifference and difference,
+   both with and without the aggregate info (outputInfo) that is only needed for points written to the hist files
+   (-o gives the extension of a file of optimization indices, as for estimate's OPT_INDICES_EXT)
+   With -t, also times numRuns forward runs at all locations with output (as sipnet writes to fileName.out, but to a
+   temporary file), on one thread with runModelOutput and on numThreads threads with runModelOutputParallel,
+   checks that both give the same output, and prints the number of locations run per second
+   With -e, also times numRuns runs done in ensembles of ensembleSize (with runEnsembleNoOut),
+   and compares the output of each member of an ensemble whose members have different parameter values
+   with that of the same run done on its own
+
+   Creation date: 10/18/26
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h> // for command-line arguments
+#include <sys/time.h>
+#include "sipnet.h"
+#include "util.h"
+#include "spatialParams.h"
+#include "paramchange.h"
+#include "parallelRun.h"
+#include "ensembleKernel.h"
+
+#define FILE_MAXNAME 256
+#define NUM_RUNS 100
+#define LOC -1 // default is run at all locations
+#define NUM_COMPARE_TYPES 0 // default is not to time model-data comparisons
+#define VALID_FRAC 0.5 // for model-data comparisons: as estimate's default
+#define NUM_THREADS 0 // default is not to time forward runs with output
+#define ENSEMBLE_SIZE 0 // default is not to time ensemble runs
+#define ENSEMBLE_PARAM_STEP 0.01 // for checking ensemble runs: member m gets parameters in ensembleParams multiplied by 1 + m * this
+
+// for checking ensemble runs: parameters (used in the photosynthesis that ensembles do together) given different values in each member
+static char *ensembleParams[] = {"aMax", "halfSatPar", "attenuation", "dVpdSlope"};
+#define NUM_ENSEMBLE_PARAMS (sizeof(ensembleParams)/sizeof(ensembleParams[0]))
+
+
+void usage(char *progName)  {
+  printf("Usage: %s [-h] [-n numRuns] [-l loc] [-d numDataTypes] [-o optIndicesExt] [-t numThreads] [-e ensembleSize] fileName\n", progName);
+  printf("[-h] : Print this usage message and exit\n");
+  printf("[-n numRuns]: Number of times to run the model\n");
+  printf("\tDefault: %d\n", NUM_RUNS);
+  printf("[-l loc]: Location to run at (-1 means run at all locations)\n");
+  printf("\tDefault: %d\n", LOC);
+  printf("[-d numDataTypes]: Also time model-data comparisons against the first numDataTypes data types,\n");
+  printf("\twith and without aggregate info (needs fileName.dat, .valid, .sigma and .spd)\n");
+  printf("\tDefault: %d (don't)\n", NUM_COMPARE_TYPES);
+  printf("[-o optIndicesExt]: For model-data comparisons: read optimization indices from fileName.optIndicesExt\n");
+  printf("\tDefault: use all data points\n");
+  printf("[-t numThreads]: Also time forward runs with output at all locations, on 1 and on numThreads threads\n");
+  printf("\tDefault: %d (don't)\n", NUM_THREADS);
+  printf("[-e ensembleSize]: Also time the runs done in ensembles of ensembleSize members, run together,\n");
+  printf("\tand check each member's output against the same run done on its own\n");
+  printf("\tDefault: %d (don't)\n", ENSEMBLE_SIZE);
+  printf("fileName: base name of the .param, .param-spatial and .clim files\n");
+}
+
+
+// return the current wall-clock time, in seconds
+double wallTime(void)  {
+  struct timeval tv;
+
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec + tv.tv_usec * 1e-6;
+}
+
+
+/* do numRuns evaluations of likely (costFunction 1) at each location firstLoc..lastLoc, filling outputInfo[loc]
+   (or without aggregate info, if outputInfo is NULL)
+   return the time taken per evaluation, in seconds
+*/
+double timeEvals(double (*likely)(double *, OutputInfo *, int, SpatialParams *, double,
+				  void (*)(double **, int, int *, SpatialParams *, int), int [], int, int, double []),
+		 OutputInfo **outputInfo, double *sigma, SpatialParams *spatialParams, int firstLoc, int lastLoc, int numRuns,
+		 int dataTypeIndices[], int numDataTypes, double dataTypeWeights[])  {
+  int runNum, currLoc;
+  double start;
+
+  start = wallTime();
+  for (runNum = 0; runNum < numRuns; runNum++)
+    for (currLoc = firstLoc; currLoc <= lastLoc; currLoc++)
+      (*likely)(sigma, (outputInfo != NULL) ? outputInfo[currLoc] : NULL, currLoc, spatialParams, 0.0, runModelNoOut,
+		dataTypeIndices, numDataTypes, 1, dataTypeWeights);
+
+  return (wallTime() - start)/((double)numRuns * (lastLoc - firstLoc + 1));
+}
+
+
+/* do numRuns forward runs at all locations, writing output to a new temporary file each time
+   (on one thread with runModelOutput if numThreads is 0, otherwise on numThreads threads with runModelOutputParallel)
+   return the time taken, in seconds, and put the output of the last run in *out (rewound to the start)
+*/
+double timeForwardRuns(SpatialParams *spatialParams, int numRuns, int numThreads, FILE **out)  {
+  int runNum;
+  double start;
+
+  *out = NULL;
+  start = wallTime();
+  for (runNum = 0; runNum < numRuns; runNum++)  {
+    if (*out != NULL)
+      fclose(*out);
+    *out = tmpfile();
+    if (*out == NULL)  {
+      printf("ERROR: couldn't create temporary file for model output\n");
+      exit(1);
+    }
+    if (numThreads == 0)
+      runModelOutput(*out, NULL, 1, spatialParams, -1);
+    else
+      runModelOutputParallel(*out, NULL, 1, spatialParams, numThreads);
+    fflush(*out);
+  }
+
+  rewind(*out);
+  return wallTime() - start;
+}
+
+
+/* do numRuns runs at each location firstLoc..lastLoc (without output), in ensembles of ensembleSize members run together
+   (the last ensemble at each location may be smaller); steps[loc] is the number of time steps at loc,
+   and maxSteps the largest of these
+   return the time taken, in seconds
+*/
+double timeEnsembleRuns(SpatialParams *spatialParams, int firstLoc, int lastLoc, int *steps, int maxSteps, int numRuns, int ensembleSize,
+			int dataTypeIndices[], int numDataTypes)  {
+  SipnetEnsemble *ens;
+  double ***models;
+  int runNum, currLoc, numMembers, member;
+  double start, time;
+
+  ens = newSipnetEnsemble(ensembleSize);
+  models = (double ***)malloc(ensembleSize * sizeof(double **));
+  for (member = 0; member < ensembleSize; member++)
+    models[member] = make2DArray(maxSteps, numDataTypes);
+
+  start = wallTime();
+  for (runNum = 0; runNum < numRuns; runNum += numMembers)  {
+    numMembers = (numRuns - runNum < ensembleSize) ? numRuns - runNum : ensembleSize;
+    for (currLoc = firstLoc; currLoc <= lastLoc; currLoc++)  {
+      for (member = 0; member < numMembers; member++)
+	setupEnsembleMember(ens, member, spatialParams, currLoc);
+      runEnsembleNoOut(ens, numMembers, models, numDataTypes, dataTypeIndices);
+    }
+  }
+  time = wallTime() - start;
+
+  for (member = 0; member < ensembleSize; member++)
+    free2DArray((void **)models[member]);
+  free(models);
+  deleteSipnetEnsemble(ens);
+
+  return time;
+}
+
+
+/* at each location firstLoc..lastLoc (with steps[loc] time steps), run an ensemble of ensembleSize members, each with different values of the ensembleParams
+   (member m has them multiplied by 1 + m * ENSEMBLE_PARAM_STEP), then do each member's run on its own with runModelNoOut
+   put the largest absolute difference between any output of an ensemble member and the same output of the single run in *maxDiff,
+   and the largest relative difference in *maxRelDiff: relative to the largest magnitude of that output over the single run
+   (rather than to the value itself, which can be close to 0)
+   (the parameter values in spatialParams are put back as they were)
+*/
+void checkEnsembleRuns(SpatialParams *spatialParams, int firstLoc, int lastLoc, int *steps, int maxSteps, int ensembleSize,
+		       int dataTypeIndices[], int numDataTypes, double *maxDiff, double *maxRelDiff)  {
+  SipnetEnsemble *ens;
+  double ***models;
+  double **model;
+  int paramIndices[NUM_ENSEMBLE_PARAMS];
+  double origValues[NUM_ENSEMBLE_PARAMS];
+  int currLoc, member, i, step, type;
+  double diff, scale;
+
+  for (i = 0; i < NUM_ENSEMBLE_PARAMS; i++)
+    paramIndices[i] = locateParam(spatialParams, ensembleParams[i]); // (-1 if the parameter doesn't exist: then leave it alone)
+
+  ens = newSipnetEnsemble(ensembleSize);
+  models = (double ***)malloc(ensembleSize * sizeof(double **));
+  for (member = 0; member < ensembleSize; member++)
+    models[member] = make2DArray(maxSteps, numDataTypes);
+  model = make2DArray(maxSteps, numDataTypes);
+
+  *maxDiff = *maxRelDiff = 0.0;
+  for (currLoc = firstLoc; currLoc <= lastLoc; currLoc++)  {
+    for (i = 0; i < NUM_ENSEMBLE_PARAMS; i++)
+      if (paramIndices[i] != -1)
+	origValues[i] = getSpatialParam(spatialParams, paramIndices[i], currLoc);
+
+    // run the ensemble:
+    for (member = 0; member < ensembleSize; member++)  {
+      for (i = 0; i < NUM_ENSEMBLE_PARAMS; i++)
+	if (paramIndices[i] != -1)
+	  setSpatialParam(spatialParams, paramIndices[i], currLoc, origValues[i] * (1 + member * ENSEMBLE_PARAM_STEP));
+      setupEnsembleMember(ens, member, spatialParams, currLoc);
+    }
+    runEnsembleNoOut(ens, ensembleSize, models, numDataTypes, dataTypeIndices);
+
+    // now do each member's run on its own, and compare:
+    for (member = 0; member < ensembleSize; member++)  {
+      for (i = 0; i < NUM_ENSEMBLE_PARAMS; i++)
+	if (paramIndices[i] != -1)
+	  setSpatialParam(spatialParams, paramIndices[i], currLoc, origValues[i] * (1 + member * ENSEMBLE_PARAM_STEP));
+      runModelNoOut(model, numDataTypes, dataTypeIndices, spatialParams, currLoc);
+
+      for (type = 0; type < numDataTypes; type++)  {
+	scale = 0.0; // largest magnitude of this output in the single run
+	for (step = 0; step < steps[currLoc]; step++)
+	  scale = fmax(scale, fabs(model[step][type]));
+	for (step = 0; step < steps[currLoc]; step++)  {
+	  diff = fabs(models[member][step][type] - model[step][type]);
+	  if (diff > *maxDiff)
+	    *maxDiff = diff;
+	  if (scale > 0 && diff/scale > *maxRelDiff)
+	    *maxRelDiff = diff/scale;
+	}
+      }
+    }
+
+    for (i = 0; i < NUM_ENSEMBLE_PARAMS; i++)
+      if (paramIndices[i] != -1)
+	setSpatialParam(spatialParams, paramIndices[i], currLoc, origValues[i]);
+  }
+
+  free2DArray((void **)model);
+  for (member = 0; member < ensembleSize; member++)
+    free2DArray((void **)models[member]);
+  free(models);
+  deleteSipnetEnsemble(ens);
+}
+
+
+// return 1 if files a and b (both at their start) have the same contents, 0 if not
+int sameContents(FILE *a, FILE *b)  {
+  int ca, cb;
+
+  do  {
+    ca = getc(a);
+    cb = getc(b);
+  } while (ca == cb && ca != EOF);
+
+  return (ca == cb);
+}
+
+
+int main(int argc, char *argv[]) {
+  char option;
+  int numRuns = NUM_RUNS, loc = LOC, numCompareTypes = NUM_COMPARE_TYPES, numThreads = NUM_THREADS, ensembleSize = ENSEMBLE_SIZE;
+  char paramFile[FILE_MAXNAME+24], climFile[FILE_MAXNAME+24], optIndicesExt[FILE_MAXNAME] = "", optIndicesFile[FILE_MAXNAME+FILE_MAXNAME+8] = "";
+  SpatialParams *spatialParams;
+  int numLocs;
+  int *steps;
+  int dataTypeIndices[MAX_DATA_TYPES];
+  int numDataTypes;
+  double **model;
+  int firstLoc, lastLoc, currLoc, maxSteps;
+  long totSteps;
+  int runNum, i;
+  double start, readTime, runTime;
+  double dataTypeWeights[MAX_DATA_TYPES];
+  double *sigma;
+  OutputInfo **outputInfo;
+  FILE *readDataOut;
+  double fusedWith, fusedWithout, diffWith, diffWithout; // time per evaluation
+  double serialTime, parallelTime;
+  FILE *serialOut, *parallelOut;
+  double ensembleTime;
+  double maxDiff, maxRelDiff;
+
+  while ((option = getopt(argc, argv, "hn:l:d:o:t:e:")) != -1) {
+    switch(option) {
+    case 'h':
+      usage(argv[0]);
+      exit(1);
+      break;
+    case 'n':
+      numRuns = atoi(optarg);
+      break;
+    case 'l':
+      loc = atoi(optarg);
+      break;
+    case 'd':
+      numCompareTypes = atoi(optarg);
+      break;
+    case 'o':
+      if (strlen(optarg) >= FILE_MAXNAME)  {
+	usage(argv[0]);
+	exit(1);
+      }
+      strcpy(optIndicesExt, optarg);
+      break;
+    case 't':
+      numThreads = atoi(optarg);
+      break;
+    case 'e':
+      ensembleSize = atoi(optarg);
+      break;
+    default:
+      usage(argv[0]);
+      exit(1);
+    }
+  }
+
+  if (optind != argc - 1 || strlen(argv[optind]) >= FILE_MAXNAME
+      || numCompareTypes < 0 || numCompareTypes > MAX_DATA_TYPES || numThreads < 0 || ensembleSize < 0)  {
+    usage(argv[0]);
+    exit(1);
+  }
+
+  buildFileName(paramFile, argv[optind], "param");
+  buildFileName(climFile, argv[optind], "clim");
+
+  start = wallTime();
+  if (loc == -1)
+    numLocs = initModel(&spatialParams, &steps, paramFile, climFile);
+  else // only read climate at loc
+    numLocs = initModelLocs(&spatialParams, &steps, paramFile, climFile, 1, &loc);
+  readTime = wallTime() - start;
+
+  if (loc == -1)  {
+    firstLoc = 0;
+    lastLoc = numLocs - 1;
+  }
+  else if (loc >= 0 && loc < numLocs)
+    firstLoc = lastLoc = loc;
+  else  {
+    printf("ERROR: loc = %d, but numLocs = %d\n", loc, numLocs);
+    exit(1);
+  }
+
+  // output all data types, as in a monte carlo statsOnly run:
+  numDataTypes = MAX_DATA_TYPES;
+  for (i = 0; i < numDataTypes; i++)
+    dataTypeIndices[i] = i;
+
+  maxSteps = 0;
+  for (currLoc = firstLoc; currLoc <= lastLoc; currLoc++)
+    if (steps[currLoc] > maxSteps)
+      maxSteps = steps[currLoc];
+  model = make2DArray(maxSteps, numDataTypes);
+
+  totSteps = 0;
+  start = wallTime();
+  for (runNum = 0; runNum < numRuns; runNum++)  {
+    for (currLoc = firstLoc; currLoc <= lastLoc; currLoc++)  {
+      runModelNoOut(model, numDataTypes, dataTypeIndices, spatialParams, currLoc);
+      totSteps += steps[currLoc];
+    }
+  }
+  runTime = wallTime() - start;
+
+  printf("Read inputs (%d locations): %.4f sec\n", numLocs, readTime);
+  printf("%d runs, %ld steps: %.4f sec, %.0f steps/sec\n", numRuns, totSteps, runTime,
+	 (runTime > 0) ? totSteps/runTime : 0.0);
+
+  if (numCompareTypes > 0)  { // time model-data comparisons, with and without aggregate info
+    if (strlen(optIndicesExt) > 0)
+      buildFileName(optIndicesFile, argv[optind], optIndicesExt);
+    readDataOut = tmpfile(); // (we don't want readData's messages)
+    readData(argv[optind], dataTypeIndices, numCompareTypes, MAX_DATA_TYPES, numLocs, steps, VALID_FRAC, optIndicesFile, "",
+	     (readDataOut != NULL) ? readDataOut : stdout);
+    if (readDataOut != NULL)
+      fclose(readDataOut);
+
+    for (i = 0; i < MAX_DATA_TYPES; i++)
+      dataTypeWeights[i] = 1.0;
+    sigma = makeArray(numCompareTypes);
+    outputInfo = (OutputInfo **)malloc(numLocs * sizeof(OutputInfo *));
+    for (currLoc = 0; currLoc < numLocs; currLoc++)
+      outputInfo[currLoc] = newOutputInfo(numCompareTypes, currLoc);
+
+    fusedWith = timeEvals(fusedDifference, outputInfo, sigma, spatialParams, firstLoc, lastLoc, numRuns,
+			  dataTypeIndices, numCompareTypes, dataTypeWeights);
+    fusedWithout = timeEvals(fusedDifference, NULL, sigma, spatialParams, firstLoc, lastLoc, numRuns,
+			     dataTypeIndices, numCompareTypes, dataTypeWeights);
+    diffWith = timeEvals(difference, outputInfo, sigma, spatialParams, firstLoc, lastLoc, numRuns,
+			 dataTypeIndices, numCompareTypes, dataTypeWeights);
+    diffWithout = timeEvals(difference, NULL, sigma, spatialParams, firstLoc, lastLoc, numRuns,
+			    dataTypeIndices, numCompareTypes, dataTypeWeights);
+
+    printf("Model-data comparisons (%d data types), time per evaluation:\n", numCompareTypes);
+    printf("  fusedDifference: %.3f ms with aggregate info, %.3f ms without (%.1f%% saved)\n",
+	   fusedWith * 1e3, fusedWithout * 1e3, (fusedWith > 0) ? 100.0 * (fusedWith - fusedWithout)/fusedWith : 0.0);
+    printf("  difference:      %.3f ms with aggregate info, %.3f ms without (%.1f%% saved)\n",
+	   diffWith * 1e3, diffWithout * 1e3, (diffWith > 0) ? 100.0 * (diffWith - diffWithout)/diffWith : 0.0);
+
+    for (currLoc = 0; currLoc < numLocs; currLoc++)
+      freeOutputInfo(outputInfo[currLoc], numCompareTypes);
+    free(outputInfo);
+    free(sigma);
+    cleanupParamchange();
+  }
+
+  if (ensembleSize > 0)  { // time runs done in ensembles, and check them against single runs
+    ensembleTime = timeEnsembleRuns(spatialParams, firstLoc, lastLoc, steps, maxSteps, numRuns, ensembleSize,
+				    dataTypeIndices, numDataTypes);
+    printf("Ensembles of %d members (%s kernel): %d runs, %ld steps: %.4f sec, %.0f steps/sec (%.2f times as fast)\n",
+	   ensembleSize, ensembleKernelName(), numRuns, totSteps, ensembleTime, (ensembleTime > 0) ? totSteps/ensembleTime : 0.0,
+	   (ensembleTime > 0) ? runTime/ensembleTime : 0.0);
+    checkEnsembleRuns(spatialParams, firstLoc, lastLoc, steps, maxSteps, ensembleSize, dataTypeIndices, numDataTypes, &maxDiff, &maxRelDiff);
+    printf("  largest difference from single runs: %g (relative to the output's largest magnitude: %g)\n", maxDiff, maxRelDiff);
+  }
+
+  if (numThreads > 0)  { // time forward runs with output at all locations, on one thread and on numThreads threads
+    serialTime = timeForwardRuns(spatialParams, numRuns, 0, &serialOut);
+    parallelTime = timeForwardRuns(spatialParams, numRuns, numThreads, &parallelOut);
+    printf("Forward runs with output at all %d locations (%d runs):\n", numLocs, numRuns);
+    printf("  1 thread:   %.4f sec, %.1f locations/sec\n", serialTime,
+	   (serialTime > 0) ? (double)numRuns * numLocs/serialTime : 0.0);
+    printf("  %d thread(s): %.4f sec, %.1f locations/sec (%.2f times as fast)\n", numThreads, parallelTime,
+	   (parallelTime > 0) ? (double)numRuns * numLocs/parallelTime : 0.0, (parallelTime > 0) ? serialTime/parallelTime : 0.0);
+    printf("  outputs are %s\n", sameContents(serialOut, parallelOut) ? "identical" : "DIFFERENT");
+    fclose(serialOut);
+    fclose(parallelOut);
+  }
+
+  free2DArray((void **)model);
+  cleanupModel(numLocs);
+  deleteSpatialParams(spatialParams);
+  free(steps);
+
+  return 0;
+}
@@ -0,0 +1,179 @@
+/* binaryOutput: self-describing binary, column-oriented model output
+
+   Rather than formatting every value of every time step as text, the output is kept in memory a chunk of time steps at a time,
+   and written one column at a time, as raw floats or doubles (see binaryOutput.h for the file format)
+   The file is several times smaller than the text version, and a reader can load a single variable
+   without parsing (or even reading) the others; outbintotxt converts it back to the text layout
+
+   Creation date: 10/18/26
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "binaryOutput.h"
+
+
+/* PRE: out is open for binary writing, and nothing has been written to it yet
+   write the header of a binary output file with the given columns to out,
+   and return a new BinaryOutput for writing its values
+*/
+BinaryOutput *newBinaryOutput(FILE *out, int numColumns, char *names[], char *units[], int valueSize, int maxChunkSteps, int flags) {
+  BinaryOutput *binOut;
+  char name[BINARY_OUTPUT_NAME_LEN];
+  int c;
+
+  if (valueSize != sizeof(float) && valueSize != sizeof(double)) {
+    printf("Error in newBinaryOutput: valueSize = %d, must be %d or %d\n", valueSize, (int)sizeof(float), (int)sizeof(double));
+    exit(1);
+  }
+  if (numColumns < 1 || maxChunkSteps < 1) {
+    printf("Error in newBinaryOutput: numColumns = %d, maxChunkSteps = %d: both must be >= 1\n", numColumns, maxChunkSteps);
+    exit(1);
+  }
+
+  binOut = (BinaryOutput *)malloc(sizeof(BinaryOutput));
+  binOut->out = out;
+  memset(&(binOut->header), 0, sizeof(BinaryOutputHeader));
+  snprintf(binOut->header.magic, sizeof(binOut->header.magic), "%s", BINARY_OUTPUT_MAGIC);
+  binOut->header.version = BINARY_OUTPUT_VERSION;
+  binOut->header.numColumns = numColumns;
+  binOut->header.valueSize = valueSize;
+  binOut->header.maxChunkSteps = maxChunkSteps;
+  binOut->header.flags = flags;
+
+  binOut->chunk = (char *)malloc((size_t)numColumns * maxChunkSteps * valueSize);
+  binOut->numInChunk = 0;
+
+  fwrite(&(binOut->header), sizeof(BinaryOutputHeader), 1, out);
+  for (c = 0; c < numColumns; c++) {
+    memset(name, 0, sizeof(name));
+    strncpy(name, names[c], sizeof(name) - 1);
+    fwrite(name, 1, sizeof(name), out);
+  }
+  for (c = 0; c < numColumns; c++) {
+    memset(name, 0, sizeof(name));
+    strncpy(name, units[c], sizeof(name) - 1);
+    fwrite(name, 1, sizeof(name), out);
+  }
+
+  return binOut;
+}
+
+
+// write the current chunk of binOut (if it has anything in it) to its file, and start a new chunk
+void writeBinaryOutputChunk(BinaryOutput *binOut) {
+  int c, n;
+  size_t columnBytes;
+
+  n = binOut->numInChunk;
+  if (n == 0)
+    return;
+
+  columnBytes = (size_t)binOut->header.maxChunkSteps * binOut->header.valueSize;
+  fwrite(&n, sizeof(int), 1, binOut->out);
+  for (c = 0; c < binOut->header.numColumns; c++)
+    fwrite(binOut->chunk + c * columnBytes, binOut->header.valueSize, n, binOut->out);
+
+  binOut->numInChunk = 0;
+}
+
+
+// add one time step's values (values[0..numColumns-1], one per column) to binOut, writing a chunk to the file if it's full
+void addBinaryOutputRow(BinaryOutput *binOut, double values[]) {
+  int c, i;
+
+  i = binOut->numInChunk;
+  if (binOut->header.valueSize == sizeof(float)) {
+    float *chunk = (float *)binOut->chunk;
+    for (c = 0; c < binOut->header.numColumns; c++)
+      chunk[(size_t)c * binOut->header.maxChunkSteps + i] = (float)values[c];
+  }
+  else {
+    double *chunk = (double *)binOut->chunk;
+    for (c = 0; c < binOut->header.numColumns; c++)
+      chunk[(size_t)c * binOut->header.maxChunkSteps + i] = values[c];
+  }
+
+  binOut->numInChunk++;
+  if (binOut->numInChunk == binOut->header.maxChunkSteps)
+    writeBinaryOutputChunk(binOut);
+}
+
+
+// write out any values not yet written and free all space used by binOut (but don't close its file)
+void finishBinaryOutput(BinaryOutput *binOut) {
+  writeBinaryOutputChunk(binOut);
+  fflush(binOut->out);
+
+  free(binOut->chunk);
+  free(binOut);
+}
+
+
+/* Read the header of a binary output file from in (at its start) into header, and the column names and units into
+   names and units (each allocated here, with numColumns strings of BINARY_OUTPUT_NAME_LEN chars)
+   Print an error message and exit if in isn't a binary output file we can read
+*/
+void readBinaryOutputHeader(FILE *in, BinaryOutputHeader *header, char **names, char **units) {
+  size_t namesSize;
+
+  if (fread(header, sizeof(BinaryOutputHeader), 1, in) != 1 || strncmp(header->magic, BINARY_OUTPUT_MAGIC, sizeof(header->magic)) != 0) {
+    printf("Error: not a binary output file\n");
+    exit(1);
+  }
+  if (header->version != BINARY_OUTPUT_VERSION) {
+    printf("Error: binary output file is version %d; can only read version %d\n", header->version, BINARY_OUTPUT_VERSION);
+    exit(1);
+  }
+  if ((header->valueSize != sizeof(float) && header->valueSize != sizeof(double))
+      || header->numColumns < 1 || header->maxChunkSteps < 1) {
+    printf("Error: bad binary output file header (valueSize = %d, numColumns = %d, maxChunkSteps = %d)\n",
+	   header->valueSize, header->numColumns, header->maxChunkSteps);
+    exit(1);
+  }
+
+  namesSize = (size_t)header->numColumns * BINARY_OUTPUT_NAME_LEN;
+  *names = (char *)malloc(namesSize);
+  *units = (char *)malloc(namesSize);
+  if (fread(*names, 1, namesSize, in) != namesSize || fread(*units, 1, namesSize, in) != namesSize) {
+    printf("Error: binary output file ends in the middle of its header\n");
+    exit(1);
+  }
+}
+
+
+/* Read the next chunk of a binary output file (whose header, already read from in, is given by header) into
+   columns[c][0..n-1] for each column c (each columns[c] must have room for header->maxChunkSteps values)
+   Return n, the number of time steps in the chunk (0 if there are no more chunks)
+*/
+int readBinaryOutputChunk(FILE *in, BinaryOutputHeader *header, double **columns) {
+  float *floats;
+  int n, c, i;
+
+  if (fread(&n, sizeof(int), 1, in) != 1)
+    return 0; // end of file
+  if (n < 1 || n > header->maxChunkSteps) {
+    printf("Error: bad chunk in binary output file (%d time steps; maximum is %d)\n", n, header->maxChunkSteps);
+    exit(1);
+  }
+
+  floats = (header->valueSize == sizeof(float)) ? (float *)malloc(n * sizeof(float)) : NULL;
+  for (c = 0; c < header->numColumns; c++) {
+    if (floats != NULL) {
+      if (fread(floats, sizeof(float), n, in) != n) {
+	printf("Error: binary output file ends in the middle of a chunk\n");
+	exit(1);
+      }
+      for (i = 0; i < n; i++)
+	columns[c][i] = floats[i];
+    }
+    else if (fread(columns[c], sizeof(double), n, in) != n) {
+      printf("Error: binary output file ends in the middle of a chunk\n");
+      exit(1);
+    }
+  }
+  free(floats);
+
+  return n;
+}
@@ -0,0 +1,78 @@
+// header file for binaryOutput.c
+// self-describing binary, column-oriented model output (an alternative to the text .out file)
+
+#ifndef BINARY_OUTPUT_H
+#define BINARY_OUTPUT_H
+
+#include <stdio.h>
+
+#define BINARY_OUTPUT_MAGIC "SIPOUTB" // identifies a binary output file
+#define BINARY_OUTPUT_VERSION 1
+#define BINARY_OUTPUT_NAME_LEN 32 // length of each column name and units string in the file, including the trailing '\0'
+
+#define BINARY_OUTPUT_PRINT_HEADER 1 // flag: the text version of this output has a header (see outbintotxt)
+
+/* Format of a binary output file (all values in native byte order, as written by the machine that ran the model):
+
+   - a BinaryOutputHeader
+   - numColumns column names, each BINARY_OUTPUT_NAME_LEN chars (null-padded)
+   - numColumns units strings, each BINARY_OUTPUT_NAME_LEN chars (null-padded)
+   - any number of chunks, each holding the values of up to maxChunkSteps consecutive time steps:
+     - an int, n: the number of time steps in this chunk
+     - for each column in turn, its n values (floats if valueSize is 4, doubles if valueSize is 8)
+
+   So the values of one column in one chunk are contiguous, and can be read with a single read:
+   e.g. to read column c of a chunk whose n has just been read, skip c*n*valueSize bytes, then read n values
+   (and the next chunk starts numColumns*n*valueSize bytes after the end of n)
+*/
+typedef struct BinaryOutputHeaderStruct {
+  char magic[8]; // BINARY_OUTPUT_MAGIC
+  int version; // BINARY_OUTPUT_VERSION
+  int numColumns;
+  int valueSize; // bytes per value: 4 (float) or 8 (double)
+  int maxChunkSteps; // maximum number of time steps in each chunk
+  int flags; // e.g. BINARY_OUTPUT_PRINT_HEADER
+  int unused; // padding
+} BinaryOutputHeader;
+
+
+// for writing a binary output file:
+typedef struct BinaryOutputStruct {
+  FILE *out;
+  BinaryOutputHeader header;
+  char *chunk; // values of the current chunk: column c's values start at chunk + c*maxChunkSteps*valueSize
+  int numInChunk; // number of time steps in the current chunk so far
+} BinaryOutput;
+
+
+/* PRE: out is open for binary writing, and nothing has been written to it yet
+        valueSize is 4 or 8; maxChunkSteps >= 1
+        names[0..numColumns-1] and units[0..numColumns-1] are each shorter than BINARY_OUTPUT_NAME_LEN
+   write the header of a binary output file with the given columns to out,
+   and return a new BinaryOutput for writing its values
+*/
+BinaryOutput *newBinaryOutput(FILE *out, int numColumns, char *names[], char *units[], int valueSize, int maxChunkSteps, int flags);
+
+
+// add one time step's values (values[0..numColumns-1], one per column) to binOut, writing a chunk to the file if it's full
+void addBinaryOutputRow(BinaryOutput *binOut, double values[]);
+
+
+// write out any values not yet written and free all space used by binOut (but don't close its file)
+void finishBinaryOutput(BinaryOutput *binOut);
+
+
+/* Read the header of a binary output file from in (at its start) into header, and the column names and units into
+   names and units (each allocated here, with numColumns strings of BINARY_OUTPUT_NAME_LEN chars; free them with free)
+   Print an error message and exit if in isn't a binary output file we can read
+*/
+void readBinaryOutputHeader(FILE *in, BinaryOutputHeader *header, char **names, char **units);
+
+
+/* Read the next chunk of a binary output file (whose header, already read from in, is given by header) into
+   columns[c][0..n-1] for each column c (each columns[c] must have room for header->maxChunkSteps values)
+   Return n, the number of time steps in the chunk (0 if there are no more chunks)
+*/
+int readBinaryOutputChunk(FILE *in, BinaryOutputHeader *header, double **columns);
+
+#endif
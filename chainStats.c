@@ -0,0 +1,307 @@
+/* chainStats: structure and functions to keep running statistics of the points of an MCMC chain:
+   means, variances, effective sample size (by batch means) and split R-hat,
+   so we can tell how well a chain is doing while it runs
+
+   Creation date: 10/18/26
+*/
+
+#include <stdlib.h>
+#include <math.h>
+#include "chainStats.h"
+#include "util.h"
+
+
+/* PRE: num >= 1
+   allocate space for and return a pointer to a new ChainStats, for points with num values,
+   with batches sized for maxPoints points in total
+*/
+ChainStats *newChainStats(int num, long maxPoints) {
+  ChainStats *stats;
+  int i;
+
+  stats = (ChainStats *)malloc(sizeof(ChainStats));
+  stats->num = num;
+  stats->batchSize = (long)sqrt((double)maxPoints);
+  if (stats->batchSize < 1)
+    stats->batchSize = 1;
+  stats->maxBatches = maxPoints / stats->batchSize;
+
+  stats->numBatches = 0;
+  stats->numInBatch = 0;
+  stats->batchMean = makeArray(num);
+  stats->batchM2 = makeArray(num);
+  stats->batchMin = makeArray(num);
+  stats->batchMax = makeArray(num);
+  for (i = 0; i < num; i++)
+    stats->batchMean[i] = stats->batchM2[i] = stats->batchMin[i] = stats->batchMax[i] = 0.0;
+  stats->means = make2DArray(stats->maxBatches + 1, num); // + 1 so we never make an empty array
+  stats->m2s = make2DArray(stats->maxBatches + 1, num);
+  stats->mins = make2DArray(stats->maxBatches + 1, num);
+  stats->maxs = make2DArray(stats->maxBatches + 1, num);
+
+  return stats;
+}
+
+
+// add the point x[0..stats->num-1] to stats
+void addChainStatsPoint(ChainStats *stats, double *x) {
+  int i;
+  double delta;
+
+  if (stats->numBatches == stats->maxBatches) // no room for any more batches
+    return;
+
+  stats->numInBatch++;
+  for (i = 0; i < stats->num; i++) {
+    delta = x[i] - stats->batchMean[i];
+    stats->batchMean[i] += delta/stats->numInBatch;
+    stats->batchM2[i] += delta * (x[i] - stats->batchMean[i]);
+    if (stats->numInBatch == 1 || x[i] < stats->batchMin[i])
+      stats->batchMin[i] = x[i];
+    if (stats->numInBatch == 1 || x[i] > stats->batchMax[i])
+      stats->batchMax[i] = x[i];
+  }
+
+  if (stats->numInBatch == stats->batchSize) { // finished a batch
+    for (i = 0; i < stats->num; i++) {
+      stats->means[stats->numBatches][i] = stats->batchMean[i];
+      stats->m2s[stats->numBatches][i] = stats->batchM2[i];
+      stats->mins[stats->numBatches][i] = stats->batchMin[i];
+      stats->maxs[stats->numBatches][i] = stats->batchMax[i];
+      stats->batchMean[i] = stats->batchM2[i] = 0.0;
+    }
+    stats->numBatches++;
+    stats->numInBatch = 0;
+  }
+}
+
+
+// return the number of points in the completed batches of stats
+// (i.e. the number of points that the statistics below are computed over)
+long getChainStatsNumPoints(ChainStats *stats) {
+  return stats->numBatches * stats->batchSize;
+}
+
+
+// return 1 if value i takes more than one value over batches firstBatch..lastBatch of stats, 0 if it never changes
+int valueChanges(ChainStats *stats, int i, long firstBatch, long lastBatch) {
+  long b;
+  double min, max;
+
+  min = stats->mins[firstBatch][i];
+  max = stats->maxs[firstBatch][i];
+  for (b = firstBatch + 1; b <= lastBatch; b++) {
+    if (stats->mins[b][i] < min)
+      min = stats->mins[b][i];
+    if (stats->maxs[b][i] > max)
+      max = stats->maxs[b][i];
+  }
+
+  return (max > min);
+}
+
+
+/* return the mean and sum of squared deviations of value i over batches firstBatch..lastBatch of stats
+   (combining the batches' own means and sums of squared deviations)
+   If the value never changes over these batches, return exactly that value and 0
+   (combining the batches' means could otherwise give a tiny non-zero spread, from round-off)
+*/
+void batchRangeStats(ChainStats *stats, int i, long firstBatch, long lastBatch, double *mean, double *m2) {
+  long b;
+
+  if (!valueChanges(stats, i, firstBatch, lastBatch)) {
+    *mean = stats->mins[firstBatch][i];
+    *m2 = 0.0;
+    return;
+  }
+
+  *mean = 0.0;
+  for (b = firstBatch; b <= lastBatch; b++)
+    *mean += stats->means[b][i];
+  *mean /= (lastBatch - firstBatch + 1);
+
+  *m2 = 0.0;
+  for (b = firstBatch; b <= lastBatch; b++)
+    *m2 += stats->m2s[b][i] + stats->batchSize * (stats->means[b][i] - *mean) * (stats->means[b][i] - *mean);
+}
+
+
+// return the mean of value i over the completed batches of stats (0 if there are none)
+double getChainStatsMean(ChainStats *stats, int i) {
+  double mean, m2;
+
+  if (stats->numBatches == 0)
+    return 0.0;
+  batchRangeStats(stats, i, 0, stats->numBatches - 1, &mean, &m2);
+  return mean;
+}
+
+
+// return the sample variance of value i over the completed batches of stats (0 if there are fewer than 2 points)
+double getChainStatsVar(ChainStats *stats, int i) {
+  double mean, m2;
+
+  if (getChainStatsNumPoints(stats) < 2)
+    return 0.0;
+  batchRangeStats(stats, i, 0, stats->numBatches - 1, &mean, &m2);
+  return m2/(getChainStatsNumPoints(stats) - 1);
+}
+
+
+/* return the effective sample size of value i, by batch means:
+   (number of points) * (variance of the points) / (batchSize * variance of the batch means)
+   returns 0 if value i has never changed, at most the number of points, or -1 if there are too few batches to tell
+*/
+double getChainStatsEss(ChainStats *stats, int i) {
+  long b;
+  double mean, m2, batchVar, ess;
+
+  if (stats->numBatches < 2)
+    return -1.0;
+  if (!valueChanges(stats, i, 0, stats->numBatches - 1)) // a stuck chain has no effective samples at all
+    return 0.0;
+
+  batchRangeStats(stats, i, 0, stats->numBatches - 1, &mean, &m2);
+  batchVar = 0.0;
+  for (b = 0; b < stats->numBatches; b++)
+    batchVar += (stats->means[b][i] - mean) * (stats->means[b][i] - mean);
+  batchVar /= (stats->numBatches - 1);
+
+  if (batchVar <= 0.0)
+    return 0.0;
+  ess = stats->numBatches * (m2/(getChainStatsNumPoints(stats) - 1)) / batchVar;
+  if (ess > getChainStatsNumPoints(stats)) // with few batches, batchVar can be far too small: a Metropolis chain can't do better than independent samples
+    ess = getChainStatsNumPoints(stats);
+  return ess;
+}
+
+
+// return the mean and sum of squared deviations of value i over half h of stats's completed batches (each half has halfBatches batches):
+// first half (h = 0): first halfBatches batches; second half (h = 1): last halfBatches batches
+void halfRangeStats(ChainStats *stats, int i, int h, long halfBatches, double *mean, double *m2) {
+  if (h == 0)
+    batchRangeStats(stats, i, 0, halfBatches - 1, mean, m2);
+  else
+    batchRangeStats(stats, i, stats->numBatches - halfBatches, stats->numBatches - 1, mean, m2);
+}
+
+
+/* return the split R-hat of value i (Gelman et al., Bayesian Data Analysis, 3rd ed.) over stats[0..numChains-1]
+   (which must all have the same batchSize): each chain's completed batches are split into a first and second half,
+   and we compare the variance between the halves' means with the variance within the halves
+   Values near 1 mean the chains (and the two halves of each) agree, so they have probably converged
+   Returns HUGE_VAL (i.e. not converged) if the value never changes within any of the halves: the chains are stuck
+   Returns -1 if there are too few batches to tell
+*/
+double getSplitRhat(ChainStats **stats, int numChains, int i) {
+  long halfBatches, halfPoints; // number of batches and points in each half-chain
+  int c, h, numHalves;
+  double mean, m2, meanOfMeans, within, between, varPlus;
+
+  // all half-chains must be the same length: use the shortest chain
+  halfBatches = stats[0]->numBatches;
+  for (c = 1; c < numChains; c++) {
+    if (stats[c]->numBatches < halfBatches)
+      halfBatches = stats[c]->numBatches;
+  }
+  halfBatches /= 2;
+  halfPoints = halfBatches * stats[0]->batchSize;
+  if (halfBatches < 1 || halfPoints < 2)
+    return -1.0;
+
+  numHalves = 2 * numChains;
+  within = meanOfMeans = 0.0;
+  for (c = 0; c < numChains; c++) {
+    for (h = 0; h < 2; h++) {
+      halfRangeStats(stats[c], i, h, halfBatches, &mean, &m2);
+      meanOfMeans += mean;
+      within += m2/(halfPoints - 1); // (exactly 0 if the value never changes in this half)
+    }
+  }
+  within /= numHalves;
+  meanOfMeans /= numHalves;
+
+  // second pass for the variance between the halves' means (recomputing the means, so we don't need to store them):
+  between = 0.0;
+  for (c = 0; c < numChains; c++) {
+    for (h = 0; h < 2; h++) {
+      halfRangeStats(stats[c], i, h, halfBatches, &mean, &m2);
+      between += (mean - meanOfMeans) * (mean - meanOfMeans);
+    }
+  }
+  between *= (double)halfPoints/(numHalves - 1);
+
+  if (within <= 0.0) // no movement within any half: however well the halves agree, the chains haven't explored anything
+    return HUGE_VAL;
+
+  varPlus = (halfPoints - 1.0)/halfPoints * within + between/halfPoints;
+  return sqrt(varPlus/within);
+}
+
+
+/* write everything in stats to out (binary), so it can be restored later by readChainStats
+   (e.g. to checkpoint a run)
+*/
+void writeChainStats(ChainStats *stats, FILE *out) {
+  long b;
+
+  fwrite(&(stats->num), sizeof(int), 1, out);
+  fwrite(&(stats->batchSize), sizeof(long), 1, out);
+  fwrite(&(stats->maxBatches), sizeof(long), 1, out);
+  fwrite(&(stats->numBatches), sizeof(long), 1, out);
+  fwrite(&(stats->numInBatch), sizeof(long), 1, out);
+  fwrite(stats->batchMean, sizeof(double), stats->num, out);
+  fwrite(stats->batchM2, sizeof(double), stats->num, out);
+  fwrite(stats->batchMin, sizeof(double), stats->num, out);
+  fwrite(stats->batchMax, sizeof(double), stats->num, out);
+  for (b = 0; b < stats->numBatches; b++) {
+    fwrite(stats->means[b], sizeof(double), stats->num, out);
+    fwrite(stats->m2s[b], sizeof(double), stats->num, out);
+    fwrite(stats->mins[b], sizeof(double), stats->num, out);
+    fwrite(stats->maxs[b], sizeof(double), stats->num, out);
+  }
+}
+
+
+/* PRE: stats was created with the same num and maxPoints as the ChainStats that was written
+   read into stats a ChainStats written by writeChainStats
+   return 1 if all went well, 0 if the file was too short or didn't match stats (in which case stats is left in an unknown state)
+*/
+int readChainStats(ChainStats *stats, FILE *in) {
+  int num;
+  long batchSize, maxBatches, b;
+
+  if (fread(&num, sizeof(int), 1, in) != 1 || fread(&batchSize, sizeof(long), 1, in) != 1
+      || fread(&maxBatches, sizeof(long), 1, in) != 1)
+    return 0;
+  if (num != stats->num || batchSize != stats->batchSize || maxBatches != stats->maxBatches)
+    return 0;
+
+  if (fread(&(stats->numBatches), sizeof(long), 1, in) != 1 || fread(&(stats->numInBatch), sizeof(long), 1, in) != 1
+      || stats->numBatches < 0 || stats->numBatches > stats->maxBatches)
+    return 0;
+  if (fread(stats->batchMean, sizeof(double), num, in) != num || fread(stats->batchM2, sizeof(double), num, in) != num
+      || fread(stats->batchMin, sizeof(double), num, in) != num || fread(stats->batchMax, sizeof(double), num, in) != num)
+    return 0;
+  for (b = 0; b < stats->numBatches; b++) {
+    if (fread(stats->means[b], sizeof(double), num, in) != num || fread(stats->m2s[b], sizeof(double), num, in) != num
+	|| fread(stats->mins[b], sizeof(double), num, in) != num || fread(stats->maxs[b], sizeof(double), num, in) != num)
+      return 0;
+  }
+
+  return 1;
+}
+
+
+// free all space used by stats
+void deleteChainStats(ChainStats *stats) {
+  free(stats->batchMean);
+  free(stats->batchM2);
+  free(stats->batchMin);
+  free(stats->batchMax);
+  free2DArray((void **)stats->means);
+  free2DArray((void **)stats->m2s);
+  free2DArray((void **)stats->mins);
+  free2DArray((void **)stats->maxs);
+  free(stats);
+}
@@ -0,0 +1,88 @@
+// header file for chainStats.c
+// includes definition of ChainStats structure, which keeps running statistics of the points of an MCMC chain
+
+#ifndef CHAIN_STATS_H
+#define CHAIN_STATS_H
+
+#include <stdio.h>
+
+/* The points are split into consecutive batches of batchSize points, and we keep the mean, sum of squared deviations,
+   minimum and maximum of each value over each batch (so we never need to keep the points themselves)
+   (the minimum and maximum tell us exactly whether a value has ever changed, which round-off in the means can't)
+   Statistics are computed over the completed batches only
+*/
+typedef struct ChainStatsStruct {
+  int num; // number of values in each point
+
+  // these remain constant for any given ChainStats (both are about the square root of the total number of points expected):
+  long batchSize;
+  long maxBatches; // once this many batches are full, further points are ignored
+
+  long numBatches; // number of completed batches so far
+  long numInBatch; // number of points in the current batch so far
+  double *batchMean, *batchM2; // running mean and sum of squared deviations of each value over the current batch
+  double *batchMin, *batchMax; // smallest and largest of each value over the current batch
+  double **means; // means[0..maxBatches-1][0..num-1]: mean of each value over each completed batch
+  double **m2s; // m2s[0..maxBatches-1][0..num-1]: sum of squared deviations from the batch mean, over each completed batch
+  double **mins, **maxs; // mins[0..maxBatches-1][0..num-1], maxs[...]: smallest and largest of each value over each completed batch
+} ChainStats;
+
+
+/* PRE: num >= 1
+   allocate space for and return a pointer to a new ChainStats, for points with num values,
+   with batches sized for maxPoints points in total
+*/
+ChainStats *newChainStats(int num, long maxPoints);
+
+
+// add the point x[0..stats->num-1] to stats
+void addChainStatsPoint(ChainStats *stats, double *x);
+
+
+// return the number of points in the completed batches of stats
+// (i.e. the number of points that the statistics below are computed over)
+long getChainStatsNumPoints(ChainStats *stats);
+
+
+// return the mean of value i over the completed batches of stats (0 if there are none)
+double getChainStatsMean(ChainStats *stats, int i);
+
+
+// return the sample variance of value i over the completed batches of stats (0 if there are fewer than 2 points)
+double getChainStatsVar(ChainStats *stats, int i);
+
+
+/* return the effective sample size of value i, by batch means:
+   (number of points) * (variance of the points) / (batchSize * variance of the batch means)
+   returns 0 if value i has never changed, at most the number of points, or -1 if there are too few batches to tell
+*/
+double getChainStatsEss(ChainStats *stats, int i);
+
+
+/* return the split R-hat of value i (Gelman et al., Bayesian Data Analysis, 3rd ed.) over stats[0..numChains-1]
+   (which must all have the same batchSize): each chain's completed batches are split into a first and second half,
+   and we compare the variance between the halves' means with the variance within the halves
+   Values near 1 mean the chains (and the two halves of each) agree, so they have probably converged
+   Returns HUGE_VAL (i.e. not converged) if the value never changes within any of the halves: the chains are stuck
+   Returns -1 if there are too few batches to tell
+*/
+double getSplitRhat(ChainStats **stats, int numChains, int i);
+
+
+/* write everything in stats to out (binary), so it can be restored later by readChainStats
+   (e.g. to checkpoint a run)
+*/
+void writeChainStats(ChainStats *stats, FILE *out);
+
+
+/* PRE: stats was created with the same num and maxPoints as the ChainStats that was written
+   read into stats a ChainStats written by writeChainStats
+   return 1 if all went well, 0 if the file was too short or didn't match stats (in which case stats is left in an unknown state)
+*/
+int readChainStats(ChainStats *stats, FILE *in);
+
+
+// free all space used by stats
+void deleteChainStats(ChainStats *stats);
+
+#endif
@@ -0,0 +1,171 @@
+/* ensembleKernel: the photosynthesis step of the model (potPsn and calcLightEff3 in sipnet.c),
+   done for a batch of ensemble members at once (see runEnsembleNoOut in sipnet.c)
+
+   This is where a model step spends most of its time: the light integral takes an exp and a pow for each canopy layer
+   The members' parameters are laid out as a structure of arrays (see ensembleKernel.h), and each loop here runs over members,
+   so that with make ENSEMBLE_SIMD=1 the compiler can do several members at once with vector instructions
+   (and vector versions of exp and pow, from glibc's libmvec), choosing AVX-512, AVX2 or SSE2 code
+   when the program starts, according to what the machine has
+
+   In the default build the loops are plain scalar code, doing the same operations in the same order as potPsn,
+   so each member's results are bitwise identical to a run on its own
+
+   Creation date: 10/18/26
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include "ensembleKernel.h"
+
+#ifdef ENSEMBLE_SIMD
+// compile a version of ensemblePotPsn for each of these instruction sets, and pick the best one the machine has at run time
+#define KERNEL_CLONES __attribute__((target_clones("avx512f", "avx2", "default")))
+// vectorize the loop over members that follows
+#define MEMBER_LOOP _Pragma("omp simd")
+#else
+#define KERNEL_CLONES
+#define MEMBER_LOOP
+#endif
+
+
+// allocate space for the photosynthesis parameters of up to maxMembers ensemble members (maxMembers must be >= 1)
+PsnParamArrays *newPsnParamArrays(int maxMembers) {
+  PsnParamArrays *p;
+
+  if (maxMembers < 1) {
+    printf("Error in newPsnParamArrays: maxMembers = %d, must be >= 1\n", maxMembers);
+    exit(1);
+  }
+
+  p = (PsnParamArrays *)malloc(sizeof(PsnParamArrays));
+  p->maxMembers = maxMembers;
+  p->grossAMax = (double *)malloc(maxMembers * sizeof(double));
+  p->respPerGram = (double *)malloc(maxMembers * sizeof(double));
+  p->psnTMin = (double *)malloc(maxMembers * sizeof(double));
+  p->psnTMax = (double *)malloc(maxMembers * sizeof(double));
+  p->tempDenom = (double *)malloc(maxMembers * sizeof(double));
+  p->dVpdSlope = (double *)malloc(maxMembers * sizeof(double));
+  p->dVpdExp = (double *)malloc(maxMembers * sizeof(double));
+  p->attenuation = (double *)malloc(maxMembers * sizeof(double));
+  p->halfSatPar = (double *)malloc(maxMembers * sizeof(double));
+  p->conversionPerLai = (double *)malloc(maxMembers * sizeof(double));
+  p->lightEff = (double *)malloc(maxMembers * sizeof(double));
+
+  return p;
+}
+
+
+// free all space used by p
+void deletePsnParamArrays(PsnParamArrays *p) {
+  free(p->grossAMax);
+  free(p->respPerGram);
+  free(p->psnTMin);
+  free(p->psnTMax);
+  free(p->tempDenom);
+  free(p->dVpdSlope);
+  free(p->dVpdExp);
+  free(p->attenuation);
+  free(p->halfSatPar);
+  free(p->conversionPerLai);
+  free(p->lightEff);
+  free(p);
+}
+
+
+/* Do potPsn (with calcLightEff3) for members 0..numMembers-1 of p, with lai[m] the current lai of member m,
+   and the given climate of this time step (the same for every member)
+   Put potential gross photosynthesis and base foliar respiration of member m into potGrossPsn[m] and baseFolResp[m],
+   and its fAPAR into fAPAR[m] (only meaningful where lai[m] > 0 and par > 0)
+
+   See calcLightEff3 for the light integral: here the loop over layers is on the outside, and each layer is done for every member
+   (each member's sums are still built up in the same order, so in the default build the results are the same as calcLightEff3's)
+*/
+KERNEL_CLONES
+void ensemblePotPsn(PsnParamArrays *p, int numMembers, double lai[], double tair, double vpd, double par, double secPerDay,
+		    double potGrossPsn[], double baseFolResp[], double fAPAR[]) {
+  double *lightEff = p->lightEff; // running sum of light efficiency in the integral, then the result
+  double layerFrac; // fraction of the lai that is above this layer
+  double cumLai; // lai from this layer up
+  double lightIntensity;
+  double currLightEff, currfAPAR;
+  double dTemp, dVpd, conversion;
+  int layer, coeff, m;
+
+  if (par > 0) { // must have some light (members with no leaves are set to 0 below)
+    MEMBER_LOOP
+    for (m = 0; m < numMembers; m++) {
+      lightEff[m] = 0.0;
+      fAPAR[m] = 0.0; // also a running sum until the end of the integral
+    }
+
+    coeff = 1;
+    for (layer = 0; layer <= PSN_LAYERS; layer++) {
+      layerFrac = (double)layer / PSN_LAYERS;
+
+      MEMBER_LOOP
+      for (m = 0; m < numMembers; m++) {
+	cumLai = lai[m] * layerFrac;
+	lightIntensity = par * exp(-1.0 * p->attenuation[m] * cumLai); // between 0 and par
+
+	currLightEff = (1 - pow(2, (-1.0 * lightIntensity/p->halfSatPar[m]))); // between 0 and 1
+	lightEff[m] += coeff * currLightEff;
+
+	currfAPAR = 1 - (lightIntensity / par);
+	fAPAR[m] += coeff * currfAPAR;
+
+	if (layer == PSN_LAYERS) { // last value should have had a coefficient of 1, but actually had a coefficient of 2
+	  lightEff[m] -= currLightEff;
+	  fAPAR[m] -= currfAPAR;
+	}
+      }
+
+      coeff = 2*(1 + (layer + 1)%2); // coeff. goes 1, 4, 2, 4, ..., 2, 4, 2
+    }
+
+    MEMBER_LOOP
+    for (m = 0; m < numMembers; m++) {
+      lightEff[m] = (lai[m] > 0) ? lightEff[m]/(3.0*PSN_LAYERS) : 0.0; // no leaves: no light absorbed
+      fAPAR[m] = fAPAR[m]/(3.0*PSN_LAYERS);
+    }
+  }
+
+  else { // no light!
+    MEMBER_LOOP
+    for (m = 0; m < numMembers; m++) {
+      lightEff[m] = 0.0;
+      fAPAR[m] = 0.0;
+    }
+  }
+
+  MEMBER_LOOP
+  for (m = 0; m < numMembers; m++) {
+    dTemp = (p->psnTMax[m] - tair)*(tair - p->psnTMin[m])/p->tempDenom[m];
+    if (dTemp < 0)
+      dTemp = 0.0;
+
+    dVpd = 1.0 - p->dVpdSlope[m] * pow(vpd, p->dVpdExp[m]);
+    if (dVpd < 0)
+      dVpd = 0.0;
+
+    conversion = p->conversionPerLai[m] * lai[m] * secPerDay;
+    potGrossPsn[m] = p->grossAMax[m] * dTemp * dVpd * lightEff[m] * conversion;
+    baseFolResp[m] = p->respPerGram[m] * conversion; // do foliar resp. even if no photosynthesis in this time step
+  }
+}
+
+
+// return a description of the version of ensemblePotPsn that runs on this machine
+const char *ensembleKernelName(void) {
+#ifdef ENSEMBLE_SIMD
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx512f"))
+    return "avx512f vector";
+  else if (__builtin_cpu_supports("avx2"))
+    return "avx2 vector";
+  else
+    return "sse2 vector";
+#else
+  return "scalar (exact)";
+#endif
+}
@@ -0,0 +1,54 @@
+// header file for ensembleKernel.c
+// the photosynthesis step of the model (potPsn and calcLightEff3 in sipnet.c), done for a batch of ensemble members at once
+
+#ifndef ENSEMBLE_KERNEL_H
+#define ENSEMBLE_KERNEL_H
+
+#define PSN_LAYERS 6 // number of canopy layers in the Simpson's rule light integral (see calcLightEff3 in sipnet.c): must be even
+
+/* The photosynthesis parameters of a batch of ensemble members, as a structure of arrays:
+   element m of each array belongs to member m, so each array can be worked through with vector instructions
+   The derived values are worked out from each member's parameters when it is set up (see setupEnsembleMember in sipnet.c),
+   with exactly the expressions potPsn uses, so they are the values potPsn would have computed on each step
+*/
+typedef struct PsnParamArraysStruct {
+  int maxMembers; // size of each array
+  double *grossAMax; // aMax * aMaxFrac + respPerGram (nmol CO2 * g^-1 leaf * sec^-1)
+  double *respPerGram; // base foliar respiration: baseFolRespFrac * aMax (nmol CO2 * g^-1 leaf * sec^-1)
+  double *psnTMin, *psnTMax;
+  double *tempDenom; // pow((psnTMax - psnTMin)/2.0, 2): denominator of the temperature effect
+  double *dVpdSlope, *dVpdExp;
+  double *attenuation, *halfSatPar;
+  double *conversionPerLai; // C_WEIGHT * (1.0/TEN_9) * (leafCSpWt/cFracLeaf): potPsn's unit conversion, without its lai * SEC_PER_DAY
+
+  double *lightEff; // work space for ensemblePotPsn: each member's light efficiency in the current time step
+} PsnParamArrays;
+
+
+// allocate space for the photosynthesis parameters of up to maxMembers ensemble members (maxMembers must be >= 1)
+PsnParamArrays *newPsnParamArrays(int maxMembers);
+
+
+// free all space used by p
+void deletePsnParamArrays(PsnParamArrays *p);
+
+
+/* Do potPsn (with calcLightEff3) for members 0..numMembers-1 of p, with lai[m] the current lai of member m,
+   and the given climate of this time step (the same for every member)
+   Put potential gross photosynthesis and base foliar respiration (g C * m^-2 ground area * day^-1) of member m
+   into potGrossPsn[m] and baseFolResp[m], and its fAPAR into fAPAR[m]
+   fAPAR[m] is only meaningful where lai[m] > 0 and par > 0 (where calcLightEff3 would add it to the FPAR mean tracker)
+
+   In the default build, each member's results are bitwise identical to potPsn's (the same operations, done in the same order)
+   With make ENSEMBLE_SIMD=1 the member loops are vectorized, with vector versions of exp and pow (see the Makefile):
+   these can differ from the scalar functions in the last bit or so, so results then agree with potPsn only to within
+   a small tolerance (see the README)
+*/
+void ensemblePotPsn(PsnParamArrays *p, int numMembers, double lai[], double tair, double vpd, double par, double secPerDay,
+		    double potGrossPsn[], double baseFolResp[], double fAPAR[]);
+
+
+// return a description of the version of ensemblePotPsn that runs on this machine (e.g. "scalar (exact)", or "avx2 vector")
+const char *ensembleKernelName(void);
+
+#endif
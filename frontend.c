@@ -13,6 +13,7 @@
 #include "spatialParams.h"
 #include "namelistInput.h"
 #include "outputItems.h"
+#include "parallelRun.h"
 
 // important constants - default values:
 
@@ -23,7 +24,14 @@
 #define DO_MAIN_OUTPUT 1
 #define DO_SINGLE_OUTPUTS 0
 #define LOC -1 // default is run at all locations (but if doing a sens. test or monte carlo run, will default to running at loc. 0)
+#define LOCATIONS "" // default is no list of locations (so LOCATION says where to run)
+#define LOCATIONS_MAXNAME 1024
 #define HEADER 0 // // Make the default no printing of header files
+#define NUM_THREADS 1 // default is to run one location at a time
+#define OUTPUT_BUFFER_STEPS 0 // default is to write output on the model thread
+#define OUTPUT_FORMAT "text" // default is the usual text .out file
+#define OUTPUT_FORMAT_MAXNAME 16
+#define ENSEMBLE_SIZE 1 // default is for a montecarlo statsOnly run to do one run at a time
 
 
 void usage(char *progName)  {
@@ -51,10 +59,16 @@ int main(int argc, char *argv[]) {
   int doMainOutput = DO_MAIN_OUTPUT;  // do we do main outputting of all variables?
   int doSingleOutputs = DO_SINGLE_OUTPUTS;  // do we do extra outputting of single-variable files?
   int loc = LOC; // location to run at (set through optional -l argument)
+  char locList[LOCATIONS_MAXNAME] = LOCATIONS; // comma-separated list of locations to run at (if not empty, replaces loc)
+  int numListLocs, *listLocs; // the locations in locList
   int numLocs; // read in initModel
   int *steps; // number of time steps in each location
 
   int printHeader=HEADER;
+  int numThreads = NUM_THREADS; // for a standard run at all locations: number of locations to run at once
+  int outputBufferSteps = OUTPUT_BUFFER_STEPS; // if > 0, write output on a separate thread, which can get this many time steps behind
+  char outputFormat[OUTPUT_FORMAT_MAXNAME] = OUTPUT_FORMAT; // text, binary32 or binary64
+  int binaryValueSize; // bytes per value if main output is binary (set from outputFormat), or 0 for text output
 
   // parameters for sens. test:
   char changeParam[PARAM_MAXNAME];
@@ -80,6 +94,10 @@ int main(int argc, char *argv[]) {
   double **means;
   double **standarddevs;
   int dataTypeIndices[MAX_DATA_TYPES];
+  int ensembleSize = ENSEMBLE_SIZE; // number of runs to do together (each from its own line of the parameter file)
+  SipnetEnsemble *ensemble;
+  double ***models; // output of each ensemble member
+  int numMembers, member;
 
 
   // get command-line arguments:
@@ -109,9 +127,13 @@ int main(int argc, char *argv[]) {
   addNamelistInputItem(namelistInputs, "RUNTYPE", STRING_TYPE, runtype, RUNTYPE_MAXNAME);
   addNamelistInputItem(namelistInputs, "FILENAME", STRING_TYPE, fileName, FILE_MAXNAME);
   addNamelistInputItem(namelistInputs, "LOCATION", INT_TYPE, &loc, 0);
+  addNamelistInputItem(namelistInputs, "LOCATIONS", STRING_TYPE, locList, LOCATIONS_MAXNAME);
   addNamelistInputItem(namelistInputs, "DO_MAIN_OUTPUT", INT_TYPE, &doMainOutput, 0);
   addNamelistInputItem(namelistInputs, "DO_SINGLE_OUTPUTS", INT_TYPE, &doSingleOutputs, 0);
   addNamelistInputItem(namelistInputs, "PRINT_HEADER", INT_TYPE, &printHeader, 0);
+  addNamelistInputItem(namelistInputs, "NUM_THREADS", INT_TYPE, &numThreads, 0);
+  addNamelistInputItem(namelistInputs, "OUTPUT_BUFFER_STEPS", INT_TYPE, &outputBufferSteps, 0);
+  addNamelistInputItem(namelistInputs, "OUTPUT_FORMAT", STRING_TYPE, outputFormat, OUTPUT_FORMAT_MAXNAME);
   addNamelistInputItem(namelistInputs, "CHANGE_PARAM", STRING_TYPE, changeParam, PARAM_MAXNAME);
   addNamelistInputItem(namelistInputs, "LOW_VAL", DOUBLE_TYPE, &lowVal, 0);
   addNamelistInputItem(namelistInputs, "HIGH_VAL", DOUBLE_TYPE, &highVal, 0);
@@ -120,6 +142,7 @@ int main(int argc, char *argv[]) {
   addNamelistInputItem(namelistInputs, "MC_OUTPUT", STRING_TYPE, mcOutFileBase, FILE_MAXNAME);
   addNamelistInputItem(namelistInputs, "NUM_TO_SKIP", INT_TYPE, &numToSkip, 0);
   addNamelistInputItem(namelistInputs, "STATS_ONLY", INT_TYPE, &statsOnly, 0);
+  addNamelistInputItem(namelistInputs, "ENSEMBLE_SIZE", INT_TYPE, &ensembleSize, 0);
 
   // read from input file:
   readNamelistInputs(namelistInputs, inputFile);
@@ -139,6 +162,33 @@ int main(int argc, char *argv[]) {
     dieIfNotSet(namelistInputs, "MC_OUTPUT");
   }
 
+  numListLocs = parseIntList(locList, "LOCATIONS", &listLocs);
+  if (numListLocs > 0)  // run at each listed location, in turn (as if running everywhere, unless there's just one)
+    loc = (numListLocs == 1) ? listLocs[0] : -1;
+
+  if (numThreads < 1)  {
+    printf("ERROR: NUM_THREADS = %d: must be at least 1\n", numThreads);
+    exit(1);
+  }
+  if (ensembleSize < 1)  {
+    printf("ERROR: ENSEMBLE_SIZE = %d: must be at least 1\n", ensembleSize);
+    exit(1);
+  }
+  if (outputBufferSteps < 0)  {
+    printf("ERROR: OUTPUT_BUFFER_STEPS = %d: must be at least 0\n", outputBufferSteps);
+    exit(1);
+  }
+  if (strcmpIgnoreCase(outputFormat, "text") == 0)
+    binaryValueSize = 0;
+  else if (strcmpIgnoreCase(outputFormat, "binary32") == 0)
+    binaryValueSize = sizeof(float);
+  else if (strcmpIgnoreCase(outputFormat, "binary64") == 0)
+    binaryValueSize = sizeof(double);
+  else  {
+    printf("ERROR: OUTPUT_FORMAT = %s: must be text, binary32 or binary64\n", outputFormat);
+    exit(1);
+  }
+
   // set values for ignored items:
   if ((strcmpIgnoreCase(runtype, "montecarlo") == 0) && (statsOnly == 1))  {
     doMainOutput = 1;  // it's silly for this to be false: means & standard dev's wouldn't be output!
@@ -149,7 +199,13 @@ int main(int argc, char *argv[]) {
   strcat(paramFile, ".param");
   strcpy(climFile, fileName);
   strcat(climFile, ".clim");
-  numLocs = initModel(&spatialParams, &steps, paramFile, climFile);
+  // only read climate where we run: at the listed locations, at loc, or (if loc = -1) at each location as it's run
+  if (numListLocs > 0)  {
+    numLocs = initModelLocs(&spatialParams, &steps, paramFile, climFile, numListLocs, listLocs);
+    setRunLocations(numListLocs, listLocs);
+  }
+  else
+    numLocs = initModelLocs(&spatialParams, &steps, paramFile, climFile, (loc == -1) ? 0 : 1, &loc);
 
   if (doSingleOutputs)  {
     outputItems = newOutputItems(fileName, ' ');
@@ -162,14 +218,27 @@ int main(int argc, char *argv[]) {
   if (strcmpIgnoreCase(runtype, "standard") == 0)  {  // do a single run
     if (doMainOutput)  {
       strcpy(outFile, fileName);
-      strcat(outFile, ".out");
-      out = openFile(outFile, "w");
+      if (binaryValueSize > 0)  {
+	strcat(outFile, ".outbin");
+	out = openFile(outFile, "wb");
+      }
+      else  {
+	strcat(outFile, ".out");
+	out = openFile(outFile, "w");
+      }
     }
     else  {
       out = NULL;
     }
 
-    runModelOutput(out, outputItems, printHeader, spatialParams, loc); 
+    if (doMainOutput && binaryValueSize > 0) // binary output (convert to text with outbintotxt)
+      runModelOutputBinary(out, binaryValueSize, outputItems, printHeader, spatialParams, loc);
+    else if (loc == -1 && numThreads > 1) // run several locations at once (giving exactly the same output)
+      runModelOutputParallel(out, outputItems, printHeader, spatialParams, numThreads);
+    else if (outputBufferSteps > 0) // format and write output on another thread (giving exactly the same output)
+      runModelOutputAsync(out, outputItems, printHeader, spatialParams, loc, outputBufferSteps);
+    else
+      runModelOutput(out, outputItems, printHeader, spatialParams, loc); 
 
     if (doMainOutput)
       fclose(out);
@@ -177,8 +246,8 @@ int main(int argc, char *argv[]) {
 
   else if (strcmpIgnoreCase(runtype, "montecarlo") == 0)  {  // multiple runs from file
     if (loc == -1) {
-      printf("loc was set to -1: can only run multiple runs from file at one location: running at location 0\n");
-      loc = 0;
+      loc = (numListLocs > 0) ? listLocs[0] : 0;
+      printf("loc was set to -1 (or LOCATIONS lists several locations): can only run multiple runs from file at one location: running at location %d\n", loc);
     }
 
     pChange = openFile(mcParamFile, "r");
@@ -216,8 +285,8 @@ int main(int argc, char *argv[]) {
 	// get next set of parameter values and do next run
 
 	if (doMainOutput)  {
-	  sprintf(outFile, "%s%d.out", mcOutFileBase, runNum);
-	  out = openFile(outFile, "w");
+	  sprintf(outFile, "%s%d.%s", mcOutFileBase, runNum, (binaryValueSize > 0) ? "outbin" : "out");
+	  out = openFile(outFile, (binaryValueSize > 0) ? "wb" : "w");
 	}
 	// else out will stay NULL
 
@@ -238,7 +307,12 @@ int main(int argc, char *argv[]) {
 	}
 
 	// do this model run:
-	runModelOutput(out, outputItems, printHeader, spatialParams, loc); 
+	if (doMainOutput && binaryValueSize > 0)
+	  runModelOutputBinary(out, binaryValueSize, outputItems, printHeader, spatialParams, loc);
+	else if (outputBufferSteps > 0)
+	  runModelOutputAsync(out, outputItems, printHeader, spatialParams, loc, outputBufferSteps);
+	else
+	  runModelOutput(out, outputItems, printHeader, spatialParams, loc); 
 	if (doMainOutput)
 	  fclose(out);
 	runNum++;
@@ -248,7 +322,10 @@ int main(int argc, char *argv[]) {
 
     else  {  // statsOnly
 
-      model = make2DArray(steps[0], MAX_DATA_TYPES);
+      ensemble = newSipnetEnsemble(ensembleSize);
+      models = (double ***)malloc(ensembleSize * sizeof(double **));
+      for (member = 0; member < ensembleSize; member++)
+	models[member] = make2DArray(steps[0], MAX_DATA_TYPES);
       means = make2DArray(steps[0], MAX_DATA_TYPES);
       standarddevs = make2DArray(steps[0], MAX_DATA_TYPES);
 
@@ -268,42 +345,52 @@ int main(int argc, char *argv[]) {
 
       for (k = 0; k < 2; k++) {
 	runNum = 1;
-	while((fgets(line, sizeof(line), pChange) != NULL) && (strcmp(line, "\n") != 0)) { 
-	  // get next set of parameter values and do next run
-	  if (numToSkip > 0) {
-	    strtok(line, " \t"); // read and ignore first value
-	    for (i = 0; i < numToSkip - 1; i++) // read and ignore other values
-	      strtok(NULL, " \t"); 
-	    // now get first real value:
-	    value = strtod(strtok(NULL, " \t"), &errc);
-	  }
-	  else // just get first real value
-	    value = strtod(strtok(line, " \t"), &errc);
-	  setSpatialParam(spatialParams, indices[0], loc, value); // set value of changeable parameter #0
-	  // now get remaining values:
-	  for (i = 1; i < numChangeableParams; i++) {
-	    value = strtod(strtok(NULL, " \t"), &errc);
-	    setSpatialParam(spatialParams, indices[i], loc, value); // set value of changeable parameter #i
-	  }
+	do {
+	  // get the next ensembleSize sets of parameter values (or as many as are left), setting up an ensemble member with each:
+	  numMembers = 0;
+	  while ((numMembers < ensembleSize) && (fgets(line, sizeof(line), pChange) != NULL) && (strcmp(line, "\n") != 0)) {
+	    if (numToSkip > 0) {
+	      strtok(line, " \t"); // read and ignore first value
+	      for (i = 0; i < numToSkip - 1; i++) // read and ignore other values
+		strtok(NULL, " \t"); 
+	      // now get first real value:
+	      value = strtod(strtok(NULL, " \t"), &errc);
+	    }
+	    else // just get first real value
+	      value = strtod(strtok(line, " \t"), &errc);
+	    setSpatialParam(spatialParams, indices[0], loc, value); // set value of changeable parameter #0
+	    // now get remaining values:
+	    for (i = 1; i < numChangeableParams; i++) {
+	      value = strtod(strtok(NULL, " \t"), &errc);
+	      setSpatialParam(spatialParams, indices[i], loc, value); // set value of changeable parameter #i
+	    }
 
-	  // do this model run:
-	  runModelNoOut(model, MAX_DATA_TYPES, dataTypeIndices, spatialParams, loc);
-	
-	  if (k == 0) { // first pass
-	    // update means:
-	    for (j = 0; j < steps[0]; j++)
-	      for (type = 0; type < MAX_DATA_TYPES; type++)
-		means[j][type] += model[j][type];
-	  }
-	  else { // second pass
-	    // update standard deviations:
-	    for (j = 0; j < steps[0]; j++)
-	      for (type = 0; type < MAX_DATA_TYPES; type++)
-		standarddevs[j][type] += pow((model[j][type] - means[j][type]), 2);
+	    setupEnsembleMember(ensemble, numMembers, spatialParams, loc);
+	    numMembers++;
 	  }
 
-	  runNum++;
-	}
+	  // do these model runs, together:
+	  runEnsembleNoOut(ensemble, numMembers, models, MAX_DATA_TYPES, dataTypeIndices);
+
+	  // (each member in turn, in the order of the parameter file, so the sums come out the same whatever the ensemble size)
+	  for (member = 0; member < numMembers; member++) {
+	    model = models[member];
+	    if (k == 0) { // first pass
+	      // update means:
+	      for (j = 0; j < steps[0]; j++)
+		for (type = 0; type < MAX_DATA_TYPES; type++)
+		  means[j][type] += model[j][type];
+	    }
+	    else { // second pass
+	      // update standard deviations:
+	      for (j = 0; j < steps[0]; j++)
+		for (type = 0; type < MAX_DATA_TYPES; type++)
+		  standarddevs[j][type] += pow((model[j][type] - means[j][type]), 2);
+	    }
+
+	    runNum++;
+	  }
+	} while (numMembers == ensembleSize); // a smaller ensemble means we've run out of parameter sets
 
 	runNum--; // correct for one extra addition
 	if (k == 0) { // first pass
@@ -341,7 +428,10 @@ int main(int argc, char *argv[]) {
 	}      
       }
 
-      free2DArray((void **)model);
+      for (member = 0; member < ensembleSize; member++)
+	free2DArray((void **)models[member]);
+      free(models);
+      deleteSipnetEnsemble(ensemble);
       free2DArray((void **)means);
       free2DArray((void **)standarddevs);
 
@@ -361,8 +451,8 @@ int main(int argc, char *argv[]) {
       out = NULL;
 
     if (loc == -1) {
-      printf("loc was set to -1: can only run sens. test at one location: running at location 0\n");
-      loc = 0;
+      loc = (numListLocs > 0) ? listLocs[0] : 0;
+      printf("loc was set to -1 (or LOCATIONS lists several locations): can only run sens. test at one location: running at location %d\n", loc);
     }
 
     changeIndex = locateParam(spatialParams, changeParam);
@@ -387,6 +477,7 @@ int main(int argc, char *argv[]) {
   if (outputItems != NULL)
     deleteOutputItems(outputItems);
   free(steps);
+  free(listLocs);
   
   return 0;
 }
@@ -0,0 +1,319 @@
+/* likelyBenchmark: A stand-alone program to time the sum-of-squares part of the likelihood calculation
+   Usage: likelyBenchmark [-h] [-n numReps] [-v validFrac] [-c costFunction] fileName
+
+   Reads fileName.dat and fileName.valid (and fileName.sigma, if there is one; otherwise every sigma is 1),
+   makes up some model output (the data plus random noise), then computes the sum of squared, sigma-weighted errors
+   for each data type numReps times in each of these ways:
+   - the loop difference used to have: every step of every data type, checking validity and costFunction inside the loop,
+   on arrays of row pointers
+   - the way difference does it now: gather the model output at each valid observation, then sum with sumWeightedSquares
+   over contiguous, aligned arrays (see ObsList in paramchange.c)
+   - just the sumWeightedSquares kernel (with the model output already gathered)
+   and prints the time taken per observation by each, and how much the sums differ
+
+   Creation date: 10/18/26
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h> // for command-line arguments
+#include <sys/time.h>
+#include "util.h"
+
+#define FILE_MAXNAME 256
+#define MAX_COLUMNS 64 // maximum number of data types in the data file
+#define NUM_REPS 10000
+#define VALID_FRAC 0.5
+#define COST_FUNCTION 1
+#define NOISE 0.1 // s.d. of the noise added to the data to make the model output
+#define SEED 1
+
+
+void usage(char *progName)  {
+  printf("Usage: %s [-h] [-n numReps] [-v validFrac] [-c costFunction] fileName\n", progName);
+  printf("[-h] : Print this usage message and exit\n");
+  printf("[-n numReps]: Number of times to compute the sums of squares in each way\n");
+  printf("\tDefault: %d\n", NUM_REPS);
+  printf("[-v validFrac]: Minimum fraction of valid data for a data point to be used\n");
+  printf("\tDefault: %g\n", VALID_FRAC);
+  printf("[-c costFunction]: 0 (sigma = sqrt(0.5) everywhere) or 1 (use sigmas from file)\n");
+  printf("\tDefault: %d\n", COST_FUNCTION);
+  printf("fileName: base name of the .dat, .valid and (optional) .sigma files\n");
+}
+
+
+// return the current wall-clock time, in seconds
+double wallTime(void)  {
+  struct timeval tv;
+
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec + tv.tv_usec * 1e-6;
+}
+
+
+// return the number of numbers on the first line of file fileName
+int countColumns(char *fileName)  {
+  FILE *in;
+  char line[1024];
+  char *pos, *end;
+  int numColumns = 0;
+
+  in = openFile(fileName, "r");
+  if (fgets(line, sizeof(line), in) != NULL)  {
+    pos = line;
+    while (strtod(pos, &end), end != pos)  {
+      numColumns++;
+      pos = end;
+    }
+  }
+  fclose(in);
+
+  return numColumns;
+}
+
+
+// read numSteps lines of numColumns numbers each from fileName into arr[0..numSteps-1][0..numColumns-1]
+void readColumns(char *fileName, double **arr, int numSteps, int numColumns)  {
+  FILE *in;
+  int i, j;
+
+  in = openFile(fileName, "r");
+  for (i = 0; i < numSteps; i++)  {
+    for (j = 0; j < numColumns; j++)  {
+      if (fscanf(in, "%lf", &(arr[i][j])) != 1)  {
+	printf("Error reading %s: expected %d lines of %d numbers\n", fileName, numSteps, numColumns);
+	exit(1);
+      }
+    }
+  }
+  fclose(in);
+}
+
+
+// return the number of lines in file fileName
+int countFileLines(char *fileName)  {
+  FILE *in;
+  int c, numLines = 0;
+
+  in = openFile(fileName, "r");
+  while ((c = fgetc(in)) != EOF)
+    if (c == '\n')
+      numLines++;
+  fclose(in);
+
+  return numLines;
+}
+
+
+/* the loop difference used to use: for each step, for each data type, if valid, add in the squared, sigma-weighted error
+   put the sums in sumSquares[0..numDataTypes-1]
+*/
+void referenceSumSquares(double *sumSquares, double **model, double **data, double **valid, double **sigmas,
+			 int numSteps, int numDataTypes, double validFrac, int costFunction)  {
+  int i, dataNum;
+  double thisSigma;
+
+  for (dataNum = 0; dataNum < numDataTypes; dataNum++)
+    sumSquares[dataNum] = 0.0;
+
+  for (i = 0; i < numSteps; i++)  {
+    for (dataNum = 0; dataNum < numDataTypes; dataNum++)  {
+      if (valid[i][dataNum] >= validFrac)  {
+	if (costFunction == 0)
+	  thisSigma = sqrt(0.5);
+	else
+	  thisSigma = sigmas[i][dataNum];
+	sumSquares[dataNum] += pow((model[i][dataNum] - data[i][dataNum]), 2) / (2.0*thisSigma*thisSigma);
+      }
+    }
+  }
+}
+
+
+int main(int argc, char *argv[]) {
+  char option;
+  int numReps = NUM_REPS, costFunction = COST_FUNCTION;
+  double validFrac = VALID_FRAC;
+  char dataFile[FILE_MAXNAME+24], validFile[FILE_MAXNAME+24], sigmaFile[FILE_MAXNAME+24];
+  int numSteps, numDataTypes, totObs;
+  double **data, **valid, **sigmas, **model;
+  int *numObs; // number of valid observations of each data type
+  int **obsStep; // obsStep[dataNum][0..numObs[dataNum]-1]: time step of each observation
+  double **obsValue, **obsInvTwoVar, **obsModel; // aligned arrays of data, 1/(2 sigma^2) and model output at each observation
+  double *sumSquares, *refSumSquares;
+  double checkSum, maxRelDiff, relDiff;
+  double start, refTime, gatherTime, kernelTime;
+  RandStream stream;
+  int rep, i, j, dataNum;
+
+  while ((option = getopt(argc, argv, "hn:v:c:")) != -1) {
+    switch(option) {
+    case 'h':
+      usage(argv[0]);
+      exit(1);
+      break;
+    case 'n':
+      numReps = atoi(optarg);
+      break;
+    case 'v':
+      validFrac = atof(optarg);
+      break;
+    case 'c':
+      costFunction = atoi(optarg);
+      break;
+    default:
+      usage(argv[0]);
+      exit(1);
+    }
+  }
+
+  if (optind != argc - 1 || strlen(argv[optind]) >= FILE_MAXNAME || numReps < 1 || (costFunction != 0 && costFunction != 1))  {
+    usage(argv[0]);
+    exit(1);
+  }
+
+  buildFileName(dataFile, argv[optind], "dat");
+  buildFileName(validFile, argv[optind], "valid");
+  buildFileName(sigmaFile, argv[optind], "sigma");
+
+  numSteps = countFileLines(dataFile);
+  numDataTypes = countColumns(dataFile);
+  if (numSteps < 1 || numDataTypes < 1 || numDataTypes > MAX_COLUMNS)  {
+    printf("ERROR: %s has %d lines of %d numbers\n", dataFile, numSteps, numDataTypes);
+    exit(1);
+  }
+
+  data = make2DArray(numSteps, numDataTypes);
+  valid = make2DArray(numSteps, numDataTypes);
+  sigmas = make2DArray(numSteps, numDataTypes);
+  model = make2DArray(numSteps, numDataTypes);
+  readColumns(dataFile, data, numSteps, numDataTypes);
+  readColumns(validFile, valid, numSteps, numDataTypes);
+  if (access(sigmaFile, R_OK) == 0)
+    readColumns(sigmaFile, sigmas, numSteps, numDataTypes);
+  else  {
+    printf("No %s: using sigma = 1 everywhere\n", sigmaFile);
+    for (i = 0; i < numSteps; i++)
+      for (dataNum = 0; dataNum < numDataTypes; dataNum++)
+	sigmas[i][dataNum] = 1.0;
+  }
+
+  seedRandStream(&stream, SEED);
+  for (i = 0; i < numSteps; i++)
+    for (dataNum = 0; dataNum < numDataTypes; dataNum++)
+      model[i][dataNum] = data[i][dataNum] + NOISE * randStreamNormal(&stream);
+
+  // make the observation lists, as readData does:
+  numObs = (int *)malloc(numDataTypes * sizeof(int));
+  obsStep = (int **)malloc(numDataTypes * sizeof(int *));
+  obsValue = (double **)malloc(numDataTypes * sizeof(double *));
+  obsInvTwoVar = (double **)malloc(numDataTypes * sizeof(double *));
+  obsModel = (double **)malloc(numDataTypes * sizeof(double *));
+  totObs = 0;
+  for (dataNum = 0; dataNum < numDataTypes; dataNum++)  {
+    numObs[dataNum] = 0;
+    for (i = 0; i < numSteps; i++)
+      if (valid[i][dataNum] >= validFrac)
+	numObs[dataNum]++;
+    totObs += numObs[dataNum];
+
+    obsStep[dataNum] = (int *)malloc((numObs[dataNum] + 1) * sizeof(int)); // + 1 so we never malloc 0
+    obsValue[dataNum] = makeAlignedArray(numObs[dataNum]);
+    obsInvTwoVar[dataNum] = makeAlignedArray(numObs[dataNum]);
+    obsModel[dataNum] = makeAlignedArray(numObs[dataNum]);
+    j = 0;
+    for (i = 0; i < numSteps; i++)  {
+      if (valid[i][dataNum] >= validFrac)  {
+	obsStep[dataNum][j] = i;
+	obsValue[dataNum][j] = data[i][dataNum];
+	obsInvTwoVar[dataNum][j] = 1.0/(2.0*sigmas[i][dataNum]*sigmas[i][dataNum]);
+	j++;
+      }
+    }
+  }
+  if (totObs == 0)  {
+    printf("ERROR: no data points in %s are valid with validFrac = %g\n", dataFile, validFrac);
+    exit(1);
+  }
+
+  sumSquares = makeArray(numDataTypes);
+  refSumSquares = makeArray(numDataTypes);
+  checkSum = 0.0; // so the compiler can't skip any of the work
+
+  start = wallTime();
+  for (rep = 0; rep < numReps; rep++)  {
+    referenceSumSquares(refSumSquares, model, data, valid, sigmas, numSteps, numDataTypes, validFrac, costFunction);
+    checkSum += refSumSquares[0];
+  }
+  refTime = wallTime() - start;
+
+  start = wallTime();
+  for (rep = 0; rep < numReps; rep++)  {
+    for (dataNum = 0; dataNum < numDataTypes; dataNum++)  {
+      for (j = 0; j < numObs[dataNum]; j++)
+	obsModel[dataNum][j] = model[obsStep[dataNum][j]][dataNum];
+      if (costFunction == 0)
+	sumSquares[dataNum] = sumWeightedSquares(obsModel[dataNum], obsValue[dataNum], NULL, numObs[dataNum]) / (2.0*sqrt(0.5)*sqrt(0.5));
+      else
+	sumSquares[dataNum] = sumWeightedSquares(obsModel[dataNum], obsValue[dataNum], obsInvTwoVar[dataNum], numObs[dataNum]);
+    }
+    checkSum += sumSquares[0];
+  }
+  gatherTime = wallTime() - start;
+
+  start = wallTime();
+  for (rep = 0; rep < numReps; rep++)  {
+    for (dataNum = 0; dataNum < numDataTypes; dataNum++)
+      sumSquares[dataNum] = sumWeightedSquares(obsModel[dataNum], obsValue[dataNum], (costFunction == 0) ? NULL : obsInvTwoVar[dataNum],
+					       numObs[dataNum]);
+    checkSum += sumSquares[0];
+  }
+  kernelTime = wallTime() - start;
+
+  // how much do the sums differ (the same terms, added in a different order)? Compare the gathered sums with the reference:
+  maxRelDiff = 0.0;
+  for (dataNum = 0; dataNum < numDataTypes; dataNum++)  {
+    if (costFunction == 0)
+      sumSquares[dataNum] = sumWeightedSquares(obsModel[dataNum], obsValue[dataNum], NULL, numObs[dataNum]) / (2.0*sqrt(0.5)*sqrt(0.5));
+    else
+      sumSquares[dataNum] = sumWeightedSquares(obsModel[dataNum], obsValue[dataNum], obsInvTwoVar[dataNum], numObs[dataNum]);
+    if (refSumSquares[dataNum] != 0.0)  {
+      relDiff = fabs(sumSquares[dataNum] - refSumSquares[dataNum])/fabs(refSumSquares[dataNum]);
+      if (relDiff > maxRelDiff)
+	maxRelDiff = relDiff;
+    }
+  }
+
+  printf("%s: %d steps, %d data types, %d valid observations (validFrac = %g), costFunction %d\n",
+	 argv[optind], numSteps, numDataTypes, totObs, validFrac, costFunction);
+  printf("%d repetitions of each:\n", numReps);
+  printf("  old loop (every step, checking validity):  %.4f sec, %.2f ns/observation\n", refTime, refTime/numReps/totObs * 1e9);
+  printf("  gather + sumWeightedSquares:               %.4f sec, %.2f ns/observation (%.2fx)\n", gatherTime,
+	 gatherTime/numReps/totObs * 1e9, (gatherTime > 0) ? refTime/gatherTime : 0.0);
+  printf("  sumWeightedSquares only:                   %.4f sec, %.2f ns/observation (%.2fx)\n", kernelTime,
+	 kernelTime/numReps/totObs * 1e9, (kernelTime > 0) ? refTime/kernelTime : 0.0);
+  printf("Largest relative difference in sums of squares: %.3g\n", maxRelDiff);
+  printf("(check sum: %g)\n", checkSum);
+
+  free2DArray((void **)data);
+  free2DArray((void **)valid);
+  free2DArray((void **)sigmas);
+  free2DArray((void **)model);
+  for (dataNum = 0; dataNum < numDataTypes; dataNum++)  {
+    free(obsStep[dataNum]);
+    free(obsValue[dataNum]);
+    free(obsInvTwoVar[dataNum]);
+    free(obsModel[dataNum]);
+  }
+  free(numObs);
+  free(obsStep);
+  free(obsValue);
+  free(obsInvTwoVar);
+  free(obsModel);
+  free(sumSquares);
+  free(refSumSquares);
+
+  return 0;
+}
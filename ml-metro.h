@@ -7,10 +7,58 @@
 
 
 /* Puts best parameters found in spatialParams
-   If loc = -1, run at all locations; if loc >= 0, run only at that single location
+   Run at locations runLocs[0..numRunLocs-1] (each a location of the model, listed only once), or at all locations if numRunLocs = 0
+    (a .hist file is written for each location we run at; with more than one, parameter information and the .chain_info file
+    cover all the model's locations, though parameters only change at the locations we run at)
    randomStart is boolean: do we start each chain with a random param. set (as opposed to guess values)?
+   earlyReject is boolean: do we stop each model run as soon as we know we'll reject the point?
+    (only valid with costFunction = 1, non-negative dataTypeWeights, scaleFactor > 0 and no aggregation:
+    in this case, likely must be difference; uses boundedDifference instead)
+   numChains start chains are each run to convergence (each with its own copy of spatialParams and its own random numbers),
+    and the best of these is then used as the starting point for the estSteps steps of the main chain
+   numThreads: number of threads to use for running the start chains at once,
+    and then for running the main chain's model runs at different locations at once
+    (results are exactly the same whatever the number of threads;
+    likely and model must be safe to call from several threads at once, as difference and runModelNoOut are)
+    With earlyReject, locations are still run one at a time
+   adaptive: if 0, each step changes a single randomly-chosen parameter value by a uniform step scaled by its knob;
+    if 1, each step of the main chain changes all parameter values at once, with a multivariate normal step whose covariance
+    adapts to that of the chain so far (adaptive Metropolis: Haario et al. 2001), which moves much faster when parameters are correlated
+    (start chains always use single-parameter steps, to tune the knobs, which give the initial covariance)
+    Either way, we write the effective sample size of the recorded steps, and effective samples per model run, to userOut
+   localSpatial: if 1 (and we're running at more than one location), a single-parameter step that picks a spatial parameter
+    changes it at just one randomly-chosen location, and only runs the model there: the log likelihood at every other location
+    is unchanged, so it's taken from that of the current point (Metropolis-within-Gibbs over locations)
+    This costs 1 model run rather than one per location; non-spatial parameters still change (and run the model) everywhere
+    If 0, a step on a spatial parameter changes it at every location at once
+   numTemps: if > 1, use parallel tempering (replica exchange) for the main chain: run numTemps replicas at once
+    (on numThreads threads), with temperatures going up geometrically from 1 to maxTemp
+    (a replica at temperature T multiplies log likelihood differences by 1/T, so hot replicas move between modes easily),
+    and every swapInterval steps propose swapping the states of each pair of neighbouring replicas
+    Only the replica at T = 1 is written to the .hist files
+   popSize: if > 0, replace the main chain by a population of popSize chains, started around the best start chain's point,
+    that move by differential evolution MCMC (DE-MC: ter Braak 2006): each member proposes changing all parameter values at once,
+    by a scaled difference between two other members, so the population's spread sets the step sizes and directions
+    Half the population moves at a time (using the other half's points), running its members at once on numThreads threads
+    Each of the estSteps (and numSpinUps) steps is then a generation, in which every member takes one step,
+    and every member's accepted points are written to the .hist files
+    Can't be combined with adaptive or numTemps > 1; needs popSize >= 4
+   Every numAtOnce steps once we start recording, we write running diagnostics of the recorded steps to userOut:
+    for each parameter value, its mean, s.d., effective sample size (by batch means) and split R-hat
+    (over the halves of the main chain, or with DE-MC, of all members of the population)
+   targetEss, targetRhat: if either is > 0, stop (at one of these checks) as soon as every parameter value has an effective sample size
+    of at least targetEss (if > 0) and a split R-hat of at most targetRhat (if > 0), rather than always taking all estSteps steps
+   checkpointInterval: if > 0, write a checkpoint of the whole state of the run to <outNameBase>.checkpoint once the start chains
+    have converged, then after every checkpointInterval steps, and once more at the end (each one written to a temporary file
+    which then replaces the last, so there is always a complete checkpoint)
+   resume: if 1, and <outNameBase>.checkpoint exists, carry on from the checkpoint (skipping the start chains), throwing away
+    anything written to the .hist files after it: the results are then exactly the same as if the run had never stopped
+    (if the run had already finished, just do what comes after the last step again)
+    If there's no checkpoint, start from the beginning
+   Each chain has its own random number stream, all from a family whose seed is taken from rand()
+    (and written to userOut), so srand (or seedRand) should be called first
    NOTE: anything but a scale factor of 1 goes against theory */
-void metropolis(char *outNameBase, SpatialParams *spatialParams, int loc,
+void metropolis(char *outNameBase, SpatialParams *spatialParams, int numRunLocs, int runLocs[],
 		double (*likely)(double *, OutputInfo *,
 				 int, SpatialParams *, double,
 				 void (*)(double **, int, int *, SpatialParams *, int),
@@ -20,6 +68,7 @@ void metropolis(char *outNameBase, SpatialParams *spatialParams, int loc,
 		long estSteps, int numAtOnce, int numChains, int randomStart, long numSpinUps, double paramWeight,
 		double scaleFactor,
 		int dataTypeIndices[], int numDataTypes, int costFunction, double dataTypeWeights [],
-		FILE *userOut);
+		int earlyReject, int numThreads, int adaptive, int localSpatial, int numTemps, double maxTemp, int swapInterval, int popSize,
+		double targetEss, double targetRhat, long checkpointInterval, int resume, FILE *userOut);
 
 #endif
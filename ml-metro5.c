@@ -10,13 +10,31 @@
 #include <math.h>
 #include <string.h>
 #include <float.h>
+#include <unistd.h>
 #include "paramchange.h"
 #include "spatialParams.h"
+#include "sipnet.h"
 #include "util.h"
+#include "threadPool.h"
+#include "chainStats.h"
+#include "allocCount.h"
 
 #define A_STAR 0.4 // target acceptance rate
 #define DEC 0.99 // how much to decrease temp. by on rejection
 #define THRESH 0.02 // how close we have to get to A_STAR before stop adjusting temperatures
+#define EARLY_REJECT_MARGIN 1e-9 /* with early rejection, only stop a run once its misfit is above the acceptance threshold
+				    by more than this fraction, so round-off can't make us reject a point we would have accepted */
+#define AM_SCALE (2.38*2.38) // adaptive proposal covariance is AM_SCALE/d times the chain's covariance (d = number of values)
+#define DEMC_GAMMA (2.38/sqrt(2.0)) // DE-MC difference vectors are multiplied by DEMC_GAMMA/sqrt(d) (d = number of values)
+#define DEMC_JUMP_INTERVAL 10 // every DEMC_JUMP_INTERVAL generations, DE-MC uses a multiplier of 1, to allow jumps between modes
+#define DEMC_NOISE 1e-4 // s.d. of the noise added to DE-MC proposals, as a fraction of each parameter's range
+#define AM_INITIAL_WEIGHT 1000.0 /* with the adaptive proposal, number of steps' worth of weight given to the initial covariance
+				    (which comes from the knobs), so the covariance is sensible before the chain has gone far */
+#define AM_MAX_INITIAL_KNOB 0.1 /* with the adaptive proposal, largest knob (as a fraction of the parameter's range) used for the initial covariance
+				   (the start chains can leave knobs well above 1, which would make almost every proposal go out of range) */
+#define AM_TARGET_ACCEPT 0.234 // the adaptive proposal's overall scale is adjusted to move its acceptance rate towards this
+#define AM_SCALE_RATE 1.0 // the n-th step of the adaptive proposal changes the log of its scale by AM_SCALE_RATE/sqrt(n) times (accept - AM_TARGET_ACCEPT)
+#define CHECKPOINT_MAGIC "SIPNET-CKPT-4" // start of every checkpoint file (change if the format changes)
 
 
 // write a header line for the .hist file
@@ -90,47 +108,1061 @@ void writeHistFileBin(FILE *histFile, double ltotnew, double *sigma, OutputInfo
 // reset parameter, log likelihood variables, etc. for start of MCMC chain
 // parameters from spatialParams through outputInfo are outputs, rest are inputs (spatialParams also provides some inputs)
 // all output parameters are arrays except ltotnew, ltotold and ltotmax;
-// loglikely, outputInfo and sigma are spatial (1st dimension of sigma and outputInfo is spatial dimension; loglikely is only one-dimensional)
-// if loc = -1, we're running everywhere (number of locations, which is also the size of loglikely and sigma, specified in spatialParams)
-// if loc >= 0, we're running at a single location; in this case, 1st dimension of loglikely and sigma only has length 1
-// randomStart is boolean: do we start each chain with a random param. set (as opposed to guess values)?
-void reset(SpatialParams *spatialParams, double *loglikely, double *ltotnew, double *ltotold, double *ltotmax,
-	   double **sigma, OutputInfo **outputInfo,
-	   int loc, int randomStart, double addFraction, FILE *userOut,
-	   double (*likely)(double *, OutputInfo *,
-			    int, SpatialParams *, double,
-			    void (*)(double **, int, int *, SpatialParams *, int),
-			    int [], int, int, double []),
-	   double paramWeight, void (*model)(double **, int, int *, SpatialParams *, int),
-	   int dataTypeIndices[], int numDataTypes, int costFunction, double dataTypeWeights[])
-{
-  int currLoc;
-  int np; // number of changeable parameters
-  int firstLoc, lastLoc, locIndex;
+// everything needed to compute the likelihood at each location we're running at (see evalLocation)
+typedef struct LocEvalInfoStruct {
+  double (*likely)(double *, OutputInfo *,
+		   int, SpatialParams *, double,
+		   void (*)(double **, int, int *, SpatialParams *, int),
+		   int [], int, int, double []);
+  void (*model)(double **, int, int *, SpatialParams *, int);
+  SpatialParams *spatialParams;
+  double paramWeight;
+  int *dataTypeIndices;
+  int numDataTypes;
+  int costFunction;
+  double *dataTypeWeights;
+
+  int *locs; // locs[locIndex] is the location of index locIndex in the arrays below
+  int numLocs; // number of locations we're running at (size of the arrays below)
+  int wantOutputInfo; /* do we need outputInfo for the points we evaluate (i.e. might they be written to the hist files)?
+			 if not, it isn't filled in, which saves the post-comparisons (see difference) */
+  // these are filled by evalLocation (1st dimension of each is spatial):
+  double *loglikely;
+  double **sigma;
+  OutputInfo **outputInfo;
+} LocEvalInfo;
+
+
+/* compute log likelihood at a single location (location # locs[locIndex]),
+   putting it in loglikely[locIndex], and filling sigma[locIndex] and (if wantOutputInfo) outputInfo[locIndex]
+   (locEvalInfo is a LocEvalInfo *: has this form so it can be run by a thread pool)
+   Only writes to this location's elements of the arrays in locEvalInfo, so different locations can be done at once
+*/
+void evalLocation(int locIndex, void *locEvalInfo) {
+  LocEvalInfo *info;
+
+  info = (LocEvalInfo *)locEvalInfo;
+  info->loglikely[locIndex] = -1.0 * (*(info->likely))(info->sigma[locIndex],
+						       info->wantOutputInfo ? info->outputInfo[locIndex] : NULL,
+						       info->locs[locIndex], info->spatialParams,
+						       info->paramWeight, info->model, info->dataTypeIndices,
+						       info->numDataTypes, info->costFunction, info->dataTypeWeights);
+}
 
-  np = spatialParams->numChangeableParams;
-  if (loc == -1) { // running at all locations
-    firstLoc = 0;
-    lastLoc = spatialParams->numLocs - 1;
+
+/* compute log likelihood of current parameter set at all locations we're running at, spreading locations over pool's threads
+   return the total log likelihood
+   the total is always summed in location order, so it's exactly the same whatever the number of threads
+*/
+double evalAllLocations(LocEvalInfo *info, ThreadPool *pool) {
+  runTasks(pool, info->numLocs, evalLocation, info);
+  return sumArray(info->loglikely, info->numLocs);
+}
+
+
+// for prepareThread: the locations we'll evaluate points at, and whether we'll need arrays for whole model runs' output there
+typedef struct PrepareThreadInfoStruct {
+  int numLocs, *locs;
+  int modelArrays;
+} PrepareThreadInfo;
+
+
+/* set up the calling thread's model context and scratch space now, rather than when it first evaluates a point,
+   so that evaluating points from then on never allocates anything (run on each thread by runOnEachThread)
+   prepareThreadInfo is a PrepareThreadInfo *
+*/
+void prepareThread(void *prepareThreadInfo) {
+  PrepareThreadInfo *info = (PrepareThreadInfo *)prepareThreadInfo;
+
+  getDefaultContext();
+  prepareModelScratch(info->numLocs, info->locs, info->modelArrays);
+}
+
+
+// settings that are the same for all chains in a call to metropolis
+typedef struct MetroSettingsStruct {
+  int loc; // location we're running at (-1 means more than one location: then parameter information is written for all locations)
+  int numLocs; // number of locations that we're actually running at
+  int *locs; // the locations that we're actually running at: locs[0..numLocs-1]
+  double addFraction; // starting knob value
+  int randomStart; // do we start each chain with a random param. set (as opposed to guess values)?
+  int numAtOnce; // interval for checking convergence and writing screen output
+  int numChains; // number of start chains
+  double scaleFactor;
+  int earlyReject; // do we stop each model run as soon as we know we'll reject the point?
+  double inc; // how much to increase temp. by on acceptance
+  int adaptive; // does the main chain change all parameters at once, using an adaptive multivariate proposal? (see ml-metro.h)
+  int localSpatial; // do single-parameter steps change a spatial parameter at just one location? (see ml-metro.h)
+
+  /* the parameter values we're estimating, as a single vector:
+     element i is the value of parameter coordParam[i] at location coordLoc[i], for i = 0..numCoords-1
+     (one element for each non-spatial changeable parameter, and one for each location we're running at for each spatial one) */
+  int numCoords;
+  int *coordParam, *coordLoc;
+} MetroSettings;
+
+
+// set settings->numCoords, coordParam and coordLoc for the changeable parameters in spatialParams
+// PRE: settings->numLocs and locs have been set
+void setupCoords(MetroSettings *settings, SpatialParams *spatialParams) {
+  int i, index, locIndex, numValues;
+
+  settings->numCoords = 0;
+  for (i = 0; i < spatialParams->numChangeableParams; i++) {
+    index = spatialParams->changeableParamIndices[i];
+    settings->numCoords += isSpatial(spatialParams, index) ? settings->numLocs : 1;
   }
-  else // only running at one location
-    firstLoc = lastLoc = loc;
 
-  resetSpatialParams(spatialParams, addFraction, randomStart); // reset value, best & knob (set knob to addFraction)
+  settings->coordParam = (int *)malloc(settings->numCoords * sizeof(int));
+  settings->coordLoc = (int *)malloc(settings->numCoords * sizeof(int));
+  numValues = 0;
+  for (i = 0; i < spatialParams->numChangeableParams; i++) {
+    index = spatialParams->changeableParamIndices[i];
+    if (isSpatial(spatialParams, index)) {
+      for (locIndex = 0; locIndex < settings->numLocs; locIndex++) {
+	settings->coordParam[numValues] = index;
+	settings->coordLoc[numValues] = settings->locs[locIndex];
+	numValues++;
+      }
+    }
+    else { // non-spatial - we just use one location (as elsewhere)
+      settings->coordParam[numValues] = index;
+      settings->coordLoc[numValues] = 0;
+      numValues++;
+    }
+  }
+}
 
-  /*compute log-likelihood of parameter set*/
-  for (currLoc = firstLoc; currLoc <= lastLoc; currLoc++) {
-    locIndex = currLoc - firstLoc; // index into arrays
-    loglikely[locIndex] = -1.0 * (*likely)(sigma[locIndex], outputInfo[locIndex], currLoc, spatialParams,
-					   paramWeight, model, dataTypeIndices, numDataTypes, costFunction, dataTypeWeights);
+
+// put the current values of all the parameters we're estimating in x[0..settings->numCoords-1]
+void getCoordValues(MetroSettings *settings, SpatialParams *spatialParams, double *x) {
+  int i;
+
+  for (i = 0; i < settings->numCoords; i++)
+    x[i] = getSpatialParam(spatialParams, settings->coordParam[i], settings->coordLoc[i]);
+}
+
+
+/* the state of the adaptive multivariate proposal (adaptive Metropolis: Haario et al. 2001, Bernoulli 7:223-242)
+   new points are drawn from a normal distribution centred on the current point,
+   with covariance (AM_SCALE/d) times the covariance of the chain so far
+   To keep this covariance positive-definite from the start, the initial covariance (from the knobs)
+   is counted as AM_INITIAL_WEIGHT steps' worth of chain
+   We keep the Cholesky factor of the (weighted) sum of squared deviations from the mean,
+   which each new point changes by a rank-one update, so we never have to refactor
+   All values are divided by their parameter's range, so they are all of a similar size
+   The whole step is also multiplied by exp(logScale), which is adapted (more and more slowly, so the chain still converges)
+   to move the acceptance rate towards AM_TARGET_ACCEPT: the optimal rate for a multivariate normal target
+   (so if the chain's covariance makes poor proposals, e.g. while it is still mostly the initial covariance, we still accept some) */
+typedef struct AdaptiveProposalStruct {
+  int d; // number of values (settings->numCoords)
+  double weight; // total weight of points so far (AM_INITIAL_WEIGHT + number of points added)
+  double *mean; // mean of the (scaled) points so far
+  double **chol; // lower-triangular Cholesky factor of the sum of squared deviations from mean
+  double logScale; // log of the factor every step is multiplied by
+  double *range; // range (max - min) of each value's parameter
+  double *z, *work; // workspace
+} AdaptiveProposal;
+
+
+// allocate and return a new adaptive proposal, starting at the current point of spatialParams,
+// with an initial covariance given by its knobs (each value's variance is that of the single-parameter step, with knobs capped at AM_MAX_INITIAL_KNOB)
+AdaptiveProposal *newAdaptiveProposal(MetroSettings *settings, SpatialParams *spatialParams) {
+  AdaptiveProposal *ap;
+  int i, j;
+  double knob;
+
+  ap = (AdaptiveProposal *)malloc(sizeof(AdaptiveProposal));
+  ap->d = settings->numCoords;
+  ap->weight = AM_INITIAL_WEIGHT;
+  ap->logScale = 0.0;
+  ap->mean = makeArray(ap->d);
+  ap->chol = make2DArray(ap->d, ap->d);
+  ap->range = makeArray(ap->d);
+  ap->z = makeArray(ap->d);
+  ap->work = makeArray(ap->d);
+
+  for (i = 0; i < ap->d; i++) {
+    ap->range[i] = getSpatialParamMax(spatialParams, settings->coordParam[i]) - getSpatialParamMin(spatialParams, settings->coordParam[i]);
+    ap->mean[i] = getSpatialParam(spatialParams, settings->coordParam[i], settings->coordLoc[i]) / ap->range[i];
+    knob = getSpatialParamKnob(spatialParams, settings->coordParam[i], settings->coordLoc[i]);
+    if (knob > AM_MAX_INITIAL_KNOB)
+      knob = AM_MAX_INITIAL_KNOB;
+    for (j = 0; j < ap->d; j++)
+      ap->chol[i][j] = 0.0;
+    ap->chol[i][i] = sqrt(AM_INITIAL_WEIGHT * knob * knob / 12.0);
+    // the single-parameter step is uniform on +/- knob/2 (as a fraction of range), which has variance knob^2/12
   }
-  *ltotold = *ltotmax = *ltotnew = sumArray(loglikely, lastLoc - firstLoc + 1);
+
+  return ap;
+}
+
+
+// add the current point of spatialParams to the adaptive proposal's mean and covariance
+void addAdaptivePoint(AdaptiveProposal *ap, MetroSettings *settings, SpatialParams *spatialParams) {
+  int i;
+  double delta, factor;
+
+  ap->weight += 1.0;
+  factor = sqrt((ap->weight - 1.0)/ap->weight);
+  for (i = 0; i < ap->d; i++) {
+    delta = getSpatialParam(spatialParams, settings->coordParam[i], settings->coordLoc[i]) / ap->range[i] - ap->mean[i];
+    ap->mean[i] += delta/ap->weight;
+    ap->work[i] = delta * factor;
+  }
+  // sum of squared deviations goes up by ((weight - 1)/weight) * delta delta^T:
+  choleskyUpdate(ap->chol, ap->work, ap->d);
+}
+
+
+// free all space used by ap
+void deleteAdaptiveProposal(AdaptiveProposal *ap) {
+  free(ap->mean);
+  free2DArray((void **)ap->chol);
+  free(ap->range);
+  free(ap->z);
+  free(ap->work);
+  free(ap);
+}
+
+
+/* put the smallest effective sample size and the largest split R-hat over all values in stats[0..numChains-1]
+   (one for each chain we record, all tracking the same values: each value's effective sample size is the sum over chains)
+   in minEss and maxRhat
+   return 1 if there were enough points to compute these, 0 if not
+*/
+int summarizeDiagnostics(ChainStats **stats, int numChains, double *minEss, double *maxRhat) {
+  int i, chainNum;
+  double thisEss, thisRhat;
+
+  if (getChainStatsEss(stats[0], 0) < 0 || getSplitRhat(stats, numChains, 0) < 0)
+    return 0;
+
+  for (i = 0; i < stats[0]->num; i++) {
+    thisEss = 0.0;
+    for (chainNum = 0; chainNum < numChains; chainNum++)
+      thisEss += getChainStatsEss(stats[chainNum], i);
+    thisRhat = getSplitRhat(stats, numChains, i);
+    if (i == 0 || thisEss < *minEss)
+      *minEss = thisEss;
+    if (i == 0 || thisRhat > *maxRhat)
+      *maxRhat = thisRhat;
+  }
+
+  return 1;
+}
+
+
+/* write (to out) running diagnostics for each parameter value we're estimating, over the recorded points so far in
+   stats[0..numChains-1] (one for each chain we record): mean, standard deviation, effective sample size and split R-hat
+*/
+void writeDiagnostics(ChainStats **stats, int numChains, MetroSettings *settings, SpatialParams *spatialParams, FILE *out) {
+  int i, chainNum;
+  long numPoints;
+  double mean, var, ess;
+
+  numPoints = 0;
+  for (chainNum = 0; chainNum < numChains; chainNum++)
+    numPoints += getChainStatsNumPoints(stats[chainNum]);
+  fprintf(out, "\n\t\tDIAGNOSTICS (over %ld recorded steps of %d chain(s)):\n", numPoints, numChains);
+  if (getChainStatsEss(stats[0], 0) < 0 || getSplitRhat(stats, numChains, 0) < 0) {
+    fprintf(out, "\t\ttoo few steps so far\n");
+    return;
+  }
+
+  for (i = 0; i < settings->numCoords; i++) {
+    mean = var = ess = 0.0;
+    for (chainNum = 0; chainNum < numChains; chainNum++) { // combine chains (all have the same number of points, except perhaps 1 batch)
+      mean += getChainStatsMean(stats[chainNum], i)/numChains;
+      var += getChainStatsVar(stats[chainNum], i)/numChains;
+      ess += getChainStatsEss(stats[chainNum], i);
+    }
+    fprintf(out, "\t\t%s", spatialParams->parameters[settings->coordParam[i]].name);
+    if (isSpatial(spatialParams, settings->coordParam[i]))
+      fprintf(out, "[%d]", settings->coordLoc[i]);
+    fprintf(out, ":\tmean = %f\tsd = %f\tESS = %.1f\tsplit R-hat = %.3f\n", mean, sqrt(var), ess, getSplitRhat(stats, numChains, i));
+  }
+}
+
+
+/* write (to out) the smallest and mean effective sample size over all values in stats[0..numChains-1],
+   and each of these divided by the number of recorded steps and by numEvals (the number of model runs it took to get them),
+   and the largest split R-hat
+   proposalName describes how the chains move */
+void writeEss(ChainStats **stats, int numChains, long numEvals, char *proposalName, FILE *out) {
+  int i, chainNum;
+  long numPoints;
+  double minEss, meanEss, maxRhat;
+
+  numPoints = 0;
+  for (chainNum = 0; chainNum < numChains; chainNum++)
+    numPoints += getChainStatsNumPoints(stats[chainNum]);
+  fprintf(out, "\nEFFECTIVE SAMPLES (%s proposals, batch means over %ld recorded steps of %d chain(s)):\n",
+	  proposalName, numPoints, numChains);
+  if (!summarizeDiagnostics(stats, numChains, &minEss, &maxRhat)) {
+    fprintf(out, "\ttoo few steps to estimate\n");
+    return;
+  }
+
+  meanEss = 0.0;
+  for (i = 0; i < stats[0]->num; i++) {
+    for (chainNum = 0; chainNum < numChains; chainNum++)
+      meanEss += getChainStatsEss(stats[chainNum], i);
+  }
+  meanEss /= stats[0]->num;
+
+  fprintf(out, "\tmin = %.1f\tmean = %.1f\t(over %d parameter values)\tmax split R-hat = %.3f\n",
+	  minEss, meanEss, stats[0]->num, maxRhat);
+  // (a proposal out of range is rejected without running the model: so count every proposal, as well as the model runs)
+  fprintf(out, "\t%.3g (min) and %.3g (mean) effective samples per recorded step (i.e. per proposal, in range or not)\n",
+	  minEss/numPoints, meanEss/numPoints);
+  if (numEvals > 0)
+    fprintf(out, "\t%ld model runs (proposals out of range don't run the model): %.3g (min) and %.3g (mean) effective samples per model run\n",
+	    numEvals, minEss/numEvals, meanEss/numEvals);
+}
+
+
+// the state of a single chain: one of the start chains, any of which may go on to be the main chain
+typedef struct ChainStruct {
+  SpatialParams *spatialParams; // this chain's own copy of the parameters: current point, bests and knobs
+  RandStream rng; // this chain's own random numbers, so its results don't depend on what other chains are doing
+  LocEvalInfo evalInfo; // for computing log likelihood (also holds loglikely, sigma and outputInfo of the latest point tried)
+  /* loglikely, sigma and outputInfo of the current point, kept from evalInfo when the point was accepted (see keepEvaluation)
+     currSigma and currOutputInfo are only up to date if currValid is true: they may not be if the current point
+     was evaluated without outputInfo, or came from a checkpoint */
+  double *currLoglikely;
+  double **currSigma;
+  OutputInfo **currOutputInfo;
+  int currValid;
+  ThreadPool *pool; // threads for running different locations at once
+  AdaptiveProposal *adaptive; // NULL unless this chain uses adaptive multivariate proposals
+  double beta; // inverse temperature: log likelihood differences are multiplied by this in accept/reject (1 for an untempered chain)
+  double *pold; // spatial (for adaptive proposals: one element for each of settings->numCoords values)
+  double ltotnew, ltotold, ltotmax;
+  int yes; // number of acceptances since last screen output
+  long numEvals, numEarlyRejects; // for early rejection: number of parameter sets evaluated, and number rejected early
+  long stepsSaved; // for early rejection: number of model steps we didn't have to run
+  long numLocalEvals; // number of parameter sets evaluated by running the model at a single location (see evalLocalProposal)
+  FILE *out; // where to write screen output
+} Chain;
+
+
+/* allocate and return a new chain, working on its own copy of spatialParams
+   evalTemplate gives all the likelihood settings (everything but spatialParams and the spatial arrays, which we allocate here)
+   rng gives the start of the chain's random numbers (which we copy)
+   pool gives the threads used for running different locations at once
+   screen output will go to out
+*/
+Chain *newChain(SpatialParams *spatialParams, MetroSettings *settings, LocEvalInfo *evalTemplate, RandStream *rng,
+		ThreadPool *pool, FILE *out) {
+  Chain *chain;
+  int locIndex;
+
+  chain = (Chain *)malloc(sizeof(Chain));
+  chain->spatialParams = copySpatialParams(spatialParams);
+  chain->rng = *rng;
+
+  chain->evalInfo = *evalTemplate;
+  chain->evalInfo.spatialParams = chain->spatialParams;
+  chain->evalInfo.loglikely = makeArray(settings->numLocs);
+  chain->evalInfo.sigma = make2DArray(settings->numLocs, evalTemplate->numDataTypes);
+  chain->evalInfo.outputInfo = (OutputInfo **)malloc(settings->numLocs * sizeof(OutputInfo *));
+  for (locIndex = 0; locIndex < settings->numLocs; locIndex++)
+    chain->evalInfo.outputInfo[locIndex] = newOutputInfo(evalTemplate->numDataTypes, settings->locs[locIndex]);
+  chain->currLoglikely = makeArray(settings->numLocs);
+  chain->currSigma = make2DArray(settings->numLocs, evalTemplate->numDataTypes);
+  chain->currOutputInfo = (OutputInfo **)malloc(settings->numLocs * sizeof(OutputInfo *));
+  for (locIndex = 0; locIndex < settings->numLocs; locIndex++) {
+    chain->currLoglikely[locIndex] = 0.0;
+    chain->currOutputInfo[locIndex] = newOutputInfo(evalTemplate->numDataTypes, settings->locs[locIndex]);
+  }
+  chain->currValid = 0;
+
+  chain->pool = pool;
+  chain->adaptive = NULL;
+  chain->beta = 1.0;
+  chain->pold = makeArray((settings->numCoords > settings->numLocs) ? settings->numCoords : settings->numLocs);
+  chain->ltotnew = chain->ltotold = chain->ltotmax = 0.0;
+  chain->yes = 0;
+  chain->numEvals = chain->numEarlyRejects = chain->stepsSaved = chain->numLocalEvals = 0;
+  chain->out = out;
+
+  return chain;
+}
+
+
+// free all space used by chain (but don't close chain->out)
+void deleteChain(Chain *chain, MetroSettings *settings) {
+  int locIndex;
+
+  deleteSpatialParams(chain->spatialParams);
+  free(chain->evalInfo.loglikely);
+  free2DArray((void **)chain->evalInfo.sigma);
+  for (locIndex = 0; locIndex < settings->numLocs; locIndex++)
+    freeOutputInfo(chain->evalInfo.outputInfo[locIndex], chain->evalInfo.numDataTypes);
+  free(chain->evalInfo.outputInfo);
+  free(chain->currLoglikely);
+  free2DArray((void **)chain->currSigma);
+  for (locIndex = 0; locIndex < settings->numLocs; locIndex++)
+    freeOutputInfo(chain->currOutputInfo[locIndex], chain->evalInfo.numDataTypes);
+  free(chain->currOutputInfo);
+  if (chain->adaptive != NULL)
+    deleteAdaptiveProposal(chain->adaptive);
+  free(chain->pold);
+  free(chain);
+}
+
+
+/* the latest point tried (evaluated in chain->evalInfo) has become the current point:
+   keep its log likelihood, sigma and outputInfo at location index locIndex as the current point's
+   (or at every location, if locIndex is -1; if keepLoglikely is false, just keep sigma and outputInfo)
+   outputInfo is kept by swapping pointers with the current point's old one, so nothing has to be copied
+*/
+void keepEvaluation(Chain *chain, MetroSettings *settings, int locIndex, int keepLoglikely) {
+  LocEvalInfo *evalInfo;
+  OutputInfo *outputInfo;
+  int first, last, i;
+
+  evalInfo = &(chain->evalInfo);
+  first = (locIndex == -1) ? 0 : locIndex;
+  last = (locIndex == -1) ? (settings->numLocs - 1) : locIndex;
+  for (i = first; i <= last; i++) {
+    if (keepLoglikely)
+      chain->currLoglikely[i] = evalInfo->loglikely[i];
+    assignArray(chain->currSigma[i], evalInfo->sigma[i], evalInfo->numDataTypes);
+    outputInfo = chain->currOutputInfo[i];
+    chain->currOutputInfo[i] = evalInfo->outputInfo[i];
+    evalInfo->outputInfo[i] = outputInfo;
+  }
+}
+
+
+// start chain again from a new point (guess values, or a random point if settings->randomStart),
+// and compute the log likelihood there
+void reset(Chain *chain, MetroSettings *settings)
+{
+  resetSpatialParams(chain->spatialParams, settings->addFraction, settings->randomStart, &(chain->rng));
+  // reset value, best & knob (set knob to addFraction)
+
+  /*compute log-likelihood of parameter set*/
+  chain->ltotold = chain->ltotmax = chain->ltotnew = evalAllLocations(&(chain->evalInfo), chain->pool);
+  keepEvaluation(chain, settings, -1, 1);
+  chain->currValid = chain->evalInfo.wantOutputInfo;
 
   /*screen output*/
-  fprintf(userOut, "\n\t\t\t**ESTIMATOR**\n");
-  writeChangeableParamInfo(spatialParams, loc, userOut);
-  fprintf(userOut, "\n\t\tlTOT\tnew= %9.6f\tmax= %9.6f\n",
-	  *ltotnew,*ltotmax);
+  fprintf(chain->out, "\n\t\t\t**ESTIMATOR**\n");
+  writeChangeableParamInfo(chain->spatialParams, settings->loc, chain->out);
+  fprintf(chain->out, "\n\t\tlTOT\tnew= %9.6f\tmax= %9.6f\n",
+	  chain->ltotnew, chain->ltotmax);
+}
+
+
+/* PRE: chain->ltotnew is the log likelihood of the proposed new point (which hasn't been rejected early)
+   decide whether to accept the new point (if it's the best point so far, also update ltotmax and the parameter bests)
+   randNum is the log of the uniform random number drawn for this point before its evaluation (see evalProposal)
+   return 1 if we accept the new point, 0 if we reject it
+*/
+int acceptOrReject(Chain *chain, MetroSettings *settings, double randNum) {
+  // compare "new" likelihood to "max" likelihood and act
+  if (chain->ltotnew > chain->ltotmax) {
+    chain->ltotmax = chain->ltotnew;
+    setAllSpatialParamBests(chain->spatialParams, settings->loc); /* set best equal to current value for all parameters
+								     if loc == -1, this will set bests at all locations */
+  }
+
+  /*compare new to old and accept or reject*/
+  if (chain->ltotnew > chain->ltotold)
+    return 1;
+  else if (randNum < settings->scaleFactor * chain->beta * (chain->ltotnew - chain->ltotold))
+    return 1; // note: anything but a scaleFactor of 1 goes against theory (except in tempered chains, where beta < 1)
+  else
+    return 0;
+}
+
+
+/* PRE: the proposed new point has been set in chain->spatialParams (and is within the allowable range)
+   compute the log likelihood there (in chain->ltotnew), and decide whether to accept the new point
+   (if it's the best point so far, also update ltotmax and the parameter bests)
+   return 1 if we accept the new point (in which case its evaluation is kept as the current point's: see keepEvaluation),
+   0 if we reject it
+*/
+int evalProposal(Chain *chain, MetroSettings *settings) {
+  SpatialParams *spatialParams;
+  LocEvalInfo *evalInfo;
+  int accept;
+  int currLoc, locIndex;
+  double randNum; // log of uniform random number used to decide whether to accept a point
+  double maxDiff, diffSoFar = 0.0; // for early rejection: largest total difference we could accept, and total difference so far
+
+  spatialParams = chain->spatialParams;
+  evalInfo = &(chain->evalInfo);
+  accept = 1; // so far, we're in accept mode - we haven't rejected the new point yet
+  chain->numEvals++;
+
+  /* draw the random number first, whether or not we need it (and whether or not we do early rejection),
+     so that a chain makes the same draws, and so the same moves, with and without early rejection */
+  randNum = randmStream(&(chain->rng));
+
+  if (settings->earlyReject) {
+    /* we know the worst likelihood we could accept,
+       so stop running the model as soon as we know we'll be worse than that
+       (we'll accept if ltotnew > ltotold + randNum/(scaleFactor * beta); note that randNum < 0) */
+    maxDiff = -1.0 * (chain->ltotold + randNum/(settings->scaleFactor * chain->beta));
+    maxDiff += EARLY_REJECT_MARGIN * (fabs(maxDiff) + 1.0);
+
+    /*compute log-likelihood of new parameter set, stopping as soon as the total is too small*/
+    // (locations are done one at a time, in order, since each one's bound depends on the ones before it)
+    for (locIndex = 0; locIndex < settings->numLocs; locIndex++) {
+      currLoc = settings->locs[locIndex];
+      evalInfo->loglikely[locIndex] = -1.0 * boundedDifference(evalInfo->sigma[locIndex],
+							       evalInfo->wantOutputInfo ? evalInfo->outputInfo[locIndex] : NULL, currLoc,
+							       spatialParams, evalInfo->dataTypeIndices, evalInfo->numDataTypes,
+							       evalInfo->dataTypeWeights, maxDiff - diffSoFar, &(chain->stepsSaved));
+      diffSoFar -= evalInfo->loglikely[locIndex];
+      if (diffSoFar > maxDiff) { // can't accept this point: no need to run remaining locations
+	chain->numEarlyRejects++;
+	accept = 0;
+	break;
+      }
+    }
+  }
+
+  if (accept == 1) { // haven't rejected early
+    if (!settings->earlyReject) {
+      /*compute log-likelihood of new parameter set*/
+      chain->ltotnew = evalAllLocations(evalInfo, chain->pool);
+    }
+    else
+      chain->ltotnew = sumArray(evalInfo->loglikely, settings->numLocs);
+
+    accept = acceptOrReject(chain, settings, randNum);
+  }
+  else // rejected early: ltotnew is an upper bound on the true log likelihood
+    chain->ltotnew = -1.0 * diffSoFar;
+
+  if (accept == 1) {
+    keepEvaluation(chain, settings, -1, 1);
+    chain->currValid = evalInfo->wantOutputInfo;
+  }
+
+  return accept;
+}
+
+
+/* PRE: the proposed new point has been set in chain->spatialParams (and is within the allowable range),
+   and differs from the current point only at location index locIndex (i.e. location # settings->locs[locIndex])
+   as evalProposal, but only runs the model at that location:
+   the log likelihood everywhere else is the same as at the current point, so we take it from chain->currLoglikely
+   (with early rejection, the run there stops as soon as we know we'll reject the point)
+   If we accept the point and need its outputInfo, but the current point's outputInfo isn't up to date at the other locations,
+   we also run the model at all the other locations, to fill it in
+   return 1 if we accept the new point, 0 if we reject it
+*/
+int evalLocalProposal(Chain *chain, MetroSettings *settings, int locIndex) {
+  LocEvalInfo *evalInfo;
+  int accept;
+  double randNum; // log of uniform random number used to decide whether to accept a point
+  double maxDiff, diffElsewhere; // for early rejection: largest total difference we could accept, and total difference at other locations
+
+  evalInfo = &(chain->evalInfo);
+  accept = 1;
+  chain->numEvals++;
+  chain->numLocalEvals++;
+
+  randNum = randmStream(&(chain->rng)); // drawn first in either mode (see evalProposal)
+
+  assignArray(evalInfo->loglikely, chain->currLoglikely, settings->numLocs);
+  if (settings->earlyReject) { // (see evalProposal)
+    maxDiff = -1.0 * (chain->ltotold + randNum/(settings->scaleFactor * chain->beta));
+    maxDiff += EARLY_REJECT_MARGIN * (fabs(maxDiff) + 1.0);
+
+    evalInfo->loglikely[locIndex] = 0.0;
+    diffElsewhere = -1.0 * sumArray(evalInfo->loglikely, settings->numLocs);
+    evalInfo->loglikely[locIndex] = -1.0 * boundedDifference(evalInfo->sigma[locIndex],
+							     evalInfo->wantOutputInfo ? evalInfo->outputInfo[locIndex] : NULL,
+							     settings->locs[locIndex], chain->spatialParams,
+							     evalInfo->dataTypeIndices, evalInfo->numDataTypes,
+							     evalInfo->dataTypeWeights, maxDiff - diffElsewhere, &(chain->stepsSaved));
+    if (diffElsewhere - evalInfo->loglikely[locIndex] > maxDiff) { // can't accept this point
+      chain->numEarlyRejects++;
+      accept = 0;
+    }
+  }
+  else
+    evalLocation(locIndex, evalInfo);
+
+  // (summed over all locations in order, just as for a point evaluated everywhere)
+  // if rejected early, this is an upper bound on the true log likelihood
+  chain->ltotnew = sumArray(evalInfo->loglikely, settings->numLocs);
+  if (accept == 1)
+    accept = acceptOrReject(chain, settings, randNum);
+
+  if (accept == 1) {
+    keepEvaluation(chain, settings, locIndex, 1);
+    if (evalInfo->wantOutputInfo && !chain->currValid) {
+      // (we already have the log likelihood everywhere: this run is just for sigma and outputInfo)
+      evalAllLocations(evalInfo, chain->pool);
+      keepEvaluation(chain, settings, -1, 0);
+    }
+    chain->currValid = evalInfo->wantOutputInfo;
+  }
+
+  return accept;
+}
+
+
+/* take one step of chain: propose a change to one parameter, and accept or reject it
+   (with settings->localSpatial, a spatial parameter is only changed at one randomly-chosen location,
+   so we only need to run the model there: see evalLocalProposal)
+   if tuneKnobs is true, adjust the changed parameter's knob (i.e. temperature) to move the acceptance rate towards A_STAR
+   return 1 if we accepted the new point, 0 if we rejected it
+*/
+int metropolisStep(Chain *chain, MetroSettings *settings, int tuneKnobs) {
+  SpatialParams *spatialParams;
+  int accept;
+  int ichg; // parameter to change
+  int *thisLocs, thisNumLocs; /* for spatial params, all the locations we're running at (or with localSpatial, just the location
+				  we're changing); for non-spatial params, just location 0 */
+  int nonSpatialLoc = 0;
+  int local; // are we only changing a spatial parameter at a single location?
+  int localIndex; // if so, the index (in settings->locs) of the location we're changing
+  int currLoc, i;
+  double range; // (max - min) of current parameter
+  double oldVal;
+  double pdelta, padd;
+
+  spatialParams = chain->spatialParams;
+  accept = 1; // so far, we're in accept mode - we haven't rejected the new point yet
+
+  /*select parameter to change at random*/
+  ichg = randomChangeableSpatialParam(spatialParams, &(chain->rng));
+
+  /* determine the locations for THIS parameter (depends on whether parameter is spatial)
+     note that we'll still use all of settings->locs for things like actually running model;
+     thisLocs just refers to locations we care about for parameter-related things like choosing a new parameter value */
+  local = 0;
+  localIndex = 0;
+  if (isSpatial(spatialParams, ichg)) {
+    if (settings->localSpatial && settings->numLocs > 1) { // change it at just one location, chosen at random
+      local = 1;
+      localIndex = (int)floor(settings->numLocs * randStreamUniform(&(chain->rng)));
+      thisLocs = &(settings->locs[localIndex]);
+      thisNumLocs = 1;
+    }
+    else {
+      thisLocs = settings->locs;
+      thisNumLocs = settings->numLocs;
+    }
+  }
+  else { // non-spatial - we just use one location (doesn't matter which one)
+    thisLocs = &nonSpatialLoc;
+    thisNumLocs = 1;
+  }
+
+  /*change parameter*/
+  range = (getSpatialParamMax(spatialParams, ichg) - getSpatialParamMin(spatialParams, ichg)); // range is the same for all locations
+  for (i = 0; i < thisNumLocs; i++) {
+    currLoc = thisLocs[i];
+    oldVal = getSpatialParam(spatialParams, ichg, currLoc);
+    chain->pold[i] = oldVal; // remember old value
+    if (accept == 1) { // we haven't set accept to 0 yet (if accept = 0 already, don't bother setting new param. values)
+      pdelta = getSpatialParamKnob(spatialParams, ichg, currLoc); // pdelta is expressed as fraction of parameter's range
+      padd = (randStreamUniform(&(chain->rng)) - 0.5) * pdelta * range;
+      // new value will be oldVal + padd
+      if (checkSpatialParam(spatialParams, ichg, oldVal + padd) == 0) { // outside allowable range
+	accept = 0; /* if new value is outside allowable range at any location, reject point (equivalent to making likelihood tiny)
+		       however, we'll continue the loop, because we need to fill pold vector in order to reset param. values later */
+      }
+      else
+	setSpatialParam(spatialParams, ichg, currLoc, oldVal + padd); // set new value equal to oldVal + padd
+    } // if accept == 1
+  } // for i
+
+  if (accept == 1) { // we're within allowable range at all locations; run model and check new total likelihood
+    if (local)
+      accept = evalLocalProposal(chain, settings, localIndex); // only need to run the model at this location
+    else
+      accept = evalProposal(chain, settings); // run model at all locations
+  }
+
+  /* act on acceptance */
+  if (accept == 1) {
+    /* update likelihoods */
+    chain->ltotold = chain->ltotnew;
+    chain->yes++; // chalk up one more acceptance
+
+    if (tuneKnobs) { // twist knob (equivalent to old pdelta)
+      for (i = 0; i < thisNumLocs; i++) {
+	currLoc = thisLocs[i];
+	pdelta = getSpatialParamKnob(spatialParams, ichg, currLoc);
+	pdelta = pdelta * settings->inc; // increase temperature
+	// we used to prevent temperature from going above 1, but we no longer care about how big pdelta gets
+	setSpatialParamKnob(spatialParams, ichg, currLoc, pdelta);
+      }
+    }
+  }
+
+  /* act on rejection */
+  else {
+    /* return to "old" parameters */
+    for (i = 0; i < thisNumLocs; i++) {
+      currLoc = thisLocs[i];
+      oldVal = chain->pold[i];
+      setSpatialParam(spatialParams, ichg, currLoc, oldVal); // restore old value
+    }
+
+    if (tuneKnobs) { // twist knob (equivalent to old pdelta)
+      for (i = 0; i < thisNumLocs; i++) {
+	currLoc = thisLocs[i];
+	pdelta = getSpatialParamKnob(spatialParams, ichg, currLoc);
+	pdelta = pdelta * DEC; // decrease temperature
+	if (pdelta < DBL_EPSILON) // don't let temperature get too small
+	  pdelta = DBL_EPSILON;
+	setSpatialParamKnob(spatialParams, ichg, currLoc, pdelta);
+      } // for (i)
+    } // if (tuneKnobs)
+  } // else (rejection)
+
+  return accept;
+}
+
+
+/* take one step of chain with its adaptive multivariate proposal (see AdaptiveProposal):
+   propose a change to all parameter values at once, accept or reject it (a proposal out of range counts as a rejection),
+   then add the resulting point to the proposal's covariance, and adapt the proposal's scale
+   return 1 if we accepted the new point, 0 if we rejected it
+*/
+int adaptiveStep(Chain *chain, MetroSettings *settings) {
+  SpatialParams *spatialParams;
+  AdaptiveProposal *ap;
+  int accept;
+  int i, j;
+  double scale; // factor to turn chol * z into a step with covariance (AM_SCALE/d) times the chain's covariance (times exp(logScale))
+  double step, newVal;
+
+  spatialParams = chain->spatialParams;
+  ap = chain->adaptive;
+  accept = 1;
+
+  // draw all the random numbers first, so we always draw the same number whether or not we go out of range
+  for (i = 0; i < ap->d; i++)
+    ap->z[i] = randStreamNormal(&(chain->rng));
+
+  /*change parameters*/
+  scale = exp(ap->logScale) * sqrt(AM_SCALE / ap->d / ap->weight);
+  getCoordValues(settings, spatialParams, chain->pold); // remember old values
+  for (i = 0; i < ap->d; i++) {
+    step = 0.0;
+    for (j = 0; j <= i; j++)
+      step += ap->chol[i][j] * ap->z[j];
+    newVal = chain->pold[i] + scale * step * ap->range[i];
+    if (checkSpatialParam(spatialParams, settings->coordParam[i], newVal) == 0) { // outside allowable range: reject point
+      accept = 0;
+      break;
+    }
+    setSpatialParam(spatialParams, settings->coordParam[i], settings->coordLoc[i], newVal);
+  }
+
+  if (accept == 1) // we're within allowable range everywhere; run model at all locations and check new total likelihood
+    accept = evalProposal(chain, settings);
+
+  if (accept == 1) {
+    chain->ltotold = chain->ltotnew;
+    chain->yes++;
+  }
+  else { // return to old parameters
+    for (i = 0; i < ap->d; i++)
+      setSpatialParam(spatialParams, settings->coordParam[i], settings->coordLoc[i], chain->pold[i]);
+  }
+
+  addAdaptivePoint(ap, settings, spatialParams);
+  // (ap->weight - AM_INITIAL_WEIGHT is now the number of steps taken, including this one)
+  ap->logScale += AM_SCALE_RATE / sqrt(ap->weight - AM_INITIAL_WEIGHT) * (accept - AM_TARGET_ACCEPT);
+
+  return accept;
+}
+
+
+/* take one step of chain as a member of a DE-MC population (differential evolution Markov chain: ter Braak 2006,
+   Statistics and Computing 16:239-249): propose moving all parameter values at once by gamma times the difference between
+   two randomly-chosen members of others[0..numOthers-1] (plus a little noise), and accept or reject this
+   others are only read, so they must not be changing while we take this step (see ReplicasInfo)
+   PRE: numOthers >= 2
+   return 1 if we accepted the new point, 0 if we rejected it
+*/
+int demcStep(Chain *chain, MetroSettings *settings, Chain **others, int numOthers, double gamma) {
+  SpatialParams *spatialParams;
+  SpatialParams *sp1, *sp2; // the members whose difference we use
+  int accept;
+  int i, r1, r2;
+  double range, newVal;
+
+  spatialParams = chain->spatialParams;
+  accept = 1;
+
+  // choose two different members:
+  r1 = (int)floor(numOthers * randStreamUniform(&(chain->rng)));
+  r2 = (int)floor((numOthers - 1) * randStreamUniform(&(chain->rng)));
+  if (r2 >= r1)
+    r2++;
+  sp1 = others[r1]->spatialParams;
+  sp2 = others[r2]->spatialParams;
+
+  /*change parameters*/
+  getCoordValues(settings, spatialParams, chain->pold); // remember old values
+  for (i = 0; i < settings->numCoords; i++) {
+    range = getSpatialParamMax(spatialParams, settings->coordParam[i]) - getSpatialParamMin(spatialParams, settings->coordParam[i]);
+    newVal = chain->pold[i]
+      + gamma * (getSpatialParam(sp1, settings->coordParam[i], settings->coordLoc[i]) - getSpatialParam(sp2, settings->coordParam[i], settings->coordLoc[i]))
+      + DEMC_NOISE * range * randStreamNormal(&(chain->rng));
+    if (checkSpatialParam(spatialParams, settings->coordParam[i], newVal) == 0) { // outside allowable range: reject point
+      accept = 0;
+      break;
+    }
+    setSpatialParam(spatialParams, settings->coordParam[i], settings->coordLoc[i], newVal);
+  }
+
+  if (accept == 1) // we're within allowable range everywhere; run model at all locations and check new total likelihood
+    accept = evalProposal(chain, settings);
+
+  if (accept == 1) {
+    chain->ltotold = chain->ltotnew;
+    chain->yes++;
+  }
+  else { // return to old parameters
+    for (i = 0; i < settings->numCoords; i++)
+      setSpatialParam(spatialParams, settings->coordParam[i], settings->coordLoc[i], chain->pold[i]);
+  }
+
+  return accept;
+}
+
+
+// write screen output for chain, after k iterations (to chain->out)
+void writeChainStatus(Chain *chain, MetroSettings *settings, long k) {
+  fprintf(chain->out, "\n\t\t\tITERATION %6ld\n",k);
+  fprintf(chain->out, "\t\t\tFRACTION ACCEPTED %3.2f\n\n", chain->yes*1.0/settings->numAtOnce);
+  writeChangeableParamInfo(chain->spatialParams, settings->loc, chain->out);
+  fprintf(chain->out, "\n\t\tlTOT\tnew= %9.6f\tmax= %9.6f\n", chain->ltotnew, chain->ltotmax);
+  if (settings->earlyReject)
+    fprintf(chain->out, "\t\tEARLY REJECTION: %ld of %ld runs stopped early, %ld model steps saved so far\n",
+	    chain->numEarlyRejects, chain->numEvals, chain->stepsSaved);
+}
+
+
+// everything runReplicaStep needs
+typedef struct ReplicasInfoStruct {
+  Chain **replicas; // with tempering, replicas[0..numReplicas-1] in order of increasing temperature (replicas[0] is untempered)
+  int numReplicas;
+  int *accepted; // accepted[i] is set to 1 if replica i accepted its latest step, 0 if not
+  MetroSettings *settings;
+
+  /* for DE-MC (demc = 1), the replicas are a population, split into two halves: replicas[0..halfSize-1] and the rest
+     half of them (starting at first) take a step at a time, using differences between members of the other half,
+     scaled by gamma */
+  int demc;
+  int halfSize;
+  int first;
+  double gamma;
+} ReplicasInfo;
+
+
+/* take one step of replica # replicaIndex (0-indexing), putting whether it was accepted in accepted[replicaIndex]
+   (replicasInfo is a ReplicasInfo *: has this form so it can be run by a thread pool)
+   Only uses this replica's own state, so different replicas can take their steps at once
+*/
+void runReplicaStep(int replicaIndex, void *replicasInfo) {
+  ReplicasInfo *info;
+  Chain *chain;
+
+  info = (ReplicasInfo *)replicasInfo;
+  if (info->demc) { // replicaIndex is relative to the half taking a step
+    replicaIndex += info->first;
+    chain = info->replicas[replicaIndex];
+    if (info->first == 0) // use the second half
+      info->accepted[replicaIndex] = demcStep(chain, info->settings, info->replicas + info->halfSize,
+					      info->numReplicas - info->halfSize, info->gamma);
+    else // use the first half
+      info->accepted[replicaIndex] = demcStep(chain, info->settings, info->replicas, info->halfSize, info->gamma);
+    return;
+  }
+
+  chain = info->replicas[replicaIndex];
+  if (chain->adaptive != NULL)
+    info->accepted[replicaIndex] = adaptiveStep(chain, info->settings);
+  else
+    info->accepted[replicaIndex] = metropolisStep(chain, info->settings, 0);
+}
+
+
+/* exchange the current states of chains a and b: their parameter values (with bests and knobs) and log likelihoods
+   (including the current point's loglikely, sigma and outputInfo at each location)
+   everything to do with how each chain moves (temperature, random numbers, adaptive proposal) stays where it is
+*/
+void swapChainStates(Chain *a, Chain *b) {
+  SpatialParams *spatialParams;
+  double ltot;
+  double *loglikely;
+  double **sigma;
+  OutputInfo **outputInfo;
+  int valid;
+
+  spatialParams = a->spatialParams;
+  a->spatialParams = b->spatialParams;
+  b->spatialParams = spatialParams;
+  a->evalInfo.spatialParams = a->spatialParams;
+  b->evalInfo.spatialParams = b->spatialParams;
+
+  ltot = a->ltotold;
+  a->ltotold = b->ltotold;
+  b->ltotold = ltot;
+
+  ltot = a->ltotmax;
+  a->ltotmax = b->ltotmax;
+  b->ltotmax = ltot;
+
+  loglikely = a->currLoglikely;
+  a->currLoglikely = b->currLoglikely;
+  b->currLoglikely = loglikely;
+
+  sigma = a->currSigma;
+  a->currSigma = b->currSigma;
+  b->currSigma = sigma;
+
+  outputInfo = a->currOutputInfo;
+  a->currOutputInfo = b->currOutputInfo;
+  b->currOutputInfo = outputInfo;
+
+  valid = a->currValid;
+  a->currValid = b->currValid;
+  b->currValid = valid;
+}
+
+
+/* propose swapping the states of each pair of neighbouring replicas in turn (see ReplicasInfo), going from coldest to hottest,
+   accepting with the usual replica-exchange probability, min(1, exp((beta_i - beta_j) * scaleFactor * (ltot_j - ltot_i)))
+   swapTries[i] and swapAccepts[i] count proposed and accepted swaps between replicas i and i+1
+*/
+void proposeSwaps(ReplicasInfo *info, RandStream *rng, long *swapTries, long *swapAccepts) {
+  Chain *a, *b;
+  int i;
+  double logRatio;
+
+  for (i = 0; i < info->numReplicas - 1; i++) {
+    a = info->replicas[i];
+    b = info->replicas[i + 1];
+    logRatio = (a->beta - b->beta) * info->settings->scaleFactor * (b->ltotold - a->ltotold);
+    swapTries[i]++;
+    if (logRatio >= 0 || randmStream(rng) < logRatio) {
+      swapChainStates(a, b);
+      swapAccepts[i]++;
+    }
+  }
+}
+
+
+/* move replica # (replicaIndex + first) away from its current point by a uniform random amount of up to +/- knob/2
+   (as a fraction of range) in each value (leaving any value that would go out of range where it is),
+   then compute its log likelihood: used to spread out the members of a DE-MC population, which all start at the same point
+   (replicasInfo is a ReplicasInfo *: has this form so it can be run by a thread pool)
+*/
+void scatterReplica(int replicaIndex, void *replicasInfo) {
+  ReplicasInfo *info;
+  MetroSettings *settings;
+  Chain *chain;
+  int i;
+  double range, knob, newVal;
+
+  info = (ReplicasInfo *)replicasInfo;
+  settings = info->settings;
+  chain = info->replicas[replicaIndex + info->first];
+
+  for (i = 0; i < settings->numCoords; i++) {
+    range = getSpatialParamMax(chain->spatialParams, settings->coordParam[i]) - getSpatialParamMin(chain->spatialParams, settings->coordParam[i]);
+    knob = getSpatialParamKnob(chain->spatialParams, settings->coordParam[i], settings->coordLoc[i]);
+    newVal = getSpatialParam(chain->spatialParams, settings->coordParam[i], settings->coordLoc[i])
+      + (randStreamUniform(&(chain->rng)) - 0.5) * knob * range;
+    if (checkSpatialParam(chain->spatialParams, settings->coordParam[i], newVal))
+      setSpatialParam(chain->spatialParams, settings->coordParam[i], settings->coordLoc[i], newVal);
+  }
+
+  chain->ltotold = chain->ltotnew = evalAllLocations(&(chain->evalInfo), chain->pool);
+  keepEvaluation(chain, settings, -1, 1);
+  chain->currValid = chain->evalInfo.wantOutputInfo;
+  if (chain->ltotnew > chain->ltotmax) {
+    chain->ltotmax = chain->ltotnew;
+    setAllSpatialParamBests(chain->spatialParams, settings->loc);
+  }
+}
+
+
+// write screen output for all tempered replicas (to out), after numAtOnce iterations
+void writeReplicaStatus(ReplicasInfo *info, long *swapTries, long *swapAccepts, FILE *out) {
+  int i;
+
+  for (i = 0; i < info->numReplicas; i++) {
+    fprintf(out, "\t\tREPLICA %d (T = %.3g): FRACTION ACCEPTED %3.2f\tlTOT old= %9.6f\tmax= %9.6f",
+	    i + 1, 1.0/info->replicas[i]->beta, info->replicas[i]->yes*1.0/info->settings->numAtOnce,
+	    info->replicas[i]->ltotold, info->replicas[i]->ltotmax);
+    if (i < info->numReplicas - 1)
+      fprintf(out, "\tSWAPS WITH NEXT: %ld of %ld", swapAccepts[i], swapTries[i]);
+    fprintf(out, "\n");
+  }
+}
+
+
+// everything runStartChain needs
+typedef struct StartChainsInfoStruct {
+  Chain **chains; // chains[0..numChains-1]
+  MetroSettings *settings;
+} StartChainsInfo;
+
+
+/* run start chain # chainIndex (0-indexing) from a new starting point (see reset),
+   adjusting knobs until it has converged (i.e. its acceptance rate is near A_STAR)
+   (startChainsInfo is a StartChainsInfo *: has this form so it can be run by a thread pool)
+   Only uses this chain's own state, so different start chains can be run at once
+*/
+void runStartChain(int chainIndex, void *startChainsInfo) {
+  StartChainsInfo *info;
+  Chain *chain;
+  MetroSettings *settings;
+  int converged = 0; // have we converged on correct param ranges yet? (we've converged when we're near A_STAR acceptance)
+  long k;
+
+  info = (StartChainsInfo *)startChainsInfo;
+  chain = info->chains[chainIndex];
+  settings = info->settings;
+
+  fprintf(chain->out, "\n\nRESETTING FOR START CHAIN %d of %d\n\n", chainIndex + 1, settings->numChains);
+  reset(chain, settings);
+  writeChangeableParamInfo(chain->spatialParams, settings->loc, chain->out);
+
+  k = 1;
+  while (!converged) {
+    metropolisStep(chain, settings, 1);
+
+    if (k % settings->numAtOnce == 0) {
+      // we've run for numAtOnce iterations - time to output, and check for convergence
+      writeChainStatus(chain, settings, k);
+      if (fabs(chain->yes*1.0/settings->numAtOnce - A_STAR) < THRESH) // we've converged
+	converged = 1;
+      chain->yes = 0;
+    }
+
+    k++;
+  }
+}
+
+
+// copy the contents of in (from the beginning) to out
+void copyFileContents(FILE *in, FILE *out) {
+  char buffer[4096];
+  size_t n;
+
+  rewind(in);
+  while ((n = fread(buffer, 1, sizeof(buffer), in)) > 0)
+    fwrite(buffer, 1, n, out);
 }
 
 /************************************************************************/
@@ -249,280 +1281,705 @@ void readChainInfo(char *chainInfo, double *ltotold, double *ltotmax, SpatialPar
 /************************************************************************/
 
 
-/* Puts best parameters found in spatialParams
-   If loc = -1, run at all locations; if loc >= 0, run only at that single location
-   randomStart is boolean: do we start each chain with a random param. set (as opposed to guess values)?
-   NOTE: anything but a scale factor of 1 goes against theory */
-void metropolis(char *outNameBase, SpatialParams *spatialParams, int loc,
-		double (*likely)(double *, OutputInfo *,
-				 int, SpatialParams *, double,
-				 void (*)(double **, int, int *, SpatialParams *, int),
-				 int [], int, int, double []),
-		void (*model)(double **, int, int *, SpatialParams *, int),
-		double addFraction,
-		long estSteps, int numAtOnce, int numChains, int randomStart, long numSpinUps, double paramWeight,
-		double scaleFactor,
-		int dataTypeIndices[], int numDataTypes, int costFunction, double dataTypeWeights[],
-		FILE *userOut)
-{
-  const double INC = pow(DEC, ((A_STAR - 1)/A_STAR));
-  // want INC^A_STAR * DEC^(1 - A_STAR) = 1
-
-  char histFileBase[256], histFileName[256], chainInfo[256];
-  FILE **histFiles; // vector of FILE ptrs (one for each location)
-  int accept, yes=0;
-  long k=1;
-  int chainNum; // which starting chain are we on (for running multiple chains to convergence then choosing best)
-  int firstLoc, lastLoc, numLocs; // first, last and number of locations that we're actually running at (based on both loc and spatialParams->numLocs)
-  int thisFirstLoc, thisLastLoc; // for spatial params, same as firstLoc and lastLoc; for non-spatial params, both are 0
-  int currLoc, locIndex;
-  int ichg; // parameter to change
-  double range; // (max - min) of current parameter
-  double *loglikely; // spatial
-  double ltotnew, ltotold,ltotmax;
-  double bestChainLtotmax; // ltotmax of the best starting chain so far
-  double oldVal;
-  double *pold; // spatial
-  double pdelta, padd;
-  double **sigma; // sigma of this point, estimated by likely function (2-d array: sigma[i][j] is sigma at loc. i, data type j)
-  OutputInfo **outputInfo; /* store error info and annual totals for each run & each data type
-			      2-d array: outputInfo[i][j] is outputInfo at location i, data type j */
-  int converged = 0; /* have we converged on correct param ranges yet?
-			we've converged when we're near A_STAR acceptance
-			If numChains > 1, converged will only be set to 1 after we've converged (numChains) times
-		     */
-  long totalIters = numSpinUps + estSteps; // how many total steps to take once temperatures have converged
+/* checkpoints: all the state metropolis needs to carry on with the main chain (or replicas) from the end of a given step,
+   so that a run that is stopped (e.g. pre-empted on a cluster) can be resumed exactly where it left off
+   format of file: binary file as follows:
+   header (CHECKPOINT_MAGIC, then numReplicas numRecorded numCoords numLocs: ints - these must match the run we're resuming)
+   k finished (long, int): last step taken, and whether the run had already finished (so there are no more steps to take)
+   numEvals numEarlyRejects stepsSaved numLocalEvals evalsBeforeRecording (longs: see metropolis)
+   size of each hist file (numLocs longs)
+   swap stream, swapTries, swapAccepts (numReplicas longs each)
+   state of each replica, in order (see writeChainState)
+   statistics of each recorded chain, in order (see writeChainStats)
+*/
 
-  if (loc == -1) { // running at all locations
-    numLocs = spatialParams->numLocs;
-    firstLoc = 0;
-    lastLoc = numLocs - 1;
-  }
-  else { // only running at one location
-    firstLoc = lastLoc = loc;
-    numLocs = 1;
+// write the state of chain to out: everything that changes as it takes steps
+// (the parameters' values, bests and knobs are written for each of settings->numCoords values)
+// return 1 if all went well, 0 if there was an error writing
+int writeChainState(Chain *chain, MetroSettings *settings, FILE *out) {
+  int i, hasAdaptive;
+  int ok;
+  double value[3];
+
+  ok = (fwrite(&(chain->rng), sizeof(RandStream), 1, out) == 1);
+  ok = ok && (fwrite(&(chain->beta), sizeof(double), 1, out) == 1);
+  ok = ok && (fwrite(&(chain->ltotnew), sizeof(double), 1, out) == 1);
+  ok = ok && (fwrite(&(chain->ltotold), sizeof(double), 1, out) == 1);
+  ok = ok && (fwrite(&(chain->ltotmax), sizeof(double), 1, out) == 1);
+  ok = ok && (fwrite(&(chain->yes), sizeof(int), 1, out) == 1);
+  ok = ok && (fwrite(&(chain->numEvals), sizeof(long), 1, out) == 1);
+  ok = ok && (fwrite(&(chain->numEarlyRejects), sizeof(long), 1, out) == 1);
+  ok = ok && (fwrite(&(chain->stepsSaved), sizeof(long), 1, out) == 1);
+  ok = ok && (fwrite(&(chain->numLocalEvals), sizeof(long), 1, out) == 1);
+  ok = ok && (fwrite(chain->currLoglikely, sizeof(double), settings->numLocs, out) == settings->numLocs);
+  // (the current point's sigma and outputInfo aren't written: they're filled in again when they're next needed)
+
+  for (i = 0; ok && i < settings->numCoords; i++) {
+    value[0] = getSpatialParam(chain->spatialParams, settings->coordParam[i], settings->coordLoc[i]);
+    value[1] = getSpatialParamBest(chain->spatialParams, settings->coordParam[i], settings->coordLoc[i]);
+    value[2] = getSpatialParamKnob(chain->spatialParams, settings->coordParam[i], settings->coordLoc[i]);
+    ok = (fwrite(value, sizeof(double), 3, out) == 3);
   }
 
-  loglikely = makeArray(numLocs);
-  pold = makeArray(numLocs);
-  sigma = make2DArray(numLocs, numDataTypes);
-  outputInfo = (OutputInfo **)malloc(numLocs * sizeof(OutputInfo *));
-  for (currLoc = firstLoc; currLoc <= lastLoc; currLoc++)
-    outputInfo[currLoc - firstLoc] = newOutputInfo(numDataTypes, currLoc);
-  histFiles = (FILE **)malloc(numLocs * sizeof(FILE *)); // one file for each location
-
-  strcpy(histFileBase, outNameBase);
-  strcpy(chainInfo, outNameBase);
-  strcat(histFileBase, ".hist");
-  strcat(chainInfo, ".chain_info");
+  hasAdaptive = (chain->adaptive != NULL);
+  ok = ok && (fwrite(&hasAdaptive, sizeof(int), 1, out) == 1);
+  if (hasAdaptive) { // (range and workspace don't change, so don't need saving)
+    ok = ok && (fwrite(&(chain->adaptive->weight), sizeof(double), 1, out) == 1);
+    ok = ok && (fwrite(&(chain->adaptive->logScale), sizeof(double), 1, out) == 1);
+    ok = ok && (fwrite(chain->adaptive->mean, sizeof(double), chain->adaptive->d, out) == chain->adaptive->d);
+    for (i = 0; ok && i < chain->adaptive->d; i++)
+      ok = (fwrite(chain->adaptive->chol[i], sizeof(double), chain->adaptive->d, out) == chain->adaptive->d);
+  }
 
-  chainNum = 1;
-  fprintf(userOut, "\n\nRESETTING FOR START CHAIN %d of %d\n\n", chainNum, numChains);
-  reset(spatialParams, loglikely, &ltotnew, &ltotold, &ltotmax, sigma, outputInfo,
-	loc, randomStart, addFraction, userOut, likely, paramWeight, model, dataTypeIndices, numDataTypes, costFunction, dataTypeWeights);
+  return ok;
+}
 
-  writeChangeableParamInfo(spatialParams, loc, userOut);
 
-  bestChainLtotmax = -1.0 * DBL_MAX; // really friggin' small (i.e. really friggin' big in the negative direction)
-  k = 1;
+// read n items of the given size into ptr from in (a checkpoint file named fileName), exiting with an error if we can't
+void readCheckpointItems(void *ptr, size_t size, size_t n, FILE *in, char *fileName) {
+  if (fread(ptr, size, n, in) != n) {
+    printf("Error reading checkpoint file %s: file is too short\n", fileName);
+    exit(1);
+  }
+}
 
-  // open all hist files (one for each location), assign file pointers (histFiles), write header to each
-  for (currLoc = firstLoc; currLoc <= lastLoc; currLoc++) {
-    locIndex = currLoc - firstLoc; // index into array
-    sprintf(histFileName, "%s%d", histFileBase, currLoc); // append currLoc to end of histFileBase to get name of current file
-    histFiles[locIndex] = openFile(histFileName, "w");
 
-    // writeHistFileHeader(histFiles[locIndex], outputInfo[locIndex][0].numYears, spatialParams->numChangeableParams, numDataTypes);
-    writeHistFileBinHeader(histFiles[locIndex], outputInfo[locIndex][0].numYears, spatialParams->numChangeableParams, numDataTypes);
-    /* NOTE: 1) this has to be done AFTER call to reset, since outputInfo.numYears is set in call to likely function
-       2) it doesn't matter which data type we use for outputInfo (here we use 0), since all will have the same numYears */
+/* PRE: chain was set up in the same way as the chain whose state was written (in particular, it has an adaptive proposal iff that one did)
+   read the state of chain from in (a checkpoint file named fileName), as written by writeChainState
+*/
+void readChainState(Chain *chain, MetroSettings *settings, FILE *in, char *fileName) {
+  int i, hasAdaptive;
+  double value[3];
+
+  readCheckpointItems(&(chain->rng), sizeof(RandStream), 1, in, fileName);
+  readCheckpointItems(&(chain->beta), sizeof(double), 1, in, fileName);
+  readCheckpointItems(&(chain->ltotnew), sizeof(double), 1, in, fileName);
+  readCheckpointItems(&(chain->ltotold), sizeof(double), 1, in, fileName);
+  readCheckpointItems(&(chain->ltotmax), sizeof(double), 1, in, fileName);
+  readCheckpointItems(&(chain->yes), sizeof(int), 1, in, fileName);
+  readCheckpointItems(&(chain->numEvals), sizeof(long), 1, in, fileName);
+  readCheckpointItems(&(chain->numEarlyRejects), sizeof(long), 1, in, fileName);
+  readCheckpointItems(&(chain->stepsSaved), sizeof(long), 1, in, fileName);
+  readCheckpointItems(&(chain->numLocalEvals), sizeof(long), 1, in, fileName);
+  readCheckpointItems(chain->currLoglikely, sizeof(double), settings->numLocs, in, fileName);
+  chain->currValid = 0;
+
+  for (i = 0; i < settings->numCoords; i++) {
+    readCheckpointItems(value, sizeof(double), 3, in, fileName);
+    setSpatialParam(chain->spatialParams, settings->coordParam[i], settings->coordLoc[i], value[0]);
+    setSpatialParamBest(chain->spatialParams, settings->coordParam[i], settings->coordLoc[i], value[1]);
+    setSpatialParamKnob(chain->spatialParams, settings->coordParam[i], settings->coordLoc[i], value[2]);
   }
 
-  /*****metropolis loop***********************************************/
+  readCheckpointItems(&hasAdaptive, sizeof(int), 1, in, fileName);
+  if (hasAdaptive != (chain->adaptive != NULL)) {
+    printf("Error reading checkpoint file %s: it was written %s ADAPTIVE = 1, but this run is %s it\n",
+	   fileName, hasAdaptive ? "with" : "without", hasAdaptive ? "without" : "with");
+    exit(1);
+  }
+  if (hasAdaptive) {
+    readCheckpointItems(&(chain->adaptive->weight), sizeof(double), 1, in, fileName);
+    readCheckpointItems(&(chain->adaptive->logScale), sizeof(double), 1, in, fileName);
+    readCheckpointItems(chain->adaptive->mean, sizeof(double), chain->adaptive->d, in, fileName);
+    for (i = 0; i < chain->adaptive->d; i++)
+      readCheckpointItems(chain->adaptive->chol[i], sizeof(double), chain->adaptive->d, in, fileName);
+  }
+}
 
-  while ((converged == 0) || (k <= totalIters)) {
-    accept = 1; // so far, we're in accept mode - we haven't rejected the new point yet
 
-    /*select parameter to change at random*/
-    ichg = randomChangeableSpatialParam(spatialParams);
+/* set name = <base><suffix>, where name has room for nameSize characters (including the trailing '\0')
+   print an error message and exit if it doesn't fit
+*/
+void buildOutputName(char *name, int nameSize, const char *base, const char *suffix) {
+  if (snprintf(name, nameSize, "%s%s", base, suffix) >= nameSize) {
+    printf("Error: output file name %s%s is too long (maximum %d characters)\n", base, suffix, nameSize - 1);
+    exit(1);
+  }
+}
 
-    /* determine first and last location for THIS parameter (depends on whether parameter is spatial)
-       note that we'll still use firstLoc and lastLoc for things like actually running model;
-       thisFirstLoc and thisLastLoc just refer to locations we care about for parameter-related things like choosing a new parameter value */
-    if (isSpatial(spatialParams, ichg)) {
-      thisFirstLoc = firstLoc;
-      thisLastLoc = lastLoc;
-    }
-    else // non-spatial - we just use one location (doesn't matter which one)
-      thisFirstLoc = thisLastLoc = 0;
 
-    /*change parameter*/
-    range = (getSpatialParamMax(spatialParams, ichg) - getSpatialParamMin(spatialParams, ichg)); // range is the same for all locations
-    for (currLoc = thisFirstLoc; currLoc <= thisLastLoc; currLoc++) {
-      oldVal = getSpatialParam(spatialParams, ichg, currLoc);
-      pold[currLoc - thisFirstLoc] = oldVal; // remember old value
-      if (accept == 1) { // we haven't set accept to 0 yet (if accept = 0 already, don't bother setting new param. values)
-	pdelta = getSpatialParamKnob(spatialParams, ichg, currLoc); // pdelta is expressed as fraction of parameter's range
-	padd = (rand() * 1.0/RAND_MAX - 0.5) * pdelta * range;
-	// new value will be oldVal + padd
-	if (checkSpatialParam(spatialParams, ichg, oldVal + padd) == 0) { // outside allowable range
-	  accept = 0; /* if new value is outside allowable range at any location, reject point (equivalent to making likelihood tiny)
-			 however, we'll continue the loop, because we need to fill pold vector in order to reset param. values later */
-	}
-	else
-	  setSpatialParam(spatialParams, ichg, currLoc, oldVal + padd); // set new value equal to oldVal + padd
-      } // if accept == 1
-    } // for currLoc
+/* write a checkpoint to checkpointFile (see above for format), after step k
+   (finished is true if there are no more steps to take: we've taken them all, or reached the convergence targets)
+   The hist files are flushed first, and their current sizes recorded, so that on resuming we can throw away anything written after this
+   The checkpoint is written to a temporary file, which then replaces checkpointFile: so if we're stopped partway through,
+   the last complete checkpoint is still there
+   If there's an error writing the checkpoint, print a warning and carry on (keeping any earlier checkpoint)
+*/
+void writeCheckpoint(char *checkpointFile, long k, int finished, ReplicasInfo *info, RandStream *swapStream,
+		     long *swapTries, long *swapAccepts, ChainStats **stats, int numRecorded,
+		     long numEvals, long numEarlyRejects, long stepsSaved, long numLocalEvals, long evalsBeforeRecording, FILE **histFiles) {
+  char tmpFile[256+16];
+  FILE *out;
+  MetroSettings *settings;
+  long histSize;
+  int i;
+  int ok;
+
+  settings = info->settings;
+  buildOutputName(tmpFile, sizeof(tmpFile), checkpointFile, ".tmp");
+  out = fopen(tmpFile, "wb");
+  if (out == NULL) {
+    printf("Warning: could not open %s for writing: not writing checkpoint after step %ld\n", tmpFile, k);
+    return;
+  }
 
-    if (accept == 1) { // we're within allowable range at all locations; run model at all locations and check new total likelihood
+  ok = (fwrite(CHECKPOINT_MAGIC, sizeof(char), sizeof(CHECKPOINT_MAGIC), out) == sizeof(CHECKPOINT_MAGIC));
+  ok = ok && (fwrite(&(info->numReplicas), sizeof(int), 1, out) == 1);
+  ok = ok && (fwrite(&numRecorded, sizeof(int), 1, out) == 1);
+  ok = ok && (fwrite(&(settings->numCoords), sizeof(int), 1, out) == 1);
+  ok = ok && (fwrite(&(settings->numLocs), sizeof(int), 1, out) == 1);
+
+  ok = ok && (fwrite(&k, sizeof(long), 1, out) == 1);
+  ok = ok && (fwrite(&finished, sizeof(int), 1, out) == 1);
+  ok = ok && (fwrite(&numEvals, sizeof(long), 1, out) == 1);
+  ok = ok && (fwrite(&numEarlyRejects, sizeof(long), 1, out) == 1);
+  ok = ok && (fwrite(&stepsSaved, sizeof(long), 1, out) == 1);
+  ok = ok && (fwrite(&numLocalEvals, sizeof(long), 1, out) == 1);
+  ok = ok && (fwrite(&evalsBeforeRecording, sizeof(long), 1, out) == 1);
+
+  for (i = 0; ok && i < settings->numLocs; i++) { // make sure everything so far is in the hist files before we say it is
+    ok = (fflush(histFiles[i]) == 0 && fsync(fileno(histFiles[i])) == 0);
+    histSize = ftell(histFiles[i]);
+    ok = ok && (histSize >= 0) && (fwrite(&histSize, sizeof(long), 1, out) == 1);
+  }
 
-      /*compute log-likelihood of new parameter set*/
-      for (currLoc = firstLoc; currLoc <= lastLoc; currLoc++) {
-	locIndex = currLoc - firstLoc; // index into arrays
-	loglikely[locIndex] = -1.0 * (*likely)(sigma[locIndex], outputInfo[locIndex], currLoc, spatialParams,
-					       paramWeight, model, dataTypeIndices, numDataTypes, costFunction, dataTypeWeights);
-      }
-      ltotnew = sumArray(loglikely, numLocs);
+  ok = ok && (fwrite(swapStream, sizeof(RandStream), 1, out) == 1);
+  ok = ok && (fwrite(swapTries, sizeof(long), info->numReplicas, out) == info->numReplicas);
+  ok = ok && (fwrite(swapAccepts, sizeof(long), info->numReplicas, out) == info->numReplicas);
+  for (i = 0; ok && i < info->numReplicas; i++)
+    ok = writeChainState(info->replicas[i], settings, out);
+  for (i = 0; ok && i < numRecorded; i++) {
+    writeChainStats(stats[i], out);
+    ok = !ferror(out);
+  }
 
-      // compare "new" likelihood to "max" likelihood and act
-      if (ltotnew > ltotmax) {
-	ltotmax = ltotnew;
-	setAllSpatialParamBests(spatialParams, loc); /* set best equal to current value for all parameters
-							if loc == -1, this will set bests at all locations */
-      }
+  ok = ok && (fflush(out) == 0 && fsync(fileno(out)) == 0);
+  if (fclose(out) != 0)
+    ok = 0;
 
-      /*compare new to old and accept or reject*/
-      if (ltotnew > ltotold)
-	accept = 1;
-      else if (randm() < scaleFactor * (ltotnew-ltotold)) // note: anything but a scaleFactor of 1 goes against theory
-	accept = 1;
-      else
-	accept = 0;
-    } // end if (accept == 1)
+  if (!ok || rename(tmpFile, checkpointFile) != 0) {
+    printf("Warning: error writing checkpoint %s after step %ld: keeping the previous checkpoint (if any)\n", checkpointFile, k);
+    remove(tmpFile);
+  }
+}
 
-    /* act on acceptance */
-    if (accept == 1) {
-      /* update likelihoods */
-      ltotold = ltotnew;
 
-      yes++; // chalk up one more acceptance
+/* PRE: info, stats and swap arrays have been set up in the same way as for the run that wrote the checkpoint
+   read the checkpoint in (the file named fileName; see above for format), putting everything in its place,
+   and putting the step it was written after in k, whether the run had finished in finished,
+   and the size that each hist file had then in histSizes[0..numLocs-1]
+   exit with an error if the checkpoint doesn't match this run
+*/
+void readCheckpoint(FILE *in, char *fileName, long *k, int *finished, ReplicasInfo *info, RandStream *swapStream,
+		    long *swapTries, long *swapAccepts, ChainStats **stats, int numRecorded,
+		    long *numEvals, long *numEarlyRejects, long *stepsSaved, long *numLocalEvals, long *evalsBeforeRecording, long *histSizes) {
+  char magic[sizeof(CHECKPOINT_MAGIC)];
+  int counts[4]; // numReplicas numRecorded numCoords numLocs
+  MetroSettings *settings;
+  int i;
+
+  settings = info->settings;
+  readCheckpointItems(magic, sizeof(char), sizeof(CHECKPOINT_MAGIC), in, fileName);
+  if (memcmp(magic, CHECKPOINT_MAGIC, sizeof(CHECKPOINT_MAGIC)) != 0) {
+    printf("Error: %s is not a checkpoint file written by this version of the program\n", fileName);
+    exit(1);
+  }
+  readCheckpointItems(counts, sizeof(int), 4, in, fileName);
+  if (counts[0] != info->numReplicas || counts[1] != numRecorded || counts[2] != settings->numCoords || counts[3] != settings->numLocs) {
+    printf("Error: checkpoint file %s doesn't match this run: it has %d replicas (%d recorded), %d parameter values and %d locations,\n",
+	   fileName, counts[0], counts[1], counts[2], counts[3]);
+    printf("but this run has %d replicas (%d recorded), %d parameter values and %d locations\n",
+	   info->numReplicas, numRecorded, settings->numCoords, settings->numLocs);
+    printf("Please check the input file, or remove the checkpoint file to start afresh\n");
+    exit(1);
+  }
 
-      if (converged == 0) { // we haven't converged yet - twist knob (equivalent to old pdelta)
-	for (currLoc = thisFirstLoc; currLoc <= thisLastLoc; currLoc++) {
-	  pdelta = getSpatialParamKnob(spatialParams, ichg, currLoc);
-	  pdelta = pdelta * INC; // increase temperature
-	  // we used to prevent temperature from going above 1, but we no longer care about how big pdelta gets
-	  setSpatialParamKnob(spatialParams, ichg, currLoc, pdelta);
-	}
-      }
-      else if (k > numSpinUps) { // only write to history files if we have been converged for > numSpinUps steps
-	/* NOTE: I THINK WE SHOULD TECHNICALLY BE WRITING TO HIST FILE WHETHER WE ACCEPT OR REJECT
-	   IF WE REJECT, SHOULD RE-WRITE OLD POINT TO HIST FILE (WILL HAVE TO SAVE OLD LOGLIKELY, SIGMA, AND OUTPUTINFO)
-	   TO DO THIS, REMOVE THIS ELSE IF BLOCK, AND PUT IT IN AN IF (CONVERGED && K > NUMSPINUPS) BLOCK
-	   AFTER END OF ELSE (REJECTION) BLOCK */
-	for (currLoc = firstLoc; currLoc <= lastLoc; currLoc++) {
-	  locIndex = currLoc - firstLoc;
-	  // writeHistFile(histFiles[locIndex], loglikely[locIndex], sigma[locIndex], outputInfo[locIndex], numDataTypes, spatialParams, currLoc);
-	  writeHistFileBin(histFiles[locIndex], loglikely[locIndex], sigma[locIndex], outputInfo[locIndex], numDataTypes, spatialParams, currLoc);
-	}
-      }
+  readCheckpointItems(k, sizeof(long), 1, in, fileName);
+  readCheckpointItems(finished, sizeof(int), 1, in, fileName);
+  readCheckpointItems(numEvals, sizeof(long), 1, in, fileName);
+  readCheckpointItems(numEarlyRejects, sizeof(long), 1, in, fileName);
+  readCheckpointItems(stepsSaved, sizeof(long), 1, in, fileName);
+  readCheckpointItems(numLocalEvals, sizeof(long), 1, in, fileName);
+  readCheckpointItems(evalsBeforeRecording, sizeof(long), 1, in, fileName);
+  readCheckpointItems(histSizes, sizeof(long), settings->numLocs, in, fileName);
+
+  readCheckpointItems(swapStream, sizeof(RandStream), 1, in, fileName);
+  readCheckpointItems(swapTries, sizeof(long), info->numReplicas, in, fileName);
+  readCheckpointItems(swapAccepts, sizeof(long), info->numReplicas, in, fileName);
+  for (i = 0; i < info->numReplicas; i++)
+    readChainState(info->replicas[i], settings, in, fileName);
+  for (i = 0; i < numRecorded; i++) {
+    if (!readChainStats(stats[i], in)) {
+      printf("Error reading checkpoint file %s: statistics of recorded chain %d don't match this run\n", fileName, i + 1);
+      printf("Please check the input file (e.g. ITER), or remove the checkpoint file to start afresh\n");
+      exit(1);
     }
+  }
+}
 
-    /* act on rejection */
-    else {
-      /* return to "old" parameters */
-      for (currLoc = thisFirstLoc; currLoc <= thisLastLoc; currLoc++) {
-	oldVal = pold[currLoc - thisFirstLoc];
-	setSpatialParam(spatialParams, ichg, currLoc, oldVal); // restore old value
-      }
-
-      if (converged == 0) { // we haven't converged yet - twist knob (equivalent to old pdelta)
-	for (currLoc = thisFirstLoc; currLoc <= thisLastLoc; currLoc++) {
-	  pdelta = getSpatialParamKnob(spatialParams, ichg, currLoc);
-	  pdelta = pdelta * DEC; // decrease temperature
-	  if (pdelta < DBL_EPSILON) // don't let temperature get too small
-	    pdelta = DBL_EPSILON;
-	  setSpatialParamKnob(spatialParams, ichg, currLoc, pdelta);
-	} // for (currLoc)
-      } // if (converged == 0)
-    } // else (rejection)
-
-
-    if (k % numAtOnce == 0) {
-      // we've run for numAtOnce iterations - time to output
 
+/* open the existing hist file histFileName to carry on writing it from a checkpoint:
+   throw away anything after the first size bytes (i.e. anything written after the checkpoint), and return it ready to write from there
+*/
+FILE *reopenHistFile(char *histFileName, long size) {
+  FILE *histFile;
+
+  histFile = openFile(histFileName, "r+");
+  fseek(histFile, 0, SEEK_END);
+  if (ftell(histFile) < size) {
+    printf("Error: hist file %s is shorter than it was when the checkpoint was written: can't resume\n", histFileName);
+    exit(1);
+  }
+  if (ftruncate(fileno(histFile), size) != 0) {
+    printf("Error: couldn't truncate hist file %s to where it was when the checkpoint was written\n", histFileName);
+    exit(1);
+  }
+  fseek(histFile, size, SEEK_SET);
 
-      /**************screen output**********************/
-      fprintf(userOut, "\n\t\t\tITERATION %6ld\n",k);
-      fprintf(userOut, "\t\t\tFRACTION ACCEPTED %3.2f\n\n",yes*1.0/numAtOnce);
-      writeChangeableParamInfo(spatialParams, loc, userOut);
-      fprintf(userOut, "\n\t\tlTOT\tnew= %9.6f\tmax= %9.6f\n", ltotnew,ltotmax);
+  return histFile;
+}
 
-      /* END SCREEN OUTPUT */
+/************************************************************************/
 
 
-      if (converged == 0) { // we haven't converged yet - check for convergence:
-	if (fabs(yes*1.0/numAtOnce - A_STAR) < THRESH) { // we've newly-converged
-	  if (ltotmax >= bestChainLtotmax) { // this is the best chain we've found so far
-	    bestChainLtotmax = ltotmax;
-	    // write current info to file so we can restore it later:
-	    writeChainInfo(chainInfo, ltotold, ltotmax, spatialParams, loc);
-	    fprintf(userOut, "\n\nBEST START CHAIN FOUND SO FAR: WRITING CHAIN INFO TO FILE\n\n");
-	  }
+/* Puts best parameters found in spatialParams
+   Run at locations runLocs[0..numRunLocs-1], or at all locations if numRunLocs = 0 (see ml-metro.h)
+   randomStart is boolean: do we start each chain with a random param. set (as opposed to guess values)?
+   earlyReject is boolean: do we stop each model run as soon as we know we'll reject the point? (see ml-metro.h)
+   numThreads: number of threads to use to run start chains, or locations, at once (see ml-metro.h)
+   adaptive is boolean: does the main chain change all parameters at once, with an adaptive multivariate proposal? (see ml-metro.h)
+   localSpatial is boolean: do single-parameter steps change a spatial parameter at just one location? (see ml-metro.h)
+   numTemps, maxTemp, swapInterval: for parallel tempering of the main chain, if numTemps > 1 (see ml-metro.h)
+   popSize: if > 0, use a DE-MC population of this size in place of the main chain (see ml-metro.h)
+   targetEss, targetRhat: if either is > 0, stop early once the recorded steps reach these targets (see ml-metro.h)
+   checkpointInterval: if > 0, write a checkpoint once the start chains have converged, then every checkpointInterval steps (see ml-metro.h)
+   resume is boolean: if there's a checkpoint, carry on from there rather than starting again (see ml-metro.h)
+   NOTE: anything but a scale factor of 1 goes against theory */
+void metropolis(char *outNameBase, SpatialParams *spatialParams, int numRunLocs, int runLocs[],
+		double (*likely)(double *, OutputInfo *,
+				 int, SpatialParams *, double,
+				 void (*)(double **, int, int *, SpatialParams *, int),
+				 int [], int, int, double []),
+		void (*model)(double **, int, int *, SpatialParams *, int),
+		double addFraction,
+		long estSteps, int numAtOnce, int numChains, int randomStart, long numSpinUps, double paramWeight,
+		double scaleFactor,
+		int dataTypeIndices[], int numDataTypes, int costFunction, double dataTypeWeights[],
+		int earlyReject, int numThreads, int adaptive, int localSpatial, int numTemps, double maxTemp, int swapInterval, int popSize,
+		double targetEss, double targetRhat, long checkpointInterval, int resume, FILE *userOut)
+{
+  char histFileBase[256], histFileName[256], chainInfo[256], checkpointFile[256];
+  char locSuffix[16]; // currLoc, as appended to histFileBase
+  FILE **histFiles; // vector of FILE ptrs (one for each location)
+  long k;
+  long firstStep; // first step of the metropolis loop to take (1, unless we're resuming from a checkpoint)
+  long loopAllocs; // number of heap allocations made during the metropolis loop (should be 0), or -1 if they aren't counted
+  PrepareThreadInfo prepareInfo;
+  int finished; // set once there are no more steps to take (all taken, or convergence targets reached)
+  FILE *checkpoint; // checkpoint we're resuming from (NULL if we're starting from the beginning)
+  int resuming; // are we resuming from a checkpoint?
+  long *histSizes; // size of each hist file when the checkpoint we're resuming from was written
+  int chainNum; // index of a start chain (for running multiple chains to convergence then choosing best)
+  int bestChain; // index of the start chain with the highest ltotmax
+  unsigned int streamSeed; // seed for the base random number stream, from which each chain's stream is found
+  RandStream baseStream, chainStream;
+  int currLoc, locIndex;
+  long totalIters = numSpinUps + estSteps; // how many total steps to take once temperatures have converged
+  long numEvals = 0, numEarlyRejects = 0, stepsSaved = 0; // totals over all chains, for early rejection
+  long numLocalEvals = 0; // total over all chains, for local spatial updates
+  MetroSettings settings;
+  LocEvalInfo evalTemplate; // likelihood settings shared by all chains
+  Chain **chains; // the start chains
+  Chain *mainChain; // the best start chain, which we carry on with once all start chains have converged
+  StartChainsInfo startChainsInfo;
+  ThreadPool *pool; // threads for running different start chains, or different locations, at once
+  ThreadPool *serialPool; // a pool with no extra threads, for chains that are themselves being run at the same time
+  ChainStats **stats; // running statistics of the recorded steps of each recorded chain
+  double minEss, maxRhat; // smallest effective sample size and largest split R-hat over all parameter values so far
+  int numRecorded; // number of chains we record (the main chain, or with DE-MC, all the population)
+  double *coordValues; // current value of each parameter value we're estimating (for ess)
+  long evalsBeforeRecording; // number of model runs the main chain (and other replicas) had done before we started recording
+  long recordedEvals; // number of model runs the main chain (and other replicas) did while we were recording
+  int i;
+  Chain **replicas; // replicas[0] is the main chain; with tempering or DE-MC, replicas[1..numReplicas-1] are copies of it
+  int numReplicas; // numTemps, or with DE-MC, popSize
+  int numAccepted; // with DE-MC, number of acceptances since last screen output, over the whole population
+  ReplicasInfo replicasInfo;
+  RandStream swapStream; // random numbers for deciding on swaps between replicas
+  long *swapTries, *swapAccepts; // for each pair of neighbouring replicas
+
+  settings.loc = (numRunLocs == 1) ? runLocs[0] : -1;
+  settings.numLocs = (numRunLocs > 0) ? numRunLocs : spatialParams->numLocs;
+  settings.locs = (int *)malloc(settings.numLocs * sizeof(int));
+  for (locIndex = 0; locIndex < settings.numLocs; locIndex++)
+    settings.locs[locIndex] = (numRunLocs > 0) ? runLocs[locIndex] : locIndex; // (with no list, run at all locations)
+  settings.addFraction = addFraction;
+  settings.randomStart = randomStart;
+  settings.numAtOnce = numAtOnce;
+  settings.numChains = numChains;
+  settings.scaleFactor = scaleFactor;
+  settings.earlyReject = earlyReject;
+  settings.inc = pow(DEC, ((A_STAR - 1)/A_STAR));
+  // want INC^A_STAR * DEC^(1 - A_STAR) = 1
+  settings.adaptive = adaptive;
+  settings.localSpatial = localSpatial;
+  setupCoords(&settings, spatialParams);
+
+  evalTemplate.likely = likely;
+  evalTemplate.model = model;
+  evalTemplate.spatialParams = NULL; // each chain points this at its own copy
+  evalTemplate.paramWeight = paramWeight;
+  evalTemplate.dataTypeIndices = dataTypeIndices;
+  evalTemplate.numDataTypes = numDataTypes;
+  evalTemplate.costFunction = costFunction;
+  evalTemplate.dataTypeWeights = dataTypeWeights;
+  evalTemplate.locs = settings.locs;
+  evalTemplate.numLocs = settings.numLocs;
+  evalTemplate.wantOutputInfo = 0; // only the recorded chains need it, once we start writing to the hist files (see below)
+  evalTemplate.loglikely = NULL; // each chain has its own
+  evalTemplate.sigma = NULL;
+  evalTemplate.outputInfo = NULL;
+
+  /* start chains are run at the same time (each one running its locations one at a time);
+     the main chain then runs its locations at the same time - or, with tempering, its replicas at the same time
+     no use having more threads than there are chains, or locations (or replicas) */
+  i = (popSize > 0) ? (popSize + 1)/2 : ((numTemps > 1) ? numTemps : settings.numLocs); // most things we can run at once after the start chains
+  if (numThreads > numChains && numThreads > i)
+    numThreads = (numChains > i) ? numChains : i;
+  pool = newThreadPool(numThreads);
+  serialPool = newThreadPool(1);
+  if (numThreads > 1)
+    fprintf(userOut, "Running start chains, and then %s, on %d threads\n", (popSize > 0 || numTemps > 1) ? "replicas" : "locations", numThreads);
+
+  buildOutputName(histFileBase, sizeof(histFileBase), outNameBase, ".hist");
+  buildOutputName(chainInfo, sizeof(chainInfo), outNameBase, ".chain_info");
+  buildOutputName(checkpointFile, sizeof(checkpointFile), outNameBase, ".checkpoint");
+
+  checkpoint = NULL;
+  if (resume) {
+    checkpoint = fopen(checkpointFile, "rb");
+    if (checkpoint == NULL)
+      fprintf(userOut, "\n\nRESUME: NO CHECKPOINT FILE %s: STARTING FROM THE BEGINNING\n\n", checkpointFile);
+  }
+  resuming = (checkpoint != NULL);
+
+  /* set up start chains: each has its own copy of spatialParams, and its own random number stream
+     (stream chainNum of the family given by streamSeed, so results don't depend on how many threads we use)
+     with more than one chain, each one's screen output goes to a temporary file, which we copy to userOut once they're all done */
+  streamSeed = (unsigned int)rand();
+  fprintf(userOut, "Seeding random number streams with %u (start chain n uses stream n-1)\n", streamSeed);
+  seedRandStream(&baseStream, streamSeed);
+  if (!resuming) {
+    chains = (Chain **)malloc(numChains * sizeof(Chain *));
+    for (chainNum = 0; chainNum < numChains; chainNum++) {
+      getRandSubstream(&chainStream, &baseStream, chainNum, 0);
+      chains[chainNum] = newChain(spatialParams, &settings, &evalTemplate, &chainStream,
+				  (numChains > 1) ? serialPool : pool, (numChains > 1) ? tmpfile() : userOut);
+    }
+    for (chainNum = 0; chainNum < numChains; chainNum++) {
+      if (chains[chainNum]->out == NULL) {
+	printf("Error in metropolis: couldn't create temporary file for screen output of start chain %d\n", chainNum + 1);
+	exit(1);
+      }
+    }
 
-	  if (chainNum < numChains) { // reset for the next chain
-	    chainNum++; // move on to the next convergence chain
-	    fprintf(userOut, "\n\nRESETTING FOR START CHAIN %d of %d\n\n", chainNum, numChains);
-	    reset(spatialParams, loglikely, &ltotnew, &ltotold, &ltotmax, sigma, outputInfo,
-		  loc, randomStart, addFraction, userOut, likely, paramWeight, model, dataTypeIndices, numDataTypes,costFunction, dataTypeWeights);
-	  }
+    // run all start chains to convergence:
+    startChainsInfo.chains = chains;
+    startChainsInfo.settings = &settings;
+    runTasks(pool, numChains, runStartChain, &startChainsInfo);
+
+    // choose best start chain (the one with the highest ltotmax - or the last of these, if there's a tie):
+    bestChain = 0;
+    for (chainNum = 0; chainNum < numChains; chainNum++) {
+      if (numChains > 1) {
+	copyFileContents(chains[chainNum]->out, userOut);
+	fclose(chains[chainNum]->out);
+      }
+      if (chains[chainNum]->ltotmax >= chains[bestChain]->ltotmax)
+	bestChain = chainNum;
+    }
 
-	  else { // chainNum >= numChains: we're done running start chains, time to read best from file
-	    converged = 1;
-	    fprintf(userOut, "\n\nCONVERGED\n\n");
+    // carry on with best start chain; we're done with the others
+    mainChain = chains[bestChain];
+    mainChain->pool = pool;
+    mainChain->out = userOut;
+    for (chainNum = 0; chainNum < numChains; chainNum++) {
+      numEvals += chains[chainNum]->numEvals;
+      numEarlyRejects += chains[chainNum]->numEarlyRejects;
+      stepsSaved += chains[chainNum]->stepsSaved;
+      numLocalEvals += chains[chainNum]->numLocalEvals;
+      if (chainNum != bestChain)
+	deleteChain(chains[chainNum], &settings);
+    }
+    free(chains);
+    numEvals -= mainChain->numEvals; // we'll add the main chain's counts back in at the end
+    numEarlyRejects -= mainChain->numEarlyRejects;
+    stepsSaved -= mainChain->stepsSaved;
+    numLocalEvals -= mainChain->numLocalEvals;
+
+    fprintf(userOut, "\n\nCONVERGED\n\n");
+    fprintf(userOut, "\n\nBEST START CHAIN WAS CHAIN %d of %d: WRITING CHAIN INFO TO FILE\n\n", bestChain + 1, numChains);
+    writeChainInfo(chainInfo, mainChain->ltotold, mainChain->ltotmax, mainChain->spatialParams, settings.loc); // (for the record)
+    writeChangeableParamInfo(mainChain->spatialParams, settings.loc, userOut);
+    fprintf(userOut, "\n\t\tlTOT\told= %9.6f\tmax= %9.6f\n", mainChain->ltotold, mainChain->ltotmax);
+    /* NOTE: could do a couple tests here:
+       1) halve all param. temperatures (i.e. knobs) after convergence
+       2) set current point to be best point after convergence
+    */
+  }
+  else { /* we don't need the start chains again: everything that came from them is in the checkpoint
+	    so set up the main chain (and below, any replicas) just as they would have been, then read their states from the checkpoint */
+    fprintf(userOut, "\n\nRESUMING FROM CHECKPOINT FILE %s\n\n", checkpointFile);
+    mainChain = newChain(spatialParams, &settings, &evalTemplate, &baseStream, pool, userOut);
+  }
 
-	    if (ltotmax < bestChainLtotmax) { // the most recent chain wasn't the best: read best from file
-	      readChainInfo(chainInfo, &ltotold, &ltotmax, spatialParams, loc);
-	      fprintf(userOut, "\n\nREADING BEST CHAIN INFO FROM FILE:\n\n");
-	      writeChangeableParamInfo(spatialParams, loc, userOut);
-	      fprintf(userOut, "\n\t\tlTOT\told= %9.6f\tmax= %9.6f\n", ltotold,ltotmax);
-	    }
+  /* set up replicas: without tempering or DE-MC, just the main chain
+     with tempering, numTemps - 1 copies of the main chain, with temperatures going up geometrically from 1 to maxTemp
+     with DE-MC, popSize - 1 copies of the main chain, each moved a little away from it
+     each copy has its own random numbers (substreams of stream numChains, after the start chains' streams)
+     the replicas take their steps at the same time, each one running its locations one at a time */
+  numReplicas = (popSize > 0) ? popSize : numTemps;
+  replicas = (Chain **)malloc(numReplicas * sizeof(Chain *));
+  replicas[0] = mainChain;
+  getRandSubstream(&swapStream, &baseStream, numChains, 0);
+  for (i = 1; i < numReplicas; i++) {
+    getRandSubstream(&chainStream, &baseStream, numChains, i);
+    replicas[i] = newChain(mainChain->spatialParams, &settings, &evalTemplate, &chainStream, serialPool, userOut);
+    if (numTemps > 1)
+      replicas[i]->beta = pow(maxTemp, -1.0 * i/(numTemps - 1));
+    replicas[i]->ltotold = mainChain->ltotold;
+    replicas[i]->ltotmax = mainChain->ltotmax;
+  }
+  if (numReplicas > 1)
+    mainChain->pool = serialPool;
+  replicasInfo.replicas = replicas;
+  replicasInfo.numReplicas = numReplicas;
+  replicasInfo.accepted = (int *)malloc(numReplicas * sizeof(int));
+  replicasInfo.settings = &settings;
+  replicasInfo.demc = (popSize > 0);
+  replicasInfo.halfSize = numReplicas/2;
+  replicasInfo.first = 0;
+  replicasInfo.gamma = 0.0;
+  swapTries = (long *)malloc(numReplicas * sizeof(long));
+  swapAccepts = (long *)malloc(numReplicas * sizeof(long));
+  for (i = 0; i < numReplicas; i++)
+    swapTries[i] = swapAccepts[i] = 0;
+
+  if (numTemps > 1)
+    fprintf(userOut, "\n\nPARALLEL TEMPERING: %d REPLICAS, TEMPERATURES FROM 1 TO %g, SWAPS PROPOSED EVERY %d STEPS\n\n",
+	    numTemps, maxTemp, swapInterval);
+  if (popSize > 0) {
+    fprintf(userOut, "\n\nDE-MC: POPULATION OF %d CHAINS, CHANGING ALL %d PARAMETER VALUES AT ONCE\n\n", popSize, settings.numCoords);
+    replicasInfo.first = 1;
+    if (!resuming) // (if we're resuming, the population's points come from the checkpoint)
+      runTasks(pool, numReplicas - 1, scatterReplica, &replicasInfo); // spread out the population (apart from the main chain)
+  }
+  if (adaptive) {
+    for (i = 0; i < numReplicas; i++)
+      replicas[i]->adaptive = newAdaptiveProposal(&settings, replicas[i]->spatialParams);
+    fprintf(userOut, "\n\nADAPTIVE PROPOSALS: CHANGING ALL %d PARAMETER VALUES AT ONCE\n\n", settings.numCoords);
+  }
 
-	    else // the most recent chain was the best: no need to read from file
-	      fprintf(userOut, "\n\nKEEPING MOST RECENT START CHAIN INFO\n\n");
+  // with DE-MC, we record every member of the population; otherwise we just record the main chain
+  numRecorded = (popSize > 0) ? popSize : 1;
+  stats = (ChainStats **)malloc(numRecorded * sizeof(ChainStats *));
+  for (i = 0; i < numRecorded; i++)
+    stats[i] = newChainStats(settings.numCoords, estSteps);
+  coordValues = makeArray(settings.numCoords + 1); // + 1 so we never make an empty array
+  evalsBeforeRecording = 0;
+  for (i = 0; i < numReplicas; i++)
+    evalsBeforeRecording += replicas[i]->numEvals;
+
+  firstStep = 1;
+  finished = 0;
+  histSizes = (long *)malloc(settings.numLocs * sizeof(long));
+  if (resuming) {
+    readCheckpoint(checkpoint, checkpointFile, &k, &finished, &replicasInfo, &swapStream, swapTries, swapAccepts, stats, numRecorded,
+		   &numEvals, &numEarlyRejects, &stepsSaved, &numLocalEvals, &evalsBeforeRecording, histSizes);
+    fclose(checkpoint);
+    firstStep = k + 1;
+    fprintf(userOut, "CARRYING ON FROM STEP %ld%s\n\n", firstStep, finished ? " (RUN HAD ALREADY FINISHED)" : "");
+  }
 
-	  } // end else done running start chains
+  /* open all hist files (one for each location), assign file pointers (histFiles), write header to each
+     (or if we're resuming, open the existing hist files, throwing away anything written after the checkpoint) */
+  histFiles = (FILE **)malloc(settings.numLocs * sizeof(FILE *)); // one file for each location
+  for (locIndex = 0; locIndex < settings.numLocs; locIndex++) {
+    currLoc = settings.locs[locIndex];
+    sprintf(locSuffix, "%d", currLoc);
+    buildOutputName(histFileName, sizeof(histFileName), histFileBase, locSuffix); // append currLoc to end of histFileBase to get name of current file
+    if (resuming)
+      histFiles[locIndex] = reopenHistFile(histFileName, histSizes[locIndex]);
+    else {
+      histFiles[locIndex] = openFile(histFileName, "w");
 
-	  k = 0; // start count over so we run for another estSteps steps
+      // writeHistFileHeader(histFiles[locIndex], getNumYears(currLoc), spatialParams->numChangeableParams, numDataTypes);
+      writeHistFileBinHeader(histFiles[locIndex], getNumYears(currLoc), spatialParams->numChangeableParams, numDataTypes);
+      // (getNumYears gives the numYears every outputInfo at this location will have)
+    }
+  }
 
-	  /* NOTE: could do a couple tests here:
-	     1) halve all param. temperatures (i.e. knobs) after convergence
-	     2) set current point to be best point after convergence
-	  */
+  /*****metropolis loop***********************************************/
+  // (with DE-MC, each step k is a generation: each member of the population takes one step)
+
+  if (!resuming) {
+    for (i = 0; i < numReplicas; i++)
+      replicas[i]->yes = 0;
+    if (checkpointInterval > 0) // so from now on, we never have to run the start chains again
+      writeCheckpoint(checkpointFile, 0, 0, &replicasInfo, &swapStream, swapTries, swapAccepts, stats, numRecorded,
+		      numEvals, numEarlyRejects, stepsSaved, numLocalEvals, evalsBeforeRecording, histFiles);
+  }
 
-	} // end if we've newly-converged
-      } // end if (converged == 0)
+  // set up each thread's model context and scratch space now, so the loop itself never allocates anything:
+  prepareInfo.numLocs = settings.numLocs;
+  prepareInfo.locs = settings.locs;
+  prepareInfo.modelArrays = (likely != fusedDifference && !earlyReject); // the others stream the model output (see fusedDifference)
+  runOnEachThread(pool, prepareThread, &prepareInfo);
+  loopAllocs = getNumAllocations();
+
+  for (k = firstStep; !finished && k <= totalIters; k++) {
+    /* the aggregate info (outputInfo) is only written out for the recorded chains, once we're past the spin-up:
+       other evaluations don't compute it */
+    for (i = 0; i < numRecorded; i++)
+      replicas[i]->evalInfo.wantOutputInfo = (k > numSpinUps);
+
+    if (popSize > 0) { // first half of population moves (using the second half), then the second half (using the first half)
+      replicasInfo.gamma = (k % DEMC_JUMP_INTERVAL == 0) ? 1.0 : DEMC_GAMMA/sqrt((double)settings.numCoords);
+      replicasInfo.first = 0;
+      runTasks(pool, replicasInfo.halfSize, runReplicaStep, &replicasInfo);
+      replicasInfo.first = replicasInfo.halfSize;
+      runTasks(pool, numReplicas - replicasInfo.halfSize, runReplicaStep, &replicasInfo);
+    }
+    else
+      runTasks(pool, numReplicas, runReplicaStep, &replicasInfo); // (without tempering, this is just one step of the main chain)
+    if (numTemps > 1 && k % swapInterval == 0)
+      proposeSwaps(&replicasInfo, &swapStream, swapTries, swapAccepts);
+
+    /* only the main (untempered) chain is recorded (or, with DE-MC, each member in turn), and only when it has just accepted a step
+       (so if the main chain has just been swapped a new state, without accepting a step, that state isn't written);
+       accepting a step leaves the chain's current point's loglikely, sigma and outputInfo up to date */
+    for (i = 0; i < numRecorded; i++) {
+      if (replicasInfo.accepted[i] && k > numSpinUps) {
+	// only write to history files if we have been converged for > numSpinUps steps
+	/* NOTE: I THINK WE SHOULD TECHNICALLY BE WRITING TO HIST FILE WHETHER WE ACCEPT OR REJECT
+	   IF WE REJECT, SHOULD RE-WRITE OLD POINT TO HIST FILE (WILL HAVE TO SAVE OLD LOGLIKELY, SIGMA, AND OUTPUTINFO)
+	   TO DO THIS, WRITE TO HIST FILES AFTER EVERY STEP (ONCE K > NUMSPINUPS) */
+	for (locIndex = 0; locIndex < settings.numLocs; locIndex++) {
+	  // writeHistFile(histFiles[locIndex], replicas[i]->currLoglikely[locIndex], replicas[i]->currSigma[locIndex], replicas[i]->currOutputInfo[locIndex], numDataTypes, replicas[i]->spatialParams, settings.locs[locIndex]);
+	  writeHistFileBin(histFiles[locIndex], replicas[i]->currLoglikely[locIndex], replicas[i]->currSigma[locIndex],
+			   replicas[i]->currOutputInfo[locIndex], numDataTypes, replicas[i]->spatialParams, settings.locs[locIndex]);
+	}
+      }
 
-      yes = 0;
+      if (k > numSpinUps) { // keep track of how well the recorded steps sample the posterior
+	getCoordValues(&settings, replicas[i]->spatialParams, coordValues);
+	addChainStatsPoint(stats[i], coordValues);
+      }
+    }
+    if (k == numSpinUps) {
+      evalsBeforeRecording = 0;
+      for (i = 0; i < numReplicas; i++)
+	evalsBeforeRecording += replicas[i]->numEvals;
+    }
 
-    } // end if (k % numAtOnce == 0)
+    if (k % numAtOnce == 0) {
+      // we've run for numAtOnce iterations - time to output
+      writeChainStatus(mainChain, &settings, k);
+      if (numTemps > 1)
+	writeReplicaStatus(&replicasInfo, swapTries, swapAccepts, userOut);
+      if (popSize > 0) {
+	numAccepted = 0;
+	for (i = 0; i < numReplicas; i++)
+	  numAccepted += replicas[i]->yes;
+	fprintf(userOut, "\t\tPOPULATION: FRACTION ACCEPTED %3.2f\n", numAccepted*1.0/(settings.numAtOnce * numReplicas));
+      }
+      for (i = 0; i < numReplicas; i++)
+	replicas[i]->yes = 0;
+
+      if (k > numSpinUps) {
+	writeDiagnostics(stats, numRecorded, &settings, mainChain->spatialParams, userOut);
+	if ((targetEss > 0 || targetRhat > 0) && summarizeDiagnostics(stats, numRecorded, &minEss, &maxRhat)
+	    && (targetEss <= 0 || minEss >= targetEss) && (targetRhat <= 0 || maxRhat <= targetRhat)) {
+	  fprintf(userOut, "\n\nCONVERGENCE TARGETS REACHED AFTER %ld STEPS (min ESS = %.1f, max split R-hat = %.3f): STOPPING\n\n",
+		  k, minEss, maxRhat);
+	  finished = 1; // (so this is the last step)
+	}
+      }
+    }
 
-    k++;
+    if (checkpointInterval > 0 && k % checkpointInterval == 0) {
+      fflush(userOut);
+      writeCheckpoint(checkpointFile, k, 0, &replicasInfo, &swapStream, swapTries, swapAccepts, stats, numRecorded,
+		      numEvals, numEarlyRejects, stepsSaved, numLocalEvals, evalsBeforeRecording, histFiles);
+    }
   } // end metropolis ESTSTEP loop
+  if (loopAllocs >= 0)
+    loopAllocs = getNumAllocations() - loopAllocs;
+
+  /* write a last checkpoint, marked as finished: so resuming a run that has already finished just repeats what comes after the loop
+     (and with NUM_RUNS > 1, goes on to the next run) */
+  if (checkpointInterval > 0)
+    writeCheckpoint(checkpointFile, k - 1, 1, &replicasInfo, &swapStream, swapTries, swapAccepts, stats, numRecorded,
+		    numEvals, numEarlyRejects, stepsSaved, numLocalEvals, evalsBeforeRecording, histFiles);
 
   /* NOTE: may want to print (to file) some measure of best point here
      (e.g. ltotmax; may even want to print outputInfo of best point, which would be more easily done in metropolis loop,
      re-writing best file each time we find a new best point)
   */
 
+  recordedEvals = 0;
+  for (i = 0; i < numReplicas; i++) {
+    numEvals += replicas[i]->numEvals;
+    numEarlyRejects += replicas[i]->numEarlyRejects;
+    stepsSaved += replicas[i]->stepsSaved;
+    numLocalEvals += replicas[i]->numLocalEvals;
+    recordedEvals += replicas[i]->numEvals;
+  }
+  recordedEvals -= evalsBeforeRecording;
+  if (popSize > 0)
+    writeEss(stats, numRecorded, recordedEvals, "DE-MC", userOut);
+  else
+    writeEss(stats, numRecorded, recordedEvals, adaptive ? "adaptive multivariate" : "single-parameter", userOut);
+
+  if (earlyReject)
+    fprintf(userOut, "\nEARLY REJECTION: %ld of %ld runs stopped early, %ld model steps saved in total\n",
+	    numEarlyRejects, numEvals, stepsSaved);
+  if (localSpatial && settings.numLocs > 1)
+    fprintf(userOut, "\nLOCAL SPATIAL UPDATES: %ld of %ld evaluations ran the model at a single location rather than all %d, saving %ld location runs\n",
+	    numLocalEvals, numEvals, settings.numLocs, numLocalEvals * (settings.numLocs - 1));
+  if (loopAllocs >= 0)
+    fprintf(userOut, "\nHEAP ALLOCATIONS: %ld during the %ld steps of the metropolis loop\n", loopAllocs, k - firstStep);
+  else
+    fprintf(userOut, "\nHEAP ALLOCATIONS: unavailable (build with make ALLOC_COUNT=1 to count them)\n");
+
+  /* put the results (in particular, the bests) in spatialParams
+     with tempering or DE-MC, the best point found may be in any of the replicas:
+     take the replica with the highest ltotmax (the main chain, if there's a tie) */
+  mainChain = replicas[0];
+  for (i = 1; i < numReplicas; i++) {
+    if (replicas[i]->ltotmax > mainChain->ltotmax)
+      mainChain = replicas[i];
+  }
+  copySpatialParamValues(spatialParams, mainChain->spatialParams);
+
   // close files, free dynamically-allocated pointers:
-  for (currLoc = firstLoc; currLoc <= lastLoc; currLoc++)
-    fclose(histFiles[currLoc - firstLoc]);
+  for (locIndex = 0; locIndex < settings.numLocs; locIndex++)
+    fclose(histFiles[locIndex]);
   free(histFiles);
-  free(pold);
-  free(loglikely);
-  free2DArray((void **)sigma);
-  for (currLoc = firstLoc; currLoc <= lastLoc; currLoc++)
-    freeOutputInfo(outputInfo[currLoc - firstLoc], numDataTypes);
-  free(outputInfo);
+  free(histSizes);
+  for (i = 0; i < numReplicas; i++)
+    deleteChain(replicas[i], &settings);
+  free(replicas);
+  free(replicasInfo.accepted);
+  free(swapTries);
+  free(swapAccepts);
+  for (i = 0; i < numRecorded; i++)
+    deleteChainStats(stats[i]);
+  free(stats);
+  free(coordValues);
+  free(settings.coordParam);
+  free(settings.coordLoc);
+  free(settings.locs);
+  deleteThreadPool(pool);
+  deleteThreadPool(serialPool);
 }
@@ -28,6 +28,8 @@
 #define ITER 375000 // number of metropolis iterations once we've converged and finished numSpinUps
 #define SCALE_FACTOR 1.0 // multiply LL difference by this
 #define LOC -1 // default is run at all locations
+#define LOCATIONS "" // default is no list of locations (so LOC says where to run)
+#define LOCATIONS_MAXNAME 1024
 #define NUM_RUNS 1
 #define NUM_AT_ONCE 10000 // interval for checking convergence
 #define PARAM_FILE "" // file to use in place of fileName.param - empty string means use fileName.param
@@ -38,6 +40,21 @@
 		     to use data from a given time step */
 #define PARAM_WEIGHT 0.0
 #define COST_FUNCTION 0  // Set different options for cost functions
+#define EARLY_REJECT 0 // default is to run the model to the end for every proposed point
+#define ADAPTIVE 0 // default is for each step to change a single parameter (rather than all at once, with an adaptive proposal)
+#define LOCAL_SPATIAL_UPDATES 0 // default is for a step on a spatial parameter to change it at all locations at once
+#define NUM_TEMPS 1 // default is to run the main chain on its own (no parallel tempering)
+#define MAX_TEMP 10.0 // with parallel tempering, temperature of the hottest replica
+#define SWAP_INTERVAL 10 // with parallel tempering, number of steps between proposed swaps of neighbouring replicas
+#define DEMC_POP_SIZE 0 // default is a single main chain (rather than a DE-MC population)
+#define TARGET_ESS 0.0 // default is to run for all ITER steps, whatever the effective sample size
+#define TARGET_RHAT 0.0 // default is to run for all ITER steps, whatever the split R-hat
+#define RAND_SEED 0 // seed for random numbers: 0 means seed from the time
+#define CHECKPOINT_INTERVAL 0 // default is not to write checkpoints
+#define RESUME 0 // default is to start from the beginning, even if there's a checkpoint
+#define NUM_THREADS 1 // default is to run one start chain, and the model at one location, at a time
+#define FUSED_DIFFERENCE 1 /* compare model with data as the model runs (fusedDifference) rather than storing model output
+			      and then comparing (difference)? Both give the same results; fusedDifference is faster */
 
 void usage(char *progName) {
   printf("Usage: %s [-h] [-i inputFile]\n", progName);
@@ -132,6 +149,8 @@ int main(int argc, char *argv[]) {
   char paramFile[FILE_MAXNAME] = PARAM_FILE; // if, after getting optional arguments, paramFile is "", set paramFile = fileName.param
   long iter = ITER, numSpinUps = NUM_SPIN_UPS;
   int numChains = NUM_CHAINS, numRuns = NUM_RUNS, numAtOnce = NUM_AT_ONCE, loc = LOC;
+  char locList[LOCATIONS_MAXNAME] = LOCATIONS; // comma-separated list of locations to run at (if not empty, replaces loc)
+  int numRunLocs, *runLocs; // the locations we run at (numRunLocs = 0 means all of them)
   int randomStart = RANDOM_START;
   double unaggedWeight = UNAGGED_WEIGHT, scaleFactor = SCALE_FACTOR, paramWeight = PARAM_WEIGHT;
   double validFrac = VALID_FRAC;
@@ -141,14 +160,31 @@ int main(int argc, char *argv[]) {
   int numDataTypes; // how many data types are we actually optimizing on?
   int runNum;
   int costFunction; // Determine which cost function we use.
+  int earlyReject = EARLY_REJECT; // stop model runs as soon as we know we'll reject the point?
+  int adaptive = ADAPTIVE; // change all parameters at once in the main chain, with an adaptive multivariate proposal?
+  int localSpatial = LOCAL_SPATIAL_UPDATES; // change spatial parameters at one location at a time?
+  int numTemps = NUM_TEMPS; // number of tempered replicas of the main chain (1 means no tempering)
+  double maxTemp = MAX_TEMP;
+  int swapInterval = SWAP_INTERVAL;
+  int popSize = DEMC_POP_SIZE; // size of DE-MC population (0 means don't use DE-MC)
+  double targetEss = TARGET_ESS, targetRhat = TARGET_RHAT; // stop once these are reached (if > 0)
+  int randSeed = RAND_SEED; // seed for random numbers (0 means seed from the time)
+  long checkpointInterval = CHECKPOINT_INTERVAL; // number of steps between checkpoints (0 means don't write checkpoints)
+  int resume = RESUME; // carry on from checkpoints, if there are any?
+  int numThreads = NUM_THREADS; // number of start chains (and then locations) to run at once
 
   FILE *userOut;
   char inFileName[FILE_MAXNAME], outFileName[FILE_MAXNAME];
   char climFile[FILE_MAXNAME+24]; // name of climate file
   char thisFile[FILE_MAXNAME+24]; // changes for each run
   char paramOutFile[FILE_MAXNAME+48], spatialParamOutFile[FILE_MAXNAME+48]; // for outputting best parameters
+#if FUSED_DIFFERENCE
+  void *differenceFunc = fusedDifference; /* the difference function to use (depends on whether we're aggregating model & data)
+					     (default is plain old vanilla "difference", done as the model runs) */
+#else
   void *differenceFunc = difference; /* the difference function to use (depends on whether we're aggregating model & data)
 					(default is plain old vanilla "difference") */
+#endif
   char **dataTypeNames;
   char optTypeName[NAMELIST_INPUT_MAXNAME];  // names such as OPT_NEE, read in from input file
   char weightTypeName[NAMELIST_INPUT_MAXNAME];  // names such as WEIGHT_NEE, read in from input file
@@ -185,6 +221,7 @@ int main(int argc, char *argv[]) {
   addNamelistInputItem(namelistInputs, "PARAM_FILE", STRING_TYPE, paramFile, FILE_MAXNAME);
   addNamelistInputItem(namelistInputs, "OUTPUT_NAME", STRING_TYPE, outFileName, FILE_MAXNAME);
   addNamelistInputItem(namelistInputs, "LOC", INT_TYPE, &loc, 0);
+  addNamelistInputItem(namelistInputs, "LOCATIONS", STRING_TYPE, locList, LOCATIONS_MAXNAME);
   addNamelistInputItem(namelistInputs, "COST_FUNCTION", INT_TYPE, &costFunction, 0);
   addNamelistInputItem(namelistInputs, "NUM_RUNS", INT_TYPE, &numRuns, 0);
   addNamelistInputItem(namelistInputs, "RANDOM_START", INT_TYPE, &randomStart, 0);
@@ -200,6 +237,19 @@ int main(int argc, char *argv[]) {
   addNamelistInputItem(namelistInputs, "COMPARE_INDICES_EXT", STRING_TYPE, compareIndicesExt, FILE_MAXNAME);
   addNamelistInputItem(namelistInputs, "AGGREGATION_EXT", STRING_TYPE, aggregationExt, FILE_MAXNAME);
   addNamelistInputItem(namelistInputs, "UNAGGED_WEIGHT", DOUBLE_TYPE, &unaggedWeight, 0);
+  addNamelistInputItem(namelistInputs, "EARLY_REJECT", INT_TYPE, &earlyReject, 0);
+  addNamelistInputItem(namelistInputs, "ADAPTIVE", INT_TYPE, &adaptive, 0);
+  addNamelistInputItem(namelistInputs, "LOCAL_SPATIAL_UPDATES", INT_TYPE, &localSpatial, 0);
+  addNamelistInputItem(namelistInputs, "NUM_TEMPS", INT_TYPE, &numTemps, 0);
+  addNamelistInputItem(namelistInputs, "MAX_TEMP", DOUBLE_TYPE, &maxTemp, 0);
+  addNamelistInputItem(namelistInputs, "SWAP_INTERVAL", INT_TYPE, &swapInterval, 0);
+  addNamelistInputItem(namelistInputs, "DEMC_POP_SIZE", INT_TYPE, &popSize, 0);
+  addNamelistInputItem(namelistInputs, "TARGET_ESS", DOUBLE_TYPE, &targetEss, 0);
+  addNamelistInputItem(namelistInputs, "TARGET_RHAT", DOUBLE_TYPE, &targetRhat, 0);
+  addNamelistInputItem(namelistInputs, "RAND_SEED", INT_TYPE, &randSeed, 0);
+  addNamelistInputItem(namelistInputs, "CHECKPOINT_INTERVAL", LONG_TYPE, &checkpointInterval, 0);
+  addNamelistInputItem(namelistInputs, "RESUME", INT_TYPE, &resume, 0);
+  addNamelistInputItem(namelistInputs, "NUM_THREADS", INT_TYPE, &numThreads, 0);
 
   // one entry for each data type that can be included in optimization:
   dataTypeNames = getDataTypeNames();
@@ -262,15 +312,69 @@ int main(int argc, char *argv[]) {
     strcpy(aggregationFile, "");
 
 
+  if (earlyReject) { // make sure early rejection is valid: the difference must be a running sum of non-negative terms
+    if (costFunction != 1 || strcmp(aggregationFile, "") != 0 || scaleFactor <= 0) {
+      printf("WARNING: EARLY_REJECT requires COST_FUNCTION = 1, SCALE_FACTOR > 0 and no AGGREGATION_EXT: turning it off\n");
+      earlyReject = 0;
+    }
+    for (i = 0; i < numDataTypes; i++) {
+      if (dataTypeWeights[dataTypeIndices[i]] < 0) {
+	printf("WARNING: EARLY_REJECT requires non-negative weights: turning it off\n");
+	earlyReject = 0;
+      }
+    }
+  }
+
+  numRunLocs = parseIntList(locList, "LOCATIONS", &runLocs);
+  if (numRunLocs == 0 && loc != -1) { // just run at loc
+    numRunLocs = 1;
+    runLocs = (int *)malloc(sizeof(int));
+    runLocs[0] = loc;
+  }
+
+  if (numTemps < 1) {
+    printf("ERROR: NUM_TEMPS = %d; must be >= 1\n", numTemps);
+    exit(1);
+  }
+  if (numTemps > 1 && (maxTemp < 1.0 || swapInterval < 1)) {
+    printf("ERROR: with NUM_TEMPS > 1, need MAX_TEMP >= 1 (it is %f) and SWAP_INTERVAL >= 1 (it is %d)\n", maxTemp, swapInterval);
+    exit(1);
+  }
+
+  if (popSize != 0 && (popSize < 4 || numTemps > 1 || adaptive)) {
+    printf("ERROR: DEMC_POP_SIZE = %d; must be 0, or >= 4 with NUM_TEMPS = 1 and ADAPTIVE = 0\n", popSize);
+    exit(1);
+  }
+
+  if (randSeed < 0) {
+    printf("ERROR: RAND_SEED = %d; must be >= 0\n", randSeed);
+    exit(1);
+  }
+
+  if (checkpointInterval < 0) {
+    printf("ERROR: CHECKPOINT_INTERVAL = %ld; must be >= 0\n", checkpointInterval);
+    exit(1);
+  }
+
+  if (numThreads < 1) {
+    printf("ERROR: NUM_THREADS = %d; must be >= 1\n", numThreads);
+    exit(1);
+  }
+
   if (strcmp(paramFile, "") == 0) { // no alternative parameter file specified
     // set paramFile = {inFileName}.param
     buildFileName(paramFile, inFileName, "param");
   }
   buildFileName(climFile, inFileName, "clim");
 
-  numLocs = initModel(&spatialParams, &steps, paramFile, climFile);
+  if (numRunLocs == 0)
+    numLocs = initModel(&spatialParams, &steps, paramFile, climFile);
+  else // only read climate where we run (at loc, or the listed locations)
+    numLocs = initModelLocs(&spatialParams, &steps, paramFile, climFile, numRunLocs, runLocs);
 
-  userOut = openFile(outFileName, "w");
+  userOut = openFile(outFileName, resume ? "a" : "w"); // (when resuming, keep what was written before)
+  if (resume)
+    fprintf(userOut, "\n\n********** RESUMING **********\n\n");
 
   fprintf(userOut, "Base input file name: %s\n", inFileName);
   fprintf(userOut, "Parameter file: %s\n", paramFile);
@@ -287,6 +391,7 @@ int main(int argc, char *argv[]) {
   fprintf(userOut, "SCALE_FACTOR = %f\n", scaleFactor);
   fprintf(userOut, "COST_FUNCTION = %d\n", costFunction);
   fprintf(userOut, "LOC = %d\n", loc);
+  fprintf(userOut, "LOCATIONS = %s\n", locList);
   fprintf(userOut, "NUM_RUNS = %d\n", numRuns);
   fprintf(userOut, "NUM_AT_ONCE = %d\n", numAtOnce);
   // would print paramFile here, but it's already printed above
@@ -295,6 +400,19 @@ int main(int argc, char *argv[]) {
   fprintf(userOut, "OPT_INDICES_FILE = %s\n", optIndicesFile);
   fprintf(userOut, "VALID_FRAC = %f\n", validFrac);
   fprintf(userOut, "PARAM_WEIGHT = %f\n", paramWeight);
+  fprintf(userOut, "EARLY_REJECT = %d\n", earlyReject);
+  fprintf(userOut, "ADAPTIVE = %d\n", adaptive);
+  fprintf(userOut, "LOCAL_SPATIAL_UPDATES = %d\n", localSpatial);
+  fprintf(userOut, "NUM_TEMPS = %d\n", numTemps);
+  fprintf(userOut, "MAX_TEMP = %f\n", maxTemp);
+  fprintf(userOut, "SWAP_INTERVAL = %d\n", swapInterval);
+  fprintf(userOut, "DEMC_POP_SIZE = %d\n", popSize);
+  fprintf(userOut, "TARGET_ESS = %f\n", targetEss);
+  fprintf(userOut, "TARGET_RHAT = %f\n", targetRhat);
+  fprintf(userOut, "RAND_SEED = %d\n", randSeed);
+  fprintf(userOut, "CHECKPOINT_INTERVAL = %ld\n", checkpointInterval);
+  fprintf(userOut, "RESUME = %d\n", resume);
+  fprintf(userOut, "NUM_THREADS = %d\n", numThreads);
   printDataTypeIndices(dataTypeIndices, numDataTypes, userOut);
   fprintf(userOut, "\n\n");
 
@@ -315,8 +433,16 @@ int main(int argc, char *argv[]) {
 		       */
   }
 
+  if (differenceFunc == fusedDifference || earlyReject) { // report time steps we never run (see getStepsNeeded)
+    for (i = 0; i < numLocs; i++) {
+      if (getStepsNeeded(i) < steps[i])
+	fprintf(userOut, "Location #%d: optimization and post-comparisons end at step %d of %d: skipping last %d steps of each model run\n\n",
+		i, getStepsNeeded(i), steps[i], steps[i] - getStepsNeeded(i));
+    }
+  }
+
   signal(SIGINT,exit);
-  seedRand(0, userOut);
+  seedRand((unsigned int)randSeed, userOut);
 
   for (runNum = 1; runNum <= numRuns; runNum++) {
     fprintf(userOut, "Run #%d of %d:\n\n", runNum, numRuns);
@@ -328,9 +454,10 @@ int main(int argc, char *argv[]) {
 							   add extra underscore at end to separate run # from location #
 							*/
 
-    metropolis(thisFile, spatialParams, loc, differenceFunc, runModelNoOut,
+    metropolis(thisFile, spatialParams, numRunLocs, runLocs, differenceFunc, runModelNoOut,
 	       addFraction, iter, numAtOnce, numChains, randomStart, numSpinUps, paramWeight, scaleFactor,
-	       dataTypeIndices, numDataTypes, costFunction, dataTypeWeights, userOut);
+	       dataTypeIndices, numDataTypes, costFunction, dataTypeWeights, earlyReject, numThreads, adaptive, localSpatial, numTemps, maxTemp, swapInterval, popSize,
+	       targetEss, targetRhat, checkpointInterval, resume, userOut);
 
     buildFileName(paramOutFile, thisFile, "param");
     strcpy(spatialParamOutFile, paramOutFile);
@@ -345,6 +472,7 @@ int main(int argc, char *argv[]) {
   cleanupParamchange();
   deleteSpatialParams(spatialParams);
   free(steps);
+  free(runLocs);
   fclose(userOut);
 
   return 0;
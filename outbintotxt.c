@@ -0,0 +1,139 @@
+/* outbintotxt: convert binary model output (as written by sipnet with OUTPUT_FORMAT = binary32 or binary64)
+   to the usual text output (as written by sipnet with OUTPUT_FORMAT = text)
+
+   Usage: outbintotxt [-h] [-l] inFile [outFile]
+   Reads inFile (e.g. foo.outbin) and writes the text version to outFile (default: inFile with .outbin replaced by .out)
+   With -l, just lists the columns (and their units) of inFile, and the number of time steps it holds
+   If inFile holds doubles, the text is exactly what sipnet would have written; if floats, values may differ in their last digit
+
+   Creation date: 10/18/26
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "binaryOutput.h"
+#include "sipnet.h"
+#include "util.h"
+
+
+void usage(char *progName) {
+  printf("Usage: %s [-h] [-l] inFile [outFile]\n", progName);
+  printf("Convert binary output from sipnet (OUTPUT_FORMAT = binary32 or binary64) to the usual text output\n");
+  printf("[-h]: Print this usage message and exit\n");
+  printf("[-l]: Just list the columns of inFile and the number of time steps it holds\n");
+  printf("outFile: Default: inFile with .outbin replaced by .out (or with .out appended)\n");
+}
+
+
+int main(int argc, char *argv[]) {
+  FILE *in, *out;
+  SipnetContext *ctx;
+  BinaryOutputHeader header;
+  char *names, *units;
+  char *modelNames[MAX_OUTPUT_COLUMNS], *modelUnits[MAX_OUTPUT_COLUMNS];
+  char outName[1024];
+  double **columns;
+  double *values; // one row of values, after loc, year, day and time
+  int numModelColumns;
+  int listOnly = 0;
+  long numSteps;
+  int n, c, i;
+  int option;
+
+  while ((option = getopt(argc, argv, "hl")) != -1) {
+    switch (option) {
+    case 'h':
+      usage(argv[0]);
+      exit(1);
+    case 'l':
+      listOnly = 1;
+      break;
+    default:
+      usage(argv[0]);
+      exit(1);
+    }
+  }
+  if (optind != argc - 1 && optind != argc - 2) {
+    usage(argv[0]);
+    exit(1);
+  }
+
+  in = openFile(argv[optind], "rb");
+  readBinaryOutputHeader(in, &header, &names, &units);
+
+  columns = (double **)malloc(header.numColumns * sizeof(double *));
+  for (c = 0; c < header.numColumns; c++)
+    columns[c] = (double *)malloc(header.maxChunkSteps * sizeof(double));
+
+  if (listOnly) {
+    printf("%d columns, %s values:\n", header.numColumns, (header.valueSize == sizeof(float)) ? "float" : "double");
+    for (c = 0; c < header.numColumns; c++)
+      printf("%3d %-24s %s\n", c, names + c * BINARY_OUTPUT_NAME_LEN, units + c * BINARY_OUTPUT_NAME_LEN);
+    numSteps = 0;
+    while ((n = readBinaryOutputChunk(in, &header, columns)) > 0)
+      numSteps += n;
+    printf("%ld time steps\n", numSteps);
+    fclose(in);
+    return 0;
+  }
+
+  // the text layout is sipnet's, so the file must have the columns that this version of sipnet writes:
+  numModelColumns = getOutputColumns(modelNames, modelUnits);
+  if (header.numColumns != numModelColumns) {
+    printf("Error: %s has %d columns, but this version of sipnet writes %d\n", argv[optind], header.numColumns, numModelColumns);
+    exit(1);
+  }
+  for (c = 0; c < numModelColumns; c++) {
+    if (strcmp(names + c * BINARY_OUTPUT_NAME_LEN, modelNames[c]) != 0) {
+      printf("Error: column %d of %s is %s, but this version of sipnet writes %s there\n", c, argv[optind],
+	     names + c * BINARY_OUTPUT_NAME_LEN, modelNames[c]);
+      exit(1);
+    }
+  }
+
+  if (optind == argc - 2)
+    n = snprintf(outName, sizeof(outName), "%s", argv[optind + 1]);
+  else {
+    n = strlen(argv[optind]);
+    if (n >= 7 && strcmp(argv[optind] + n - 7, ".outbin") == 0) // foo.outbin -> foo.out
+      n = snprintf(outName, sizeof(outName), "%.*s", n - 3, argv[optind]);
+    else
+      n = snprintf(outName, sizeof(outName), "%s.out", argv[optind]);
+  }
+  if (n >= sizeof(outName)) {
+    printf("Error: output file name is too long (maximum %d characters)\n", (int)sizeof(outName) - 1);
+    exit(1);
+  }
+  out = openFile(outName, "w");
+
+  if (header.flags & BINARY_OUTPUT_PRINT_HEADER)  {
+    ctx = newSipnetContext(); // (outputHeader needs a context)
+    outputHeader(ctx, out);
+    deleteSipnetContext(ctx);
+  }
+
+  values = (double *)malloc(header.numColumns * sizeof(double));
+  numSteps = 0;
+  while ((n = readBinaryOutputChunk(in, &header, columns)) > 0) {
+    for (i = 0; i < n; i++) {
+      for (c = 4; c < header.numColumns; c++)
+	values[c - 4] = columns[c][i];
+      writeOutputStateValues(out, (int)columns[0][i], (int)columns[1][i], (int)columns[2][i], columns[3][i], values);
+    }
+    numSteps += n;
+  }
+  printf("Wrote %ld time steps to %s\n", numSteps, outName);
+
+  fclose(in);
+  fclose(out);
+  free(values);
+  for (c = 0; c < header.numColumns; c++)
+    free(columns[c]);
+  free(columns);
+  free(names);
+  free(units);
+
+  return 0;
+}
@@ -28,6 +28,8 @@ SingleOutputItem *newSingleOutputItem(char *name, double *ptr)  {
   strcpy(singleOutputItem->name, name);
   singleOutputItem->ptr = ptr;
   singleOutputItem->f = NULL;
+  singleOutputItem->buffer = NULL;
+  singleOutputItem->bufferSize = 0;
   singleOutputItem->nextItem = NULL;
 
   return singleOutputItem;
@@ -50,10 +52,24 @@ void openOutputItemFile(SingleOutputItem *singleOutputItem, char *filenameBase)
 }
 
 
-// close the file associated with this output item
+/* Open a memory buffer for this output item to write to, in place of a file
+   (singleOutputItem->buffer and bufferSize are updated each time f is flushed)
+ */
+void openOutputItemBuffer(SingleOutputItem *singleOutputItem)  {
+  singleOutputItem->f = open_memstream(&(singleOutputItem->buffer), &(singleOutputItem->bufferSize));
+  if (singleOutputItem->f == NULL)  {
+    printf("ERROR in openOutputItemBuffer: couldn't open memory buffer for output item '%s'\n", singleOutputItem->name);
+    exit(1);
+  }
+}
+
+
+// close the file (or memory buffer) associated with this output item
 void closeOutputItemFile(SingleOutputItem *singleOutputItem)  {
   fclose(singleOutputItem->f);
   singleOutputItem->f = NULL;
+  free(singleOutputItem->buffer); // (NULL unless this is a buffered output item)
+  singleOutputItem->buffer = NULL;
 }
 
 
@@ -85,17 +101,42 @@ OutputItems *newOutputItems(char *filenameBase, char separator)  {
 }
 
 
+/* Allocate space for a new outputItems structure that writes to memory rather than to files, return a pointer to it
+   separator is the character separating values
+   Once the same items have been added to it, in the same order, as to some outputItems structure that writes to files,
+   what it holds can be appended to those files with writeBufferedOutputItems
+   (so that several runs can write their output at once, and their outputs can then be written to the files in order)
+ */
+OutputItems *newBufferedOutputItems(char separator)  {
+  OutputItems *outputItems;
+
+  outputItems = (OutputItems *)malloc(sizeof(OutputItems));
+
+  outputItems->head = newSingleOutputItem("", NULL);  // we'll keep a dummy item at the head of the list
+  outputItems->tail = outputItems->head;
+  outputItems->count = 0;
+  outputItems->filenameBase = NULL;
+  outputItems->separator = separator;
+
+  return outputItems;
+}
+
+
 /* Add a new singleOutputItem to the end of the list given by outputItems
    strlen(name) must be < OUTPUT_ITEMS_MAXNAME
    ptr must be a pointer to the variable holding this item (double)
    
    After calling this function, the file associated with this output item will be open for writing
+   (or for buffered output items, its memory buffer)
  */
 void addOutputItem(OutputItems *outputItems, char *name, double *ptr)  {
   SingleOutputItem *singleOutputItem;
 
   singleOutputItem = newSingleOutputItem(name, ptr);
-  openOutputItemFile(singleOutputItem, outputItems->filenameBase);
+  if (outputItems->filenameBase == NULL)
+    openOutputItemBuffer(singleOutputItem);
+  else
+    openOutputItemFile(singleOutputItem, outputItems->filenameBase);
 
   outputItems->tail->nextItem = singleOutputItem;
   outputItems->tail = singleOutputItem;
@@ -130,6 +171,34 @@ void writeOutputItemValues(OutputItems *outputItems)  {
 }
 
 
+// Put the current value of each output item in values[0..outputItems->count-1] (to be written later with writeOutputItemValuesFrom)
+void getOutputItemValues(OutputItems *outputItems, double values[])  {
+  SingleOutputItem *singleOutputItem;
+  int i;
+
+  i = 0;
+  singleOutputItem = outputItems->head->nextItem;
+  while (singleOutputItem != NULL)  {
+    values[i++] = *(singleOutputItem->ptr);
+    singleOutputItem = singleOutputItem->nextItem;
+  }
+}
+
+
+// Same as writeOutputItemValues, but write values[0..outputItems->count-1] (as got by getOutputItemValues) rather than the current values
+void writeOutputItemValuesFrom(OutputItems *outputItems, double values[])  {
+  SingleOutputItem *singleOutputItem;
+  int i;
+
+  i = 0;
+  singleOutputItem = outputItems->head->nextItem;
+  while (singleOutputItem != NULL)  {
+    fprintf(singleOutputItem->f, "%f%c", values[i++], outputItems->separator);
+    singleOutputItem = singleOutputItem->nextItem;
+  }
+}
+
+
 /* For each output item, write a newline
    This is intended to be called at the end of each run
  */
@@ -144,6 +213,23 @@ void terminateOutputItemLines(OutputItems *outputItems)  {
 }
 
 
+/* PRE: buffered was created with newBufferedOutputItems, and has had the same items added to it, in the same order, as outputItems
+   Append everything written to each item of buffered so far to the file of the corresponding item of outputItems
+ */
+void writeBufferedOutputItems(OutputItems *outputItems, OutputItems *buffered)  {
+  SingleOutputItem *singleOutputItem, *bufferedItem;
+
+  singleOutputItem = outputItems->head->nextItem;
+  bufferedItem = buffered->head->nextItem;
+  while (singleOutputItem != NULL && bufferedItem != NULL)  {
+    fflush(bufferedItem->f); // (brings buffer and bufferSize up to date)
+    fwrite(bufferedItem->buffer, sizeof(char), bufferedItem->bufferSize, singleOutputItem->f);
+    singleOutputItem = singleOutputItem->nextItem;
+    bufferedItem = bufferedItem->nextItem;
+  }
+}
+
+
 /* Free up space used by outputItems
    Also, close all files associated with the individual output items
  */
@@ -161,6 +247,6 @@ void deleteOutputItems(OutputItems *outputItems)  {
     }
   }
 
-  free(outputItems->filenameBase);
+  free(outputItems->filenameBase); // (NULL for buffered output items)
   free(outputItems);
 }
@@ -11,6 +11,8 @@ typedef struct SingleOutputItemStruct  {
   char name[OUTPUT_ITEMS_MAXNAME];  // name of output item
   double *ptr;  // pointer to the variable holding this item
   FILE *f;  // output file for this output item
+  char *buffer;  // for buffered output items: the memory f writes to (see newBufferedOutputItems)
+  size_t bufferSize;  // number of characters in buffer (only up to date once f has been flushed)
   
   struct SingleOutputItemStruct *nextItem;
 } SingleOutputItem;
@@ -23,7 +25,7 @@ typedef struct OutputItemsStruct  {
   SingleOutputItem *tail;
 
   int count;  // number of items in the list, not counting the dummy item at the head
-  char *filenameBase;
+  char *filenameBase;  // NULL for buffered output items
   char separator;  // character separating values in the output files (e.g. space, tab, or comma)
 } OutputItems;
 
@@ -37,11 +39,21 @@ typedef struct OutputItemsStruct  {
 OutputItems *newOutputItems(char *filenameBase, char separator);
 
 
+/* Allocate space for a new outputItems structure that writes to memory rather than to files, return a pointer to it
+   separator is the character separating values
+   Once the same items have been added to it, in the same order, as to some outputItems structure that writes to files,
+   what it holds can be appended to those files with writeBufferedOutputItems
+   (so that several runs can write their output at once, and their outputs can then be written to the files in order)
+ */
+OutputItems *newBufferedOutputItems(char separator);
+
+
 /* Add a new singleOutputItem to the end of the list given by outputItems
    strlen(name) must be < OUTPUT_ITEMS_MAXNAME
    ptr must be a pointer to the variable holding this item (double)
    
    After calling this function, the file associated with this output item will be open for writing
+   (or for buffered output items, its memory buffer)
  */
 void addOutputItem(OutputItems *outputItems, char *name, double *ptr);
 
@@ -57,12 +69,26 @@ void writeOutputItemLabels(OutputItems *outputItems, char *label);
 void writeOutputItemValues(OutputItems *outputItems);
 
 
+// Put the current value of each output item in values[0..outputItems->count-1] (to be written later with writeOutputItemValuesFrom)
+void getOutputItemValues(OutputItems *outputItems, double values[]);
+
+
+// Same as writeOutputItemValues, but write values[0..outputItems->count-1] (as got by getOutputItemValues) rather than the current values
+void writeOutputItemValuesFrom(OutputItems *outputItems, double values[]);
+
+
 /* For each output item, write a newline
    This is intended to be called at the end of each run
  */
 void terminateOutputItemLines(OutputItems *outputItems);
 
 
+/* PRE: buffered was created with newBufferedOutputItems, and has had the same items added to it, in the same order, as outputItems
+   Append everything written to each item of buffered so far to the file of the corresponding item of outputItems
+ */
+void writeBufferedOutputItems(OutputItems *outputItems, OutputItems *buffered);
+
+
 /* Free up space used by outputItems
    Also, close all files associated with the individual output items
  */
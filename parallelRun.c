@@ -0,0 +1,164 @@
+/* parallelRun: forward runs of the model at all locations, with different locations run at once on several threads
+   (e.g. for regional runs over thousands of grid cells), giving exactly the same output files as a run on a single thread
+
+   Creation date: 10/18/26
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include "parallelRun.h"
+#include "sipnet.h"
+#include "threadPool.h"
+
+#define LOCS_AHEAD_PER_THREAD 4 /* no thread starts a location more than this many locations per thread
+				   beyond the last one whose output has been written */
+
+
+// the output of one location, held in memory until it can be written
+typedef struct LocOutputStruct {
+  FILE *out; // NULL if we're not doing main output
+  char *outBuffer; // the memory out writes to
+  size_t outSize;
+  OutputItems *outputItems; // buffered output items (NULL if we're not doing single-variable output)
+  int done; // has this location finished running?
+} LocOutput;
+
+
+// everything runOneLocation needs
+typedef struct ParallelRunInfoStruct {
+  FILE *out; // where the main output goes in the end (NULL for none)
+  OutputItems *outputItems; // where the single-variable output goes in the end (NULL for none)
+  int printHeader;
+  SpatialParams *spatialParams;
+  int numLocs;
+  int *locs; // the locations we run at, in order: locs[0..numLocs-1]
+  int maxAhead; // no location is started until the one maxAhead before it has been written
+
+  LocOutput *locOutputs; // locOutputs[0..numLocs-1]: the output of each of locs
+  int nextToWrite; // index of the first location whose output hasn't been written yet
+  int writing; // is some thread writing output now? (only that thread writes to out and outputItems)
+  pthread_mutex_t lock; // protects nextToWrite, writing and the done flags (but isn't held while writing)
+  pthread_cond_t written; // signalled when more output has been written
+} ParallelRunInfo;
+
+
+// write the output of location # locIndex (which has finished) to info->out and info->outputItems, then free it
+// PRE: this thread is the writer (i.e. it set info->writing)
+void writeLocOutput(ParallelRunInfo *info, int locIndex) {
+  LocOutput *locOutput = &(info->locOutputs[locIndex]);
+
+  if (locOutput->out != NULL) {
+    fclose(locOutput->out); // (brings outBuffer and outSize up to date)
+    fwrite(locOutput->outBuffer, sizeof(char), locOutput->outSize, info->out);
+    free(locOutput->outBuffer);
+    locOutput->out = NULL;
+    locOutput->outBuffer = NULL;
+  }
+  if (locOutput->outputItems != NULL) {
+    writeBufferedOutputItems(info->outputItems, locOutput->outputItems);
+    deleteOutputItems(locOutput->outputItems);
+    locOutput->outputItems = NULL;
+  }
+}
+
+
+/* run the model at location info->locs[locIndex], writing its output to memory, then (unless another thread is already doing it)
+   write out all the finished locations' output that can now be written in order
+   The lock is only held to check and update the flags, not while writing: so the other threads can carry on
+   finishing locations (and starting new ones) while the output is written
+   (parallelRunInfo is a ParallelRunInfo *: has this form so it can be run by a thread pool)
+*/
+void runOneLocation(int locIndex, void *parallelRunInfo) {
+  ParallelRunInfo *info = (ParallelRunInfo *)parallelRunInfo;
+  LocOutput *locOutput = &(info->locOutputs[locIndex]);
+  SipnetContext *ctx;
+  char label[64];
+  int loc = info->locs[locIndex];
+  int writeIndex;
+
+  pthread_mutex_lock(&(info->lock));
+  while (locIndex >= info->nextToWrite + info->maxAhead) // don't get too far ahead of the output
+    pthread_cond_wait(&(info->written), &(info->lock));
+  pthread_mutex_unlock(&(info->lock));
+
+  ctx = getDefaultContext(); // this thread's own context
+  locOutput->out = NULL;
+  locOutput->outputItems = NULL;
+  if (info->out != NULL) {
+    locOutput->out = open_memstream(&(locOutput->outBuffer), &(locOutput->outSize));
+    if (locOutput->out == NULL) {
+      printf("Error in runOneLocation: couldn't open memory buffer for output of location %d\n", loc);
+      exit(1);
+    }
+  }
+  if (info->outputItems != NULL) { // (as runModelOutput does when running everywhere, start each line with the location)
+    locOutput->outputItems = newBufferedOutputItems(info->outputItems->separator);
+    setupOutputItemsCtx(ctx, locOutput->outputItems);
+    sprintf(label, "%d", loc);
+    writeOutputItemLabels(locOutput->outputItems, label);
+  }
+
+  // (the header goes at the start of the first location's output, just as it would in a single run everywhere)
+  runModelOutputCtx(ctx, locOutput->out, locOutput->outputItems, info->printHeader && locIndex == 0, info->spatialParams, loc);
+  releaseClimate(loc); // (if climate is loaded lazily) we won't run here again
+
+  pthread_mutex_lock(&(info->lock));
+  locOutput->done = 1;
+  if (!info->writing) {
+    /* become the writer: and keep writing while the next location is done
+       (a location that finishes while we're writing sees that we're the writer and leaves its output for us:
+        since we check the done flags again, with the lock held, after each location we write, we'll find it) */
+    info->writing = 1;
+    while (info->nextToWrite < info->numLocs && info->locOutputs[info->nextToWrite].done) {
+      writeIndex = info->nextToWrite; // (no other thread changes nextToWrite while we're the writer)
+      pthread_mutex_unlock(&(info->lock));
+      writeLocOutput(info, writeIndex);
+      pthread_mutex_lock(&(info->lock));
+      info->nextToWrite++;
+      pthread_cond_broadcast(&(info->written));
+    }
+    info->writing = 0;
+  }
+  pthread_mutex_unlock(&(info->lock));
+}
+
+
+/* Same as runModelOutput with loc = -1 (run at every location, or those set by setRunLocations, in turn),
+   but running locations at once on numThreads threads
+   The output of each location is written to memory first, then written to out and outputItems in location order,
+   so the files are exactly the same as those from runModelOutput
+   Locations are handed out one at a time to whichever thread is free next (so locations with more time steps don't
+   hold the others up), and no thread starts a location more than a few locations ahead of the last one written,
+   so we never hold more than a few locations' output per thread in memory
+   PRE: outputItems (if not NULL) was set up with setupOutputItems
+        numThreads >= 1
+*/
+void runModelOutputParallel(FILE *out, OutputItems *outputItems, int printHeader, SpatialParams *spatialParams, int numThreads) {
+  ParallelRunInfo info;
+  ThreadPool *pool;
+  int locIndex;
+
+  info.out = out;
+  info.outputItems = outputItems;
+  info.printHeader = printHeader;
+  info.spatialParams = spatialParams;
+  info.numLocs = getRunLocations(spatialParams, &(info.locs));
+  info.maxAhead = LOCS_AHEAD_PER_THREAD * numThreads;
+  info.locOutputs = (LocOutput *)malloc(info.numLocs * sizeof(LocOutput));
+  for (locIndex = 0; locIndex < info.numLocs; locIndex++)
+    info.locOutputs[locIndex].done = 0;
+  info.nextToWrite = 0;
+  info.writing = 0;
+  pthread_mutex_init(&(info.lock), NULL);
+  pthread_cond_init(&(info.written), NULL);
+
+  pool = newThreadPool(numThreads);
+  runTasks(pool, info.numLocs, runOneLocation, &info);
+  deleteThreadPool(pool);
+
+  pthread_mutex_destroy(&(info.lock));
+  pthread_cond_destroy(&(info.written));
+  free(info.locOutputs);
+  free(info.locs);
+}
@@ -0,0 +1,24 @@
+// header file for parallelRun.c
+// forward runs of the model at all locations, with different locations run at once on several threads
+
+#ifndef PARALLEL_RUN_H
+#define PARALLEL_RUN_H
+
+#include <stdio.h>
+#include "spatialParams.h"
+#include "outputItems.h"
+
+
+/* Same as runModelOutput with loc = -1 (run at every location, or those set by setRunLocations, in turn),
+   but running locations at once on numThreads threads
+   The output of each location is written to memory first, then written to out and outputItems in location order,
+   so the files are exactly the same as those from runModelOutput
+   Locations are handed out one at a time to whichever thread is free next (so locations with more time steps don't
+   hold the others up), and no thread starts a location more than a few locations ahead of the last one written,
+   so we never hold more than a few locations' output per thread in memory
+   PRE: outputItems (if not NULL) was set up with setupOutputItems
+        numThreads >= 1
+*/
+void runModelOutputParallel(FILE *out, OutputItems *outputItems, int printHeader, SpatialParams *spatialParams, int numThreads);
+
+#endif
@@ -7,24 +7,38 @@
 #include <string.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <pthread.h>
 #include "paramchange.h"
 #include "util.h"
+#include "sipnet.h"
 
 // the following variables are made global because they are computed once
 // at the beginning of the program, and then must stick around (unchanging) for the whole program
 
-static double numLocs; /* number of spatial locations: first dimension of data, startOpt, endOpt, valid, numAggSteps, aggSteps, aggedData, aggInfo
+static double numLocs; /* number of spatial locations: first dimension of data, startOpt, endOpt, obs, numAggSteps, aggSteps, aggedData, aggInfo
 			  set in readData */
 static double ***data; /* read in once at start of program
-			 compared with model data in difference function
+			 compared with model data in post-comparisons (aggregates) and aggregation
 			 1st dimension is spatial location, 2nd is time step, 3rd is data type */
-static double ***sigmas; /* (dm) data uncertainty read in once at start of program
-			 compared with model data in difference function
-			 1st dimension is spatial location, 2nd is time step, 3rd is data type */
-static double **model; // made global so don't have to re-allocate memory all the time
 static int *startOpt, *endOpt; // starting and ending indices for optimization (1-indexing) (vector: spatial)
-static int ***valid; /* valid[i][j][k] indicates whether data[i][j][k] is valid (0 = invalid, non-0 = valid)
-		       (based on fraction of valid data points) */
+static int *stopAfter; /* number of time steps we need to run the model for, for optimization and post-comparisons
+			  (max. of endOpt and aggInfo.endPt) (vector: spatial) */
+
+/* The observations used in optimization at one location, for one data type: just the valid points (based on fraction of
+   valid data points) between startOpt and endOpt, in order of time step
+   So the likelihood only has to visit real observations (e.g. FAPAR, which is only valid every 8 days),
+   rather than checking every step of every data type for validity
+   value and invTwoVar are contiguous, aligned arrays (see makeAlignedArray), so the sum of squares over them
+   can be vectorized (see obsSumSquares) */
+typedef struct ObsListStruct {
+  int num; // number of observations
+  int *step; // step[0..num-1]: time step of each observation (0-indexing)
+  double *value; // value[0..num-1]: measured value at each observation
+  double *invTwoVar; // invTwoVar[0..num-1]: 1 / (2 * sigma^2) at each observation, where sigma is the (dm) data uncertainty read in from file
+} ObsList;
+
+static ObsList **obs; // obs[loc][dataNum]: observations at location loc for data type dataNum (set in readData)
+static double cf0TwoVar; // 2 * sigma^2 used for every observation with costFunction 0, where sigma = sqrt(0.5) (set in readData)
 
 static int *numAggSteps = NULL; /* size of 2nd dimension of aggSteps array (spatial)
 				   (explicitly initialized to NULL because we may never malloc this array) */
@@ -33,9 +47,6 @@ static int **aggSteps = NULL; /* array specifying how many steps make up each ag
 				 (explicitly initialized to NULL because we may never malloc this array) */
 static double ***aggedData = NULL; /* aggregated data (initialized to NULL b/c we may never malloc this array)
 				     only holds data between startOpt and endOpt */
-static double **aggedModel = NULL; /* aggregated model (intitialized to NULL b/c we may never malloc this array)
-				      made global so don't have to re-allocate memory all the time
-				      only holds model output between startOpt and endOpt */
 static double unaggedWeight = 0.0; /* if aggregation is done, weight of unaggregated data in optimization
 				      (0 -> only use aggregated data) */
 
@@ -50,93 +61,190 @@ typedef struct AggregateInfoStruct { // set at beginning of program
 static AggregateInfo *aggInfo; // vector: spatial
 
 
-/* Difference, version 4 - READS IN SIGMAS (dm) ESTIMATES SIGMA, RETURNS AGGREGATE INFO
-   Run modelF with given parameters at location loc, compare output with measured data
-   using data types given by dataTypeIndices[0..numDataTypes-1]
-   Return a measure of the difference between measured and predicted data
-   (Higher = worse)
-   Return best sigma value for each data type in sigma[0..numDataTypes-1]
-   Return mean error, mean daily-aggregated error, and yearly-aggregated output for each year
-   and each data type in *outputInfo array
-   Pre: sigma and outputInfo are already malloced, as are outputInfo[*].years arrays
+/* Scratch space for model output, made global so don't have to re-allocate memory all the time
+   Each thread has its own (see getModelScratch), with one array per location,
+   so different threads can run the model at once - even at the same location (e.g. several chains at once)
+   Also holds the small arrays each evaluation needs, so that once a thread's scratch space is set up
+   (see prepareModelScratch), evaluating a point never allocates anything
+*/
+typedef struct ModelScratchStruct {
+  double ***model; // model[loc]: model output at location loc (2nd dimension is time step, 3rd is data type); NULL until first needed
+  double ***aggedModel; /* aggedModel[loc]: aggregated model output at location loc; NULL until first needed
+			   only holds model output between startOpt and endOpt */
+  double ***obsModel; /* obsModel[loc][dataNum][0..obs[loc][dataNum].num-1]: model output at each observation at location loc
+			 (gathered from the model output, so it lines up with obs[loc][dataNum].value); NULL until first needed */
+
+  // per-evaluation arrays, allocated along with the ModelScratch, big enough for any location:
+  double *sumSquares; // [0..2*scratchNumDataTypes-1]: sum of squares for each data type (x2: aggedDifference has two of each)
+  int *n; // [0..2*scratchNumDataTypes-1]: number of data points in each sumSquares
+  double *sumError, *sumDaysError, *dayModel, *dayData, *yearModel; // [0..scratchNumDataTypes-1]: for streamDifference
+  double *modelD, *dataD; // [0..(max. numDays)-1]: daily aggregations, for aggregates
+} ModelScratch;
+
+static pthread_key_t scratchKey; // gives each thread's ModelScratch (set up in readData)
+static int *scratchSteps; // number of time steps at each location: size of model[loc] (vector: spatial)
+static int scratchNumDataTypes; // number of data types in each model and aggedModel array
+
+
+// free all space used by a ModelScratch (also called when a thread exits, to free that thread's scratch space)
+void deleteModelScratch(void *modelScratch) {
+  ModelScratch *scratch;
+  int loc;
 
-   Only use "valid" data points (as determined by validFrac in readData)
-   And only use points between startOpt and endOpt (set in readData)
-   [IGNORE paramWeight - just there to be consistent with old difference function]
+  int dataNum;
 
-   NOTE: this is actually the NEGATIVE log likelihood, discarding constant terms
-   to get true log likelihood, add n*log(sqrt(2*pi)), then multiply by -1
-*/
-/*Added read in ***sigmas
- * removed ***sigma from double difference(double  *sigma, ***sigmas, OutputInfo *outputInfo,
- *
- */
-double difference(double  *sigma, OutputInfo *outputInfo,
-		  int loc, SpatialParams *spatialParams, double paramWeight,
-		  void (*modelF)(double **, int, int *, SpatialParams *, int),
-		  int dataTypeIndices[], int numDataTypes, int costFunction, double dataTypeWeights[])
-{
-  int i, dataNum;
-  double *sumSquares; // one sum of squares value for each data type
-  double *DownWtSumSquares; //sum of square value downweighted by the number of data points _dm 05 24 10
-  int *n; // number of data points used in each sumSquares
-  double logLike; // the log likelihood
-  double thisSigma; //(dm) declare thisSigma
-  //FILE *dbg; //(dm) debug file
-  sumSquares = makeArray(numDataTypes);
-  DownWtSumSquares = makeArray(numDataTypes);
-  n = (int *)malloc(numDataTypes * sizeof(int));
+  scratch = (ModelScratch *)modelScratch;
+  for (loc = 0; loc < numLocs; loc++) {
+    if (scratch->model[loc] != NULL)
+      free2DArray((void **)scratch->model[loc]);
+    if (scratch->aggedModel[loc] != NULL)
+      free2DArray((void **)scratch->aggedModel[loc]);
+    if (scratch->obsModel[loc] != NULL) {
+      for (dataNum = 0; dataNum < scratchNumDataTypes; dataNum++)
+	free(scratch->obsModel[loc][dataNum]);
+      free(scratch->obsModel[loc]);
+    }
+  }
+  free(scratch->model);
+  free(scratch->aggedModel);
+  free(scratch->obsModel);
+  free(scratch->sumSquares);
+  free(scratch->n);
+  free(scratch->sumError);
+  free(scratch->sumDaysError);
+  free(scratch->dayModel);
+  free(scratch->dayData);
+  free(scratch->yearModel);
+  free(scratch->modelD);
+  free(scratch->dataD);
+  free(scratch);
+}
 
-  (*modelF)(model, numDataTypes, dataTypeIndices, spatialParams, loc);
-  // run model, put results in model array
 
-  // initialize sumSquares and count arrays
+// return the calling thread's scratch space, creating it if this thread doesn't have any yet
+// PRE: readData has been called
+ModelScratch *getModelScratch(void) {
+  ModelScratch *scratch;
+  int loc, maxDays;
+
+  scratch = (ModelScratch *)pthread_getspecific(scratchKey);
+  if (scratch == NULL) {
+    scratch = (ModelScratch *)malloc(sizeof(ModelScratch));
+    scratch->model = (double ***)malloc(numLocs * sizeof(double **));
+    scratch->aggedModel = (double ***)malloc(numLocs * sizeof(double **));
+    scratch->obsModel = (double ***)malloc(numLocs * sizeof(double **));
+    maxDays = 1; // so we never malloc 0
+    for (loc = 0; loc < numLocs; loc++) {
+      scratch->model[loc] = scratch->aggedModel[loc] = scratch->obsModel[loc] = NULL;
+      if (aggInfo[loc].numDays > maxDays)
+	maxDays = aggInfo[loc].numDays;
+    }
 
-  for (dataNum = 0; dataNum < numDataTypes; dataNum++) {
-    sumSquares[dataNum] = 0.0;
-    DownWtSumSquares[dataNum] = 0.0;
-    n[dataNum] = 0;
+    scratch->sumSquares = makeArray(2 * scratchNumDataTypes);
+    scratch->n = (int *)malloc(2 * scratchNumDataTypes * sizeof(int));
+    scratch->sumError = makeArray(scratchNumDataTypes);
+    scratch->sumDaysError = makeArray(scratchNumDataTypes);
+    scratch->dayModel = makeArray(scratchNumDataTypes);
+    scratch->dayData = makeArray(scratchNumDataTypes);
+    scratch->yearModel = makeArray(scratchNumDataTypes);
+    scratch->modelD = makeArray(maxDays);
+    scratch->dataD = makeArray(maxDays);
+
+    pthread_setspecific(scratchKey, scratch);
   }
 
+  return scratch;
+}
 
-  for (i = startOpt[loc] - 1; i < endOpt[loc]; i++) {
-    for (dataNum = 0; dataNum < numDataTypes; dataNum++) {
-      if (valid[loc][i][dataNum]) {
 
+// return the calling thread's array for holding model output at location loc
+double **getModelArray(int loc) {
+  ModelScratch *scratch;
 
-    	  if (costFunction==0) {
-    		  thisSigma = sqrt(0.5); // set it to be the square root of 0.5 to cancel out the expression below if we aren't estimating sigma.
-    	  }
-    	  else {
-    		  thisSigma = sigmas[loc][i][dataNum];  /* Now set it to be the sigma value read in */
-    	  }
+  scratch = getModelScratch();
+  if (scratch->model[loc] == NULL)
+    scratch->model[loc] = make2DArray(scratchSteps[loc], scratchNumDataTypes);
 
-    	  //output thissigma to screen to debug
-    	  //fprintf(stdout,"thisSigma = %f\n\n", thisSigma);
-    	  // sigmas are read in and provide expected numbers but there are some missing data points??
-    	  //output residual to the screen
-    //	  	FILE *fp=stdout;
-    //	  	stdout=fopen("out-snap","w");
-    //	  	fprintf(stdout,"thisSigma = %f\n\n", thisSigma);
-    	  	//sometimes this results in the creation of an empty file - probably indicating that the sigmas are not being read in correctly
-    	  	//fprintf(stdout,"Square residual = %f\n\n", (pow((model[i][dataNum] - data[loc][i][dataNum]), 2)));
-    	  	//printf("Hello hello");
-    //	  	fclose(stdout);
+  return scratch->model[loc];
+}
 
-    //	  	stdout=fp;
 
-    	  sumSquares[dataNum] += (pow((model[i][dataNum] - data[loc][i][dataNum]), 2) / (2.0*thisSigma*thisSigma));
+// return the calling thread's array for holding aggregated model output at location loc
+// PRE: readFileForAgg has been called
+double **getAggedModelArray(int loc) {
+  ModelScratch *scratch;
 
-	n[dataNum]++;
-      }
+  scratch = getModelScratch();
+  if (scratch->aggedModel[loc] == NULL)
+    scratch->aggedModel[loc] = make2DArray(numAggSteps[loc], scratchNumDataTypes);
 
+  return scratch->aggedModel[loc];
+}
+
+
+/* return the calling thread's arrays for holding the model output at each observation at location loc:
+   array [dataNum] has room for obs[loc][dataNum].num values (and is aligned, like obs[loc][dataNum].value)
+*/
+double **getObsModelArrays(int loc) {
+  ModelScratch *scratch;
+  int dataNum;
+
+  scratch = getModelScratch();
+  if (scratch->obsModel[loc] == NULL) {
+    scratch->obsModel[loc] = (double **)malloc(scratchNumDataTypes * sizeof(double *));
+    for (dataNum = 0; dataNum < scratchNumDataTypes; dataNum++)
+      scratch->obsModel[loc][dataNum] = makeAlignedArray(obs[loc][dataNum].num);
+  }
+
+  return scratch->obsModel[loc];
+}
+
+
+/* pre: readData (and readFileForAgg, if we're aggregating) have been called
+   set up all of the calling thread's scratch space for evaluating points at locations locs[0..myNumLocs-1] now,
+   rather than as it's first needed, so evaluations there never allocate anything
+   If modelArrays is true, include the arrays for a whole model run's output, which difference and aggedDifference need
+   (fusedDifference and boundedDifference don't, and these can be big)
+*/
+void prepareModelScratch(int myNumLocs, int locs[], int modelArrays) {
+  int i, loc;
+
+  for (i = 0; i < myNumLocs; i++) {
+    loc = locs[i];
+    getObsModelArrays(loc);
+    if (modelArrays) {
+      getModelArray(loc);
+      if (numAggSteps != NULL) // we're aggregating
+	getAggedModelArray(loc);
     }
   }
-//(removed dm) sumSquares[dataNum] += pow((model[i][dataNum] - data[loc][i][dataNum]), 2);
+}
 
-  // calculate aggregate info on each data type
-  for (dataNum = 0; dataNum < numDataTypes; dataNum++)
-    aggregates(outputInfo, model, loc, dataNum);
+
+/* return the sum of squared, sigma-weighted errors over the observations in *dataObs,
+   given the model output at each observation in obsModel[0..dataObs->num-1]
+   With costFunction 0, don't use the sigmas read in from file: use sigma = sqrt(0.5) for every observation
+   The sum is done by sumWeightedSquares (vectorized, with a fixed summation order), so every difference function
+   that uses this gets exactly the same sums from the same model output
+*/
+double obsSumSquares(ObsList *dataObs, double *obsModel, int costFunction) {
+  if (costFunction == 0)
+    return sumWeightedSquares(obsModel, dataObs->value, NULL, dataObs->num) / cf0TwoVar;
+  else
+    return sumWeightedSquares(obsModel, dataObs->value, dataObs->invTwoVar, dataObs->num); // (dm) use the sigma values read in
+}
+
+
+/* Given sumSquares[0..numDataTypes-1] (sum of squared, sigma-weighted errors for each data type)
+   and n[0..numDataTypes-1] (number of data points used in each sumSquares),
+   return the difference between model and data (negative log likelihood, discarding constant terms) for the given costFunction
+   Also return best sigma value for each data type in sigma[0..numDataTypes-1]
+*/
+double sumSquaresToLogLike(double *sigma, double *sumSquares, int *n,
+			   int dataTypeIndices[], int numDataTypes, int costFunction, double dataTypeWeights[])
+{
+  int dataNum;
+  double logLike; // the log likelihood
 
   // Make sure we don't keep multiplying by zero for the product cost function
   if (costFunction ==3) {
@@ -200,21 +308,347 @@ double difference(double  *sigma, OutputInfo *outputInfo,
  *  (2.0*(sigma[dataNum])*(sigma[dataNum])
   */
 
+  return logLike;
+}
+
+
+/* Difference, version 4 - READS IN SIGMAS (dm) ESTIMATES SIGMA, RETURNS AGGREGATE INFO
+   Run modelF with given parameters at location loc, compare output with measured data
+   using data types given by dataTypeIndices[0..numDataTypes-1]
+   Return a measure of the difference between measured and predicted data
+   (Higher = worse)
+   Return best sigma value for each data type in sigma[0..numDataTypes-1]
+   Return mean error, mean daily-aggregated error, and yearly-aggregated output for each year
+   and each data type in *outputInfo array
+   Pre: sigma and outputInfo are already malloced, as are outputInfo[*].years arrays
+   outputInfo can be NULL, in which case we skip computing this aggregate info (see paramchange.h)
+
+   Only use "valid" data points (as determined by validFrac in readData)
+   And only use points between startOpt and endOpt (set in readData)
+   [IGNORE paramWeight - just there to be consistent with old difference function]
+
+   NOTE: this is actually the NEGATIVE log likelihood, discarding constant terms
+   to get true log likelihood, add n*log(sqrt(2*pi)), then multiply by -1
+*/
+/*Added read in ***sigmas
+ * removed ***sigma from double difference(double  *sigma, ***sigmas, OutputInfo *outputInfo,
+ *
+ */
+double difference(double  *sigma, OutputInfo *outputInfo,
+		  int loc, SpatialParams *spatialParams, double paramWeight,
+		  void (*modelF)(double **, int, int *, SpatialParams *, int),
+		  int dataTypeIndices[], int numDataTypes, int costFunction, double dataTypeWeights[])
+{
+  int j, dataNum;
+  double *sumSquares; // one sum of squares value for each data type
+  int *n; // number of data points used in each sumSquares
+  double logLike; // the log likelihood
+  ObsList *dataObs; // observations of the current data type
+  ModelScratch *scratch; // this thread's scratch space (so we don't allocate anything here)
+  double **model; // this thread's space for model output at this location
+  double **obsModel; // this thread's space for model output at each observation at this location
+  //FILE *dbg; //(dm) debug file
+  scratch = getModelScratch();
+  sumSquares = scratch->sumSquares;
+  n = scratch->n;
+
+  model = getModelArray(loc);
+  obsModel = getObsModelArrays(loc);
+  (*modelF)(model, numDataTypes, dataTypeIndices, spatialParams, loc);
+  // run model, put results in model array
+
+  // initialize sumSquares and count arrays
+
+  for (dataNum = 0; dataNum < numDataTypes; dataNum++) {
+    sumSquares[dataNum] = 0.0;
+    n[dataNum] = 0;
+  }
+
+
+  for (dataNum = 0; dataNum < numDataTypes; dataNum++) {
+    dataObs = &(obs[loc][dataNum]);
+    for (j = 0; j < dataObs->num; j++) // gather the model output at each observation, so it lines up with the observations
+      obsModel[dataNum][j] = model[dataObs->step[j]][dataNum];
+    sumSquares[dataNum] = obsSumSquares(dataObs, obsModel[dataNum], costFunction);
+    n[dataNum] = dataObs->num;
+  }
+//(removed dm) sumSquares[dataNum] += pow((model[i][dataNum] - data[loc][i][dataNum]), 2);
+
+  // calculate aggregate info on each data type (if anyone wants it)
+  if (outputInfo != NULL) {
+    for (dataNum = 0; dataNum < numDataTypes; dataNum++)
+      aggregates(outputInfo, model, loc, dataNum);
+  }
+
+  logLike = sumSquaresToLogLike(sigma, sumSquares, n, dataTypeIndices, numDataTypes, costFunction, dataTypeWeights);
+
   //debug;
   //dbg = openFile(outFileName, "w");
   //fprintf(stdout,"sumSquares = %f\n\n", sumSquares[dataNum]);
   //fprintf(dbg, "\n\n");
   //fclose(dbg);
 
-  free(sumSquares);
-  free(n);
-
   // NOTE: this is actually the NEGATIVE log likelihood, discarding constant terms
   // to get true log likelihood, add n*log(sqrt(2*pi)), then multiply by -1
 
   return logLike;
 }
 
+/* Running totals for a streamed model-data comparison (see streamDifference), updated after each model step
+   This holds everything that difference and aggregates compute from the model array,
+   so we never need to store more than one step of model output */
+typedef struct StreamInfoStruct {
+  int loc;
+  int numDataTypes;
+  int *dataTypeIndices;
+  double *dataTypeWeights;
+  int costFunction;
+  int checkBound; // if true, stop once the (costFunction 1) difference so far goes above maxDiff
+  double maxDiff;
+  int stopAfter; // number of steps we need to run (as in getStepsNeeded, but only the optimization window if outputInfo is NULL)
+  int lastStep; // index of the last step we've been given
+
+  double *sumSquares; /* one sum of squares value for each data type, so far
+			 (only kept up to date as we go if checkBound is set: otherwise it's computed at the end, from obsModel) */
+  int *n; // number of data points used in each sumSquares, so far (also the index of the next observation of each data type)
+  double **obsModel; // obsModel[dataNum][0..n[dataNum]-1]: model output at each observation so far (see getObsModelArrays)
+
+  // for the aggregate info (see aggregates); each of these is one value per data type:
+  OutputInfo *outputInfo; // NULL if we don't want the aggregate info (so we don't do the post-comparisons)
+  double *sumError; // sum of |model - data| so far
+  double *sumDaysError; // sum of |daily model - daily data| over days so far
+  double *dayModel, *dayData; // model and data totals for the current day, so far
+  double *yearModel; // model total for the current year, so far
+  int day; // index of current day (0 = first day of post-comparisons)
+  int stepsInDay; // number of steps done in the current day
+  int julianDay, year, leapYr, yearIndex; // current date and index into outputInfo[*].years
+} StreamInfo;
+
+
+// finish the current day in *info: add it to the daily error sums and the yearly totals, then move on to the next day
+void streamEndDay(StreamInfo *info) {
+  const int DAYS_IN_YR[] = {365,366}; // as in aggregates
+  int dataNum;
+
+  if (info->julianDay > DAYS_IN_YR[info->leapYr]) { // HAPPY NEW YEAR! Store the last year's totals first
+    for (dataNum = 0; dataNum < info->numDataTypes; dataNum++) {
+      info->outputInfo[dataNum].years[info->yearIndex] = info->yearModel[dataNum];
+      info->yearModel[dataNum] = 0.0;
+    }
+    info->julianDay = 1;
+    info->year++;
+    info->yearIndex++;
+    info->leapYr = (info->year % 4 == 0); // holds for 1900 < year < 2100
+  }
+
+  for (dataNum = 0; dataNum < info->numDataTypes; dataNum++) {
+    info->sumDaysError[dataNum] += fabs(info->dayModel[dataNum] - info->dayData[dataNum]);
+    info->yearModel[dataNum] += info->dayModel[dataNum];
+    info->dayModel[dataNum] = info->dayData[dataNum] = 0.0;
+  }
+
+  info->julianDay++;
+  info->day++;
+  info->stepsInDay = 0;
+}
+
+
+/* Called by runModelNoOutChecked after each model step, with modelStep holding the model output at (0-indexed) step i
+   Fold this step into the running totals in *streamInfo (a StreamInfo struct), and save the model output at any observations
+   All sums are done in the same order as in difference and aggregates, so they give exactly the same results
+   (the sums of squares are done at the end, from the saved model output, just like difference does them)
+   Return 0 (stop running) if we're checking a bound and the difference so far is greater than maxDiff,
+   or if later steps aren't used in either optimization or post-comparisons; 1 (keep going) otherwise
+*/
+int streamStep(double *modelStep, int i, void *streamInfo) {
+  StreamInfo *info = (StreamInfo *)streamInfo;
+  int loc = info->loc;
+  int dataNum, j;
+  ObsList *dataObs;
+  double err;
+  double logLike;
+  int keepGoing;
+
+  info->lastStep = i;
+  keepGoing = (i + 1 < info->stopAfter); // is there anything left to compare after this step?
+
+  // post-comparisons (as in aggregates):
+  if (info->outputInfo != NULL && i >= aggInfo[loc].startPt - 1 && i < aggInfo[loc].endPt) {
+    while (info->day < aggInfo[loc].numDays && info->stepsInDay == aggInfo[loc].spd[info->day]) // skip over any days without steps
+      streamEndDay(info);
+
+    for (dataNum = 0; dataNum < info->numDataTypes; dataNum++) {
+      info->sumError[dataNum] += fabs(modelStep[dataNum] - data[loc][i][dataNum]);
+      info->dayModel[dataNum] += modelStep[dataNum];
+      info->dayData[dataNum] += data[loc][i][dataNum];
+    }
+    info->stepsInDay++;
+
+    if (info->stepsInDay == aggInfo[loc].spd[info->day])
+      streamEndDay(info);
+  }
+
+  if (i < startOpt[loc] - 1 || i >= endOpt[loc]) // outside the optimization window: difference hasn't changed
+    return keepGoing;
+
+  // save the model output for any data types that have an observation at this step:
+  for (dataNum = 0; dataNum < info->numDataTypes; dataNum++) {
+    dataObs = &(obs[loc][dataNum]);
+    j = info->n[dataNum];
+    if (j < dataObs->num && dataObs->step[j] == i) {
+      info->obsModel[dataNum][j] = modelStep[dataNum];
+      if (info->checkBound) { // we need the sums of squares so far (costFunction 1) to check against the bound
+	err = modelStep[dataNum] - dataObs->value[j];
+	info->sumSquares[dataNum] += err*err * dataObs->invTwoVar[j];
+      }
+      info->n[dataNum]++;
+    }
+  }
+
+  if (!info->checkBound)
+    return keepGoing;
+
+  logLike = 0;
+  for (dataNum = 0; dataNum < info->numDataTypes; dataNum++)
+    logLike += info->dataTypeWeights[info->dataTypeIndices[dataNum]] * info->sumSquares[dataNum];
+
+  return keepGoing && (logLike <= info->maxDiff);
+}
+
+
+/* Run the model at location loc, streaming each step's output into the model-data comparison
+   (rather than storing all model output and then comparing), and return the difference
+   The model is only run as far as the end of the optimization and post-comparison windows (see getStepsNeeded)
+   If checkBound is true (only allowed for costFunction 1), stop the run as soon as the difference goes above maxDiff:
+   see boundedDifference
+   Otherwise, return exactly what difference would
+   Fill sigma and outputInfo like difference does (unless we stopped early)
+   If outputInfo is NULL, skip the post-comparisons, and only run the model to the end of the optimization window
+   Add the number of model steps we skipped because of checkBound to *stepsSaved
+   (this doesn't count the steps after the end of the optimization and post-comparison windows, which we never run)
+*/
+double streamDifference(double *sigma, OutputInfo *outputInfo, int loc, SpatialParams *spatialParams,
+			int dataTypeIndices[], int numDataTypes, int costFunction, double dataTypeWeights[],
+			int checkBound, double maxDiff, long *stepsSaved)
+{
+  StreamInfo info;
+  ModelScratch *scratch; // this thread's scratch space (so we don't allocate anything here)
+  int dataNum;
+  double logLike = 0.0;
+
+  scratch = getModelScratch();
+
+  info.loc = loc;
+  info.numDataTypes = numDataTypes;
+  info.dataTypeIndices = dataTypeIndices;
+  info.dataTypeWeights = dataTypeWeights;
+  info.costFunction = costFunction;
+  info.checkBound = checkBound;
+  info.maxDiff = maxDiff;
+  info.sumSquares = scratch->sumSquares;
+  info.n = scratch->n;
+  info.obsModel = getObsModelArrays(loc);
+
+  info.outputInfo = outputInfo;
+  info.sumError = scratch->sumError;
+  info.sumDaysError = scratch->sumDaysError;
+  info.dayModel = scratch->dayModel;
+  info.dayData = scratch->dayData;
+  info.yearModel = scratch->yearModel;
+  info.day = 0;
+  info.stepsInDay = 0;
+  info.julianDay = aggInfo[loc].startDay;
+  info.year = aggInfo[loc].startYear;
+  info.leapYr = (info.year % 4 == 0); // holds for 1900 < year < 2100
+  info.yearIndex = 0;
+  info.lastStep = -1;
+  info.stopAfter = (outputInfo != NULL) ? stopAfter[loc] : endOpt[loc];
+
+  for (dataNum = 0; dataNum < numDataTypes; dataNum++) {
+    info.sumSquares[dataNum] = 0.0;
+    info.n[dataNum] = 0;
+    info.sumError[dataNum] = info.sumDaysError[dataNum] = 0.0;
+    info.dayModel[dataNum] = info.dayData[dataNum] = info.yearModel[dataNum] = 0.0;
+  }
+
+  // run model, folding each step into the running totals as we go:
+  runModelNoOutChecked(NULL, numDataTypes, dataTypeIndices, spatialParams, loc, streamStep, &info);
+  *stepsSaved += info.stopAfter - (info.lastStep + 1);
+
+  if (checkBound) {
+    logLike = 0;
+    for (dataNum = 0; dataNum < numDataTypes; dataNum++)
+      logLike += dataTypeWeights[dataTypeIndices[dataNum]] * info.sumSquares[dataNum];
+  }
+
+  if (!checkBound || logLike <= maxDiff) { // we made it to the end: finish up as in difference and aggregates
+    if (outputInfo != NULL) {
+      while (info.day < aggInfo[loc].numDays) // finish any remaining days (there can only be days without steps left)
+	streamEndDay(&info);
+
+      for (dataNum = 0; dataNum < numDataTypes; dataNum++) {
+	outputInfo[dataNum].meanError = info.sumError[dataNum]/aggInfo[loc].numDays;
+	outputInfo[dataNum].daysError = info.sumDaysError[dataNum]/aggInfo[loc].numDays;
+	outputInfo[dataNum].years[info.yearIndex] = info.yearModel[dataNum]; // the last (possibly partial) year
+	outputInfo[dataNum].numYears = info.yearIndex + 1;
+      }
+    }
+
+    for (dataNum = 0; dataNum < numDataTypes; dataNum++) {
+      // the full sums of squares, done just as in difference (so any partial sums from checking the bound are replaced):
+      info.sumSquares[dataNum] = obsSumSquares(&(obs[loc][dataNum]), info.obsModel[dataNum], costFunction);
+    }
+
+    logLike = sumSquaresToLogLike(sigma, info.sumSquares, info.n, dataTypeIndices, numDataTypes, costFunction, dataTypeWeights);
+  }
+
+  return logLike;
+}
+
+
+/* Fused difference: same as difference (and gives exactly the same results),
+   but compares each step of model output with the data as soon as it is computed,
+   rather than storing all the model output in an array and then going through it again
+   Also stops the model run once we're past the end of the optimization and post-comparison windows (see getStepsNeeded)
+   - or just the optimization window, if outputInfo is NULL
+   [IGNORE paramWeight and modelF - just there to be consistent with difference function: we always run sipnet directly]
+*/
+double fusedDifference(double *sigma, OutputInfo *outputInfo,
+		       int loc, SpatialParams *spatialParams, double paramWeight,
+		       void (*modelF)(double **, int, int *, SpatialParams *, int),
+		       int dataTypeIndices[], int numDataTypes, int costFunction, double dataTypeWeights[])
+{
+  long stepsSaved = 0; // ignored
+
+  return streamDifference(sigma, outputInfo, loc, spatialParams, dataTypeIndices, numDataTypes, costFunction, dataTypeWeights,
+			  0, 0.0, &stepsSaved);
+}
+
+
+/* Bounded difference - for early rejection of a proposed parameter set
+   Same as difference with costFunction = 1 (where we use the sigmas read in from file),
+   but stop running the model as soon as the difference is known to be greater than maxDiff
+
+   This works because with costFunction = 1 (and non-negative dataTypeWeights), the difference is a weighted sum of squares,
+   which can only grow as we add more time steps: so once the partial sum is greater than maxDiff, so is the full sum
+
+   If we stopped early, return the partial difference (which is > maxDiff, and a lower bound on the full difference),
+   and leave sigma and outputInfo unset
+   (the partial sums are added in time order, the full sum pairwise, so they can differ by round-off:
+   metropolis allows for this with EARLY_REJECT_MARGIN)
+   Otherwise, return exactly what difference would (which is <= maxDiff), and fill sigma and outputInfo like difference does
+   In either case, add the number of model steps we skipped to *stepsSaved
+   (not counting the steps after the end of the optimization and post-comparison windows, which are never run:
+   see getStepsNeeded)
+*/
+double boundedDifference(double *sigma, OutputInfo *outputInfo, int loc, SpatialParams *spatialParams,
+			 int dataTypeIndices[], int numDataTypes, double dataTypeWeights[], double maxDiff, long *stepsSaved)
+{
+  return streamDifference(sigma, outputInfo, loc, spatialParams, dataTypeIndices, numDataTypes, 1, dataTypeWeights,
+			  1, maxDiff, stepsSaved);
+}
+
+
 /* Difference, version 3 - ESTIMATES SIGMA, RETURNS AGGREGATE INFO
    Run modelF with given parameters at location loc, compare output with measured data
    using data types given by dataTypeIndices[0..numDataTypes-1]
@@ -337,7 +771,6 @@ void computeAggedData(double **theAggedData, double **origArray, int myNumAggSte
 
    Pre: sigma and outputInfo are already malloced, as are outputInfo[*].years arrays
    global *numAggSteps, **aggSteps and ***aggedData have all been set appropriately,
-   and global **aggedModel has been malloced appropriately
    numDataTypes is actually TWICE the number of data types
    (for each data type, one unaggregated and one aggregated)
 
@@ -354,14 +787,22 @@ double aggedDifference(double *sigma, OutputInfo *outputInfo,
 		       void (*modelF)(double **, int, int *, SpatialParams *, int),
 		       int dataTypeIndices[], int numDataTypes, int costFunction, double dataTypeWeights[])
 {
-  int i, dataNum;
+  int i, j, dataNum;
   double *sumSquares; // one sum of squares value for each data type
   int *n; // number of data points used in each sumSquares
   double logLike; // the log likelihood
-
-  sumSquares = makeArray(numDataTypes);
-  n = (int *)malloc(numDataTypes * sizeof(int));
-
+  ObsList *dataObs; // observations of the current data type
+  ModelScratch *scratch; // this thread's scratch space (so we don't allocate anything here)
+  double **model, **aggedModel; // this thread's space for model output at this location
+  double **obsModel; // this thread's space for model output at each observation at this location
+
+  scratch = getModelScratch();
+  sumSquares = scratch->sumSquares;
+  n = scratch->n;
+
+  model = getModelArray(loc);
+  aggedModel = getAggedModelArray(loc);
+  obsModel = getObsModelArrays(loc);
   (*modelF)(model, numDataTypes/2, dataTypeIndices, spatialParams, loc);
   // run model, put results in model array
   // divide numDataTypes by 2 so we have actual (unbifurcated) number of data types
@@ -376,13 +817,12 @@ double aggedDifference(double *sigma, OutputInfo *outputInfo,
   }
 
   // compute sum of squares on unaggregated data:
-  for (i = startOpt[loc] - 1; i < endOpt[loc]; i++) {
-    for (dataNum = 0; dataNum < numDataTypes/2; dataNum++) {
-      if (valid[loc][i][dataNum]) {
-	sumSquares[dataNum] += pow((model[i][dataNum] - data[loc][i][dataNum]), 2);
-	n[dataNum]++;
-      }
-    }
+  for (dataNum = 0; dataNum < numDataTypes/2; dataNum++) {
+    dataObs = &(obs[loc][dataNum]);
+    for (j = 0; j < dataObs->num; j++)
+      obsModel[dataNum][j] = model[dataObs->step[j]][dataNum];
+    sumSquares[dataNum] = sumWeightedSquares(obsModel[dataNum], dataObs->value, NULL, dataObs->num); // unweighted
+    n[dataNum] = dataObs->num;
   }
 
   // compute sum of squares on aggregated data (note: we don't check validity here - instead use all points):
@@ -393,8 +833,8 @@ double aggedDifference(double *sigma, OutputInfo *outputInfo,
     }
   }
 
-  // calculate aggregate info on each data type
-  for (dataNum = 0; dataNum < numDataTypes/2; dataNum++) {
+  // calculate aggregate info on each data type (if anyone wants it)
+  for (dataNum = 0; dataNum < numDataTypes/2 && outputInfo != NULL; dataNum++) {
     aggregates(outputInfo, model, loc, dataNum);
 
     // copy aggregate info from position i to position (numDataTypes/2 + i)
@@ -417,9 +857,6 @@ double aggedDifference(double *sigma, OutputInfo *outputInfo,
       logLike *= unaggedWeight;
   }
 
-  free(sumSquares);
-  free(n);
-
   // NOTE: this is actually the NEGATIVE log likelihood, discarding constant terms
 
   return logLike;
@@ -442,13 +879,13 @@ void aggregates(OutputInfo *outputInfo, double **model, int loc, int dataNum)
   int i, j, day, julianDay, year;
   int leapYr; // 1 if this is a leap year
   int index;
-  double *modelD, *dataD; // daily aggregations
+  double *modelD, *dataD; // daily aggregations (in this thread's scratch space, so we don't allocate anything here)
   int yearIndex; // starting at 0 rather than being a 4-digit year
   double sum;
   double netNeeM, netNeeD; // net model and data nee for this aggregated step
 
-  modelD = makeArray(aggInfo[loc].numDays);
-  dataD = makeArray(aggInfo[loc].numDays);
+  modelD = getModelScratch()->modelD;
+  dataD = getModelScratch()->dataD;
 
   sum = 0.0;
   for (i = aggInfo[loc].startPt - 1; i < aggInfo[loc].endPt; i++) {
@@ -502,9 +939,6 @@ void aggregates(OutputInfo *outputInfo, double **model, int loc, int dataNum)
     leapYr = (year % 4 == 0); // holds for 1900 < year < 2100
   }
   outputInfo[dataNum].numYears = yearIndex; // the actual number of years
-
-  free(modelD);
-  free(dataD);
 }
 
 
@@ -602,8 +1036,21 @@ void readIndicesFile(char *fileName, int *startIndices, int *endIndices, int num
 }
 
 
-/* Read measured data (from fileName.dat) and valid fractions (from fileName.valid) into arrays (used to also read sigmas)
-   and set values in valid array (based on validFrac)
+// return a new aligned array (see makeAlignedArray) holding arr[0..size-1], and free arr
+double *shrinkAlignedArray(double *arr, int size) {
+  double *newArr;
+
+  newArr = makeAlignedArray(size);
+  memcpy(newArr, arr, size * sizeof(double));
+  free(arr);
+
+  return newArr;
+}
+
+
+/* Read measured data (from fileName.dat), valid fractions (from fileName.valid) and (dm) sigmas (from fileName.sigma),
+   and make the list of observations used in optimization at each location, for each data type
+   (the valid points, based on validFrac, between the optimization start and end indices: see ObsList)
    Each line in data (and valid) file has totNumDataTypes columns
    and each file has one line for each time step at each of the myNumLocs location (all time steps for a single location are continuous),
    with NO blank lines
@@ -622,7 +1069,7 @@ void readIndicesFile(char *fileName, int *startIndices, int *endIndices, int num
 
    steps is an array giving the number of time steps at each of the myNumLocs locations
 
-   This function also allocates space for model array
+   This function also sets up the scratch space for model output used by difference and aggedDifference
 */
 void readData(char *fileName, int dataTypeIndices[], int numDataTypes, int totNumDataTypes, int myNumLocs, int *steps,
 	      double validFrac, char *optIndicesFile, char *compareIndicesFile, FILE *outFile)
@@ -637,6 +1084,9 @@ void readData(char *fileName, int dataTypeIndices[], int numDataTypes, int totNu
   double *oneLine; // data from one line of a file
   int totSteps, maxSteps; // total number of time steps (sum over all locations), maximum number of time steps at any location
   int numData;
+  int numOptSteps; // number of time steps in the optimization window at the current location
+  int *isValid; // for the current time step, is each data type we're using valid?
+  ObsList *dataObs;
   int i, loc;
   char spdString[32]; // store one # from spd file (in a string to allow for shorthands like #<n>)
   int count, startCount;
@@ -675,17 +1125,34 @@ void readData(char *fileName, int dataTypeIndices[], int numDataTypes, int totNu
   data = (double ***)malloc(numLocs * sizeof(double **));
   for (loc = 0; loc < numLocs; loc++)
     data[loc] = make2DArray(steps[loc], numDataTypes); // make 2-d array just big enough for known # of time steps in this location
-  model = make2DArray(numData, numDataTypes);
-
-  //  (dm) added code to read sigmas for each time step and each data type
-  sigmas = (double ***)malloc(numLocs * sizeof(double **));
+  // set up scratch space for model output (each thread's is allocated when it's first needed):
+  pthread_key_create(&scratchKey, deleteModelScratch);
+  scratchSteps = (int *)malloc(numLocs * sizeof(int));
   for (loc = 0; loc < numLocs; loc++)
-    sigmas[loc] = make2DArray(steps[loc], numDataTypes); // make 2-d array just big enough for known # of time steps in this location
+    scratchSteps[loc] = steps[loc];
+  scratchNumDataTypes = numDataTypes;
+
+  startOpt = (int *)malloc(numLocs * sizeof(int));
+  endOpt = (int *)malloc(numLocs * sizeof(int));
+  readIndicesFile(optIndicesFile, startOpt, endOpt, numLocs, steps);
+
+  /* observations used in optimization: for each location and data type, just the valid points between startOpt and endOpt,
+     with their (dm) sigmas (we start with room for every step in the optimization window, then shrink to fit) */
+  obs = (ObsList **)malloc(numLocs * sizeof(ObsList *));
+  for (loc = 0; loc < numLocs; loc++) {
+    obs[loc] = (ObsList *)malloc(numDataTypes * sizeof(ObsList));
+    numOptSteps = (endOpt[loc] >= startOpt[loc]) ? (endOpt[loc] - startOpt[loc] + 1) : 0;
+    for (i = 0; i < numDataTypes; i++) {
+      obs[loc][i].num = 0;
+      obs[loc][i].step = (int *)malloc((numOptSteps + 1) * sizeof(int)); // + 1 so we never malloc 0
+      obs[loc][i].value = makeAlignedArray(numOptSteps);
+      obs[loc][i].invTwoVar = makeAlignedArray(numOptSteps);
+    }
+  }
+  cf0TwoVar = 2.0*sqrt(0.5)*sqrt(0.5);
 
-  valid = (int ***)malloc(numLocs * sizeof(int **));
-  for (loc = 0; loc < numLocs; loc++)
-    valid[loc] = make2DIntArray(numData, numDataTypes); // make 2-d array just big enough for known # of time steps in this location
   oneLine = makeArray(totNumDataTypes);
+  isValid = (int *)malloc(numDataTypes * sizeof(int));
 
   for (loc = 0; loc < numLocs; loc++) {
     for (index = 0; index < steps[loc]; index++) {
@@ -695,26 +1162,41 @@ void readData(char *fileName, int dataTypeIndices[], int numDataTypes, int totNu
 	data[loc][index][i] = oneLine[dataTypeIndices[i]];
 
       readDataLine(in2, oneLine, totNumDataTypes); // read valid file
-      // assign valid elements appropriately, based on which data types we're using:
+      // decide which data types are valid here, based on which data types we're using:
       for (i = 0; i < numDataTypes; i++)
-	valid[loc][index][i] = (oneLine[dataTypeIndices[i]] >= validFrac);
+	isValid[i] = (oneLine[dataTypeIndices[i]] >= validFrac);
 
       readDataLine(in3, oneLine, totNumDataTypes); // read sigmas file
-      // assign sigmas elements appropriately, based on which data types we're using:
-      for (i = 0; i < numDataTypes; i++)
-    	  sigmas[loc][index][i] = oneLine[dataTypeIndices[i]];
+      if (index < startOpt[loc] - 1 || index >= endOpt[loc]) // outside the optimization window
+	continue;
+      // add an observation for each valid data type we're using:
+      for (i = 0; i < numDataTypes; i++) {
+	if (isValid[i]) {
+	  dataObs = &(obs[loc][i]);
+	  dataObs->step[dataObs->num] = index;
+	  dataObs->value[dataObs->num] = data[loc][index][i];
+	  dataObs->invTwoVar[dataObs->num] = 1.0/(2.0*oneLine[dataTypeIndices[i]]*oneLine[dataTypeIndices[i]]);
+	  dataObs->num++;
+	}
+      }
+    }
+  }
+
+  for (loc = 0; loc < numLocs; loc++) {
+    for (i = 0; i < numDataTypes; i++) {
+      dataObs = &(obs[loc][i]);
+      dataObs->step = (int *)realloc(dataObs->step, (dataObs->num + 1) * sizeof(int));
+      dataObs->value = shrinkAlignedArray(dataObs->value, dataObs->num); // (realloc wouldn't keep the alignment)
+      dataObs->invTwoVar = shrinkAlignedArray(dataObs->invTwoVar, dataObs->num);
     }
   }
 
   free(oneLine);
+  free(isValid);
   fclose(in1);
   fclose(in2);
   fclose(in3);
 
-  startOpt = (int *)malloc(numLocs * sizeof(int));
-  endOpt = (int *)malloc(numLocs * sizeof(int));
-  readIndicesFile(optIndicesFile, startOpt, endOpt, numLocs, steps);
-
   // now find start day, start year, and steps per day
 
   aggInfo = (AggregateInfo *)malloc(numLocs * sizeof(AggregateInfo));
@@ -729,6 +1211,10 @@ void readData(char *fileName, int dataTypeIndices[], int numDataTypes, int totNu
   free(tempStartCompare);
   free(tempEndCompare);
 
+  stopAfter = (int *)malloc(numLocs * sizeof(int));
+  for (loc = 0; loc < numLocs; loc++)
+    stopAfter[loc] = (endOpt[loc] > aggInfo[loc].endPt) ? endOpt[loc] : aggInfo[loc].endPt;
+
   in1 = openFile(spdFile, "r");
   for (loc = 0; loc < numLocs; loc++) {
     aggInfo[loc].numDays = 0;
@@ -855,6 +1341,46 @@ void readData(char *fileName, int dataTypeIndices[], int numDataTypes, int totNu
 }
 
 
+/* pre: readData has been called
+   return the number of time steps the model needs to be run for at location loc,
+   for both optimization and post-comparisons (i.e. the end of whichever of these windows is later)
+   fusedDifference and boundedDifference only run the model this far
+*/
+int getStepsNeeded(int loc) {
+  return stopAfter[loc];
+}
+
+
+/* pre: readData has been called
+   return the number of years in the post-comparison window at location loc:
+   the number of years of aggregate info the difference functions put in outputInfo[*].years (i.e. outputInfo[*].numYears)
+   (counted the same way as in aggregates)
+*/
+int getNumYears(int loc) {
+  const int DAYS_IN_YR[] = {365,366}; // as in aggregates
+  int day, julianDay, year, leapYr;
+  int numYears;
+
+  day = 0;
+  julianDay = aggInfo[loc].startDay;
+  year = aggInfo[loc].startYear;
+  leapYr = (year % 4 == 0); // holds for 1900 < year < 2100
+  numYears = 0;
+  while (day < aggInfo[loc].numDays) {
+    while (julianDay <= DAYS_IN_YR[leapYr] && day < aggInfo[loc].numDays) { // loop through current year
+      day++;
+      julianDay++;
+    }
+    julianDay = 1;
+    year++;
+    numYears++;
+    leapYr = (year % 4 == 0);
+  }
+
+  return numYears;
+}
+
+
 /* pre: readData has been called (to set global startOpt, endOpt and numLocs appropriately)
 
    read number of time steps per each model-data aggregation from file
@@ -872,7 +1398,7 @@ void readData(char *fileName, int dataTypeIndices[], int numDataTypes, int totNu
 */
 void readFileForAgg(char *fileForAgg, int numDataTypes, double myUnaggedWeight) {
   FILE *f;
-  int curr, sum, count, maxCount;
+  int curr, sum, count;
   int i, loc;
   long filePos; // so we can rewind to a previous location in the file
 
@@ -882,7 +1408,6 @@ void readFileForAgg(char *fileForAgg, int numDataTypes, double myUnaggedWeight)
 
   f = openFile(fileForAgg, "r");
 
-  maxCount = 0;
   for (loc = 0; loc < numLocs; loc++) {
     // first, find number of agged steps in this location:
     filePos = ftell(f); // save current location
@@ -894,8 +1419,6 @@ void readFileForAgg(char *fileForAgg, int numDataTypes, double myUnaggedWeight)
     }
     numAggSteps[loc] = count;
     aggSteps[loc] = (int *)malloc(count * sizeof(int));
-    if (count > maxCount)
-      maxCount = count;
 
     // now fill aggSteps[loc] vector
     fseek(f, filePos, SEEK_SET); // rewind to beginning of this location (SEEK_SET makes offset from start of file)
@@ -919,7 +1442,6 @@ void readFileForAgg(char *fileForAgg, int numDataTypes, double myUnaggedWeight)
 
   fclose(f);
 
-  aggedModel = make2DArray(maxCount, numDataTypes);
   unaggedWeight = myUnaggedWeight;
 }
 
@@ -966,25 +1488,33 @@ void freeOutputInfo(OutputInfo *outputInfo, int numDataTypes) {
 // call this when done program:
 // free space used by global pointers
 void cleanupParamchange() {
-  int loc;
+  int loc, i;
 
   for (loc = 0; loc < numLocs; loc++)
     free2DArray((void **)data[loc]);
   free(data);
 
-  free2DArray((void **)model);
+  if (pthread_getspecific(scratchKey) != NULL) { // free this thread's scratch space (other threads' is freed when they exit)
+    deleteModelScratch(pthread_getspecific(scratchKey));
+    pthread_setspecific(scratchKey, NULL);
+  }
+  pthread_key_delete(scratchKey);
+  free(scratchSteps);
 
   free(startOpt);
   free(endOpt);
+  free(stopAfter);
 
-  for (loc = 0; loc < numLocs; loc++)
-    free2DArray((void **)valid[loc]);
-  free(valid);
-
-  // JZ ADD: Free sigma values
-  for (loc = 0; loc < numLocs; loc++)
-    free2DArray((void **)sigmas[loc]);
-  free(sigmas);
+  // free observations (including sigma values):
+  for (loc = 0; loc < numLocs; loc++) {
+    for (i = 0; i < scratchNumDataTypes; i++) { // (the number of data types read in readData)
+      free(obs[loc][i].step);
+      free(obs[loc][i].value);
+      free(obs[loc][i].invTwoVar);
+    }
+    free(obs[loc]);
+  }
+  free(obs);
 
   for (loc = 0; loc < numLocs; loc++)
     free(aggInfo[loc].spd);
@@ -1004,8 +1534,5 @@ void cleanupParamchange() {
       free2DArray((void **)aggedData[loc]);
     free(aggedData);
   }
-
-  if (aggedModel != NULL) // we've malloced it
-    free2DArray((void **)aggedModel);
 }
 
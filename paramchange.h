@@ -31,6 +31,9 @@ typedef struct OutputInfoStruct {
    Return mean error, mean daily-aggregated error, and yearly-aggregated output for each year
    and each data type in *outputInfo array
    Pre: sigma and outputInfo are already malloced, as are outputInfo[*].years arrays
+   outputInfo can be NULL, in which case we skip computing this aggregate info
+   (which is only needed for points that will be written out), and the difference is the same
+   (this goes for all the difference functions below, too)
 
    Only use "valid" data points (as determined by validFrac in readData)
    And only use points between startOpt and endOpt (set in readData)
@@ -38,6 +41,10 @@ typedef struct OutputInfoStruct {
 
    NOTE: this is actually the NEGATIVE log likelihood, discarding constant terms
    to get true log likelihood, add n*log(sqrt(2*pi)), then multiply by -1
+
+   Each thread has its own space for model output, so this (like fusedDifference, boundedDifference and aggedDifference)
+   can be called from several threads at once, even for the same location - as long as modelF can be
+   (runModelNoOut can: each thread gets its own default model context)
 */
 double difference(double *sigma, OutputInfo *outputInfo,
 		  int loc, SpatialParams *spatialParams, double paramWeight,
@@ -46,6 +53,36 @@ double difference(double *sigma, OutputInfo *outputInfo,
 
 
 
+/* Fused difference: same as difference (and gives exactly the same results),
+   but compares each step of model output with the data as soon as it is computed,
+   rather than storing all the model output in an array and then going through it again
+   (so avoids filling and re-reading the model array, which is (# steps) x numDataTypes)
+   Also stops the model run once we're past the end of the optimization and post-comparison windows (see getStepsNeeded)
+   - or just the optimization window, if outputInfo is NULL
+   [IGNORE paramWeight and modelF - just there to be consistent with difference function: we always run sipnet directly]
+*/
+double fusedDifference(double *sigma, OutputInfo *outputInfo,
+		       int loc, SpatialParams *spatialParams, double paramWeight,
+		       void (*modelF)(double **, int, int *, SpatialParams *, int),
+		       int dataTypeIndices[], int numDataTypes, int costFunction, double dataTypeWeights[]);
+
+
+
+/* Bounded difference - for early rejection of a proposed parameter set
+   Same as difference with costFunction = 1 (where we use the sigmas read in from file),
+   but stop running the model as soon as the difference is known to be greater than maxDiff
+   (with costFunction = 1 and non-negative dataTypeWeights, the difference can only grow as we add more time steps)
+
+   If we stopped early, return the partial difference (which is > maxDiff, and a lower bound on the full difference),
+   and leave sigma and outputInfo unset
+   Otherwise, return exactly what difference would (which is <= maxDiff), and fill sigma and outputInfo like difference does
+   In either case, add the number of model steps we skipped to *stepsSaved
+*/
+double boundedDifference(double *sigma, OutputInfo *outputInfo, int loc, SpatialParams *spatialParams,
+			 int dataTypeIndices[], int numDataTypes, double dataTypeWeights[], double maxDiff, long *stepsSaved);
+
+
+
 /* Aggregated difference - ESTIMATES SIGMA, RETURNS AGGREGATE INFO
    Same as difference function above, but aggregates model output to fewer steps
    Total difference is a weighted sum of error on aggregated output vs. data
@@ -65,7 +102,7 @@ double difference(double *sigma, OutputInfo *outputInfo,
 
    Pre: sigma and outputInfo are already malloced, as are outputInfo[*].years arrays
    global *numAggSteps, **aggSteps and ***aggedData have all been set appropriately,
-   and global **aggedModel has been malloced appropriately
+   and global ***aggedModel has been malloced appropriately
    numDataTypes is actually TWICE the number of data types
    (for each data type, one unaggregated and one aggregated)
 
@@ -95,8 +132,10 @@ void aggregates(OutputInfo *outputInfo, double **model, int loc, int dataNum);
 
 
 
-/* Read measured data (from fileName.dat) and valid fractions (from fileName.valid) into arrays (used to also read sigmas)
-   and set values in valid array (based on validFrac)
+/* Read measured data (from fileName.dat), valid fractions (from fileName.valid) and (dm) sigmas (from fileName.sigma),
+   and make the list of observations used in optimization at each location, for each data type
+   (the valid points, based on validFrac, between the optimization start and end indices), so the difference functions
+   only visit real observations
    Each line in data (and valid) file has totNumDataTypes columns
    and each file has one line for each time step at each of the myNumLocs location (all time steps for a single location are continuous),
    with NO blank lines
@@ -121,6 +160,30 @@ void readData(char *fileName, int dataTypeIndices[], int numDataTypes, int totNu
 	      double validFrac, char *optIndicesFile, char *compareIndicesFile, FILE *outFile);
 
 
+/* pre: readData has been called
+   return the number of time steps the model needs to be run for at location loc,
+   for both optimization and post-comparisons (i.e. the end of whichever of these windows is later)
+   fusedDifference and boundedDifference only run the model this far
+*/
+int getStepsNeeded(int loc);
+
+
+/* pre: readData has been called
+   return the number of years in the post-comparison window at location loc:
+   the number of years of aggregate info the difference functions put in outputInfo[*].years (i.e. outputInfo[*].numYears)
+*/
+int getNumYears(int loc);
+
+
+/* pre: readData (and readFileForAgg, if we're aggregating) have been called
+   set up all of the calling thread's scratch space for evaluating points at locations locs[0..myNumLocs-1] now,
+   rather than as it's first needed, so evaluations there never allocate anything
+   If modelArrays is true, include the arrays for a whole model run's output, which difference and aggedDifference need
+   (fusedDifference and boundedDifference don't, and these can be big)
+*/
+void prepareModelScratch(int myNumLocs, int locs[], int modelArrays);
+
+
 /* pre: readData has been called (to set global startOpt, endOpt and numLocs appropriately)
 
    read number of time steps per each model-data aggregation from file
@@ -13,11 +13,21 @@
 #include <string.h>
 #include <stdlib.h>
 #include <math.h>
+#include <limits.h>
+#include <ctype.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <pthread.h>
 #include "sipnet.h"
 #include "runmean.h"
 #include "util.h"
 #include "spatialParams.h"
 #include "outputItems.h"
+#include "asyncOutput.h"
+#include "binaryOutput.h"
+#include "ensembleKernel.h"
 
 // begin definitions for choosing different model structures
 // (1 -> true, 0 -> false)
@@ -156,42 +166,78 @@
 
 #define TINY 0.000001 // to avoid those nasty divide-by-zero errors
 
+#define CLIMATE_INIT_STEPS 1024 // initial number of time steps allocated for each location's climate arrays (grows as needed)
+
+#define CLIMATE_CACHE 1 // read climate from / write climate to a binary cache (climFile + "bin"), to avoid re-parsing climFile?
+#define CLIMBIN_MAGIC "SIPCLIM" // identifies a binary climate cache file
+#define CLIMBIN_VERSION 1 // increment this whenever the format or contents of the binary climate cache change
+#define CLIMBIN_NUM_DOUBLES (11 + (GDD)) // number of double arrays per location in the binary climate cache
+#define CLIMIDX_MAGIC "SIPCIDX" // identifies a climate location index file (climFile + "idx"; only written if CLIMATE_CACHE)
+#define CLIMIDX_LINE_LEN 1024 // length of buffer for reading lines of the climate file when building the location index
+#define CLIM_RECORD_FIELDS 14 // number of values in each climate record (each line of the climate file)
+#define CLIMATE_PREFETCH 1 /* when climate is loaded lazily and we run everywhere, read the next location's climate
+			      on a background thread while the current location runs? */
+#define CLIMATE_PREFETCH_SLOTS 2 /* number of locations' climate held at once when prefetching:
+				    the one being run, and up to (this - 1) read ahead of it */
+
+// loading state of each location's climate, when climate is loaded lazily:
+#define CLIM_NOT_LOADED 0
+#define CLIM_LOADING 1 // being read by some thread (others needing it wait on climLoaded)
+#define CLIM_LOADED 2
+
+// number of values on each line written by outputState, after loc, year, day and time:
+#if SOIL_MULTIPOOL
+#define NUM_OUTPUT_STATE_VALUES (24 + NUMBER_SOIL_CARBON_POOLS)
+#else
+#define NUM_OUTPUT_STATE_VALUES 24
+#endif
+
+#if 4 + NUM_OUTPUT_STATE_VALUES > MAX_OUTPUT_COLUMNS
+#error "MAX_OUTPUT_COLUMNS (sipnet.h) is too small for the main output"
+#endif
+
+#define BINARY_OUTPUT_CHUNK_STEPS 4096 // maximum number of time steps in each chunk of binary output (see binaryOutput.h)
+
+// types of record passed to the output writer thread by runModelOutputAsync:
+#define OUTPUT_RECORD_STEP 0 // one time step's output
+#define OUTPUT_RECORD_LABEL 1 // label at the start of each output item's line
+#define OUTPUT_RECORD_END_LINE 2 // end of each output item's line
+
 // end constant definitions
 
-// linked list of climate variables
-// one node for each time step
+// climate variables for one spatial location, stored as one array per variable
+// element i of each array holds the climate for time step i
 // these climate data are read in from a file
 
-typedef struct ClimateVars ClimateNode;
-
-struct ClimateVars {
-  int year; // year of start of this timestep
-  int day; // day of start of this timestep (1 = Jan 1.)
-  double time; // time of start of this timestep (hour.fraction - e.g. noon = 12.0, midnight = 0.0)
-  double length; // length of this timestep (in days) - allow variable-length timesteps
-  double tair; // avg. air temp for this time step (degrees C)
-  double tsoil; // avg. soil temp for this time step (degrees C)
-  double par; /* average par for this time step (Einsteins * m^-2 ground area * day^-1)
-		NOTE: input is in Einsteins * m^-2 ground area, summed over entire time step */
-  double precip; /* total precip. for this time step (cm water equiv. - either rain or snow)
-		    NOTE: input is in mm */
-  double vpd; /* average vapor pressure deficit (kPa)
-		 NOTE: input is in Pa */
-  double vpdSoil; /* average vapor pressure deficit between soil and air (kPa)
-		     NOTE: input is in Pa
-		     differs from vpd in that saturation vapor pressure calculated using Tsoil rather than Tair */
-  double vPress; /* average vapor pressure in canopy airspace (kPa)
-		    NOTE: input is in Pa */
-  double wspd; // avg. wind speed (m/s)
-  double soilWetness; // fractional soil wetness (fraction of saturation - between 0 and 1)
+typedef struct ClimateArraysStruct {
+  int numSteps; // number of time steps (0 means no climate data for this location)
+  int maxSteps; // number of elements allocated in each array
+
+  int *year; // year of start of this timestep
+  int *day; // day of start of this timestep (1 = Jan 1.)
+  double *time; // time of start of this timestep (hour.fraction - e.g. noon = 12.0, midnight = 0.0)
+  double *length; // length of this timestep (in days) - allow variable-length timesteps
+  double *tair; // avg. air temp for this time step (degrees C)
+  double *tsoil; // avg. soil temp for this time step (degrees C)
+  double *par; /* average par for this time step (Einsteins * m^-2 ground area * day^-1)
+		  NOTE: input is in Einsteins * m^-2 ground area, summed over entire time step */
+  double *precip; /* total precip. for this time step (cm water equiv. - either rain or snow)
+		     NOTE: input is in mm */
+  double *vpd; /* average vapor pressure deficit (kPa)
+		  NOTE: input is in Pa */
+  double *vpdSoil; /* average vapor pressure deficit between soil and air (kPa)
+		      NOTE: input is in Pa
+		      differs from vpd in that saturation vapor pressure calculated using Tsoil rather than Tair */
+  double *vPress; /* average vapor pressure in canopy airspace (kPa)
+		     NOTE: input is in Pa */
+  double *wspd; // avg. wind speed (m/s)
+  double *soilWetness; // fractional soil wetness (fraction of saturation - between 0 and 1)
 
 #if GDD
-  double gdd; /* growing degree days from Jan. 1 to now
-		 NOTE: Calculated, *not* read from file */
+  double *gdd; /* growing degree days from Jan. 1 to now
+		  NOTE: Calculated, *not* read from file */
 #endif
-
-  ClimateNode *nextClim;
-};
+} ClimateArrays;
 
 
 // model parameters which can change from one run to the next
@@ -470,27 +516,169 @@ typedef struct PhenologyTrackersStruct { /* variables to track each year's pheno
 // made global so they can be initialized in a separate function
 // so they only have to be initialized once
 
-static ClimateNode **firstClimates; // a vector of pointers to first climates of each point in space
+static ClimateArrays *allClimates; // a vector of climate arrays, one element for each point in space
+
+/* if climate is loaded lazily (see initModelLocs), the offset in the climate file and number of time steps of each location
+   (NULL if all climate was read up front); allClimates[loc] is then empty (numSteps = 0) until location loc is first needed
+   climLock protects climState; a location's climate is read without holding the lock (so reading one location
+   doesn't hold up threads using others), with its state set to CLIM_LOADING meanwhile */
+static struct ClimbinLocEntryStruct *climIndex = NULL;
+static char climIndexFile[1024]; // the text climate file that climIndex refers to
+static int *climState = NULL; // loading state of each location's climate (CLIM_NOT_LOADED, etc.)
+static pthread_mutex_t climLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t climLoaded = PTHREAD_COND_INITIALIZER; // broadcast whenever a location finishes loading
+
+static int numRunLocs = 0; /* if > 0, a run everywhere only runs at locations runLocs[0..numRunLocs-1], in that order
+			      (see setRunLocations); if 0, it runs at every location */
+static int *runLocs = NULL;
+
+static Params paramLayout; /* never written: spatialParams' externalLoc pointers point into this structure,
+			      and are used only to find where each parameter lives within a Params structure
+			      (values are then loaded into the Params of a given SipnetContext) */
+
+// all the state of a single model run
+// the model functions get this passed in rather than using globals,
+// so that several runs can be going at once (sharing read-only climate and parameter data)
+struct SipnetContextStruct {
+  Params params;
+  Envi envi; // state variables
+  Trackers trackers;
+  PhenologyTrackers phenologyTrackers;
+  MeanTracker *meanNPP; // running mean of NPP over some fixed time (stored in g C * m^-2 * day^-1)
+  MeanTracker *meanGPP; // running mean of GPP over some fixed time for linkages (stored in g C * m^-2 * day^-1)
+  MeanTracker *meanFPAR; // running mean of FPAR of some fixed time for MODIS
+
+  ClimateArrays *clim; // climate for the location we're running at
+  int step; // index of current time step into the arrays in clim
+  Fluxes fluxes;
+  double *outputPtrs[MAX_DATA_TYPES]; // pointers to different possible outputs (into this context's trackers)
+  int lastYear; // year of the last step, for resetting yearly trackers (used in updateTrackers)
+};
+
+// a batch of model runs that are stepped through the same location's climate together (see runEnsembleNoOut)
+struct SipnetEnsembleStruct {
+  int maxMembers;
+  SipnetContext **members; // each member's state, parameters and trackers
+  PsnParamArrays *psnParams; // photosynthesis parameters of all members, as a structure of arrays for ensemblePotPsn
+  // each member's values in the current time step:
+  double *lai, *potGrossPsn, *baseFolResp, *fAPAR;
+};
+
+// the context used by the non-context functions (runModelOutput, runModelNoOut, etc.): see getDefaultContext
+// each thread has its own, so these functions can be called from several threads at once
+static pthread_key_t defaultContextKey;
+
+
+// called when a thread exits: free that thread's default context
+void deleteDefaultContext(void *ctx) {
+  deleteSipnetContext((SipnetContext *)ctx);
+}
+
+
+/* return the calling thread's default context, creating it if this thread doesn't have one yet
+   The main thread's default context is created in initModel and deleted in cleanupModel;
+   other threads' are created when first needed, and deleted when the thread exits
+*/
+SipnetContext *getDefaultContext(void) {
+  SipnetContext *ctx;
+
+  ctx = (SipnetContext *)pthread_getspecific(defaultContextKey);
+  if (ctx == NULL) {
+    ctx = newSipnetContext();
+    pthread_setspecific(defaultContextKey, ctx);
+  }
+
+  return ctx;
+}
+
+
+
+/* Resize each array in clim to hold maxSteps time steps, keeping existing values
+   (can be used to either grow or shrink the arrays; maxSteps must be > 0)
+*/
+void resizeClimateArrays(ClimateArrays *clim, int maxSteps) {
+  clim->year = (int *)realloc(clim->year, maxSteps * sizeof(int));
+  clim->day = (int *)realloc(clim->day, maxSteps * sizeof(int));
+  clim->time = (double *)realloc(clim->time, maxSteps * sizeof(double));
+  clim->length = (double *)realloc(clim->length, maxSteps * sizeof(double));
+  clim->tair = (double *)realloc(clim->tair, maxSteps * sizeof(double));
+  clim->tsoil = (double *)realloc(clim->tsoil, maxSteps * sizeof(double));
+  clim->par = (double *)realloc(clim->par, maxSteps * sizeof(double));
+  clim->precip = (double *)realloc(clim->precip, maxSteps * sizeof(double));
+  clim->vpd = (double *)realloc(clim->vpd, maxSteps * sizeof(double));
+  clim->vpdSoil = (double *)realloc(clim->vpdSoil, maxSteps * sizeof(double));
+  clim->vPress = (double *)realloc(clim->vPress, maxSteps * sizeof(double));
+  clim->wspd = (double *)realloc(clim->wspd, maxSteps * sizeof(double));
+  clim->soilWetness = (double *)realloc(clim->soilWetness, maxSteps * sizeof(double));
+#if GDD
+  clim->gdd = (double *)realloc(clim->gdd, maxSteps * sizeof(double));
+#endif
+
+  if (clim->year == NULL || clim->day == NULL || clim->time == NULL || clim->length == NULL
+      || clim->tair == NULL || clim->tsoil == NULL || clim->par == NULL || clim->precip == NULL
+      || clim->vpd == NULL || clim->vpdSoil == NULL || clim->vPress == NULL || clim->wspd == NULL
+      || clim->soilWetness == NULL
+#if GDD
+      || clim->gdd == NULL
+#endif
+      ) {
+    printf("Error allocating space for %d climate records\n", maxSteps);
+    exit(1);
+  }
+
+  clim->maxSteps = maxSteps;
+}
 
-// more global variables:
-// these are global to increase efficiency (avoid lots of parameter passing)
 
-static Params params;
-static Envi envi; // state variables
-static Trackers trackers;
-static PhenologyTrackers phenologyTrackers;
-static MeanTracker *meanNPP; // running mean of NPP over some fixed time (stored in g C * m^-2 * day^-1)
-static MeanTracker *meanGPP; // running mean of GPP over some fixed time for linkages (stored in g C * m^-2 * day^-1)
-static MeanTracker *meanFPAR; // running mean of FPAR of some fixed time for MODIS
+/* Store one climate record (as read from the climate file) as time step i of clim, converting units
+   (clim must already have room for at least i+1 time steps, and time steps 0..i-1 must already be stored,
+   since growing degree days accumulate over the year)
+*/
+void setClimRecord(ClimateArrays *clim, int i, int year, int day, double time, double length,
+		   double tair, double tsoil, double par, double precip, double vpd, double vpdSoil, double vPress, double wspd, double soilWetness) {
+#if GDD
+  double thisGdd; // growing degree days of this time step
+  double gdd; // growing degree days since the last Jan. 1
+#endif
 
-static ClimateNode *climate; // current climate
-static Fluxes fluxes;
-static double *outputPtrs[MAX_DATA_TYPES]; // pointers to different possible outputs
+  clim->year[i] = year;
+  clim->day[i] = day;
+  clim->time[i] = time;
+  if (length < 0) // parse as seconds
+    length = length/-86400.; // convert to days
+  clim->length[i] = length;
+
+  clim->tair[i] = tair;
+  clim->tsoil[i] = tsoil;
+  clim->par[i] = par * (1.0/length);
+  // convert par from Einsteins * m^-2 to Eisteins * m^-2 * day^-1
+  clim->precip[i] = precip * 0.1; // convert from mm to cm
+  clim->vpd[i] = vpd * 0.001; // convert from Pa to kPa
+  if (clim->vpd[i] < TINY)
+    clim->vpd[i] = TINY; // avoid divide by zero
+  clim->vpdSoil[i] = vpdSoil * 0.001; // convert from Pa to kPa
+  clim->vPress[i] = vPress * 0.001; // convert from Pa to kPa
+  clim->wspd[i] = wspd;
+  if (clim->wspd[i] < TINY)
+    clim->wspd[i] = TINY; // avoid divide by zero
+  clim->soilWetness[i] = soilWetness;
 
+#if GDD
+  if (i == 0 || year != clim->year[i-1]) // first record of this location, or HAPPY NEW YEAR!
+    gdd = 0; // reset growing degree days
+  else
+    gdd = clim->gdd[i-1];
+  thisGdd = tair * length;
+  if (thisGdd < 0) // can't have negative growing degree days
+    thisGdd = 0;
+  gdd += thisGdd;
+  clim->gdd[i] = gdd;
+#endif
+}
 
 
-/* Read climate file into linked lists,
-   make firstClimates be a vector where each element is a pointer to the head of a list corresponding to one spatial location
+/* Read climate file into arrays,
+   make allClimates be a vector where each element holds the climate arrays for one spatial location
 
    return an array containing the number of time steps in each location (dynamically allocated with malloc)
 
@@ -506,21 +694,14 @@ static double *outputPtrs[MAX_DATA_TYPES]; // pointers to different possible out
 */
 int * readClimData(char *climFile, int numLocs) {
   FILE *in;
-  ClimateNode *curr, *next;
+  ClimateArrays *clim; // the arrays for the location we're currently reading
   int loc, year, day;
-  int lastYear;
   double time, length; // time in hours, length in days (or fraction of day)
   double tair, tsoil, par, precip, vpd, vpdSoil, vPress, wspd, soilWetness;
   int currLoc;
-  int count;
   int i;
   int *steps; // # of time steps in each location
 
-#if GDD
-  double thisGdd; // growing degree days of this time step
-  double gdd = 0.0; // growing degree days since the last Jan. 1
-#endif
-
   int status; // status of the read
 
   steps = (int *)malloc(numLocs * sizeof(int));
@@ -540,79 +721,36 @@ int * readClimData(char *climFile, int numLocs) {
     exit(1);
   }
 
-  firstClimates = (ClimateNode **)malloc(numLocs * sizeof(ClimateNode *)); // vector of heads
-  for (currLoc = 0; currLoc < numLocs; currLoc++)
-    firstClimates[currLoc] = NULL; // default is null
-  // if firstClimates[i] stays null for some i, that means we didn't read any climate data for location i, so use climate from location 0
+  allClimates = (ClimateArrays *)calloc(numLocs, sizeof(ClimateArrays)); // all arrays NULL, numSteps = 0
+  // if allClimates[i].numSteps stays 0 for some i, that means we didn't read any climate data for location i, so use climate from location 0
 
   currLoc = loc;
-  firstClimates[currLoc] = (ClimateNode *)malloc(sizeof(ClimateNode)); // allocate space for head
-  curr = next = firstClimates[currLoc];
-  count = 0;
+  clim = &(allClimates[currLoc]);
   while (status != EOF) {
-    // we have another day's climate
-    curr = next;
-    count++; // # of time steps in this location
-
-    curr->year = year;
-    curr->day = day;
-    curr->time = time;
-
-    if (length < 0) // parse as seconds
-      length = length/-86400.; // convert to days
-    curr->length = length;
-
-    curr->tair = tair;
-    curr->tsoil = tsoil;
-    curr->par = par * (1.0/length);
-    // convert par from Einsteins * m^-2 to Eisteins * m^-2 * day^-1
-    curr->precip = precip * 0.1; // convert from mm to cm
-    curr->vpd = vpd * 0.001; // convert from Pa to kPa
-    if (curr->vpd < TINY)
-      curr->vpd = TINY; // avoid divide by zero
-    curr->vpdSoil = vpdSoil * 0.001; // convert from Pa to kPa
-    curr->vPress = vPress * 0.001; // convert from Pa to kPa
-    curr->wspd = wspd;
-    if (curr->wspd < TINY)
-      curr->wspd = TINY; // avoid divide by zero
-    curr->soilWetness = soilWetness;
-
-
-#if GDD
-    if (year != lastYear) // HAPPY NEW YEAR!
-      gdd = 0; // reset growing degree days
-    thisGdd = tair * length;
-    if (thisGdd < 0) // can't have negative growing degree days
-      thisGdd = 0;
-    gdd += thisGdd;
-    curr->gdd = gdd;
-#endif
+    // we have another time step's climate
+    if (clim->numSteps == clim->maxSteps) // out of space: double the size of the arrays
+      resizeClimateArrays(clim, (clim->maxSteps > 0) ? 2 * clim->maxSteps : CLIMATE_INIT_STEPS);
+    i = clim->numSteps; // index of this time step
+    clim->numSteps++; // # of time steps in this location
 
-    lastYear = year;
+    setClimRecord(clim, i, year, day, time, length, tair, tsoil, par, precip, vpd, vpdSoil, vPress, wspd, soilWetness);
 
     status = fscanf(in, "%d %d %d %lf %lf %lf %lf %lf %lf %lf %lf %lf %lf %lf", &loc, &year, &day, &time, &length, &tair, &tsoil, &par, &precip, &vpd, &vpdSoil, &vPress, &wspd, &soilWetness);
 
     if (status != EOF) { // we have another climate record
       // check new location, compare with old location (currLoc), make sure new location is valid, and act accordingly:
-      if (loc == currLoc) { // still reading climate records from the same place: add a node at end of linked list
-	next = (ClimateNode *)malloc(sizeof(ClimateNode));
-	curr->nextClim = next;
-	// set this down here rather than at top of loop so head treated the same as rest of list
+      if (loc == currLoc) { // still reading climate records from the same place: keep adding to the same arrays
+	;
       }
       else if (loc >= numLocs) { // (loc == numLocs is an error since we use 0-indexing)
 	printf("Error reading climate file: trying to read location %d, but numLocs = %d\n", loc, numLocs);
 	exit(1);
       }
       else if (loc > currLoc) { // we've advanced to the next location (note: possible that we skipped some locations: this is OK)
-	curr->nextClim = NULL; // terminate last linked list
-	steps[currLoc] = count; // record the number of time steps for last location
-	count = 0; // reset count of # of time steps
-#if GDD
-	gdd = 0; // reset growing degree days
-#endif
+	resizeClimateArrays(clim, clim->numSteps); // free up any unused space in the last location's arrays
+	steps[currLoc] = clim->numSteps; // record the number of time steps for last location
 	currLoc = loc;
-	firstClimates[currLoc] = (ClimateNode *)malloc(sizeof(ClimateNode)); // allocate space for head
-	curr = next = firstClimates[currLoc]; // we'll start writing to next linked list
+	clim = &(allClimates[currLoc]); // we'll start writing to the next location's arrays
       }
       else { // loc < currLoc
 	printf("Error reading climate file: was reading location %d, trying to read location %d\n", currLoc, loc);
@@ -621,8 +759,8 @@ int * readClimData(char *climFile, int numLocs) {
       }
     }
     else { // status == EOF - no more records
-      curr->nextClim = NULL; // terminate this last linked list
-      steps[currLoc] = count; // record the number of time steps for last location
+      resizeClimateArrays(clim, clim->numSteps); // free up any unused space in the last location's arrays
+      steps[currLoc] = clim->numSteps; // record the number of time steps for last location
     }
 
   } // end while
@@ -663,93 +801,93 @@ int readParamData(SpatialParams **spatialParamsPtr, char *paramFile, char *spati
   *spatialParamsPtr = newSpatialParams(NUM_PARAMS, numLocs);
   spatialParams = *spatialParamsPtr; // to prevent lots of unnecessary dereferences
 
-  initializeOneSpatialParam(spatialParams, "plantWoodInit", &(params.plantWoodInit), 1);
-  initializeOneSpatialParam(spatialParams, "laiInit", &(params.laiInit), 1);
-  initializeOneSpatialParam(spatialParams, "litterInit", &(params.litterInit), 1);
-  initializeOneSpatialParam(spatialParams, "soilInit", &(params.soilInit), 1);
-  initializeOneSpatialParam(spatialParams, "litterWFracInit", &(params.litterWFracInit), 1);
-  initializeOneSpatialParam(spatialParams, "soilWFracInit", &(params.soilWFracInit), 1);
-  initializeOneSpatialParam(spatialParams, "snowInit", &(params.snowInit), 1);
-  initializeOneSpatialParam(spatialParams, "aMax", &(params.aMax), 1);
-  initializeOneSpatialParam(spatialParams, "aMaxFrac", &(params.aMaxFrac), 1);
-  initializeOneSpatialParam(spatialParams, "baseFolRespFrac", &(params.baseFolRespFrac), 1);
-
-  initializeOneSpatialParam(spatialParams, "psnTMin", &(params.psnTMin), 1);
-  initializeOneSpatialParam(spatialParams, "psnTOpt", &(params.psnTOpt), 1);
-  initializeOneSpatialParam(spatialParams, "vegRespQ10", &(params.vegRespQ10), 1);
-  initializeOneSpatialParam(spatialParams, "growthRespFrac", &(params.growthRespFrac), GROWTH_RESP);
-  initializeOneSpatialParam(spatialParams, "frozenSoilFolREff", &(params.frozenSoilFolREff), 1);
-  initializeOneSpatialParam(spatialParams, "frozenSoilThreshold", &(params.frozenSoilThreshold), 1);
-  initializeOneSpatialParam(spatialParams, "dVpdSlope", &(params.dVpdSlope), 1);
-  initializeOneSpatialParam(spatialParams, "dVpdExp", &(params.dVpdExp), 1);
-  initializeOneSpatialParam(spatialParams, "halfSatPar", &(params.halfSatPar), 1);
-  initializeOneSpatialParam(spatialParams, "attenuation", &(params.attenuation), 1);
-
-  initializeOneSpatialParam(spatialParams, "leafOnDay", &(params.leafOnDay), !((GDD) || (SOIL_PHENOL)));
-  initializeOneSpatialParam(spatialParams, "gddLeafOn", &(params.gddLeafOn), GDD);
-  initializeOneSpatialParam(spatialParams, "soilTempLeafOn", &(params.soilTempLeafOn), SOIL_PHENOL);
-  initializeOneSpatialParam(spatialParams, "leafOffDay", &(params.leafOffDay), 1);
-  initializeOneSpatialParam(spatialParams, "leafGrowth", &(params.leafGrowth), 1);
-  initializeOneSpatialParam(spatialParams, "fracLeafFall", &(params.fracLeafFall), 1);
-  initializeOneSpatialParam(spatialParams, "leafAllocation", &(params.leafAllocation), 1);
-  initializeOneSpatialParam(spatialParams, "leafTurnoverRate", &(params.leafTurnoverRate), 1);
-  initializeOneSpatialParam(spatialParams, "baseVegResp", &(params.baseVegResp), 1);
-  initializeOneSpatialParam(spatialParams, "litterBreakdownRate", &(params.litterBreakdownRate), LITTER_POOL);
-
-  initializeOneSpatialParam(spatialParams, "fracLitterRespired", &(params.fracLitterRespired), LITTER_POOL);
-  initializeOneSpatialParam(spatialParams, "baseSoilResp", &(params.baseSoilResp), 1);
-  initializeOneSpatialParam(spatialParams, "baseSoilRespCold", &(params.baseSoilRespCold), SEASONAL_R_SOIL);
-  initializeOneSpatialParam(spatialParams, "soilRespQ10", &(params.soilRespQ10), 1);
-  initializeOneSpatialParam(spatialParams, "soilRespQ10Cold", &(params.soilRespQ10Cold), SEASONAL_R_SOIL);
-  initializeOneSpatialParam(spatialParams, "coldSoilThreshold", &(params.coldSoilThreshold), SEASONAL_R_SOIL);
-
-  initializeOneSpatialParam(spatialParams, "E0", &(params.E0), LLOYD_TAYLOR);
-  initializeOneSpatialParam(spatialParams, "T0", &(params.T0), LLOYD_TAYLOR);
-  initializeOneSpatialParam(spatialParams, "soilRespMoistEffect", &(params.soilRespMoistEffect), ((WATER_HRESP) && !(DAYCENT_WATER_HRESP)));
-  initializeOneSpatialParam(spatialParams, "waterRemoveFrac", &(params.waterRemoveFrac), 1);
-  initializeOneSpatialParam(spatialParams, "frozenSoilEff", &(params.frozenSoilEff), 1);
-  initializeOneSpatialParam(spatialParams, "wueConst", &(params.wueConst), 1);
-  initializeOneSpatialParam(spatialParams, "litterWHC", &(params.litterWHC), 1);
-  initializeOneSpatialParam(spatialParams, "soilWHC", &(params.soilWHC), 1);
-  initializeOneSpatialParam(spatialParams, "immedEvapFrac", &(params.immedEvapFrac), COMPLEX_WATER);
-  initializeOneSpatialParam(spatialParams, "fastFlowFrac", &(params.fastFlowFrac), COMPLEX_WATER);
-  initializeOneSpatialParam(spatialParams, "leafPoolDepth", &(params.leafPoolDepth), LEAF_WATER);
-
-  initializeOneSpatialParam(spatialParams, "snowMelt", &(params.snowMelt), SNOW);
-  initializeOneSpatialParam(spatialParams, "litWaterDrainRate", &(params.litWaterDrainRate), LITTER_WATER_DRAINAGE);
-  initializeOneSpatialParam(spatialParams, "rdConst", &(params.rdConst), (COMPLEX_WATER) || (PENMAN_MONTEITH_TRANS));
-  initializeOneSpatialParam(spatialParams, "rSoilConst1", &(params.rSoilConst1), COMPLEX_WATER);
-  initializeOneSpatialParam(spatialParams, "rSoilConst2", &(params.rSoilConst2), COMPLEX_WATER);
-  initializeOneSpatialParam(spatialParams, "leafCSpWt", &(params.leafCSpWt), 1);
-  initializeOneSpatialParam(spatialParams, "cFracLeaf", &(params.cFracLeaf), 1);
-  initializeOneSpatialParam(spatialParams, "woodTurnoverRate", &(params.woodTurnoverRate), 1);
-  initializeOneSpatialParam(spatialParams, "qualityLeaf", &(params.qualityLeaf), SOIL_QUALITY);
-  initializeOneSpatialParam(spatialParams, "qualityWood", &(params.qualityWood), SOIL_QUALITY);
-
-  initializeOneSpatialParam(spatialParams, "efficiency", &(params.efficiency), (SOIL_QUALITY) || (MICROBES));
-  initializeOneSpatialParam(spatialParams, "maxIngestionRate", &(params.maxIngestionRate), (SOIL_QUALITY) || (MICROBES));
-  initializeOneSpatialParam(spatialParams, "halfSatIngestion", &(params.halfSatIngestion), MICROBES);
-  initializeOneSpatialParam(spatialParams, "totNitrogen", &(params.totNitrogen), STOICHIOMETRY);
-  initializeOneSpatialParam(spatialParams, "microbeNC", &(params.microbeNC), STOICHIOMETRY);
-  initializeOneSpatialParam(spatialParams, "microbeInit", &(params.microbeInit), (SOIL_QUALITY) || (MICROBES));
-  initializeOneSpatialParam(spatialParams, "fineRootFrac", &(params.fineRootFrac), ROOTS);
-  initializeOneSpatialParam(spatialParams, "coarseRootFrac", &(params.coarseRootFrac), ROOTS);
-
-  initializeOneSpatialParam(spatialParams, "fineRootAllocation", &(params.fineRootAllocation), ROOTS);
-  initializeOneSpatialParam(spatialParams, "woodAllocation", &(params.woodAllocation), ROOTS);
-  initializeOneSpatialParam(spatialParams, "fineRootExudation", &(params.fineRootExudation), ROOTS);
-  initializeOneSpatialParam(spatialParams, "coarseRootExudation", &(params.coarseRootExudation), ROOTS);
-  initializeOneSpatialParam(spatialParams, "fineRootTurnoverRate", &(params.fineRootTurnoverRate), ROOTS);
-  initializeOneSpatialParam(spatialParams, "coarseRootTurnoverRate", &(params.coarseRootTurnoverRate), ROOTS);
-  initializeOneSpatialParam(spatialParams, "baseFineRootResp", &(params.baseFineRootResp), ROOTS);
-  initializeOneSpatialParam(spatialParams, "baseCoarseRootResp", &(params.baseCoarseRootResp), ROOTS);
-  initializeOneSpatialParam(spatialParams, "fineRootQ10", &(params.fineRootQ10), ROOTS);
-  initializeOneSpatialParam(spatialParams, "coarseRootQ10", &(params.coarseRootQ10), ROOTS);
-
-  initializeOneSpatialParam(spatialParams, "baseMicrobeResp", &(params.baseMicrobeResp), MICROBES);
-  initializeOneSpatialParam(spatialParams, "microbeQ10", &(params.microbeQ10), MICROBES);
-  initializeOneSpatialParam(spatialParams, "microbePulseEff", &(params.microbePulseEff), (ROOTS) && (MICROBES) );
-  initializeOneSpatialParam(spatialParams, "m_ballBerry", &(params.m_ballBerry), 1);
+  initializeOneSpatialParam(spatialParams, "plantWoodInit", &(paramLayout.plantWoodInit), 1);
+  initializeOneSpatialParam(spatialParams, "laiInit", &(paramLayout.laiInit), 1);
+  initializeOneSpatialParam(spatialParams, "litterInit", &(paramLayout.litterInit), 1);
+  initializeOneSpatialParam(spatialParams, "soilInit", &(paramLayout.soilInit), 1);
+  initializeOneSpatialParam(spatialParams, "litterWFracInit", &(paramLayout.litterWFracInit), 1);
+  initializeOneSpatialParam(spatialParams, "soilWFracInit", &(paramLayout.soilWFracInit), 1);
+  initializeOneSpatialParam(spatialParams, "snowInit", &(paramLayout.snowInit), 1);
+  initializeOneSpatialParam(spatialParams, "aMax", &(paramLayout.aMax), 1);
+  initializeOneSpatialParam(spatialParams, "aMaxFrac", &(paramLayout.aMaxFrac), 1);
+  initializeOneSpatialParam(spatialParams, "baseFolRespFrac", &(paramLayout.baseFolRespFrac), 1);
+
+  initializeOneSpatialParam(spatialParams, "psnTMin", &(paramLayout.psnTMin), 1);
+  initializeOneSpatialParam(spatialParams, "psnTOpt", &(paramLayout.psnTOpt), 1);
+  initializeOneSpatialParam(spatialParams, "vegRespQ10", &(paramLayout.vegRespQ10), 1);
+  initializeOneSpatialParam(spatialParams, "growthRespFrac", &(paramLayout.growthRespFrac), GROWTH_RESP);
+  initializeOneSpatialParam(spatialParams, "frozenSoilFolREff", &(paramLayout.frozenSoilFolREff), 1);
+  initializeOneSpatialParam(spatialParams, "frozenSoilThreshold", &(paramLayout.frozenSoilThreshold), 1);
+  initializeOneSpatialParam(spatialParams, "dVpdSlope", &(paramLayout.dVpdSlope), 1);
+  initializeOneSpatialParam(spatialParams, "dVpdExp", &(paramLayout.dVpdExp), 1);
+  initializeOneSpatialParam(spatialParams, "halfSatPar", &(paramLayout.halfSatPar), 1);
+  initializeOneSpatialParam(spatialParams, "attenuation", &(paramLayout.attenuation), 1);
+
+  initializeOneSpatialParam(spatialParams, "leafOnDay", &(paramLayout.leafOnDay), !((GDD) || (SOIL_PHENOL)));
+  initializeOneSpatialParam(spatialParams, "gddLeafOn", &(paramLayout.gddLeafOn), GDD);
+  initializeOneSpatialParam(spatialParams, "soilTempLeafOn", &(paramLayout.soilTempLeafOn), SOIL_PHENOL);
+  initializeOneSpatialParam(spatialParams, "leafOffDay", &(paramLayout.leafOffDay), 1);
+  initializeOneSpatialParam(spatialParams, "leafGrowth", &(paramLayout.leafGrowth), 1);
+  initializeOneSpatialParam(spatialParams, "fracLeafFall", &(paramLayout.fracLeafFall), 1);
+  initializeOneSpatialParam(spatialParams, "leafAllocation", &(paramLayout.leafAllocation), 1);
+  initializeOneSpatialParam(spatialParams, "leafTurnoverRate", &(paramLayout.leafTurnoverRate), 1);
+  initializeOneSpatialParam(spatialParams, "baseVegResp", &(paramLayout.baseVegResp), 1);
+  initializeOneSpatialParam(spatialParams, "litterBreakdownRate", &(paramLayout.litterBreakdownRate), LITTER_POOL);
+
+  initializeOneSpatialParam(spatialParams, "fracLitterRespired", &(paramLayout.fracLitterRespired), LITTER_POOL);
+  initializeOneSpatialParam(spatialParams, "baseSoilResp", &(paramLayout.baseSoilResp), 1);
+  initializeOneSpatialParam(spatialParams, "baseSoilRespCold", &(paramLayout.baseSoilRespCold), SEASONAL_R_SOIL);
+  initializeOneSpatialParam(spatialParams, "soilRespQ10", &(paramLayout.soilRespQ10), 1);
+  initializeOneSpatialParam(spatialParams, "soilRespQ10Cold", &(paramLayout.soilRespQ10Cold), SEASONAL_R_SOIL);
+  initializeOneSpatialParam(spatialParams, "coldSoilThreshold", &(paramLayout.coldSoilThreshold), SEASONAL_R_SOIL);
+
+  initializeOneSpatialParam(spatialParams, "E0", &(paramLayout.E0), LLOYD_TAYLOR);
+  initializeOneSpatialParam(spatialParams, "T0", &(paramLayout.T0), LLOYD_TAYLOR);
+  initializeOneSpatialParam(spatialParams, "soilRespMoistEffect", &(paramLayout.soilRespMoistEffect), ((WATER_HRESP) && !(DAYCENT_WATER_HRESP)));
+  initializeOneSpatialParam(spatialParams, "waterRemoveFrac", &(paramLayout.waterRemoveFrac), 1);
+  initializeOneSpatialParam(spatialParams, "frozenSoilEff", &(paramLayout.frozenSoilEff), 1);
+  initializeOneSpatialParam(spatialParams, "wueConst", &(paramLayout.wueConst), 1);
+  initializeOneSpatialParam(spatialParams, "litterWHC", &(paramLayout.litterWHC), 1);
+  initializeOneSpatialParam(spatialParams, "soilWHC", &(paramLayout.soilWHC), 1);
+  initializeOneSpatialParam(spatialParams, "immedEvapFrac", &(paramLayout.immedEvapFrac), COMPLEX_WATER);
+  initializeOneSpatialParam(spatialParams, "fastFlowFrac", &(paramLayout.fastFlowFrac), COMPLEX_WATER);
+  initializeOneSpatialParam(spatialParams, "leafPoolDepth", &(paramLayout.leafPoolDepth), LEAF_WATER);
+
+  initializeOneSpatialParam(spatialParams, "snowMelt", &(paramLayout.snowMelt), SNOW);
+  initializeOneSpatialParam(spatialParams, "litWaterDrainRate", &(paramLayout.litWaterDrainRate), LITTER_WATER_DRAINAGE);
+  initializeOneSpatialParam(spatialParams, "rdConst", &(paramLayout.rdConst), (COMPLEX_WATER) || (PENMAN_MONTEITH_TRANS));
+  initializeOneSpatialParam(spatialParams, "rSoilConst1", &(paramLayout.rSoilConst1), COMPLEX_WATER);
+  initializeOneSpatialParam(spatialParams, "rSoilConst2", &(paramLayout.rSoilConst2), COMPLEX_WATER);
+  initializeOneSpatialParam(spatialParams, "leafCSpWt", &(paramLayout.leafCSpWt), 1);
+  initializeOneSpatialParam(spatialParams, "cFracLeaf", &(paramLayout.cFracLeaf), 1);
+  initializeOneSpatialParam(spatialParams, "woodTurnoverRate", &(paramLayout.woodTurnoverRate), 1);
+  initializeOneSpatialParam(spatialParams, "qualityLeaf", &(paramLayout.qualityLeaf), SOIL_QUALITY);
+  initializeOneSpatialParam(spatialParams, "qualityWood", &(paramLayout.qualityWood), SOIL_QUALITY);
+
+  initializeOneSpatialParam(spatialParams, "efficiency", &(paramLayout.efficiency), (SOIL_QUALITY) || (MICROBES));
+  initializeOneSpatialParam(spatialParams, "maxIngestionRate", &(paramLayout.maxIngestionRate), (SOIL_QUALITY) || (MICROBES));
+  initializeOneSpatialParam(spatialParams, "halfSatIngestion", &(paramLayout.halfSatIngestion), MICROBES);
+  initializeOneSpatialParam(spatialParams, "totNitrogen", &(paramLayout.totNitrogen), STOICHIOMETRY);
+  initializeOneSpatialParam(spatialParams, "microbeNC", &(paramLayout.microbeNC), STOICHIOMETRY);
+  initializeOneSpatialParam(spatialParams, "microbeInit", &(paramLayout.microbeInit), (SOIL_QUALITY) || (MICROBES));
+  initializeOneSpatialParam(spatialParams, "fineRootFrac", &(paramLayout.fineRootFrac), ROOTS);
+  initializeOneSpatialParam(spatialParams, "coarseRootFrac", &(paramLayout.coarseRootFrac), ROOTS);
+
+  initializeOneSpatialParam(spatialParams, "fineRootAllocation", &(paramLayout.fineRootAllocation), ROOTS);
+  initializeOneSpatialParam(spatialParams, "woodAllocation", &(paramLayout.woodAllocation), ROOTS);
+  initializeOneSpatialParam(spatialParams, "fineRootExudation", &(paramLayout.fineRootExudation), ROOTS);
+  initializeOneSpatialParam(spatialParams, "coarseRootExudation", &(paramLayout.coarseRootExudation), ROOTS);
+  initializeOneSpatialParam(spatialParams, "fineRootTurnoverRate", &(paramLayout.fineRootTurnoverRate), ROOTS);
+  initializeOneSpatialParam(spatialParams, "coarseRootTurnoverRate", &(paramLayout.coarseRootTurnoverRate), ROOTS);
+  initializeOneSpatialParam(spatialParams, "baseFineRootResp", &(paramLayout.baseFineRootResp), ROOTS);
+  initializeOneSpatialParam(spatialParams, "baseCoarseRootResp", &(paramLayout.baseCoarseRootResp), ROOTS);
+  initializeOneSpatialParam(spatialParams, "fineRootQ10", &(paramLayout.fineRootQ10), ROOTS);
+  initializeOneSpatialParam(spatialParams, "coarseRootQ10", &(paramLayout.coarseRootQ10), ROOTS);
+
+  initializeOneSpatialParam(spatialParams, "baseMicrobeResp", &(paramLayout.baseMicrobeResp), MICROBES);
+  initializeOneSpatialParam(spatialParams, "microbeQ10", &(paramLayout.microbeQ10), MICROBES);
+  initializeOneSpatialParam(spatialParams, "microbePulseEff", &(paramLayout.microbePulseEff), (ROOTS) && (MICROBES) );
+  initializeOneSpatialParam(spatialParams, "m_ballBerry", &(paramLayout.m_ballBerry), 1);
 
 
   readSpatialParams(spatialParams, paramF, spatialParamF);
@@ -768,7 +906,7 @@ int readParamData(SpatialParams **spatialParamsPtr, char *paramFile, char *spati
 
 // Not only that ...I'd like the options used in the model run to be added to the file;
 
-void outputHeader(FILE *out) {
+void outputHeader(SipnetContext *ctx, FILE *out) {
   fprintf(out, "Notes: (PlantWoodC, PlantLeafC, Soil and Litter in g C/m^2; Water and Snow in cm; SoilWetness is fraction of WHC;\n");
   fprintf(out, "loc year day time plantWoodC plantLeafC ");
 
@@ -776,7 +914,7 @@ void outputHeader(FILE *out) {
   			int counter;
 
   			for(counter=0; counter<NUMBER_SOIL_CARBON_POOLS; counter++) {
-  				fprintf(out, "soil(%8.2f) ",envi.soil[counter]);
+  				fprintf(out, "soil(%8.2f) ",ctx->envi.soil[counter]);
 	  		}
  		  		fprintf(out,"totSoilC ");
 
@@ -790,79 +928,917 @@ void outputHeader(FILE *out) {
   fprintf(out, "npp nee cumNEE gpp rAboveground rSoil rRoot ra rh rtot evapotranspiration fluxestranspiration fPAR\n");
 }
 
+// put the values that outputState writes (after loc, year, day and time) in values[0..NUM_OUTPUT_STATE_VALUES-1]
+void getOutputStateValues(SipnetContext *ctx, double values[]) {
+  int i = 0;
+#if SOIL_MULTIPOOL
+  int counter;
+#endif
+
+  values[i++] = ctx->envi.plantWoodC;
+  values[i++] = ctx->envi.plantLeafC;
+#if SOIL_MULTIPOOL
+  for (counter = 0; counter < NUMBER_SOIL_CARBON_POOLS; counter++)
+    values[i++] = ctx->envi.soil[counter];
+  values[i++] = ctx->trackers.totSoilC;
+#else
+  values[i++] = ctx->envi.soil;
+#endif
+  values[i++] = ctx->envi.microbeC;
+  values[i++] = ctx->envi.coarseRootC;
+  values[i++] = ctx->envi.fineRootC;
+  values[i++] = ctx->envi.litter;
+  values[i++] = ctx->envi.litterWater;
+  values[i++] = ctx->envi.soilWater;
+  values[i++] = ctx->trackers.soilWetnessFrac;
+  values[i++] = ctx->envi.snow;
+  values[i++] = ctx->trackers.npp;
+  values[i++] = ctx->trackers.nee;
+  values[i++] = ctx->trackers.totNee;
+  values[i++] = ctx->trackers.gpp;
+  values[i++] = ctx->trackers.rAboveground;
+  values[i++] = ctx->trackers.rSoil;
+  values[i++] = ctx->trackers.rRoot;
+  values[i++] = ctx->trackers.ra;
+  values[i++] = ctx->trackers.rh;
+  values[i++] = ctx->trackers.rtot;
+  values[i++] = ctx->trackers.evapotranspiration;
+  values[i++] = ctx->fluxes.transpiration;
+  values[i++] = ctx->trackers.fpar;
+}
+
+
+// pre: out is open for writing
+// write one line of output (as outputState), given the values from getOutputStateValues
+void writeOutputStateValues(FILE *out, int loc, int year, int day, double time, double v[]) {
+  int i;
+#if SOIL_MULTIPOOL
+  int counter;
+#endif
+
+  fprintf(out,"%8d %4d %3d %5.2f %8.2f %8.2f ", loc, year, day, time, v[0], v[1]);
+  i = 2;
+#if SOIL_MULTIPOOL
+  for (counter = 0; counter < NUMBER_SOIL_CARBON_POOLS; counter++)
+    fprintf(out, "%8.2f ", v[i++]);
+  fprintf(out, "%8.2f ", v[i++]); // totSoilC
+#else
+  fprintf(out, "%8.2f ", v[i++]);
+#endif
+  fprintf(out, "%8.2f", v[i]); // microbeC
+  fprintf(out, "%8.2f %8.2f", v[i+1], v[i+2]);
+  fprintf(out, " %8.2f %8.3f %8.2f %8.3f %8.2f ", v[i+3], v[i+4], v[i+5], v[i+6], v[i+7]);
+  fprintf(out,"%8.2f %8.2f %8.2f %8.2f %8.3f %8.3f %8.3f %8.3f %8.3f %8.3f %8.8f %8.4f %8.4f\n", v[i+8], v[i+9], v[i+10], v[i+11], v[i+12],
+	  v[i+13], v[i+14], v[i+15], v[i+16], v[i+17], v[i+18], v[i+19], v[i+20]);
+
+//note without modeling root dynamics
+
+//ctx->trackers.fa, ctx->trackers.fr, ctx->fluxes.rLeaf*ctx->clim->length[ctx->step],ctx->trackers.evapotranspiration
+}
+
+
+/* Put the name and units of each column of output (loc, year, day and time, then the values from getOutputStateValues)
+   in names[i] and units[i] (pointers to strings that mustn't be changed), for i from 0 to (4 + NUM_OUTPUT_STATE_VALUES - 1)
+   return the number of columns
+*/
+int getOutputColumns(char *names[], char *units[]) {
+  int i = 0;
+#if SOIL_MULTIPOOL
+  static char poolNames[NUMBER_SOIL_CARBON_POOLS][16];
+  int counter;
+#endif
+
+  names[i] = "loc"; units[i++] = "-";
+  names[i] = "year"; units[i++] = "-";
+  names[i] = "day"; units[i++] = "day of year";
+  names[i] = "time"; units[i++] = "hour";
+  names[i] = "plantWoodC"; units[i++] = "g C m-2";
+  names[i] = "plantLeafC"; units[i++] = "g C m-2";
+#if SOIL_MULTIPOOL
+  for (counter = 0; counter < NUMBER_SOIL_CARBON_POOLS; counter++) {
+    sprintf(poolNames[counter], "soil%d", counter + 1);
+    names[i] = poolNames[counter]; units[i++] = "g C m-2";
+  }
+  names[i] = "totSoilC"; units[i++] = "g C m-2";
+#else
+  names[i] = "soil"; units[i++] = "g C m-2";
+#endif
+  names[i] = "microbeC"; units[i++] = "g C m-2";
+  names[i] = "coarseRootC"; units[i++] = "g C m-2";
+  names[i] = "fineRootC"; units[i++] = "g C m-2";
+  names[i] = "litter"; units[i++] = "g C m-2";
+  names[i] = "litterWater"; units[i++] = "cm";
+  names[i] = "soilWater"; units[i++] = "cm";
+  names[i] = "soilWetnessFrac"; units[i++] = "fraction of WHC";
+  names[i] = "snow"; units[i++] = "cm";
+  names[i] = "npp"; units[i++] = "g C m-2 per time step";
+  names[i] = "nee"; units[i++] = "g C m-2 per time step";
+  names[i] = "cumNEE"; units[i++] = "g C m-2";
+  names[i] = "gpp"; units[i++] = "g C m-2 per time step";
+  names[i] = "rAboveground"; units[i++] = "g C m-2 per time step";
+  names[i] = "rSoil"; units[i++] = "g C m-2 per time step";
+  names[i] = "rRoot"; units[i++] = "g C m-2 per time step";
+  names[i] = "ra"; units[i++] = "g C m-2 per time step";
+  names[i] = "rh"; units[i++] = "g C m-2 per time step";
+  names[i] = "rtot"; units[i++] = "g C m-2 per time step";
+  names[i] = "evapotranspiration"; units[i++] = "cm per time step";
+  names[i] = "fluxestranspiration"; units[i++] = "cm day-1";
+  names[i] = "fPAR"; units[i++] = "fraction";
+
+  return i;
+}
+
+
 // pre: out is open for writing
 // print current state to output file
-void outputState(FILE *out, int loc, int year, int day, double time) {
+void outputState(SipnetContext *ctx, FILE *out, int loc, int year, int day, double time) {
+  double values[NUM_OUTPUT_STATE_VALUES];
 
+  getOutputStateValues(ctx, values);
+  writeOutputStateValues(out, loc, year, day, time, values);
+}
 
-  		fprintf(out,"%8d %4d %3d %5.2f %8.2f %8.2f ",loc,year,day,time,envi.plantWoodC,envi.plantLeafC);
+void outputStatecsv(SipnetContext *ctx, FILE *out, int loc, int year, int day, double time) {
+  fprintf(out, "%8d , %4d , %3d , %5.2f , %8.2f , %8.2f , ", loc, year, day, time,
+  		ctx->envi.plantWoodC, ctx->envi.plantLeafC);
 
+	#if SOIL_MULTIPOOL
+		fprintf(out, "%8.2f ,", ctx->trackers.totSoilC);
+	#else
+		fprintf(out, "%8.2f ,", ctx->envi.soil);
+	#endif
 
-  		#if SOIL_MULTIPOOL
-  			int counter;
+	fprintf(out, "%8.2f , %8.3f, %8.2f , %8.3f , %8.2f , %8.2f , %8.2f , %8.2f , %8.2f , %8.3f , %8.3f , %8.3f, %8.3f , %8.3f , %8.3f %8.8f %8.4f %8.4f\n",
+	  ctx->envi.litter, ctx->envi.litterWater, ctx->envi.soilWater, ctx->trackers.soilWetnessFrac, ctx->envi.snow,
+	  ctx->trackers.npp, ctx->trackers.nee, ctx->trackers.totNee, ctx->trackers.gpp, ctx->trackers.rAboveground, ctx->trackers.rSoil, ctx->trackers.rRoot, ctx->trackers.ra, ctx->trackers.rh, ctx->trackers.rtot, ctx->trackers.evapotranspiration, ctx->fluxes.transpiration, ctx->trackers.fpar); 
 
-  			for(counter=0; counter<NUMBER_SOIL_CARBON_POOLS; counter++) {
-  				fprintf(out, "%8.2f ",envi.soil[counter]);
-	  		}
- 		  		fprintf(out,"%8.2f ",trackers.totSoilC);
+}
 
 
+// !!! binary climate cache !!!
 
-	  	#else
-	  		fprintf(out, "%8.2f ",envi.soil);
-	  	#endif
+int * indexClimData(char *climFile, int numLocs, int numWanted, int locs[]); // (below)
 
+/* To avoid re-parsing the text climate file on every run, after reading climFile we write the
+   (already unit-converted) climate arrays, including the derived gdd, to a binary file, climFile + "bin"
+   (e.g. foo.clim -> foo.climbin). On later runs, if this file is newer than climFile and was made from
+   the same version of climFile, we mmap it and point the climate arrays directly into the mapping.
 
+   Format of the binary file (all values in native byte order - the cache is not meant to be portable between machines;
+   if it can't be used, it is simply regenerated):
+   - a ClimbinHeader
+   - a table of numLocs ClimbinLocEntry's, giving the offset (in bytes from start of file) and number of time steps
+     of each location's data (numSteps = 0 means no climate data for this location)
+   - for each location with data, the arrays for that location: first the double arrays
+     (in the order given by getClimDoubleFields), then the int arrays (year, then day)
+   Every section is a multiple of 8 bytes long, so all arrays are suitably aligned
+*/
+
+typedef struct ClimbinHeaderStruct {
+  char magic[8]; // CLIMBIN_MAGIC
+  int version; // CLIMBIN_VERSION
+  int numLocs;
+  int numDoubles; // number of double arrays per location (depends on GDD)
+  int unused; // padding
+  long long textSize; // size (bytes) of the text climate file this was made from
+  long long textMtime; // modification time of the text climate file this was made from
+} ClimbinHeader;
+
+typedef struct ClimbinLocEntryStruct {
+  long long offset; // offset of this location's data, in bytes from start of file
+  long long numSteps; // number of time steps in this location
+} ClimbinLocEntry;
+
+static void *climMapping = NULL; // if non-NULL, climate arrays point into this mapping of the binary climate cache
+static size_t climMappingSize;
+
+
+// set fields[i] to point to the i'th double array in clim (in the order used in the binary climate cache)
+// return the number of double arrays (CLIMBIN_NUM_DOUBLES)
+int getClimDoubleFields(ClimateArrays *clim, double **fields[]) {
+  int i = 0;
+
+  fields[i++] = &(clim->time);
+  fields[i++] = &(clim->length);
+  fields[i++] = &(clim->tair);
+  fields[i++] = &(clim->tsoil);
+  fields[i++] = &(clim->par);
+  fields[i++] = &(clim->precip);
+  fields[i++] = &(clim->vpd);
+  fields[i++] = &(clim->vpdSoil);
+  fields[i++] = &(clim->vPress);
+  fields[i++] = &(clim->wspd);
+  fields[i++] = &(clim->soilWetness);
+#if GDD
+  fields[i++] = &(clim->gdd);
+#endif
 
-  			fprintf(out, "%8.2f", envi.microbeC);
+  return i;
+}
 
-  			fprintf(out, "%8.2f %8.2f", envi.coarseRootC,envi.fineRootC);
 
-  	fprintf(out, " %8.2f %8.3f %8.2f %8.3f %8.2f ",
-		 envi.litter, envi.litterWater, envi.soilWater, trackers.soilWetnessFrac, envi.snow);
-  	fprintf(out,"%8.2f %8.2f %8.2f %8.2f %8.3f %8.3f %8.3f %8.3f %8.3f %8.3f %8.8f %8.4f %8.4f\n", trackers.npp, trackers.nee, trackers.totNee, trackers.gpp, trackers.rAboveground,
-           trackers.rSoil, trackers.rRoot, trackers.ra, trackers.rh, trackers.rtot, trackers.evapotranspiration, fluxes.transpiration, trackers.fpar);
+// fill header with the values that describe a cache (of the type given by magic) made from climFile (whose status is given by textStat)
+void makeClimbinHeader(ClimbinHeader *header, char *magic, int numLocs, struct stat *textStat) {
+  memset(header, 0, sizeof(ClimbinHeader));
+  snprintf(header->magic, sizeof(header->magic), "%s", magic);
+  header->version = CLIMBIN_VERSION;
+  header->numLocs = numLocs;
+  header->numDoubles = CLIMBIN_NUM_DOUBLES;
+  header->textSize = (long long)textStat->st_size;
+  header->textMtime = (long long)textStat->st_mtime;
+}
 
-//note without modeling root dynamics
 
-//trackers.fa, trackers.fr, fluxes.rLeaf*climate->length,trackers.evapotranspiration
+/* Write the climate arrays in allClimates to the binary cache file binFile
+   textStat gives the status of the text climate file they were read from
+   Writes to a temporary file and then renames it, so other processes never see a partially-written cache
+   If the cache can't be written (e.g. no write permission), print a warning and carry on
+*/
+void writeClimCache(char *binFile, int numLocs, struct stat *textStat) {
+  char tmpFile[1024];
+  FILE *out;
+  ClimbinHeader header;
+  ClimbinLocEntry *table;
+  double **fields[CLIMBIN_NUM_DOUBLES];
+  long long offset;
+  int loc, i, n;
+  int ok;
+
+  if (strlen(binFile) + 32 > sizeof(tmpFile)) {
+    printf("Warning: climate cache file name %s is too long: not writing climate cache\n", binFile);
+    return;
+  }
+  sprintf(tmpFile, "%s.tmp%ld", binFile, (long)getpid());
+
+  out = fopen(tmpFile, "wb");
+  if (out == NULL) {
+    printf("Warning: could not open %s for writing: not writing climate cache\n", tmpFile);
+    return;
+  }
 
+  makeClimbinHeader(&header, CLIMBIN_MAGIC, numLocs, textStat);
+
+  table = (ClimbinLocEntry *)malloc(numLocs * sizeof(ClimbinLocEntry));
+  offset = sizeof(ClimbinHeader) + numLocs * sizeof(ClimbinLocEntry);
+  for (loc = 0; loc < numLocs; loc++) {
+    n = allClimates[loc].numSteps;
+    table[loc].offset = (n > 0) ? offset : 0;
+    table[loc].numSteps = n;
+    offset += (long long)n * (CLIMBIN_NUM_DOUBLES * sizeof(double) + 2 * sizeof(int));
+  }
+
+  ok = (fwrite(&header, sizeof(ClimbinHeader), 1, out) == 1);
+  ok = ok && (fwrite(table, sizeof(ClimbinLocEntry), numLocs, out) == numLocs);
+  for (loc = 0; ok && loc < numLocs; loc++) {
+    n = allClimates[loc].numSteps;
+    if (n > 0) {
+      getClimDoubleFields(&(allClimates[loc]), fields);
+      for (i = 0; ok && i < CLIMBIN_NUM_DOUBLES; i++)
+	ok = (fwrite(*(fields[i]), sizeof(double), n, out) == n);
+      ok = ok && (fwrite(allClimates[loc].year, sizeof(int), n, out) == n);
+      ok = ok && (fwrite(allClimates[loc].day, sizeof(int), n, out) == n);
+    }
+  }
+
+  free(table);
+  if (fclose(out) != 0)
+    ok = 0;
+
+  if (!ok || rename(tmpFile, binFile) != 0) {
+    printf("Warning: error writing climate cache %s\n", binFile);
+    remove(tmpFile);
+  }
 }
 
-void outputStatecsv(FILE *out, int loc, int year, int day, double time) {
-  fprintf(out, "%8d , %4d , %3d , %5.2f , %8.2f , %8.2f , ", loc, year, day, time,
-  		envi.plantWoodC, envi.plantLeafC);
 
-	#if SOIL_MULTIPOOL
-		fprintf(out, "%8.2f ,", trackers.totSoilC);
-	#else
-		fprintf(out, "%8.2f ,", envi.soil);
-	#endif
+/* Try to load climate data from the binary cache file binFile (see writeClimCache)
+   If binFile exists, is newer than the text climate file, was made from this version of the text file
+   (as given by textStat), and is consistent with numLocs and this version of the code,
+   then mmap it, set up allClimates to point into it, and return 1
+   Otherwise return 0 (and leave allClimates unset)
+*/
+int readClimCache(char *binFile, int numLocs, struct stat *textStat) {
+  int fd;
+  struct stat binStat;
+  void *map;
+  ClimbinHeader header, expected;
+  ClimbinLocEntry *table;
+  double **fields[CLIMBIN_NUM_DOUBLES];
+  long long n, blockSize;
+  int loc, i;
+
+  if (stat(binFile, &binStat) != 0)
+    return 0; // no cache
+  if (binStat.st_mtime < textStat->st_mtime)
+    return 0; // text file has changed since cache was written
+  if (binStat.st_size < sizeof(ClimbinHeader) + numLocs * sizeof(ClimbinLocEntry))
+    return 0; // too short to be valid
+
+  fd = open(binFile, O_RDONLY);
+  if (fd < 0)
+    return 0;
+  map = mmap(NULL, binStat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd); // mapping stays valid after closing
+  if (map == MAP_FAILED)
+    return 0;
+
+  // make sure this is the cache we want:
+  memcpy(&header, map, sizeof(ClimbinHeader));
+  makeClimbinHeader(&expected, CLIMBIN_MAGIC, numLocs, textStat);
+  if (memcmp(&header, &expected, sizeof(ClimbinHeader)) != 0) {
+    munmap(map, binStat.st_size);
+    return 0;
+  }
 
-	fprintf(out, "%8.2f , %8.3f, %8.2f , %8.3f , %8.2f , %8.2f , %8.2f , %8.2f , %8.2f , %8.3f , %8.3f , %8.3f, %8.3f , %8.3f , %8.3f %8.8f %8.4f %8.4f\n",
-	  envi.litter, envi.litterWater, envi.soilWater, trackers.soilWetnessFrac, envi.snow,
-	  trackers.npp, trackers.nee, trackers.totNee, trackers.gpp, trackers.rAboveground, trackers.rSoil, trackers.rRoot, trackers.ra, trackers.rh, trackers.rtot, trackers.evapotranspiration, fluxes.transpiration, trackers.fpar); 
+  // check the offset table before pointing anything into the file:
+  table = (ClimbinLocEntry *)((char *)map + sizeof(ClimbinHeader));
+  blockSize = CLIMBIN_NUM_DOUBLES * sizeof(double) + 2 * sizeof(int); // bytes per time step
+  if (table[0].numSteps <= 0) {
+    munmap(map, binStat.st_size);
+    return 0; // must have data for location 0
+  }
+  for (loc = 0; loc < numLocs; loc++) {
+    n = table[loc].numSteps;
+    if (n < 0 || n > INT_MAX || (n > 0 && (table[loc].offset % sizeof(double) != 0
+					   || table[loc].offset < sizeof(ClimbinHeader) + numLocs * sizeof(ClimbinLocEntry)
+					   || table[loc].offset + n * blockSize > binStat.st_size))) {
+      munmap(map, binStat.st_size);
+      return 0;
+    }
+  }
+
+  allClimates = (ClimateArrays *)calloc(numLocs, sizeof(ClimateArrays));
+  for (loc = 0; loc < numLocs; loc++) {
+    n = table[loc].numSteps;
+    if (n > 0) {
+      allClimates[loc].numSteps = allClimates[loc].maxSteps = n;
+      getClimDoubleFields(&(allClimates[loc]), fields);
+      for (i = 0; i < CLIMBIN_NUM_DOUBLES; i++)
+	*(fields[i]) = (double *)((char *)map + table[loc].offset) + i * n;
+      allClimates[loc].year = (int *)((double *)((char *)map + table[loc].offset) + CLIMBIN_NUM_DOUBLES * n);
+      allClimates[loc].day = allClimates[loc].year + n;
+    }
+  }
 
+  climMapping = map;
+  climMappingSize = binStat.st_size;
+  return 1;
 }
 
 
-// de-allocate space used for climate linked list
-void freeClimateList(int numLocs) {
-  ClimateNode *curr, *prev;
+/* Try to load climate data for numLocs locations from the binary cache file binFile (see readClimCache)
+   If successful, return an array containing the number of time steps in each location (dynamically allocated with malloc)
+   (locations without climate data get the number of time steps in location 0); otherwise return NULL
+*/
+int * loadClimCache(char *binFile, int numLocs, struct stat *textStat) {
+  int *steps;
   int loc;
 
-  for (loc = 0; loc < numLocs; loc++) { // loop through firstClimates, deallocating each linked list
-    curr = firstClimates[loc];
-    while (curr != NULL) {
-      prev = curr;
-      curr = curr->nextClim;
-      free(prev);
+  if (!readClimCache(binFile, numLocs, textStat))
+    return NULL;
+
+  steps = (int *)malloc(numLocs * sizeof(int));
+  for (loc = 0; loc < numLocs; loc++)
+    steps[loc] = (allClimates[loc].numSteps > 0) ? allClimates[loc].numSteps : allClimates[0].numSteps;
+  return steps;
+}
+
+
+/* Load climate data for numLocs locations into allClimates: either from the binary cache for climFile
+   (if there is an up-to-date one) or from climFile itself (in which case we then write the binary cache)
+
+   return an array containing the number of time steps in each location (dynamically allocated with malloc)
+   (locations without climate data get the number of time steps in location 0)
+*/
+int * loadClimData(char *climFile, int numLocs) {
+#if CLIMATE_CACHE
+  char binFile[1024];
+  struct stat textStat;
+  int *steps;
+
+  if (strlen(climFile) + 4 > sizeof(binFile) || stat(climFile, &textStat) != 0) // can't use cache: just read text file
+    return readClimData(climFile, numLocs);
+
+  strcpy(binFile, climFile);
+  strcat(binFile, "bin");
+
+  steps = loadClimCache(binFile, numLocs, &textStat);
+  if (steps == NULL) {
+    steps = readClimData(climFile, numLocs);
+    writeClimCache(binFile, numLocs, &textStat);
+  }
+
+  return steps;
+#else
+  return readClimData(climFile, numLocs);
+#endif
+}
+
+
+/* Load climate data for numLocs locations, reading only what's needed:
+   if there is an up-to-date binary cache for climFile, map it (then only the parts of it that are used are ever read from disk);
+   otherwise read the climate of locations locs[0..numWanted-1] from climFile now, and any other location's when it is first needed
+   (unlike loadClimData, this never writes the binary cache, since that would mean reading every location)
+
+   return an array containing the number of time steps in each location (dynamically allocated with malloc)
+   (locations without climate data get the number of time steps in location 0)
+*/
+int * loadClimDataLocs(char *climFile, int numLocs, int numWanted, int locs[]) {
+#if CLIMATE_CACHE
+  char binFile[1024];
+  struct stat textStat;
+  int *steps;
+
+  if (strlen(climFile) + 4 <= sizeof(binFile) && stat(climFile, &textStat) == 0) {
+    strcpy(binFile, climFile);
+    strcat(binFile, "bin");
+    steps = loadClimCache(binFile, numLocs, &textStat);
+    if (steps != NULL)
+      return steps;
+  }
+#endif
+
+  return indexClimData(climFile, numLocs, numWanted, locs);
+}
+
+
+
+// !!! lazy, location-by-location climate loading !!!
+
+/* Instead of reading the whole climate file up front, we can build an index giving, for each location,
+   the offset (in bytes) of its first record in the text climate file and its number of time steps,
+   and then read each location's records only when that location is first run (see initModelLocs)
+   Building the index still reads through the climate file once, but only looks at the location at the start of each line,
+   and doesn't allocate or convert anything
+   If CLIMATE_CACHE is set, the index is saved in climFile + "idx" (e.g. foo.clim -> foo.climidx):
+   a ClimbinHeader (with magic CLIMIDX_MAGIC) followed by a table of numLocs ClimbinLocEntry's,
+   used on later runs if it is newer than climFile and was made from the same version of climFile
+*/
+
+
+/* Build the location index of climFile for numLocs locations into index[0..numLocs-1] (numSteps = 0 for locations with no data)
+   (with the same checks on the order of locations as readClimData)
+   Since records are found by looking at the start of each line, every record must be on a line of its own
+   (as described in readClimData - though readClimData itself doesn't care): print an error and exit if any line
+   (other than a blank one) doesn't hold exactly CLIM_RECORD_FIELDS values
+*/
+void buildClimIndex(char *climFile, int numLocs, ClimbinLocEntry *index) {
+  FILE *in;
+  char line[CLIMIDX_LINE_LEN];
+  char *c;
+  long long lineStart;
+  long lineNum;
+  int atLineStart; // is line the start of a line of the file? (lines longer than the buffer are read in pieces)
+  int inValue; // (while counting values) are we in the middle of a value?
+  int numValues; // number of values in the current line so far
+  int loc, currLoc;
+
+  for (loc = 0; loc < numLocs; loc++)
+    index[loc].offset = index[loc].numSteps = 0;
+
+  in = openFile(climFile, "r");
+  currLoc = -1;
+  atLineStart = 1;
+  lineStart = 0;
+  lineNum = 0;
+  inValue = numValues = 0;
+  while (fgets(line, sizeof(line), in) != NULL) {
+    if (atLineStart)
+      lineNum++;
+
+    // count the values in this line (without converting them: a value is a run of characters other than white space):
+    for (c = line; *c != '\0'; c++) {
+      if (isspace((unsigned char)*c))
+	inValue = 0;
+      else if (!inValue) {
+	inValue = 1;
+	numValues++;
+      }
     }
+
+    if (atLineStart && sscanf(line, "%d", &loc) == 1) { // a new record (blank lines are skipped, as fscanf does in readClimData)
+      if (currLoc == -1 && loc != 0) {
+	printf("Error reading from climate file: first location must be loc. 0\n");
+	exit(1);
+      }
+      if (loc >= numLocs || loc < 0) {
+	printf("Error reading climate file: trying to read location %d, but numLocs = %d\n", loc, numLocs);
+	exit(1);
+      }
+      if (loc < currLoc) {
+	printf("Error reading climate file: was reading location %d, trying to read location %d\n", currLoc, loc);
+	printf("Climate records for a given location should be contiguous, and locations should be in ascending order\n");
+	exit(1);
+      }
+      if (loc > currLoc) { // first record of a new location
+	index[loc].offset = lineStart;
+	currLoc = loc;
+      }
+      index[loc].numSteps++;
+    }
+    atLineStart = (strchr(line, '\n') != NULL);
+    if (atLineStart || feof(in)) { // end of a line: check it held a whole record (or nothing)
+      if (numValues != 0 && numValues != CLIM_RECORD_FIELDS) {
+	printf("Error reading climate file %s: line %ld has %d values, but each record must be on a line of its own, with %d values\n",
+	       climFile, lineNum, numValues, CLIM_RECORD_FIELDS);
+	exit(1);
+      }
+      inValue = numValues = 0;
+    }
+    if (atLineStart)
+      lineStart = (long long)ftello(in);
   }
-  // and finally deallocate the vector itself:
- free(firstClimates);
+  fclose(in);
+
+  if (currLoc == -1) {
+    printf("Error: no climate data in %s\n", climFile);
+    exit(1);
+  }
+}
+
+
+/* Try to read the location index of a text climate file (whose status is given by textStat) from idxFile into index
+   return 1 if idxFile exists, is up to date and is consistent with numLocs; 0 if not (in which case index is left in an unknown state)
+*/
+int readClimIndex(char *idxFile, int numLocs, struct stat *textStat, ClimbinLocEntry *index) {
+  FILE *in;
+  struct stat idxStat;
+  ClimbinHeader header, expected;
+  int loc, ok;
+
+  if (stat(idxFile, &idxStat) != 0 || idxStat.st_mtime < textStat->st_mtime)
+    return 0; // no index, or text file has changed since index was written
+  in = fopen(idxFile, "rb");
+  if (in == NULL)
+    return 0;
+
+  makeClimbinHeader(&expected, CLIMIDX_MAGIC, numLocs, textStat);
+  ok = (fread(&header, sizeof(ClimbinHeader), 1, in) == 1) && (memcmp(&header, &expected, sizeof(ClimbinHeader)) == 0);
+  ok = ok && (fread(index, sizeof(ClimbinLocEntry), numLocs, in) == numLocs);
+  fclose(in);
+
+  ok = ok && (index[0].numSteps > 0); // must have data for location 0
+  for (loc = 0; ok && loc < numLocs; loc++)
+    ok = (index[loc].numSteps >= 0 && index[loc].numSteps <= INT_MAX && index[loc].offset >= 0 && index[loc].offset < textStat->st_size);
+  return ok;
+}
+
+
+/* Write the location index of a text climate file (whose status is given by textStat) to idxFile
+   As in writeClimCache, writes to a temporary file and then renames it; if it can't be written, print a warning and carry on
+*/
+void writeClimIndex(char *idxFile, int numLocs, struct stat *textStat, ClimbinLocEntry *index) {
+  char tmpFile[1024];
+  FILE *out;
+  ClimbinHeader header;
+  int ok;
+
+  if (strlen(idxFile) + 32 > sizeof(tmpFile)) {
+    printf("Warning: climate index file name %s is too long: not writing climate index\n", idxFile);
+    return;
+  }
+  sprintf(tmpFile, "%s.tmp%ld", idxFile, (long)getpid());
+
+  out = fopen(tmpFile, "wb");
+  if (out == NULL) {
+    printf("Warning: could not open %s for writing: not writing climate index\n", tmpFile);
+    return;
+  }
+
+  makeClimbinHeader(&header, CLIMIDX_MAGIC, numLocs, textStat);
+  ok = (fwrite(&header, sizeof(ClimbinHeader), 1, out) == 1);
+  ok = ok && (fwrite(index, sizeof(ClimbinLocEntry), numLocs, out) == numLocs);
+  if (fclose(out) != 0)
+    ok = 0;
+
+  if (!ok || rename(tmpFile, idxFile) != 0) {
+    printf("Warning: error writing climate index %s\n", idxFile);
+    remove(tmpFile);
+  }
+}
+
+
+/* PRE: climIndex is set up, location loc has climate data, and this thread has set its state to CLIM_LOADING
+   read location loc's climate records from the text climate file into allClimates[loc]
+*/
+void loadClimLocation(int loc) {
+  FILE *in;
+  ClimateArrays *clim;
+  int fileLoc, year, day;
+  double time, length;
+  double tair, tsoil, par, precip, vpd, vpdSoil, vPress, wspd, soilWetness;
+  int i, n;
+
+  n = climIndex[loc].numSteps;
+  clim = &(allClimates[loc]);
+  resizeClimateArrays(clim, n);
+
+  in = openFile(climIndexFile, "r");
+  if (fseeko(in, (off_t)climIndex[loc].offset, SEEK_SET) != 0) {
+    printf("Error reading climate file %s: couldn't seek to location %d\n", climIndexFile, loc);
+    exit(1);
+  }
+  for (i = 0; i < n; i++) {
+    if (fscanf(in, "%d %d %d %lf %lf %lf %lf %lf %lf %lf %lf %lf %lf %lf", &fileLoc, &year, &day, &time, &length, &tair, &tsoil, &par, &precip, &vpd, &vpdSoil, &vPress, &wspd, &soilWetness) != 14
+	|| fileLoc != loc) {
+      printf("Error reading climate file %s: record %d of location %d is missing or bad (has the file changed?)\n", climIndexFile, i, loc);
+      exit(1);
+    }
+    setClimRecord(clim, i, year, day, time, length, tair, tsoil, par, precip, vpd, vpdSoil, vPress, wspd, soilWetness);
+  }
+  fclose(in);
+
+  clim->numSteps = n;
+}
+
+
+/* Return the climate arrays to use at location loc (location 0's if there is no climate data for loc),
+   first reading them from the climate file if climate is loaded lazily and they haven't been read yet
+*/
+ClimateArrays *getClimate(int loc) {
+  if (climIndex == NULL) { // all climate was read up front
+    if (allClimates[loc].numSteps > 0)
+      return &(allClimates[loc]);
+    else // no climate data for this location
+      return &(allClimates[0]);
+  }
+
+  if (climIndex[loc].numSteps == 0) // no climate data for this location: use location 0's
+    loc = 0;
+  pthread_mutex_lock(&climLock);
+  while (climState[loc] == CLIM_LOADING) // another thread is reading it (e.g. the prefetch thread)
+    pthread_cond_wait(&climLoaded, &climLock);
+  if (climState[loc] == CLIM_NOT_LOADED) {
+    climState[loc] = CLIM_LOADING;
+    pthread_mutex_unlock(&climLock);
+    loadClimLocation(loc);
+    pthread_mutex_lock(&climLock);
+    climState[loc] = CLIM_LOADED;
+    pthread_cond_broadcast(&climLoaded);
+  }
+  pthread_mutex_unlock(&climLock);
+
+  return &(allClimates[loc]);
+}
+
+
+/* If climate is loaded lazily, free the climate arrays of location loc (they'll be read again if they're needed again)
+   so a run that goes through the locations one at a time only holds a few locations' climate at once
+   Location 0's climate is kept, since it is also used by every location without its own climate data
+   PRE: nothing is running at location loc
+*/
+void releaseClimate(int loc) {
+  ClimateArrays *clim;
+
+  if (climIndex == NULL || loc == 0)
+    return;
+
+  pthread_mutex_lock(&climLock);
+  clim = &(allClimates[loc]);
+  if (climState[loc] == CLIM_LOADED) {
+    free(clim->year);
+    free(clim->day);
+    free(clim->time);
+    free(clim->length);
+    free(clim->tair);
+    free(clim->tsoil);
+    free(clim->par);
+    free(clim->precip);
+    free(clim->vpd);
+    free(clim->vpdSoil);
+    free(clim->vPress);
+    free(clim->wspd);
+    free(clim->soilWetness);
+#if GDD
+    free(clim->gdd);
+#endif
+    memset(clim, 0, sizeof(ClimateArrays)); // all arrays NULL, numSteps = 0
+    climState[loc] = CLIM_NOT_LOADED;
+  }
+  pthread_mutex_unlock(&climLock);
+}
+
+
+/* A background reader for a run through locations locs[0..numLocs-1] in order: one thread, which reads each location's
+   climate ahead of the run, but never more than CLIMATE_PREFETCH_SLOTS - 1 locations ahead of the one being run
+   (so with the run releasing each location when it's done with it, at most CLIMATE_PREFETCH_SLOTS locations are held at once)
+   The reader never reads a location the run has already reached (the run reads that itself, through getClimate, if it
+   gets there first), and the run waits for any read of a location in progress before releasing it:
+   so no location is ever read again after it's been released
+*/
+typedef struct ClimatePrefetchStruct {
+  pthread_t reader;
+  pthread_mutex_t lock; // protects the rest
+  pthread_cond_t changed; // broadcast whenever running, reading or stop changes
+  int numLocs;
+  int *locs;
+  int running; // index (in locs) of the location being run
+  int nextToRead; // index of the next location the reader will read (if it's still ahead of running)
+  int reading; // the location the reader is reading now (-1 if none)
+  int stop; // set when the run is finished
+} ClimatePrefetch;
+
+
+// main function of the reader thread of prefetch (a ClimatePrefetch *)
+void *prefetchClimateMain(void *prefetch) {
+  ClimatePrefetch *pf = (ClimatePrefetch *)prefetch;
+  int loc;
+
+  pthread_mutex_lock(&(pf->lock));
+  while (1) {
+    if (pf->nextToRead <= pf->running) // the run has caught up with us
+      pf->nextToRead = pf->running + 1;
+    if (pf->stop || pf->nextToRead >= pf->numLocs)
+      break;
+    if (pf->nextToRead >= pf->running + CLIMATE_PREFETCH_SLOTS) { // far enough ahead: wait for the run to move on
+      pthread_cond_wait(&(pf->changed), &(pf->lock));
+      continue;
+    }
+
+    loc = pf->reading = pf->locs[pf->nextToRead++];
+    pthread_mutex_unlock(&(pf->lock));
+    getClimate(loc);
+    pthread_mutex_lock(&(pf->lock));
+    pf->reading = -1;
+    pthread_cond_broadcast(&(pf->changed));
+  }
+  pthread_mutex_unlock(&(pf->lock));
+
+  return NULL;
+}
+
+
+/* If climate is loaded lazily (and CLIMATE_PREFETCH is set), start a reader thread for a run through locations
+   locs[0..numLocs-1] in order (which starts at locs[0]), and return it; otherwise return NULL
+   The run must call prefetchMoveTo as it starts each location, prefetchRelease (rather than releaseClimate) when it's done
+   with each location, and finishClimatePrefetch at the end
+   locs must not change until then
+*/
+ClimatePrefetch *startClimatePrefetch(int numLocs, int locs[]) {
+#if CLIMATE_PREFETCH
+  ClimatePrefetch *pf;
+
+  if (climIndex == NULL || numLocs < 2)
+    return NULL;
+
+  pf = (ClimatePrefetch *)malloc(sizeof(ClimatePrefetch));
+  pthread_mutex_init(&(pf->lock), NULL);
+  pthread_cond_init(&(pf->changed), NULL);
+  pf->numLocs = numLocs;
+  pf->locs = locs;
+  pf->running = 0;
+  pf->nextToRead = 1;
+  pf->reading = -1;
+  pf->stop = 0;
+  if (pthread_create(&(pf->reader), NULL, prefetchClimateMain, pf) != 0) { // (if we can't, each location is just read when it's run)
+    pthread_mutex_destroy(&(pf->lock));
+    pthread_cond_destroy(&(pf->changed));
+    free(pf);
+    return NULL;
+  }
+  return pf;
+#else
+  return NULL;
+#endif
+}
+
+
+// tell the reader of pf (if not NULL) that the run is starting location # locIndex of its list (so it can read further ahead)
+void prefetchMoveTo(ClimatePrefetch *pf, int locIndex) {
+  if (pf == NULL)
+    return;
+
+  pthread_mutex_lock(&(pf->lock));
+  pf->running = locIndex;
+  pthread_cond_broadcast(&(pf->changed));
+  pthread_mutex_unlock(&(pf->lock));
+}
+
+
+// the run is done with location loc: release its climate (see releaseClimate), once pf's reader (if any) isn't reading it
+void prefetchRelease(ClimatePrefetch *pf, int loc) {
+  if (pf != NULL) {
+    pthread_mutex_lock(&(pf->lock));
+    while (pf->reading == loc)
+      pthread_cond_wait(&(pf->changed), &(pf->lock));
+    pthread_mutex_unlock(&(pf->lock));
+  }
+  releaseClimate(loc);
+}
+
+
+// stop the reader of pf (if not NULL), wait for it to finish, and free pf
+void finishClimatePrefetch(ClimatePrefetch *pf) {
+  if (pf == NULL)
+    return;
+
+  pthread_mutex_lock(&(pf->lock));
+  pf->stop = 1;
+  pthread_cond_broadcast(&(pf->changed));
+  pthread_mutex_unlock(&(pf->lock));
+  pthread_join(pf->reader, NULL);
+
+  pthread_mutex_destroy(&(pf->lock));
+  pthread_cond_destroy(&(pf->changed));
+  free(pf);
+}
+
+
+/* Set up lazy loading of climFile for numLocs locations: build (or read) its location index,
+   leave every location of allClimates empty, and then read the climate of locs[0..numWanted-1] now
+   (all other locations are read when first needed)
+
+   return an array containing the number of time steps in each location (dynamically allocated with malloc)
+   (locations without climate data get the number of time steps in location 0)
+*/
+int * indexClimData(char *climFile, int numLocs, int numWanted, int locs[]) {
+  int *steps;
+  int loc, i;
+#if CLIMATE_CACHE
+  char idxFile[1024];
+  struct stat textStat;
+  int haveIndex;
+#endif
+
+  if (strlen(climFile) + 4 > sizeof(climIndexFile)) {
+    printf("Error: climate file name %s is too long\n", climFile);
+    exit(1);
+  }
+  strcpy(climIndexFile, climFile);
+  climIndex = (ClimbinLocEntry *)malloc(numLocs * sizeof(ClimbinLocEntry));
+
+#if CLIMATE_CACHE
+  snprintf(idxFile, sizeof(idxFile), "%sidx", climFile); // (fits: climFile is no longer than climIndexFile allows)
+  haveIndex = (stat(climFile, &textStat) == 0) && readClimIndex(idxFile, numLocs, &textStat, climIndex);
+  if (!haveIndex) {
+    buildClimIndex(climFile, numLocs, climIndex);
+    if (stat(climFile, &textStat) == 0)
+      writeClimIndex(idxFile, numLocs, &textStat, climIndex);
+  }
+#else
+  buildClimIndex(climFile, numLocs, climIndex);
+#endif
+
+  allClimates = (ClimateArrays *)calloc(numLocs, sizeof(ClimateArrays)); // all arrays NULL, numSteps = 0
+  climState = (int *)malloc(numLocs * sizeof(int));
+  for (loc = 0; loc < numLocs; loc++)
+    climState[loc] = CLIM_NOT_LOADED;
+
+  steps = (int *)malloc(numLocs * sizeof(int));
+  for (loc = 0; loc < numLocs; loc++)
+    steps[loc] = (climIndex[loc].numSteps > 0) ? climIndex[loc].numSteps : climIndex[0].numSteps;
+
+  for (i = 0; i < numWanted; i++) {
+    if (locs[i] < 0 || locs[i] >= numLocs) {
+      printf("Error: asked to load climate for location %d, but numLocs = %d\n", locs[i], numLocs);
+      exit(1);
+    }
+    getClimate(locs[i]);
+  }
+
+  return steps;
+}
+
 
+// de-allocate space used for climate arrays
+void freeClimateArrays(int numLocs) {
+  ClimateArrays *clim;
+  int loc;
+
+  if (climMapping != NULL) { // arrays point into the binary climate cache: just unmap it
+    munmap(climMapping, climMappingSize);
+    climMapping = NULL;
+    free(allClimates);
+    return;
+  }
+
+  for (loc = 0; loc < numLocs; loc++) { // loop through allClimates, deallocating each location's arrays
+    clim = &(allClimates[loc]);
+    // note: free(NULL) is fine, for locations without any climate data
+    free(clim->year);
+    free(clim->day);
+    free(clim->time);
+    free(clim->length);
+    free(clim->tair);
+    free(clim->tsoil);
+    free(clim->par);
+    free(clim->precip);
+    free(clim->vpd);
+    free(clim->vpdSoil);
+    free(clim->vPress);
+    free(clim->wspd);
+    free(clim->soilWetness);
+#if GDD
+    free(clim->gdd);
+#endif
+  }
+  // and finally deallocate the vector itself:
+  free(allClimates);
 
+  free(climIndex); // (NULL unless climate was loaded lazily)
+  climIndex = NULL;
+  free(climState);
+  climState = NULL;
 }
 
 
@@ -874,7 +1850,7 @@ void freeClimateList(int numLocs) {
 // calculate amount of light absorbed
 // using light attenuation (as in PnET)
 // CURRENTLY UNUSED (see calcLightEff3)
-void calcLightEff2 (double *lightEff, double lai, double par) {
+void calcLightEff2(SipnetContext *ctx, double *lightEff, double lai, double par) {
   static const int NUM_LAYERS = 50;
 
   int layer; // counter
@@ -885,8 +1861,8 @@ void calcLightEff2 (double *lightEff, double lai, double par) {
   if (lai > 0 && par > 0) { // must have at least some leaves and some light
     for (layer = 1; layer <= NUM_LAYERS; layer++) {
       cumLai = lai * ((double)layer / NUM_LAYERS); // lai from this layer up
-      lightIntensity = par * exp(-1.0 * params.attenuation * cumLai); // between 0 and par
-      cumLightEff += (1 - pow(2, (-1.0 * lightIntensity/params.halfSatPar))); // add between 0 and 1
+      lightIntensity = par * exp(-1.0 * ctx->params.attenuation * cumLai); // between 0 and par
+      cumLightEff += (1 - pow(2, (-1.0 * lightIntensity/ctx->params.halfSatPar))); // add between 0 and 1
       // when lightIntensity = halfSatPar, add 1/2
     }
 
@@ -897,10 +1873,25 @@ void calcLightEff2 (double *lightEff, double lai, double par) {
 }
 
 
+// update running mean of FPAR (we don't care about climate length)
+// (called for each time step with some leaves and some light: by calcLightEff3, or by runEnsembleNoOut)
+void addFPAR(SipnetContext *ctx, double fAPAR) {
+  int err;
+
+  err = addValueToMeanTracker(ctx->meanFPAR, fAPAR, 1);
+  if (err != 0) {
+    printf("******* Error type %d while trying to add value to FPAR mean tracker in sipnet:potPSN() *******\n", err);
+    printf("FPAR = %f, climate->length = %f\n", fAPAR, ctx->clim->length[ctx->step]);
+    printf("Suggestion: try changing MEAN_FPAR_MAX_ENTRIES in sipnet.c\n");
+    exit(1);
+  }
+}
+
+
 // another method to calculate amount of light absorbed
 // using light attenuation (as in PnET)
 // difference between this and calcLightEff2 is that here we use Simpson's method to approximate the integral
-void calcLightEff3 (double *lightEff, double lai, double par) {
+void calcLightEff3(SipnetContext *ctx, double *lightEff, double lai, double par) {
   /*
     We are essentially integrating over the canopy, from top to bottom,
     but it's an ugly integral, so we'll approximate it numerically.
@@ -916,7 +1907,7 @@ void calcLightEff3 (double *lightEff, double lai, double par) {
   // Information on the distribution of LAI with height is available
   // as of March 2007 ... contact Dr. Maggie Prater Maggie.Prater@colorado.edu
 
-  static const int NUM_LAYERS = 6;
+  static const int NUM_LAYERS = PSN_LAYERS; // 6 (defined in ensembleKernel.h, since ensemblePotPsn uses it too)
   // believe it or not, 6 layers gives approximately the same result as 100 layers
 
   int layer; // counter
@@ -932,7 +1923,6 @@ void calcLightEff3 (double *lightEff, double lai, double par) {
     cumLightEff = 0.0; // the running sum
     layer = 0;
     coeff = 1;
-    int err;
     double fAPAR;		// Calculation of fAPAR according to 1 - exp(attenuation*LAI)
     double APAR;		// Absorbed PAR by the canopy
     double lightIntensityTop, lightIntensityBottom;	// PAR absorbed by the canopy
@@ -942,9 +1932,9 @@ void calcLightEff3 (double *lightEff, double lai, double par) {
     while (layer <= NUM_LAYERS) {
       cumLai = lai * ((double)layer / NUM_LAYERS); // lai from this layer up (starting at top)
 
-      lightIntensity = par * exp(-1.0 * params.attenuation * cumLai); // between 0 and par
+      lightIntensity = par * exp(-1.0 * ctx->params.attenuation * cumLai); // between 0 and par
 
-      currLightEff = (1 - pow(2, (-1.0 * lightIntensity/params.halfSatPar))); // between 0 and 1
+      currLightEff = (1 - pow(2, (-1.0 * lightIntensity/ctx->params.halfSatPar))); // between 0 and 1
       // when lightIntensity = halfSatPar, currLightEff = 1/2
       cumLightEff += coeff * currLightEff;
 
@@ -967,23 +1957,17 @@ void calcLightEff3 (double *lightEff, double lai, double par) {
 
 
     lightIntensityTop = par;  // Energy at the top of the canopy
-    lightIntensityBottom = par * exp(-1.0 * params.attenuation * lai); // LAI at the bottom of the canopy
+    lightIntensityBottom = par * exp(-1.0 * ctx->params.attenuation * lai); // LAI at the bottom of the canopy
 																		// between 0 and par
         // this is the amount of incident par
-    APAR = params.m_ballBerry * (lightIntensityTop - lightIntensityBottom);		// APAR at this layer
+    APAR = ctx->params.m_ballBerry * (lightIntensityTop - lightIntensityBottom);		// APAR at this layer
               // is a fraction of the difference between incoming par and transmitted par
 
 
     //fAPAR = APAR / par;		// Take the average across all of the layers
-	// fAPAR =  (1 - exp(-1.0 * params.attenuation * lai));		// 4/28/11: Update from TQuaife
-
-	  err = addValueToMeanTracker(meanFPAR, fAPAR, 1); // update running mean of FPAR (we don't care about climate length)
-	if (err != 0) {
-		printf("******* Error type %d while trying to add value to FPAR mean tracker in sipnet:potPSN() *******\n", err);
-		printf("FPAR = %f, climate->length = %f\n", fAPAR, climate->length);
-		printf("Suggestion: try changing MEAN_FPAR_MAX_ENTRIES in sipnet.c\n");
-		exit(1);
-	}
+	// fAPAR =  (1 - exp(-1.0 * ctx->params.attenuation * lai));		// 4/28/11: Update from TQuaife
+
+	addFPAR(ctx, fAPAR);
 
   }
   else // no leaves or no light!
@@ -998,7 +1982,7 @@ void calcLightEff3 (double *lightEff, double lai, double par) {
 
 // calculate gross photosynthesis without water effect (g C * m^-2 ground area * day^-1)
 // and base foliar respiration without temp, water, etc. (g C * m^-2 ground area * day^-1)
-void potPsn(double *potGrossPsn, double *baseFolResp, double lai, double tair, double vpd, double par, int day) {
+void potPsn(SipnetContext *ctx, double *potGrossPsn, double *baseFolResp, double lai, double tair, double vpd, double par, int day) {
   double grossAMax; // maximum possible gross respiration (nmol CO2 * g^-1 leaf * sec^-1)
   double dTemp, dVpd, lightEff; // decrease in photosynth. due to temp, vpd and amt. of light absorbed
   double respPerGram; // base foliar respiration in nmol CO2 * g^-1 leaf * sec^-1
@@ -1006,32 +1990,32 @@ void potPsn(double *potGrossPsn, double *baseFolResp, double lai, double tair, d
 		       to (g C * m^-2 ground area * day^-1) */
 
 
-  respPerGram = params.baseFolRespFrac * params.aMax;
+  respPerGram = ctx->params.baseFolRespFrac * ctx->params.aMax;
   // foliar respiration, unmodified by temp, etc.
-  grossAMax = params.aMax * params.aMaxFrac + respPerGram;
+  grossAMax = ctx->params.aMax * ctx->params.aMaxFrac + respPerGram;
 
-  dTemp = (params.psnTMax - tair)*(tair - params.psnTMin)/pow((params.psnTMax - params.psnTMin)/2.0, 2);
+  dTemp = (ctx->params.psnTMax - tair)*(tair - ctx->params.psnTMin)/pow((ctx->params.psnTMax - ctx->params.psnTMin)/2.0, 2);
   if (dTemp < 0)
     dTemp = 0.0;
 
-  dVpd = 1.0 - params.dVpdSlope * pow(vpd, params.dVpdExp);
+  dVpd = 1.0 - ctx->params.dVpdSlope * pow(vpd, ctx->params.dVpdExp);
   if (dVpd < 0)
     dVpd = 0.0;
 
-  calcLightEff3(&lightEff, lai, par);
+  calcLightEff3(ctx, &lightEff, lai, par);
 
-  conversion = C_WEIGHT * (1.0/TEN_9) * (params.leafCSpWt/params.cFracLeaf) * lai * SEC_PER_DAY; // to convert units
+  conversion = C_WEIGHT * (1.0/TEN_9) * (ctx->params.leafCSpWt/ctx->params.cFracLeaf) * lai * SEC_PER_DAY; // to convert units
   *potGrossPsn = grossAMax * dTemp * dVpd * lightEff * conversion;
   *baseFolResp = respPerGram * conversion; // do foliar resp. even if no photosynthesis in this time step
 
 
 
-  // printf("%f %f %f %f %f %f ", climate->length, grossAMax, conversion, dTemp, dVpd, lightEff);
+  // printf("%f %f %f %f %f %f ", ctx->clim->length[ctx->step], grossAMax, conversion, dTemp, dVpd, lightEff);
 }
 
 
 
-void moisture_bwb(double *trans, double *dWater, double potGrossPsn, double vpd, double vPress, double plantLeafC, double leafCSpWt, double soilWater) {
+void moisture_bwb(SipnetContext *ctx, double *trans, double *dWater, double potGrossPsn, double vpd, double vPress, double plantLeafC, double leafCSpWt, double soilWater) {
 /*moisture_bwb:  Calculates moisture use by using a Ball Woodrow Berry
  * Instead of A (net photosynthesis) we are driving the Ball Woodrow Berry
  * equation with potGrossPsn units: g C * m^-2 ground area * day^-1
@@ -1043,11 +2027,11 @@ double potTrans; // potential transpiration in the absense of plant water stress
   double vPress_sat; // Saturating Vapor Press (sum of VPD and vPress)
   double RH_pcent; // Relative Humidity - the ratio of vPress to saturating vapor pressure
   double lai_int; // calculate lai from current plantLeafC and the leafCSpwt */
-  lai_int = envi.plantLeafC / params.leafCSpWt;
+  lai_int = ctx->envi.plantLeafC / ctx->params.leafCSpWt;
  /*  We do not require lai since potGrossPsn is in units of
  *  g C * m^-2 ground area * day^-1 */
-  vPress_sat = climate->vPress + climate->vpd; //calculate saturating vapor pressure
-  RH_pcent = climate->vPress / vPress_sat; // calculate relative humidity for ball berry
+  vPress_sat = ctx->clim->vPress[ctx->step] + ctx->clim->vpd[ctx->step]; //calculate saturating vapor pressure
+  RH_pcent = ctx->clim->vPress[ctx->step] / vPress_sat; // calculate relative humidity for ball berry
 
 //  double wue; // water use efficiency, in mg CO2 fixed * g^-1 H20 transpired
 
@@ -1064,12 +2048,12 @@ double potTrans; // potential transpiration in the absense of plant water stress
                      * potGrossPsn/12*1000*LAI = umol carbon dioxide per
                      * m^2
                      * */;
-		gs_canopy = params.m_ballBerry * potGrossPsn/12*1000*lai_int * (RH_pcent/CO2_stom) ;
+		gs_canopy = ctx->params.m_ballBerry * potGrossPsn/12*1000*lai_int * (RH_pcent/CO2_stom) ;
 
 		//gcan = m*A*RelHum/CO2;
 		//mol  / m^2 leaf area
 
-		potTrans = (gs_canopy*climate->vpd)/lai_int*20/1000;
+		potTrans = (gs_canopy*ctx->clim->vpd[ctx->step])/lai_int*20/1000;
 		/* gs_canopy*climate_>vpd is the transpiration rate mol/m^2 leaf area per day
 		 * dividing by lai_init converts to mol per m^2 ground area
 		 * there are 20g water per mol
@@ -1078,9 +2062,9 @@ double potTrans; // potential transpiration in the absense of plant water stress
 		 *
 		 *  must convert to cm3 per cm2 land area.
 		 */
-    removableWater = soilWater * params.waterRemoveFrac;
-    if (climate->tsoil < params.frozenSoilThreshold) // frozen soil - less or no water available
-      removableWater *= params.frozenSoilEff;
+    removableWater = soilWater * ctx->params.waterRemoveFrac;
+    if (ctx->clim->tsoil[ctx->step] < ctx->params.frozenSoilThreshold) // frozen soil - less or no water available
+      removableWater *= ctx->params.frozenSoilEff;
       /* frozen soil effect: fraction of water available if soil is frozen
 		 (assume amt. of water avail. w/ frozen soil scales linearly with amt. of
 		 water avail. in thawed soil) */
@@ -1092,13 +2076,13 @@ double potTrans; // potential transpiration in the absense of plant water stress
 #if WATER_PSN // we're modeling water stress
     *dWater = *trans/potTrans; // from PnET: equivalent to setting DWATER_MAX = 1
 #else // WATER_PSN = 0
-    if (climate->tsoil < params.frozenSoilThreshold && params.frozenSoilEff == 0)
+    if (ctx->clim->tsoil[ctx->step] < ctx->params.frozenSoilThreshold && ctx->params.frozenSoilEff == 0)
       // (note: can't have partial shutdown of psn with frozen soil if WATER_PSN = 0)
       *dWater = 0; // still allow total shut down of psn. if soil is frozen
     else // either soil is thawed, or frozenSoilEff > 0
       *dWater = 1; // no water stress, even if *trans/potTrans < 1
 #endif // WATER_PSN
-//printf("Remove %f potT %f dW %f vpd %f \n", removableWater, potTrans, *dWater, climate->vpd);
+//printf("Remove %f potT %f dW %f vpd %f \n", removableWater, potTrans, *dWater, ctx->clim->vpd[ctx->step]);
   }
 }
 
@@ -1118,7 +2102,7 @@ double potTrans; // potential transpiration in the absense of plant water stress
 // Penman Monteith method of estimating transiration and water use
 //  Started Nov 2006 - coding commenced Nov 20th
 
-void moisture_pm(double *trans, double *dWater, double potGrossPsn, double vpd, double soilWater) {
+void moisture_pm(SipnetContext *ctx, double *trans, double *dWater, double potGrossPsn, double vpd, double soilWater) {
   double potTrans; // potential transpiration in the absense of plant water stress (cm H20 * day^-1)
   double removableWater;
 //not used   double wue; // water use efficiency, in mg CO2 fixed * g^-1 H20 transpired
@@ -1145,8 +2129,8 @@ void moisture_pm(double *trans, double *dWater, double potGrossPsn, double vpd,
     *dWater = 1; // dWater doesn't matter, since we don't have any photosynthesis
   }
   else {
-  	DELTA = (2508.3/((climate->tair +237.3)*(climate->tair +237.3))*exp((17.3*climate->tair)/(climate->tair +237.3)));
-    potTrans = (DELTA*((1- gapfraction/100)*climate->par - climate->tsoil) + (RHO*CP*vpd)/(rCanConst/climate->wspd))/(DELTA+GAMMA*(1 + (params.rdConst/climate->wspd)/(rCanConst/climate->wspd)));
+  	DELTA = (2508.3/((ctx->clim->tair[ctx->step] +237.3)*(ctx->clim->tair[ctx->step] +237.3))*exp((17.3*ctx->clim->tair[ctx->step])/(ctx->clim->tair[ctx->step] +237.3)));
+    potTrans = (DELTA*((1- gapfraction/100)*ctx->clim->par[ctx->step] - ctx->clim->tsoil[ctx->step]) + (RHO*CP*vpd)/(rCanConst/ctx->clim->wspd[ctx->step]))/(DELTA+GAMMA*(1 + (ctx->params.rdConst/ctx->clim->wspd[ctx->step])/(rCanConst/ctx->clim->wspd[ctx->step])));
 
     /*
      * the aerodynamic resistance - of the canopy can be calculated as follows:
@@ -1161,9 +2145,9 @@ void moisture_pm(double *trans, double *dWater, double potGrossPsn, double vpd,
      * k von Karman's constant, 0.41 [-],
      * wspd wind speed at height z [m s-1].
     */
-    removableWater = soilWater * params.waterRemoveFrac;
-    if (climate->tsoil < params.frozenSoilThreshold) // frozen soil - less or no water available
-      removableWater *= params.frozenSoilEff;
+    removableWater = soilWater * ctx->params.waterRemoveFrac;
+    if (ctx->clim->tsoil[ctx->step] < ctx->params.frozenSoilThreshold) // frozen soil - less or no water available
+      removableWater *= ctx->params.frozenSoilEff;
       /* frozen soil effect: fraction of water available if soil is frozen
 		(assume amt. of water avail. w/ frozen soil scales linearly with amt. of
 		 water avail. in thawed soil) */
@@ -1176,7 +2160,7 @@ void moisture_pm(double *trans, double *dWater, double potGrossPsn, double vpd,
 #if WATER_PSN // we're modeling water stress
     *dWater = *trans/potTrans; // from PnET: equivalent to setting DWATER_MAX = 1
 #else // WATER_PSN = 0
-    if (climate->tsoil < params.frozenSoilThreshold && params.frozenSoilEff == 0)
+    if (ctx->clim->tsoil[ctx->step] < ctx->params.frozenSoilThreshold && ctx->params.frozenSoilEff == 0)
       // (note: can't have partial shutdown of psn with frozen soil if WATER_PSN = 0)
       *dWater = 0; // still allow total shut down of psn. if soil is frozen
     else // either soil is thawed, or frozenSoilEff > 0
@@ -1191,7 +2175,7 @@ void moisture_pm(double *trans, double *dWater, double potGrossPsn, double vpd,
 
 // calculate transpiration (cm H20 * day^-1)
 // and dWater (factor between 0 and 1)
-void moisture(double *trans, double *dWater, double potGrossPsn, double vpd, double soilWater) {
+void moisture(SipnetContext *ctx, double *trans, double *dWater, double potGrossPsn, double vpd, double soilWater) {
   double potTrans; // potential transpiration in the absense of plant water stress (cm H20 * day^-1)
   double removableWater;
   double wue; // water use efficiency, in mg CO2 fixed * g^-1 H20 transpired
@@ -1202,13 +2186,13 @@ void moisture(double *trans, double *dWater, double potGrossPsn, double vpd, dou
   }
 
   else {
-    wue = params.wueConst/vpd;
+    wue = ctx->params.wueConst/vpd;
     potTrans = potGrossPsn/wue * 1000.0 * (44.0/12.0) * (1.0/10000.0);
     // 1000 converts g to mg; 44/12 converts g C to g CO2, 1/10000 converts m^2 to cm^2
 
-    removableWater = soilWater * params.waterRemoveFrac;
-    if (climate->tsoil < params.frozenSoilThreshold) // frozen soil - less or no water available
-      removableWater *= params.frozenSoilEff; /* frozen soil effect: fraction of water available if soil is frozen
+    removableWater = soilWater * ctx->params.waterRemoveFrac;
+    if (ctx->clim->tsoil[ctx->step] < ctx->params.frozenSoilThreshold) // frozen soil - less or no water available
+      removableWater *= ctx->params.frozenSoilEff; /* frozen soil effect: fraction of water available if soil is frozen
 						 (assume amt. of water avail. w/ frozen soil scales linearly with amt. of
 						 water avail. in thawed soil) */
     if (removableWater >= potTrans)
@@ -1220,7 +2204,7 @@ void moisture(double *trans, double *dWater, double potGrossPsn, double vpd, dou
 #if WATER_PSN // we're modeling water stress
     *dWater = *trans/potTrans; // from PnET: equivalent to setting DWATER_MAX = 1
 #else // WATER_PSN = 0
-    if (climate->tsoil < params.frozenSoilThreshold && params.frozenSoilEff == 0)
+    if (ctx->clim->tsoil[ctx->step] < ctx->params.frozenSoilThreshold && ctx->params.frozenSoilEff == 0)
       // (note: can't have partial shutdown of psn with frozen soil if WATER_PSN = 0)
       *dWater = 0; // still allow total shut down of psn. if soil is frozen
     else // either soil is thawed, or frozenSoilEff > 0
@@ -1236,31 +2220,31 @@ void moisture(double *trans, double *dWater, double potGrossPsn, double vpd, dou
 // 0 = no, 1 = yes
 // note: there may be some fluctuations in this signal for some methods of determining growing season start
 // (e.g. for soil temp-based leaf growth)
-int pastLeafGrowth() {
+int pastLeafGrowth(SipnetContext *ctx) {
 
 #if GDD
-  return (climate->gdd >= params.gddLeafOn); // growing degree days threshold
+  return (ctx->clim->gdd[ctx->step] >= ctx->params.gddLeafOn); // growing degree days threshold
 #elif SOIL_PHENOL
-  return (climate->tsoil >= params.soilTempLeafOn); // soil temperature threshold
+  return (ctx->clim->tsoil[ctx->step] >= ctx->params.soilTempLeafOn); // soil temperature threshold
 #else
   double currTime;
   int currYear;
   int currDay;
-  currYear = climate->year;
-  currDay = climate->day;
-  currTime = (double) climate->day + climate->time/24.0;
+  currYear = ctx->clim->year[ctx->step];
+  currDay = ctx->clim->day[ctx->step];
+  currTime = (double) ctx->clim->day[ctx->step] + ctx->clim->time[ctx->step]/24.0;
 
  // printf("stuff: %8d  %8d  \n",currYear,currDay);
 
-  return (currTime >= params.leafOnDay); // turn-on day
+  return (currTime >= ctx->params.leafOnDay); // turn-on day
   //return 1;
 #endif
 }
 
 // have we passed the growing season-end leaf fall trigger this year?
 // 0 = no, 1 = yes
-int pastLeafFall() {
-  return ((climate->day + climate->time/24.0) >= params.leafOffDay); // turn-off day
+int pastLeafFall(SipnetContext *ctx) {
+  return ((ctx->clim->day[ctx->step] + ctx->clim->time[ctx->step]/24.0) >= ctx->params.leafOffDay); // turn-off day
 	//return 1;
 }
 
@@ -1268,37 +2252,37 @@ int pastLeafFall() {
 // calculate leafCreation and leafLitter fluxes (g C/m^2 ground/day)
 // leafCreation is a fraction of recent mean npp, plus some constant amount at start of growing season
 // leafLitter is a constant rate, plus some additional fraction of leaves at end of growing season
-void leafFluxes(double *leafCreation, double *leafLitter, double plantLeafC) {
+void leafFluxes(SipnetContext *ctx, double *leafCreation, double *leafLitter, double plantLeafC) {
   double npp; // temporal mean of recent npp (g C * m^-2 ground * day^-1)
 
-  npp = getMeanTrackerMean(meanNPP);
+  npp = getMeanTrackerMean(ctx->meanNPP);
   // first determine the fluxes that happen at every time step, not just start & end of growing season:
   if (npp > 0)
-    *leafCreation = npp * params.leafAllocation; // a fraction of NPP is allocated to leaf growth
+    *leafCreation = npp * ctx->params.leafAllocation; // a fraction of NPP is allocated to leaf growth
   else // net loss of C in this time step - no C left for growth
     *leafCreation = 0;
-  *leafLitter = plantLeafC * params.leafTurnoverRate; // a constant fraction of leaves fall in each time step
+  *leafLitter = plantLeafC * ctx->params.leafTurnoverRate; // a constant fraction of leaves fall in each time step
 
   // now add add'l fluxes at start/end of growing season:
 
   // first check for new year; if new year, reset trackers (since we haven't done leaf growth or fall yet in this new year):
-  if (climate->year > phenologyTrackers.lastYear) { // HAPPY NEW YEAR!
-    phenologyTrackers.didLeafGrowth = 0;
-    phenologyTrackers.didLeafFall = 0;
-    phenologyTrackers.lastYear = climate->year;
+  if (ctx->clim->year[ctx->step] > ctx->phenologyTrackers.lastYear) { // HAPPY NEW YEAR!
+    ctx->phenologyTrackers.didLeafGrowth = 0;
+    ctx->phenologyTrackers.didLeafFall = 0;
+    ctx->phenologyTrackers.lastYear = ctx->clim->year[ctx->step];
 
   }
 
   // check for start of growing season:
-  if (!phenologyTrackers.didLeafGrowth && pastLeafGrowth()) { // we just reached the start of the growing season
-    *leafCreation += (params.leafGrowth / climate->length);
-    phenologyTrackers.didLeafGrowth = 1;
+  if (!ctx->phenologyTrackers.didLeafGrowth && pastLeafGrowth(ctx)) { // we just reached the start of the growing season
+    *leafCreation += (ctx->params.leafGrowth / ctx->clim->length[ctx->step]);
+    ctx->phenologyTrackers.didLeafGrowth = 1;
   }
 
   // check for end of growing season:
-  if (!phenologyTrackers.didLeafFall && pastLeafFall()) { // we just reached the end of the growing season
-    *leafLitter += (plantLeafC * params.fracLeafFall) / climate->length;
-    phenologyTrackers.didLeafFall = 1;
+  if (!ctx->phenologyTrackers.didLeafFall && pastLeafFall(ctx)) { // we just reached the end of the growing season
+    *leafLitter += (plantLeafC * ctx->params.fracLeafFall) / ctx->clim->length[ctx->step];
+    ctx->phenologyTrackers.didLeafFall = 1;
   }
 }
 
@@ -1309,7 +2293,7 @@ void leafFluxes(double *leafCreation, double *leafLitter, double plantLeafC) {
 
 // this is the simplified water flow function, which has only one soil moisture layer
 // and does not do evaporation of any kind, or fast flow (sets these all to 0)
-void simpleWaterFlow(double *rain, double *snowFall, double *immedEvap, double *snowMelt, double *sublimation,
+void simpleWaterFlow(SipnetContext *ctx, double *rain, double *snowFall, double *immedEvap, double *snowMelt, double *sublimation,
 		     double *fastFlow, double *evaporation, double *topDrainage, double *bottomDrainage,
 		     double water, double snow, double precip, double temp, double length, double trans)
 {
@@ -1325,7 +2309,7 @@ void simpleWaterFlow(double *rain, double *snowFall, double *immedEvap, double *
 	*snowFall = 0;
 	*rain = precip/length;
 	if (snow > 0) {
-	  *snowMelt = params.snowMelt * temp; // snow melt proportional to temp.
+	  *snowMelt = ctx->params.snowMelt * temp; // snow melt proportional to temp.
 	  if ((*snowMelt * length) > snow) // can only melt what's there!
 	    *snowMelt = snow/length;
 	}
@@ -1340,7 +2324,7 @@ void simpleWaterFlow(double *rain, double *snowFall, double *immedEvap, double *
 #endif // #if snow
 
   netIn = (*rain + *snowMelt - trans) * length;
-  *bottomDrainage = ((water + netIn) - params.soilWHC)/length;
+  *bottomDrainage = ((water + netIn) - ctx->params.soilWHC)/length;
   if (*bottomDrainage < 0)
     *bottomDrainage = 0;
 
@@ -1353,18 +2337,18 @@ void simpleWaterFlow(double *rain, double *snowFall, double *immedEvap, double *
 
 // calculate total rain and snowfall (cm water equiv./day)
 // also, immediate evaporation (from interception) (cm/day)
-void calcPrecip(double *rain, double *snowFall, double *immedEvap, double lai)
+void calcPrecip(SipnetContext *ctx, double *rain, double *snowFall, double *immedEvap, double lai)
 {
   // below freezing -> precip falls as snow
-  if (climate->tair <= 0) {
-    *snowFall = climate->precip/climate->length;
+  if (ctx->clim->tair[ctx->step] <= 0) {
+    *snowFall = ctx->clim->precip[ctx->step]/ctx->clim->length[ctx->step];
     *rain = 0;
   }
 
   // above freezing -> precip falls as rain
   else {
     *snowFall = 0;
-    *rain = climate->precip/climate->length;
+    *rain = ctx->clim->precip[ctx->step]/ctx->clim->length[ctx->step];
   }
 
   /* Immediate evaporation is a sum of evaporation from canopy interception
@@ -1376,17 +2360,17 @@ void calcPrecip(double *rain, double *snowFall, double *immedEvap, double lai)
 
    #if LEAF_WATER
     double maxLeafPool;
-    printf("Leaf water is on. This is a message to confirm testing.\n");
+//    printf("Leaf water is on. This is a message to confirm testing.\n");
 
-    maxLeafPool = lai * params.leafPoolDepth; // calculate current leaf pool size depending on lai
-    *immedEvap = (*rain) * params.immedEvapFrac; 
+    maxLeafPool = lai * ctx->params.leafPoolDepth; // calculate current leaf pool size depending on lai
+    *immedEvap = (*rain) * ctx->params.immedEvapFrac; 
 
     // don't evaporate more than pool size, excess water will go to the soil
     if(*immedEvap > maxLeafPool)
      *immedEvap = maxLeafPool;
  
    #else
-    *immedEvap = (*rain) * params.immedEvapFrac;
+    *immedEvap = (*rain) * ctx->params.immedEvapFrac;
    #endif
 }
 
@@ -1394,7 +2378,7 @@ void calcPrecip(double *rain, double *snowFall, double *immedEvap, double lai)
 // calculate snow melt (cm water equiv./day) & sublimation (cm water equiv./day)
 // ensure we don't overdrain the snowpack (so that it becomes negative)
 // snowFall in cm/day
-void snowPack(double *snowMelt, double *sublimation, double snowFall)
+void snowPack(SipnetContext *ctx, double *snowMelt, double *sublimation, double snowFall)
 {
   // conversion factor for sublimation
   static const double CONVERSION = (RHO * CP)/GAMMA * (1./LAMBDA_S)
@@ -1405,7 +2389,7 @@ void snowPack(double *snowMelt, double *sublimation, double snowFall)
   double snowRemaining; // to make sure we don't get rid of more than there is
 
   // if no snow, set fluxes to 0
-  if (envi.snow <= 0) {
+  if (ctx->envi.snow <= 0) {
     *snowMelt = 0;
     *sublimation = 0;
   }
@@ -1414,10 +2398,10 @@ void snowPack(double *snowMelt, double *sublimation, double snowFall)
   else {
     // first calculate sublimation, then snow melt
     // (if there's not enough snow to do both, priority given to sublimation)
-    rd = (params.rdConst)/(climate->wspd); // aerodynamic resistance (sec/m)
-    *sublimation = CONVERSION * (E_STAR_SNOW - climate->vPress)/rd;
+    rd = (ctx->params.rdConst)/(ctx->clim->wspd[ctx->step]); // aerodynamic resistance (sec/m)
+    *sublimation = CONVERSION * (E_STAR_SNOW - ctx->clim->vPress[ctx->step])/rd;
 
-    snowRemaining = envi.snow + (snowFall * climate->length);
+    snowRemaining = ctx->envi.snow + (snowFall * ctx->clim->length[ctx->step]);
 
     // remove to allow sublimation of a negative amount of snow
     // right now we can't sublime a negative amount of snow
@@ -1425,26 +2409,26 @@ void snowPack(double *snowMelt, double *sublimation, double snowFall)
       *sublimation = 0;
 
     // make sure we don't sublime more than there is to sublime:
-    if (snowRemaining - (*sublimation * climate->length) < 0) {
-      *sublimation = snowRemaining/climate->length;
+    if (snowRemaining - (*sublimation * ctx->clim->length[ctx->step]) < 0) {
+      *sublimation = snowRemaining/ctx->clim->length[ctx->step];
       snowRemaining = 0;
     }
 
     else
-      snowRemaining -= (*sublimation * climate->length);
+      snowRemaining -= (*sublimation * ctx->clim->length[ctx->step]);
 
 
     // below freezing: no snow melt
-    if (climate->tair <= 0)
+    if (ctx->clim->tair[ctx->step] <= 0)
       *snowMelt = 0;
 
     // above freezing: melt snow
     else {
-      *snowMelt = params.snowMelt * climate->tair; // snow melt proportional to temp.
+      *snowMelt = ctx->params.snowMelt * ctx->clim->tair[ctx->step]; // snow melt proportional to temp.
 
       // make sure we don't melt more than there is to melt:
-      if (snowRemaining - (*snowMelt * climate->length) < 0)
-	*snowMelt = snowRemaining/climate->length;
+      if (snowRemaining - (*snowMelt * ctx->clim->length[ctx->step]) < 0)
+	*snowMelt = snowRemaining/ctx->clim->length[ctx->step];
     } // end else above freezing
   } // end else there is snow
 } // end snowPack
@@ -1460,7 +2444,7 @@ void snowPack(double *snowMelt, double *sublimation, double snowFall)
 // snowMelt in cm water equiv./day
 // fluxesOut is the sum of any fluxes out of this layer that have already been calculated
 // (e.g. transpiration if we're just using one layer) (for calculating remaining water/drainage) (cm/day)
-void evapSoilFluxes(double *fastFlow, double *evaporation, double *drainage,
+void evapSoilFluxes(SipnetContext *ctx, double *fastFlow, double *evaporation, double *drainage,
 	      double water, double whc, double netRain, double snowMelt, double fluxesOut)
 {
   // conversion factor for evaporation
@@ -1477,22 +2461,22 @@ void evapSoilFluxes(double *fastFlow, double *evaporation, double *drainage,
   netIn = netRain + snowMelt;
 
   // fast flow: fraction that goes directly to drainage
-  *fastFlow = netIn * params.fastFlowFrac;
+  *fastFlow = netIn * ctx->params.fastFlowFrac;
   netIn -= *fastFlow;
 
   // calculate evaporation:
   // first calculate how much water is left to evaporate (used later)
-  waterRemaining = water + netIn * climate->length - fluxesOut * climate->length;
+  waterRemaining = water + netIn * ctx->clim->length[ctx->step] - fluxesOut * ctx->clim->length[ctx->step];
 
   // if there's a snow pack, don't evaporate from soil:
-  if (envi.snow > 0)
+  if (ctx->envi.snow > 0)
     *evaporation = 0;
 
   // else no snow pack:
   else {
-    rd = (params.rdConst)/(climate->wspd); // aerodynamic resistance (sec/m)
-    rsoil = exp(params.rSoilConst1 - params.rSoilConst2 * (water/whc));
-    *evaporation = CONVERSION * climate->vpdSoil/(rd + rsoil);
+    rd = (ctx->params.rdConst)/(ctx->clim->wspd[ctx->step]); // aerodynamic resistance (sec/m)
+    rsoil = exp(ctx->params.rSoilConst1 - ctx->params.rSoilConst2 * (water/whc));
+    *evaporation = CONVERSION * ctx->clim->vpdSoil[ctx->step]/(rd + rsoil);
     // by using vpd we assume that relative humidity of soil pore space is 1
     // (when this isn't true, there won't be much water evaporated anyway)
 
@@ -1501,40 +2485,40 @@ void evapSoilFluxes(double *fastFlow, double *evaporation, double *drainage,
       *evaporation = 0;
 
     // make sure we don't evaporate more than we have:
-    if (waterRemaining - (*evaporation * climate->length) < TINY) {
-      *evaporation = (waterRemaining - TINY)/climate->length; // leave a tiny little bit, to avoid negative water due to round-off errors
+    if (waterRemaining - (*evaporation * ctx->clim->length[ctx->step]) < TINY) {
+      *evaporation = (waterRemaining - TINY)/ctx->clim->length[ctx->step]; // leave a tiny little bit, to avoid negative water due to round-off errors
       waterRemaining = 0;
     }
     else
-      waterRemaining -= (*evaporation * climate->length);
+      waterRemaining -= (*evaporation * ctx->clim->length[ctx->step]);
   }
 
 #if LITTER_WATER_DRAINAGE // we're calculating drainage even when evap. layer is not overflowing
-  *drainage = params.litWaterDrainRate * (water/whc); // drainage rate is proportional to fractional soil moisture
+  *drainage = ctx->params.litWaterDrainRate * (water/whc); // drainage rate is proportional to fractional soil moisture
   // make sure we don't drain more than we have:
-  if (waterRemaining - (*drainage * climate->length) < TINY) {
-    *drainage = (waterRemaining - TINY)/climate->length; // leave a tiny little bit, to avoid negative water due to round-off errors
+  if (waterRemaining - (*drainage * ctx->clim->length[ctx->step]) < TINY) {
+    *drainage = (waterRemaining - TINY)/ctx->clim->length[ctx->step]; // leave a tiny little bit, to avoid negative water due to round-off errors
     waterRemaining = 0;
   }
   else
-    waterRemaining -= (*drainage * climate->length);
+    waterRemaining -= (*drainage * ctx->clim->length[ctx->step]);
 #else // LITTER_WATER_DRAINAGE = 0
   *drainage = 0;
 #endif
 
   // drain any water that remains beyond water holding capacity:
   if (waterRemaining > whc)
-    *drainage += (waterRemaining - whc)/(climate->length);
+    *drainage += (waterRemaining - whc)/(ctx->clim->length[ctx->step]);
 }
 
 
 // calculate drainage from bottom (soil/transpiration) layer (cm/day)
 // based on current soil water store (cm), whc, drainage from top (cm/day) and transpiration (cm/day)
-void transSoilDrainage(double *bottomDrainage, double topDrainage, double trans, double soilWater) {
+void transSoilDrainage(SipnetContext *ctx, double *bottomDrainage, double topDrainage, double trans, double soilWater) {
   double waterRemaining; // cm
 
-  waterRemaining = soilWater + (topDrainage - trans) * climate->length;
-  *bottomDrainage = (waterRemaining - params.soilWHC)/(climate->length);
+  waterRemaining = soilWater + (topDrainage - trans) * ctx->clim->length[ctx->step];
+  *bottomDrainage = (waterRemaining - ctx->params.soilWHC)/(ctx->clim->length[ctx->step]);
   if (*bottomDrainage < 0)
     *bottomDrainage = 0;
 }
@@ -1547,16 +2531,16 @@ void transSoilDrainage(double *bottomDrainage, double topDrainage, double trans,
 // Also calculates drainage from bottom (soil/transpiration) layer (cm/day)
 // Note that there may only be one layer, in which case we have only the bottomDrainage term,
 // and evap. and trans. come from same layer.
-void soilWaterFluxes(double *fastFlow, double *evaporation, double *topDrainage, double *bottomDrainage,
+void soilWaterFluxes(SipnetContext *ctx, double *fastFlow, double *evaporation, double *topDrainage, double *bottomDrainage,
 		     double netRain, double snowMelt, double trans, double litterWater, double soilWater) {
 
 #if LITTER_WATER
-  evapSoilFluxes(fastFlow, evaporation, topDrainage, litterWater, params.litterWHC, netRain, snowMelt, 0);
+  evapSoilFluxes(ctx, fastFlow, evaporation, topDrainage, litterWater, ctx->params.litterWHC, netRain, snowMelt, 0);
   // last parameter = fluxes out that have already been calculated = 0
-  transSoilDrainage(bottomDrainage, *topDrainage, trans, soilWater);
+  transSoilDrainage(ctx, bottomDrainage, *topDrainage, trans, soilWater);
 #else // only one soil moisture pool: evap. and trans. both happen from this pool
   *topDrainage = 0; // no top layer, only a bottom layer
-  evapSoilFluxes(fastFlow, evaporation, bottomDrainage, soilWater, params.soilWHC, netRain, snowMelt, trans);
+  evapSoilFluxes(ctx, fastFlow, evaporation, bottomDrainage, soilWater, ctx->params.soilWHC, netRain, snowMelt, trans);
   // last parameter = fluxes out that have already been calculated: transpiration
 #endif
 
@@ -1571,18 +2555,18 @@ void getGpp(double *gpp, double potGrossPsn, double dWater) {
 
 // calculate foliar respiration and wood maint. resp, both in g C * m^-2 ground area * day^-1
 // does *not* explicitly model growth resp. (includes it in maint. resp)
-void vegResp(double *folResp, double *woodResp, double baseFolResp) {
-  *folResp = baseFolResp * pow(params.vegRespQ10, (climate->tair - params.psnTOpt)/10.0);
-  if (climate->tsoil < params.frozenSoilThreshold)
-    *folResp *= params.frozenSoilFolREff; // allows foliar resp. to be shutdown by a given fraction in winter
+void vegResp(SipnetContext *ctx, double *folResp, double *woodResp, double baseFolResp) {
+  *folResp = baseFolResp * pow(ctx->params.vegRespQ10, (ctx->clim->tair[ctx->step] - ctx->params.psnTOpt)/10.0);
+  if (ctx->clim->tsoil[ctx->step] < ctx->params.frozenSoilThreshold)
+    *folResp *= ctx->params.frozenSoilFolREff; // allows foliar resp. to be shutdown by a given fraction in winter
 
-  *woodResp = params.baseVegResp * envi.plantWoodC * pow(params.vegRespQ10, climate->tair/10.0);
+  *woodResp = ctx->params.baseVegResp * ctx->envi.plantWoodC * pow(ctx->params.vegRespQ10, ctx->clim->tair[ctx->step]/10.0);
 }
 
 // calculate foliar respiration and wood maint. resp, both in g C * m^-2 ground area * day^-1
 // does *not* explicitly model growth resp. (includes it in maint. resp)
-void calcRootResp(double *rootResp, double respQ10, double baseRate, double poolSize) {
-  *rootResp = baseRate * poolSize * pow(respQ10, climate->tsoil/10.0);
+void calcRootResp(SipnetContext *ctx, double *rootResp, double respQ10, double baseRate, double poolSize) {
+  *rootResp = baseRate * poolSize * pow(respQ10, ctx->clim->tsoil[ctx->step]/10.0);
 
 
 }
@@ -1591,13 +2575,13 @@ void calcRootResp(double *rootResp, double respQ10, double baseRate, double pool
 // a second veg. resp. method:
 // calculate foliar resp., wood maint. resp. and growth resp., all in g C * m^-2 ground area * day^-1
 // growth resp. modeled in a very simple way
-void vegResp2(double *folResp, double *woodResp, double *growthResp, double baseFolResp, double gpp) {
-  *folResp = baseFolResp * pow(params.vegRespQ10, (climate->tair - params.psnTOpt)/10.0);
-  if (climate->tsoil < params.frozenSoilThreshold)
-    *folResp *= params.frozenSoilFolREff; // allows foliar resp. to be shutdown by a given fraction in winter
+void vegResp2(SipnetContext *ctx, double *folResp, double *woodResp, double *growthResp, double baseFolResp, double gpp) {
+  *folResp = baseFolResp * pow(ctx->params.vegRespQ10, (ctx->clim->tair[ctx->step] - ctx->params.psnTOpt)/10.0);
+  if (ctx->clim->tsoil[ctx->step] < ctx->params.frozenSoilThreshold)
+    *folResp *= ctx->params.frozenSoilFolREff; // allows foliar resp. to be shutdown by a given fraction in winter
 
-  *woodResp = params.baseVegResp * envi.plantWoodC * pow(params.vegRespQ10, climate->tair/10.0);
-  *growthResp = params.growthRespFrac * getMeanTrackerMean(meanNPP); // Rg is a fraction of the recent mean NPP
+  *woodResp = ctx->params.baseVegResp * ctx->envi.plantWoodC * pow(ctx->params.vegRespQ10, ctx->clim->tair[ctx->step]/10.0);
+  *growthResp = ctx->params.growthRespFrac * getMeanTrackerMean(ctx->meanNPP); // Rg is a fraction of the recent mean NPP
 
   if (*growthResp < 0)
     *growthResp = 0;
@@ -1606,19 +2590,19 @@ void vegResp2(double *folResp, double *woodResp, double *growthResp, double base
 /////////////////
 
 // ensure that all the allocation to wood + leaves + fine roots < 1
-void ensureAllocation() {
+void ensureAllocation(SipnetContext *ctx) {
 	double allocationSum;
 
-	allocationSum = params.leafAllocation+params.woodAllocation+params.fineRootAllocation;
+	allocationSum = ctx->params.leafAllocation+ctx->params.woodAllocation+ctx->params.fineRootAllocation;
 
 	if (allocationSum > 1) {
-		params.woodAllocation = 0;
+		ctx->params.woodAllocation = 0;
 
-		if (params.leafAllocation+params.fineRootAllocation > 1) {
-	 		params.fineRootAllocation = 0;
+		if (ctx->params.leafAllocation+ctx->params.fineRootAllocation > 1) {
+	 		ctx->params.fineRootAllocation = 0;
 
-	 		if (params.leafAllocation > 1 ) {
-				params.leafAllocation = 0; }
+	 		if (ctx->params.leafAllocation > 1 ) {
+				ctx->params.leafAllocation = 0; }
 	 	}
 	}
 
@@ -1627,7 +2611,7 @@ void ensureAllocation() {
 
 
 // Currently we have a water effect and an effect for different cold soil parameters  (this is maintenance respiration)
-void calcMaintenanceRespiration(double tsoil, double water, double whc) {
+void calcMaintenanceRespiration(SipnetContext *ctx, double tsoil, double water, double whc) {
 
 	double moistEffect;
 	double tempEffect;
@@ -1645,10 +2629,10 @@ void calcMaintenanceRespiration(double tsoil, double water, double whc) {
   			moistEffect = pow(((water/whc - 1.7)/(0.55 - 1.7)), daycentWaterExp)
     			* pow((water/whc + 0.007)/(0.55 + 0.007), 3.22);
 		#else // using PnET formulation
-  			moistEffect = pow((water/whc), params.soilRespMoistEffect);
+  			moistEffect = pow((water/whc), ctx->params.soilRespMoistEffect);
 		#endif // DAYCENT_WATER_HRESP
 
-		if (climate->tsoil < 0) moistEffect=1;		// Ignore moisture effects in frozen soils
+		if (ctx->clim->tsoil[ctx->step] < 0) moistEffect=1;		// Ignore moisture effects in frozen soils
 	#else // no WATER_HRESP
  		moistEffect = 1;
 	#endif // WATER_HRESP
@@ -1677,17 +2661,17 @@ void calcMaintenanceRespiration(double tsoil, double water, double whc) {
 
 
 			#if SEASONAL_R_SOIL 		// decide which parameters to use based on tsoil
-  				if (tsoil >= params.coldSoilThreshold) {	// use normal (warm temp.) params
+  				if (tsoil >= ctx->params.coldSoilThreshold) {	// use normal (warm temp.) params
 
-    					poolBaseRespiration=params.baseSoilResp;
-		 				poolQ10=params.soilRespQ10;
+    					poolBaseRespiration=ctx->params.baseSoilResp;
+		 				poolQ10=ctx->params.soilRespQ10;
 
 		 				tempEffect=poolBaseRespiration*pow(poolQ10,tsoil/10);
 
   				} else { // use cold temp. params
 
-    				poolBaseRespiration=params.baseSoilRespCold;
-		 			poolQ10=params.soilRespQ10Cold;
+    				poolBaseRespiration=ctx->params.baseSoilRespCold;
+		 			poolQ10=ctx->params.soilRespQ10Cold;
 
 
 		 			tempEffect=poolBaseRespiration*pow(poolQ10,tsoil/10);
@@ -1695,14 +2679,14 @@ void calcMaintenanceRespiration(double tsoil, double water, double whc) {
   				}
 			#else // SEASONAL_R_SOIL FALSE -> always use normal params
 
-    			poolBaseRespiration=params.baseSoilResp;
-				poolQ10=params.soilRespQ10;
+    			poolBaseRespiration=ctx->params.baseSoilResp;
+				poolQ10=ctx->params.soilRespQ10;
 
 				tempEffect=poolBaseRespiration*pow(poolQ10,tsoil/10);
 
 			#endif
 
-			fluxes.maintRespiration[counter]=envi.soil[counter]*moistEffect*tempEffect;
+			ctx->fluxes.maintRespiration[counter]=ctx->envi.soil[counter]*moistEffect*tempEffect;
 		}
 
 	#else		// We use a single pool model
@@ -1711,24 +2695,24 @@ void calcMaintenanceRespiration(double tsoil, double water, double whc) {
 
 		#if MICROBES	// If we don't have a multipool approach, respiration is determined by microbe biomass
 
-			tempEffect=params.baseMicrobeResp*pow(params.microbeQ10,tsoil/10);
+			tempEffect=ctx->params.baseMicrobeResp*pow(ctx->params.microbeQ10,tsoil/10);
 
-			fluxes.maintRespiration=envi.microbeC*moistEffect*tempEffect;
+			ctx->fluxes.maintRespiration=ctx->envi.microbeC*moistEffect*tempEffect;
 		#else
 
 			#if SEASONAL_R_SOIL 		// decide which parameters to use based on tsoil
-  				if (tsoil >= params.coldSoilThreshold) {	// use normal (warm temp.) params
-		 			tempEffect=params.baseSoilResp*pow(params.soilRespQ10,tsoil/10);
+  				if (tsoil >= ctx->params.coldSoilThreshold) {	// use normal (warm temp.) params
+		 			tempEffect=ctx->params.baseSoilResp*pow(ctx->params.soilRespQ10,tsoil/10);
   				} else { // use cold temp. params
-  					tempEffect=params.baseSoilRespCold*pow(params.soilRespQ10Cold,tsoil/10);
+  					tempEffect=ctx->params.baseSoilRespCold*pow(ctx->params.soilRespQ10Cold,tsoil/10);
   				}
 			#else // SEASONAL_R_SOIL FALSE -> always use normal params
 
-				tempEffect=params.baseSoilResp*pow(params.soilRespQ10,tsoil/10);
+				tempEffect=ctx->params.baseSoilResp*pow(ctx->params.soilRespQ10,tsoil/10);
 
 			#endif
 
-			fluxes.maintRespiration=envi.soil*moistEffect*tempEffect;
+			ctx->fluxes.maintRespiration=ctx->envi.soil*moistEffect*tempEffect;
 		#endif
 
 	#endif
@@ -1738,13 +2722,13 @@ void calcMaintenanceRespiration(double tsoil, double water, double whc) {
 
 
 
-double microbeQualityEfficiency(double soilQuality) {
+double microbeQualityEfficiency(SipnetContext *ctx, double soilQuality) {
 
 
-	return params.efficiency;	// Efficiency an increasing function of quality
+	return ctx->params.efficiency;	// Efficiency an increasing function of quality
 }
 
-void microbeGrowth() {
+void microbeGrowth(SipnetContext *ctx) {
 	#if SOIL_MULTIPOOL
 		int counter;	// Counter of quality pools
 		for( counter=0; counter < NUMBER_SOIL_CARBON_POOLS; counter++) {
@@ -1755,16 +2739,16 @@ void microbeGrowth() {
 
 				soilQuality=(counter+1)/NUMBER_SOIL_CARBON_POOLS;	// Ensures that the quality will never be zero
 
-    			ingestionCoeff=params.maxIngestionRate;
+    			ingestionCoeff=ctx->params.maxIngestionRate;
 
-				fluxes.microbeIngestion[counter]=ingestionCoeff * envi.soil[counter]/trackers.totSoilC;	// Scale this proportional to total soil
+				ctx->fluxes.microbeIngestion[counter]=ingestionCoeff * ctx->envi.soil[counter]/ctx->trackers.totSoilC;	// Scale this proportional to total soil
 			#endif  //We need code in here if we just have a rate coefficient pool
 		}
 	#elif MICROBES
 		double baseRate;
 
-		baseRate=params.maxIngestionRate*envi.soil/(params.halfSatIngestion+envi.soil);
-		fluxes.microbeIngestion=baseRate*envi.microbeC;		// Flux that microbes remove from soil  (mg C g soil day)
+		baseRate=ctx->params.maxIngestionRate*ctx->envi.soil/(ctx->params.halfSatIngestion+ctx->envi.soil);
+		ctx->fluxes.microbeIngestion=baseRate*ctx->envi.microbeC;		// Flux that microbes remove from soil  (mg C g soil day)
 
 	#endif
 
@@ -1785,16 +2769,16 @@ int litterInputPool(double qualityComponent) {
 }
 
 
-void soilDegradation() {
+void soilDegradation(SipnetContext *ctx) {
 
 	double soilWater;
 	#if MODEL_WATER // take soilWater from environment
- 		soilWater = envi.soilWater;
+ 		soilWater = ctx->envi.soilWater;
 	#else // take  soilWater from climate drivers
-  		soilWater = climate->soilWetness * params.soilWHC;
+  		soilWater = ctx->clim->soilWetness[ctx->step] * ctx->params.soilWHC;
 	#endif
 
-	calcMaintenanceRespiration(climate->tsoil,soilWater,params.soilWHC);
+	calcMaintenanceRespiration(ctx, ctx->clim->tsoil[ctx->step],soilWater,ctx->params.soilWHC);
 
 
 
@@ -1805,7 +2789,7 @@ void soilDegradation() {
 
 		double totResp, poolResp;	// Respiration rate summed across all pools
 
-		microbeGrowth();
+		microbeGrowth(ctx);
 		#if SOIL_QUALITY
 
 
@@ -1814,9 +2798,9 @@ void soilDegradation() {
 			double soilQuality;
 
 			totResp=0;
-			woodLitterInput=litterInputPool(params.qualityWood);	//fluxes.woodLitter gives us the amount in the pool we adjust these by 1 because the input pool will
+			woodLitterInput=litterInputPool(ctx->params.qualityWood);	//ctx->fluxes.woodLitter gives us the amount in the pool we adjust these by 1 because the input pool will
 																//never be 0
-			leafLitterInput=litterInputPool(params.qualityLeaf);	//fluxes.leafLitter gives us the amount in the pool
+			leafLitterInput=litterInputPool(ctx->params.qualityLeaf);	//ctx->fluxes.leafLitter gives us the amount in the pool
 
 
 			for( counter=NUMBER_SOIL_CARBON_POOLS-1; -1 < counter; counter--) {
@@ -1827,25 +2811,25 @@ void soilDegradation() {
 
 
 			// calculate the microbial efficiency
-				microbeEff=params.efficiency*soilQuality;
+				microbeEff=ctx->params.efficiency*soilQuality;
 
-				poolResp=(1-microbeEff)*fluxes.microbeIngestion[counter];
-				totResp+=poolResp+fluxes.maintRespiration[counter];			// Add in growth + maintenance respiration
+				poolResp=(1-microbeEff)*ctx->fluxes.microbeIngestion[counter];
+				totResp+=poolResp+ctx->fluxes.maintRespiration[counter];			// Add in growth + maintenance respiration
 
 
 				if (woodLitterInput == counter) {
-					litterInput+=fluxes.woodLitter*climate -> length;
+					litterInput+=ctx->fluxes.woodLitter*ctx->clim->length[ctx->step];
 				}
 
 				if (leafLitterInput == counter) {
-					litterInput+=fluxes.leafLitter*climate -> length;
+					litterInput+=ctx->fluxes.leafLitter*ctx->clim->length[ctx->step];
 				}
 
 				#if (counter==0)
-					envi.soil[counter]+=(litterInput-fluxes.microbeIngestion[counter]-fluxes.maintRespiration[counter])*climate->length;	// Transfer from this pool
+					ctx->envi.soil[counter]+=(litterInput-ctx->fluxes.microbeIngestion[counter]-ctx->fluxes.maintRespiration[counter])*ctx->clim->length[ctx->step];	// Transfer from this pool
 				#else
-					envi.soil[counter]+=(litterInput-fluxes.microbeIngestion[counter]-fluxes.maintRespiration[counter])*climate->length;	// Transfer from this pool
-					envi.soil[counter-1]+=(microbeEff*fluxes.microbeIngestion[counter])*climate->length;	// Transfer into next pool
+					ctx->envi.soil[counter]+=(litterInput-ctx->fluxes.microbeIngestion[counter]-ctx->fluxes.maintRespiration[counter])*ctx->clim->length[ctx->step];	// Transfer from this pool
+					ctx->envi.soil[counter-1]+=(microbeEff*ctx->fluxes.microbeIngestion[counter])*ctx->clim->length[ctx->step];	// Transfer into next pool
 
 				#endif
 
@@ -1854,52 +2838,52 @@ void soilDegradation() {
 			}
 			// Do the roots.  If we don't model roots, the value of these fluxes will be zero.
 
-			envi.soil[NUMBER_SOIL_CARBON_POOLS-1]+=(fluxes.coarseRootLoss+fluxes.fineRootLoss) * climate->length;
-			fluxes.rSoil=totResp;
+			ctx->envi.soil[NUMBER_SOIL_CARBON_POOLS-1]+=(ctx->fluxes.coarseRootLoss+ctx->fluxes.fineRootLoss) * ctx->clim->length[ctx->step];
+			ctx->fluxes.rSoil=totResp;
 		//#else		This is the loop for no quality model
 
 		#endif
 	#elif MICROBES
-		microbeGrowth();
+		microbeGrowth(ctx);
 		double microbeEff;
 
 
 		#if STOICHIOMETRY
 			double microbeAdjustment;
-			microbeAdjustment=(params.totNitrogen-params.microbeNC*envi.microbeC)/envi.soil/params.microbeNC;
+			microbeAdjustment=(ctx->params.totNitrogen-ctx->params.microbeNC*ctx->envi.microbeC)/ctx->envi.soil/ctx->params.microbeNC;
 			#if microbeAdjustment > 1
-				microbeEff=params.efficiency;
+				microbeEff=ctx->params.efficiency;
 			#else
-				microbeEff=params.efficiency*microbeAdjustment;
+				microbeEff=ctx->params.efficiency*microbeAdjustment;
 			#endif
 		#else		// Now we do the single pool model
 
-			microbeEff=params.efficiency;
+			microbeEff=ctx->params.efficiency;
 		#endif
 
 
 
-		envi.soil+=(fluxes.coarseRootLoss+fluxes.fineRootLoss+fluxes.woodLitter+fluxes.leafLitter-fluxes.microbeIngestion)*climate->length;
-		envi.microbeC+=(microbeEff*fluxes.microbeIngestion+fluxes.soilPulse-fluxes.maintRespiration)*climate->length;
+		ctx->envi.soil+=(ctx->fluxes.coarseRootLoss+ctx->fluxes.fineRootLoss+ctx->fluxes.woodLitter+ctx->fluxes.leafLitter-ctx->fluxes.microbeIngestion)*ctx->clim->length[ctx->step];
+		ctx->envi.microbeC+=(microbeEff*ctx->fluxes.microbeIngestion+ctx->fluxes.soilPulse-ctx->fluxes.maintRespiration)*ctx->clim->length[ctx->step];
 
-		fluxes.rSoil=fluxes.maintRespiration+(1-microbeEff)*fluxes.microbeIngestion;
+		ctx->fluxes.rSoil=ctx->fluxes.maintRespiration+(1-microbeEff)*ctx->fluxes.microbeIngestion;
 
 
 	#elif LITTER_POOL		// If LITTER_POOL = 1, then all other bets are off
-  		envi.litter += (fluxes.woodLitter + fluxes.leafLitter - fluxes.litterToSoil - fluxes.rLitter)
-			* climate->length;
+  		ctx->envi.litter += (ctx->fluxes.woodLitter + ctx->fluxes.leafLitter - ctx->fluxes.litterToSoil - ctx->fluxes.rLitter)
+			* ctx->clim->length[ctx->step];
 
-		envi.soil += (fluxes.coarseRootLoss+fluxes.fineRootLoss+fluxes.litterToSoil - fluxes.rSoil) * climate->length;
+		ctx->envi.soil += (ctx->fluxes.coarseRootLoss+ctx->fluxes.fineRootLoss+ctx->fluxes.litterToSoil - ctx->fluxes.rSoil) * ctx->clim->length[ctx->step];
 
 
 	#else // Normal pool (single pool, no microbes)
-		fluxes.rSoil=fluxes.maintRespiration;
-		envi.soil+=(fluxes.coarseRootLoss+fluxes.fineRootLoss+fluxes.woodLitter + fluxes.leafLitter - fluxes.rSoil) * climate->length;
+		ctx->fluxes.rSoil=ctx->fluxes.maintRespiration;
+		ctx->envi.soil+=(ctx->fluxes.coarseRootLoss+ctx->fluxes.fineRootLoss+ctx->fluxes.woodLitter + ctx->fluxes.leafLitter - ctx->fluxes.rSoil) * ctx->clim->length[ctx->step];
 	#endif
 
 	// Update roots.  If we don't model roots, these fluxes will be zero.
-	envi.coarseRootC += (fluxes.coarseRootCreation-fluxes.coarseRootLoss-fluxes.rCoarseRoot) * climate->length;
-	envi.fineRootC += (fluxes.fineRootCreation-fluxes.fineRootLoss-fluxes.rFineRoot) * climate->length;
+	ctx->envi.coarseRootC += (ctx->fluxes.coarseRootCreation-ctx->fluxes.coarseRootLoss-ctx->fluxes.rCoarseRoot) * ctx->clim->length[ctx->step];
+	ctx->envi.fineRootC += (ctx->fluxes.fineRootCreation-ctx->fluxes.fineRootLoss-ctx->fluxes.rFineRoot) * ctx->clim->length[ctx->step];
 
 
 }
@@ -1922,17 +2906,16 @@ void soilDegradation() {
 
 // transfer of carbon from plant woody material to litter, in g C * m^-2 ground area * day^-1
 // (includes above-ground and roots)
-double woodLitterF(double plantWoodC) {
-  return plantWoodC * params.woodTurnoverRate; // turnover rate is fraction lost per day
+double woodLitterF(SipnetContext *ctx, double plantWoodC) {
+  return plantWoodC * ctx->params.woodTurnoverRate; // turnover rate is fraction lost per day
 }
 
 
-void calculateFluxes() {
+// calculate all fluxes for this time step, given its lai (m^2 leaf/m^2 ground, calculated from plantLeafC)
+// and the potential gross photosynthesis (without water stress) and base foliar respiration that potPsn gives for it
+void calculateFluxes(SipnetContext *ctx, double lai, double potGrossPsn, double baseFolResp) {
   // auxiliary variables:
-  	double baseFolResp;
-  	double potGrossPsn; // potential photosynthesis, without water stress
   	double dWater;
-  	double lai; // m^2 leaf/m^2 ground (calculated from plantLeafC)
   	double litterBreakdown; /* total litter breakdown (i.e. litterToSoil + rLitter)
 							 (g C/m^2 ground/day) */
   	double folResp, woodResp; // maintenance respiration terms, g C * m^-2 ground area * day^-1
@@ -1951,115 +2934,112 @@ void calculateFluxes() {
 
 
 	#if MODEL_WATER // take litterWater and soilWater from environment
-  		litterWater = envi.litterWater;
-  		soilWater = envi.soilWater;
+  		litterWater = ctx->envi.litterWater;
+  		soilWater = ctx->envi.soilWater;
 	#else // take litterWater and soilWater from climate drivers
-  		litterWater = climate->soilWetness * params.litterWHC; /* assume wetness is uniform throughout all layers
+  		litterWater = ctx->clim->soilWetness[ctx->step] * ctx->params.litterWHC; /* assume wetness is uniform throughout all layers
 							    (probably unrealistic, but it shouldn't matter too much) */
-  		soilWater = climate->soilWetness * params.soilWHC;
+  		soilWater = ctx->clim->soilWetness[ctx->step] * ctx->params.soilWHC;
 	#endif
 
-  	lai = envi.plantLeafC / params.leafCSpWt; // current lai
-
-  	potPsn(&potGrossPsn, &baseFolResp, lai, climate->tair, climate->vpd, climate->par, climate->day);
-  	moisture(&(fluxes.transpiration), &dWater, potGrossPsn, climate->vpd, soilWater);
+  	moisture(ctx, &(ctx->fluxes.transpiration), &dWater, potGrossPsn, ctx->clim->vpd[ctx->step], soilWater);
 
 	#if MODEL_WATER // water modeling happens here:
 
 		#if COMPLEX_WATER
-		  	calcPrecip(&(fluxes.rain), &(fluxes.snowFall), &(fluxes.immedEvap), lai);
-  			netRain = fluxes.rain - fluxes.immedEvap;
-  			snowPack(&(fluxes.snowMelt), &(fluxes.sublimation), fluxes.snowFall);
-			soilWaterFluxes(&(fluxes.fastFlow), &(fluxes.evaporation), &(fluxes.topDrainage), &(fluxes.bottomDrainage),
-		  		netRain, fluxes.snowMelt, fluxes.transpiration, litterWater, soilWater);
+		  	calcPrecip(ctx, &(ctx->fluxes.rain), &(ctx->fluxes.snowFall), &(ctx->fluxes.immedEvap), lai);
+  			netRain = ctx->fluxes.rain - ctx->fluxes.immedEvap;
+  			snowPack(ctx, &(ctx->fluxes.snowMelt), &(ctx->fluxes.sublimation), ctx->fluxes.snowFall);
+			soilWaterFluxes(ctx, &(ctx->fluxes.fastFlow), &(ctx->fluxes.evaporation), &(ctx->fluxes.topDrainage), &(ctx->fluxes.bottomDrainage),
+		  		netRain, ctx->fluxes.snowMelt, ctx->fluxes.transpiration, litterWater, soilWater);
 		#else
-			simpleWaterFlow(&(fluxes.rain), &(fluxes.snowFall), &(fluxes.immedEvap), &(fluxes.snowMelt), &(fluxes.sublimation),
-		  		&(fluxes.fastFlow), &(fluxes.evaporation), &(fluxes.topDrainage), &(fluxes.bottomDrainage),
-		  		soilWater, envi.snow, climate->precip, climate->tair, climate->length, fluxes.transpiration);
+			simpleWaterFlow(ctx, &(ctx->fluxes.rain), &(ctx->fluxes.snowFall), &(ctx->fluxes.immedEvap), &(ctx->fluxes.snowMelt), &(ctx->fluxes.sublimation),
+		  		&(ctx->fluxes.fastFlow), &(ctx->fluxes.evaporation), &(ctx->fluxes.topDrainage), &(ctx->fluxes.bottomDrainage),
+		  		soilWater, ctx->envi.snow, ctx->clim->precip[ctx->step], ctx->clim->tair[ctx->step], ctx->clim->length[ctx->step], ctx->fluxes.transpiration);
 		#endif // COMPLEX_WATER
 
 	#else // MODEL_WATER = 0: set all water fluxes to 0
-  		fluxes.rain = fluxes.snowFall = fluxes.immedEvap = fluxes.snowMelt = fluxes.sublimation
-    	= fluxes.fastFlow = fluxes.evaporation = fluxes.topDrainage = fluxes.bottomDrainage = 0;
+  		ctx->fluxes.rain = ctx->fluxes.snowFall = ctx->fluxes.immedEvap = ctx->fluxes.snowMelt = ctx->fluxes.sublimation
+    	= ctx->fluxes.fastFlow = ctx->fluxes.evaporation = ctx->fluxes.topDrainage = ctx->fluxes.bottomDrainage = 0;
 	#endif // MODEL_WATER
 
-  	getGpp(&(fluxes.photosynthesis), potGrossPsn, dWater);
+  	getGpp(&(ctx->fluxes.photosynthesis), potGrossPsn, dWater);
 
 	#if GROWTH_RESP
-  		vegResp2(&folResp, &woodResp, &growthResp, baseFolResp, fluxes.photosynthesis);
-  		fluxes.rVeg = folResp + woodResp + growthResp;
-  		fluxes.rWood = woodResp;
-  		fluxes.rLeaf= folResp+growthResp;
+  		vegResp2(ctx, &folResp, &woodResp, &growthResp, baseFolResp, ctx->fluxes.photosynthesis);
+  		ctx->fluxes.rVeg = folResp + woodResp + growthResp;
+  		ctx->fluxes.rWood = woodResp;
+  		ctx->fluxes.rLeaf= folResp+growthResp;
 	#else
-  		vegResp(&folResp, &woodResp, baseFolResp);
-  		fluxes.rVeg = folResp + woodResp;
-  		fluxes.rWood = woodResp;
-  		fluxes.rLeaf= folResp;
+  		vegResp(ctx, &folResp, &woodResp, baseFolResp);
+  		ctx->fluxes.rVeg = folResp + woodResp;
+  		ctx->fluxes.rWood = woodResp;
+  		ctx->fluxes.rLeaf= folResp;
 	#endif
 
-  	leafFluxes(&(fluxes.leafCreation), &(fluxes.leafLitter), envi.plantLeafC);
+  	leafFluxes(ctx, &(ctx->fluxes.leafCreation), &(ctx->fluxes.leafLitter), ctx->envi.plantLeafC);
 
 	#if LITTER_POOL
-  		litterBreakdown = soilBreakdown(envi.litter, params.litterBreakdownRate,
-				  litterWater, params.litterWHC, climate->tsoil, params.soilRespQ10);
-		fluxes.rLitter = litterBreakdown * params.fracLitterRespired;
-		fluxes.litterToSoil = litterBreakdown * (1.0 - params.fracLitterRespired);
+  		litterBreakdown = soilBreakdown(ctx->envi.litter, ctx->params.litterBreakdownRate,
+				  litterWater, ctx->params.litterWHC, ctx->clim->tsoil[ctx->step], ctx->params.soilRespQ10);
+		ctx->fluxes.rLitter = litterBreakdown * ctx->params.fracLitterRespired;
+		ctx->fluxes.litterToSoil = litterBreakdown * (1.0 - ctx->params.fracLitterRespired);
   	// NOTE: right now, we don't have capability to use separate cold soil params for litter
 	#else
   		litterBreakdown = 0;
-		fluxes.rLitter = 0;
-		fluxes.litterToSoil = 0;
+		ctx->fluxes.rLitter = 0;
+		ctx->fluxes.litterToSoil = 0;
 	#endif
 
   // finally, calculate fluxes that we haven't already calculated:
 
-  	fluxes.woodLitter = woodLitterF(envi.plantWoodC);
+  	ctx->fluxes.woodLitter = woodLitterF(ctx, ctx->envi.plantWoodC);
 
 
 	#if ROOTS
 	double coarseExudate, fineExudate;	// exudates in and out of soil
 	double npp, gppSoil;		// running means of our tracker variables
 
-	npp=getMeanTrackerMean(meanNPP);
-	gppSoil=getMeanTrackerMean(meanGPP);
+	npp=getMeanTrackerMean(ctx->meanNPP);
+	gppSoil=getMeanTrackerMean(ctx->meanGPP);
 		if (npp > 0) {
-			fluxes.coarseRootCreation=(1-params.leafAllocation-params.fineRootAllocation-params.woodAllocation)*npp;
-			fluxes.fineRootCreation=params.fineRootAllocation*npp;
-			fluxes.woodCreation=params.woodAllocation*npp; }
+			ctx->fluxes.coarseRootCreation=(1-ctx->params.leafAllocation-ctx->params.fineRootAllocation-ctx->params.woodAllocation)*npp;
+			ctx->fluxes.fineRootCreation=ctx->params.fineRootAllocation*npp;
+			ctx->fluxes.woodCreation=ctx->params.woodAllocation*npp; }
 		else {
-			fluxes.coarseRootCreation=0;
-			fluxes.fineRootCreation=0;
-			fluxes.woodCreation=0;
+			ctx->fluxes.coarseRootCreation=0;
+			ctx->fluxes.fineRootCreation=0;
+			ctx->fluxes.woodCreation=0;
 		}
 
 
 
-		if ((gppSoil > 0) & (envi.fineRootC > 0)) {
-			coarseExudate=params.coarseRootExudation*gppSoil;
-			fineExudate=params.fineRootExudation*gppSoil; }
+		if ((gppSoil > 0) & (ctx->envi.fineRootC > 0)) {
+			coarseExudate=ctx->params.coarseRootExudation*gppSoil;
+			fineExudate=ctx->params.fineRootExudation*gppSoil; }
 		else {
 			fineExudate=0;
 			coarseExudate=0;
 		}
 
-		fluxes.coarseRootLoss=(1-params.microbePulseEff)*coarseExudate+params.coarseRootTurnoverRate*envi.coarseRootC;
-		fluxes.fineRootLoss=(1-params.microbePulseEff)*fineExudate+params.fineRootTurnoverRate*envi.fineRootC;
+		ctx->fluxes.coarseRootLoss=(1-ctx->params.microbePulseEff)*coarseExudate+ctx->params.coarseRootTurnoverRate*ctx->envi.coarseRootC;
+		ctx->fluxes.fineRootLoss=(1-ctx->params.microbePulseEff)*fineExudate+ctx->params.fineRootTurnoverRate*ctx->envi.fineRootC;
 
-		fluxes.soilPulse=params.microbePulseEff*(coarseExudate+fineExudate);	// fluxes that get added to microbe pool
+		ctx->fluxes.soilPulse=ctx->params.microbePulseEff*(coarseExudate+fineExudate);	// fluxes that get added to microbe pool
 
-		calcRootResp(&fluxes.rCoarseRoot, params.coarseRootQ10, params.baseCoarseRootResp, envi.coarseRootC);
-		calcRootResp(&fluxes.rFineRoot, params.fineRootQ10, params.baseFineRootResp, envi.fineRootC);
+		calcRootResp(ctx, &ctx->fluxes.rCoarseRoot, ctx->params.coarseRootQ10, ctx->params.baseCoarseRootResp, ctx->envi.coarseRootC);
+		calcRootResp(ctx, &ctx->fluxes.rFineRoot, ctx->params.fineRootQ10, ctx->params.baseFineRootResp, ctx->envi.fineRootC);
 
      #else		// If we don't model roots, then all these fluxes will be zero
 
-		fluxes.rCoarseRoot=0;
-		fluxes.rFineRoot=0;
-		fluxes.coarseRootCreation=0;
-		fluxes.fineRootCreation=0;
-		fluxes.woodCreation=0;
-		fluxes.coarseRootLoss=0;
-		fluxes.fineRootLoss=0;
-		fluxes.soilPulse=0;
+		ctx->fluxes.rCoarseRoot=0;
+		ctx->fluxes.rFineRoot=0;
+		ctx->fluxes.coarseRootCreation=0;
+		ctx->fluxes.fineRootCreation=0;
+		ctx->fluxes.woodCreation=0;
+		ctx->fluxes.coarseRootLoss=0;
+		ctx->fluxes.fineRootLoss=0;
+		ctx->fluxes.soilPulse=0;
 
 	#endif
 
@@ -2068,22 +3048,22 @@ void calculateFluxes() {
 
 
 
-  // printf("%f %f %f\n", fluxes.rLitter*climate->length, fluxes.rSoil*climate->length, (fluxes.leafLitter+fluxes.woodLitter)*climate->length);
+  // printf("%f %f %f\n", ctx->fluxes.rLitter*ctx->clim->length[ctx->step], ctx->fluxes.rSoil*ctx->clim->length[ctx->step], (ctx->fluxes.leafLitter+ctx->fluxes.woodLitter)*ctx->clim->length[ctx->step]);
 
-  // printf("%f %f %f %f %f\n", fluxes.photosynthesis*climate->length, folResp*climate->length, woodResp*climate->length, fluxes.rSoil*climate->length, fluxes.rLitter*climate->length);
+  // printf("%f %f %f %f %f\n", ctx->fluxes.photosynthesis*ctx->clim->length[ctx->step], folResp*ctx->clim->length[ctx->step], woodResp*ctx->clim->length[ctx->step], ctx->fluxes.rSoil*ctx->clim->length[ctx->step], ctx->fluxes.rLitter*ctx->clim->length[ctx->step]);
 
-  // printf("%f %f %f %f %f\n", fluxes.leafLitter*climate->length, fluxes.woodLitter*climate->length, fluxes.rVeg*climate->length, fluxes.rSoil*climate->length, fluxes.photosynthesis*climate->length);
+  // printf("%f %f %f %f %f\n", ctx->fluxes.leafLitter*ctx->clim->length[ctx->step], ctx->fluxes.woodLitter*ctx->clim->length[ctx->step], ctx->fluxes.rVeg*ctx->clim->length[ctx->step], ctx->fluxes.rSoil*ctx->clim->length[ctx->step], ctx->fluxes.photosynthesis*ctx->clim->length[ctx->step]);
 
   /* diagnosis: print water fluxes:
   printf("%f %f %f %f %f %f %f %f %f %f\n",
-	 fluxes.rain*climate->length, fluxes.snowFall*climate->length, fluxes.immedEvap*climate->length,
-	 fluxes.snowMelt*climate->length, fluxes.sublimation*climate->length,
-	 fluxes.fastFlow*climate->length, fluxes.evaporation*climate->length, fluxes.topDrainage*climate->length,
-	 fluxes.bottomDrainage*climate->length, fluxes.transpiration*climate->length);
+	 ctx->fluxes.rain*ctx->clim->length[ctx->step], ctx->fluxes.snowFall*ctx->clim->length[ctx->step], ctx->fluxes.immedEvap*ctx->clim->length[ctx->step],
+	 ctx->fluxes.snowMelt*ctx->clim->length[ctx->step], ctx->fluxes.sublimation*ctx->clim->length[ctx->step],
+	 ctx->fluxes.fastFlow*ctx->clim->length[ctx->step], ctx->fluxes.evaporation*ctx->clim->length[ctx->step], ctx->fluxes.topDrainage*ctx->clim->length[ctx->step],
+	 ctx->fluxes.bottomDrainage*ctx->clim->length[ctx->step], ctx->fluxes.transpiration*ctx->clim->length[ctx->step]);
   */
 
-  /* printf("%f %f %f\n", fluxes.photosynthesis*climate->length, fluxes.transpiration*climate->length,
-	 (fluxes.transpiration > 0) ? (fluxes.photosynthesis/fluxes.transpiration) : 0);
+  /* printf("%f %f %f\n", ctx->fluxes.photosynthesis*ctx->clim->length[ctx->step], ctx->fluxes.transpiration*ctx->clim->length[ctx->step],
+	 (ctx->fluxes.transpiration > 0) ? (ctx->fluxes.photosynthesis/ctx->fluxes.transpiration) : 0);
   */
 
 }
@@ -2092,42 +3072,42 @@ void calculateFluxes() {
 // !!! functions for updating tracker variables !!!
 
 // initialize trackers at start of simulation:
-void initTrackers(void) {
-  trackers.gpp = 0.0;
-  trackers.rtot = 0.0;
-  trackers.ra = 0.0;
-  trackers.rh = 0.0;
-  trackers.npp = 0.0;
-  trackers.nee = 0.0;
-  trackers.yearlyGpp = 0.0;
-  trackers.yearlyRtot = 0.0;
-  trackers.yearlyRa = 0.0;
-  trackers.yearlyRh = 0.0;
-  trackers.yearlyNpp = 0.0;
-  trackers.yearlyNee = 0.0;
-  trackers.totGpp = 0.0;
-  trackers.totRtot = 0.0;
-  trackers.totRa = 0.0;
-  trackers.totRh = 0.0;
-  trackers.totNpp = 0.0;
-  trackers.totNee = 0.0;
-  trackers.evapotranspiration = 0.0;
-  trackers.soilWetnessFrac = envi.soilWater/params.soilWHC;
-  trackers.fa = 0.0;
-  trackers.fr = 0.0;
-  trackers.totSoilC = 0.0;
-  trackers.rSoil = 0.0;
-
-  trackers.rRoot = 0.0;
-
-
-  trackers.totSoilC = params.soilInit;
-  trackers.rAboveground = 0.0;
-  trackers.fpar = 0.0;
-
-  trackers.plantWoodC = 0.0;
-  	trackers.LAI = 0.0;
-  	trackers.yearlyLitter = 0.0;
+void initTrackers(SipnetContext *ctx) {
+  ctx->trackers.gpp = 0.0;
+  ctx->trackers.rtot = 0.0;
+  ctx->trackers.ra = 0.0;
+  ctx->trackers.rh = 0.0;
+  ctx->trackers.npp = 0.0;
+  ctx->trackers.nee = 0.0;
+  ctx->trackers.yearlyGpp = 0.0;
+  ctx->trackers.yearlyRtot = 0.0;
+  ctx->trackers.yearlyRa = 0.0;
+  ctx->trackers.yearlyRh = 0.0;
+  ctx->trackers.yearlyNpp = 0.0;
+  ctx->trackers.yearlyNee = 0.0;
+  ctx->trackers.totGpp = 0.0;
+  ctx->trackers.totRtot = 0.0;
+  ctx->trackers.totRa = 0.0;
+  ctx->trackers.totRh = 0.0;
+  ctx->trackers.totNpp = 0.0;
+  ctx->trackers.totNee = 0.0;
+  ctx->trackers.evapotranspiration = 0.0;
+  ctx->trackers.soilWetnessFrac = ctx->envi.soilWater/ctx->params.soilWHC;
+  ctx->trackers.fa = 0.0;
+  ctx->trackers.fr = 0.0;
+  ctx->trackers.totSoilC = 0.0;
+  ctx->trackers.rSoil = 0.0;
+
+  ctx->trackers.rRoot = 0.0;
+
+
+  ctx->trackers.totSoilC = ctx->params.soilInit;
+  ctx->trackers.rAboveground = 0.0;
+  ctx->trackers.fpar = 0.0;
+
+  ctx->trackers.plantWoodC = 0.0;
+  	ctx->trackers.LAI = 0.0;
+  	ctx->trackers.yearlyLitter = 0.0;
 
 
 }
@@ -2149,35 +3129,35 @@ void ensureNonNegative(double *var, double minVal) {
 // For other variables, there are NOT currently (as of 7-16-06) checks to make sure out-fluxes aren't too large
 //  In these cases, this function should be thought of as a last-resort check - ideally, the fluxes would be modified
 //  so that they did not make the stocks negative (otherwise the fluxes could be inconsistent with the changes in the stocks)
-void ensureNonNegativeStocks() {
+void ensureNonNegativeStocks(SipnetContext *ctx) {
 
-  ensureNonNegative(&(envi.plantWoodC), 0);
-  ensureNonNegative(&(envi.plantLeafC), 0);
+  ensureNonNegative(&(ctx->envi.plantWoodC), 0);
+  ensureNonNegative(&(ctx->envi.plantLeafC), 0);
 
 #if LITTER_POOL
-  ensureNonNegative(&(envi.litter), 0);
+  ensureNonNegative(&(ctx->envi.litter), 0);
 #endif
 
   #if SOIL_MULTIPOOL
   	int counter;
   	for(counter=0; counter< NUMBER_SOIL_CARBON_POOLS; counter++)
-  	 {ensureNonNegative(&(envi.soil[counter]), 0);}
+  	 {ensureNonNegative(&(ctx->envi.soil[counter]), 0);}
   #else
-  	ensureNonNegative(&(envi.soil), 0);
+  	ensureNonNegative(&(ctx->envi.soil), 0);
   #endif
 
-   ensureNonNegative(&(envi.coarseRootC), 0);
-   ensureNonNegative(&(envi.fineRootC), 0);
-   ensureNonNegative(&(envi.microbeC), 0);
+   ensureNonNegative(&(ctx->envi.coarseRootC), 0);
+   ensureNonNegative(&(ctx->envi.fineRootC), 0);
+   ensureNonNegative(&(ctx->envi.microbeC), 0);
 
 #if MODEL_WATER
 
 #if LITTER_WATER
-  ensureNonNegative(&(envi.litterWater), 0);
+  ensureNonNegative(&(ctx->envi.litterWater), 0);
 #endif
 
-  ensureNonNegative(&(envi.soilWater), 0);
-  ensureNonNegative(&(envi.snow), TINY); /* In the case of snow, the model has very different behavior for a snow pack of 0
+  ensureNonNegative(&(ctx->envi.soilWater), 0);
+  ensureNonNegative(&(ctx->envi.snow), TINY); /* In the case of snow, the model has very different behavior for a snow pack of 0
 					 vs. a snow pack of slightly greater than 0 (e.g. no soil evaporation if snow > 0).
 					 Thus to avoid large errors due to small rounding errors, we'll set snow = 0 any time it falls below TINY,
 					 the assumption being that if snow < TINY, then it was really supposed to be 0, but isn't because of rounding errors.
@@ -2188,84 +3168,82 @@ void ensureNonNegativeStocks() {
 
 // update trackers at each time step
 // oldSoilWater is how much soil water there was at the beginning of the time step (cm)
-void updateTrackers(double oldSoilWater) {
-  static int lastYear = -1; // what was the year of the last step?
+void updateTrackers(SipnetContext *ctx, double oldSoilWater) {
+  if (ctx->clim->year[ctx->step] != ctx->lastYear) { // new year: reset yearly trackers
+    ctx->trackers.yearlyGpp = 0.0;
+    ctx->trackers.yearlyRtot = 0.0;
+    ctx->trackers.yearlyRa = 0.0;
+    ctx->trackers.yearlyRh = 0.0;
+    ctx->trackers.yearlyNpp = 0.0;
+    ctx->trackers.yearlyNee = 0.0;
 
-  if (climate->year != lastYear) { // new year: reset yearly trackers
-    trackers.yearlyGpp = 0.0;
-    trackers.yearlyRtot = 0.0;
-    trackers.yearlyRa = 0.0;
-    trackers.yearlyRh = 0.0;
-    trackers.yearlyNpp = 0.0;
-    trackers.yearlyNee = 0.0;
-
-    lastYear = climate->year;
+    ctx->lastYear = ctx->clim->year[ctx->step];
 
 
     // At start of 1999, reset cumulative trackers
     // Note that this is only for one specific application: we don't usually want to do this
     /*
-    if (climate->year == 1999) {
-      trackers.totGpp = 0.0;
-      trackers.totRtot = 0.0;
-      trackers.totRa = 0.0;
-      trackers.totRh = 0.0;
-      trackers.totNpp = 0.0;
-      trackers.totNee = 0.0;
+    if (ctx->clim->year[ctx->step] == 1999) {
+      ctx->trackers.totGpp = 0.0;
+      ctx->trackers.totRtot = 0.0;
+      ctx->trackers.totRa = 0.0;
+      ctx->trackers.totRh = 0.0;
+      ctx->trackers.totNpp = 0.0;
+      ctx->trackers.totNee = 0.0;
     }
     */
   }
 
-  trackers.gpp = fluxes.photosynthesis * climate->length;
+  ctx->trackers.gpp = ctx->fluxes.photosynthesis * ctx->clim->length[ctx->step];
 
-  trackers.rh = (fluxes.rLitter + fluxes.rSoil) * climate->length;  // everything that is microbial
-  trackers.rAboveground = (fluxes.rVeg) * climate->length;	// This is wood plus leaf respiration
-  trackers.rRoot=(fluxes.rCoarseRoot+fluxes.rFineRoot) * climate ->length;
-  trackers.rSoil=trackers.rRoot+trackers.rh;
-  trackers.ra = trackers.rRoot+ trackers.rAboveground;
-  trackers.rtot = trackers.ra + trackers.rh;
-  trackers.npp = trackers.gpp - trackers.ra;
-  trackers.nee = -1.0*(trackers.npp - trackers.rh);
+  ctx->trackers.rh = (ctx->fluxes.rLitter + ctx->fluxes.rSoil) * ctx->clim->length[ctx->step];  // everything that is microbial
+  ctx->trackers.rAboveground = (ctx->fluxes.rVeg) * ctx->clim->length[ctx->step];	// This is wood plus leaf respiration
+  ctx->trackers.rRoot=(ctx->fluxes.rCoarseRoot+ctx->fluxes.rFineRoot) * ctx->clim->length[ctx->step];
+  ctx->trackers.rSoil=ctx->trackers.rRoot+ctx->trackers.rh;
+  ctx->trackers.ra = ctx->trackers.rRoot+ ctx->trackers.rAboveground;
+  ctx->trackers.rtot = ctx->trackers.ra + ctx->trackers.rh;
+  ctx->trackers.npp = ctx->trackers.gpp - ctx->trackers.ra;
+  ctx->trackers.nee = -1.0*(ctx->trackers.npp - ctx->trackers.rh);
 
-  trackers.fa = trackers.gpp- (fluxes.rLeaf) * climate ->length;
-  trackers.fr = trackers.rh + (fluxes.rWood) * climate ->length;
+  ctx->trackers.fa = ctx->trackers.gpp- (ctx->fluxes.rLeaf) * ctx->clim->length[ctx->step];
+  ctx->trackers.fr = ctx->trackers.rh + (ctx->fluxes.rWood) * ctx->clim->length[ctx->step];
 
 
-  trackers.yearlyGpp += trackers.gpp;
-  trackers.yearlyRa += trackers.ra;
-  trackers.yearlyRh += trackers.rh;
-  trackers.yearlyRtot += trackers.rtot;
-  trackers.yearlyNpp += trackers.npp;
-  trackers.yearlyNee += trackers.nee;
+  ctx->trackers.yearlyGpp += ctx->trackers.gpp;
+  ctx->trackers.yearlyRa += ctx->trackers.ra;
+  ctx->trackers.yearlyRh += ctx->trackers.rh;
+  ctx->trackers.yearlyRtot += ctx->trackers.rtot;
+  ctx->trackers.yearlyNpp += ctx->trackers.npp;
+  ctx->trackers.yearlyNee += ctx->trackers.nee;
 
-  trackers.totGpp += trackers.gpp;
-  trackers.totRa += trackers.ra;
-  trackers.totRh += trackers.rh;
-  trackers.totRtot += trackers.rtot;
-  trackers.totNpp += trackers.npp;
-  trackers.totNee += trackers.nee;
+  ctx->trackers.totGpp += ctx->trackers.gpp;
+  ctx->trackers.totRa += ctx->trackers.ra;
+  ctx->trackers.totRh += ctx->trackers.rh;
+  ctx->trackers.totRtot += ctx->trackers.rtot;
+  ctx->trackers.totNpp += ctx->trackers.npp;
+  ctx->trackers.totNee += ctx->trackers.nee;
 
-  trackers.evapotranspiration = (fluxes.transpiration + fluxes.immedEvap + fluxes.evaporation + fluxes.sublimation)
-    * climate->length;
+  ctx->trackers.evapotranspiration = (ctx->fluxes.transpiration + ctx->fluxes.immedEvap + ctx->fluxes.evaporation + ctx->fluxes.sublimation)
+    * ctx->clim->length[ctx->step];
 
-  trackers.soilWetnessFrac = (oldSoilWater + envi.soilWater)/(2.0*params.soilWHC);
-	trackers.totSoilC=0;	// Set this to 0, and then we add to it
+  ctx->trackers.soilWetnessFrac = (oldSoilWater + ctx->envi.soilWater)/(2.0*ctx->params.soilWHC);
+	ctx->trackers.totSoilC=0;	// Set this to 0, and then we add to it
     #if SOIL_MULTIPOOL
       int counter;
 
   		for( counter=0; counter < NUMBER_SOIL_CARBON_POOLS; counter++) {
-  			trackers.totSoilC += envi.soil[counter];
+  			ctx->trackers.totSoilC += ctx->envi.soil[counter];
   		}
   	#else
-  		trackers.totSoilC += envi.soil;
+  		ctx->trackers.totSoilC += ctx->envi.soil;
   	#endif
 
 
-    trackers.fpar = getMeanTrackerMean(meanFPAR);
+    ctx->trackers.fpar = getMeanTrackerMean(ctx->meanFPAR);
 
-    trackers.LAI = envi.plantLeafC/params.leafCSpWt;
-    trackers.yearlyLitter += fluxes.leafLitter;
-    trackers.plantWoodC = envi.plantWoodC;
+    ctx->trackers.LAI = ctx->envi.plantLeafC/ctx->params.leafCSpWt;
+    ctx->trackers.yearlyLitter += ctx->fluxes.leafLitter;
+    ctx->trackers.plantWoodC = ctx->envi.plantWoodC;
     	//note this variable is added for Howland forest multi-model comparison includes ONLY leaf litter
 
 
@@ -2277,79 +3255,93 @@ void updateTrackers(double oldSoilWater) {
 
 
 
-// calculate all fluxes and update state for this time step
+// calculate all fluxes and update state for this time step, given its lai, potGrossPsn and baseFolResp (see calculateFluxes)
 // we calculate all fluxes before updating state in case flux calculations depend on the old state
-void updateState() {
+// (split from updateState so that runEnsembleNoOut can do the photosynthesis for all of its members at once)
+void updateStateFromPsn(SipnetContext *ctx, double lai, double potGrossPsn, double baseFolResp) {
 	double npp; // net primary productivity, g C * m^-2 ground area * day^-1
   	double oldSoilWater; // how much soil water was there before we updated it? Used in trackers
     int err;
-  	oldSoilWater = envi.soilWater;
+  	oldSoilWater = ctx->envi.soilWater;
 
-  	calculateFluxes();
+  	calculateFluxes(ctx, lai, potGrossPsn, baseFolResp);
 
   	// update the stocks, with fluxes adjusted for length of time step:
-  	envi.plantWoodC += (fluxes.photosynthesis + fluxes.woodCreation - fluxes.leafCreation - fluxes.woodLitter
-  				- fluxes.rVeg-fluxes.coarseRootCreation-fluxes.fineRootCreation)* climate->length;
-  	envi.plantLeafC += (fluxes.leafCreation - fluxes.leafLitter) * climate->length;
+  	ctx->envi.plantWoodC += (ctx->fluxes.photosynthesis + ctx->fluxes.woodCreation - ctx->fluxes.leafCreation - ctx->fluxes.woodLitter
+  				- ctx->fluxes.rVeg-ctx->fluxes.coarseRootCreation-ctx->fluxes.fineRootCreation)* ctx->clim->length[ctx->step];
+  	ctx->envi.plantLeafC += (ctx->fluxes.leafCreation - ctx->fluxes.leafLitter) * ctx->clim->length[ctx->step];
 
 
 
 
-	soilDegradation();		// This updates all the soil functions
+	soilDegradation(ctx);		// This updates all the soil functions
 
 
 
 	#if MODEL_WATER // water pool updating happens here:
 
 		#if LITTER_WATER // (2 soil water layers; litter water will only be on if complex water is also on)
-  			envi.litterWater += (fluxes.rain + fluxes.snowMelt - fluxes.immedEvap - fluxes.fastFlow
-		    	   - fluxes.evaporation - fluxes.topDrainage) * climate->length;
-  			envi.soilWater += (fluxes.topDrainage - fluxes.transpiration - fluxes.bottomDrainage)
-    		* climate->length;
+  			ctx->envi.litterWater += (ctx->fluxes.rain + ctx->fluxes.snowMelt - ctx->fluxes.immedEvap - ctx->fluxes.fastFlow
+		    	   - ctx->fluxes.evaporation - ctx->fluxes.topDrainage) * ctx->clim->length[ctx->step];
+  			ctx->envi.soilWater += (ctx->fluxes.topDrainage - ctx->fluxes.transpiration - ctx->fluxes.bottomDrainage)
+    		* ctx->clim->length[ctx->step];
 
 		#else // LITTER_WATER = 0 (only one soil water layer)
   		// note: some of these fluxes will always be 0 if complex water is off
-  			envi.soilWater += (fluxes.rain + fluxes.snowMelt - fluxes.immedEvap - fluxes.fastFlow
-		     	- fluxes.evaporation - fluxes.transpiration - fluxes.bottomDrainage) * climate->length;
+  			ctx->envi.soilWater += (ctx->fluxes.rain + ctx->fluxes.snowMelt - ctx->fluxes.immedEvap - ctx->fluxes.fastFlow
+		     	- ctx->fluxes.evaporation - ctx->fluxes.transpiration - ctx->fluxes.bottomDrainage) * ctx->clim->length[ctx->step];
 		#endif // LITTER_WATER
 
   		// if COMPLEX_WATER = 0 or SNOW = 0, some or all of these fluxes will always be 0
-  		envi.snow += (fluxes.snowFall - fluxes.snowMelt - fluxes.sublimation) * climate->length;
+  		ctx->envi.snow += (ctx->fluxes.snowFall - ctx->fluxes.snowMelt - ctx->fluxes.sublimation) * ctx->clim->length[ctx->step];
 
 	#endif // MODEL_WATER
 
-  ensureNonNegativeStocks();
+  ensureNonNegativeStocks(ctx);
 
 
-  npp = fluxes.photosynthesis - fluxes.rVeg-fluxes.rCoarseRoot-fluxes.rFineRoot;
+  npp = ctx->fluxes.photosynthesis - ctx->fluxes.rVeg-ctx->fluxes.rCoarseRoot-ctx->fluxes.rFineRoot;
 
-  err = addValueToMeanTracker(meanNPP, npp, climate->length); // update running mean of NPP
+  err = addValueToMeanTracker(ctx->meanNPP, npp, ctx->clim->length[ctx->step]); // update running mean of NPP
   if (err != 0) {
     printf("******* Error type %d while trying to add value to NPP mean tracker in sipnet:updateState() *******\n", err);
-    printf("npp = %f, climate->length = %f\n", npp, climate->length);
+    printf("npp = %f, climate->length = %f\n", npp, ctx->clim->length[ctx->step]);
     printf("Suggestion: try changing MEAN_NPP_MAX_ENTRIES in sipnet.c\n");
     exit(1);
   }
 
-  err = addValueToMeanTracker(meanGPP, fluxes.photosynthesis, climate->length); // update running mean of GPP
+  err = addValueToMeanTracker(ctx->meanGPP, ctx->fluxes.photosynthesis, ctx->clim->length[ctx->step]); // update running mean of GPP
   if (err != 0) {
     printf("******* Error type %d while trying to add value to GPP mean tracker in sipnet:updateState() *******\n", err);
-    printf("GPP = %f, climate->length = %f\n", fluxes.photosynthesis, climate->length);
+    printf("GPP = %f, climate->length = %f\n", ctx->fluxes.photosynthesis, ctx->clim->length[ctx->step]);
     printf("Suggestion: try changing MEAN_GPP_SOIL_MAX_ENTRIES in sipnet.c\n");
     exit(1);
   }
 
-  updateTrackers(oldSoilWater);
+  updateTrackers(ctx, oldSoilWater);
+
+}
+
+
+// calculate all fluxes and update state for this time step
+void updateState(SipnetContext *ctx) {
+  double lai; // m^2 leaf/m^2 ground (calculated from plantLeafC)
+  double potGrossPsn; // potential photosynthesis, without water stress
+  double baseFolResp;
+
+  lai = ctx->envi.plantLeafC / ctx->params.leafCSpWt; // current lai
 
+  potPsn(ctx, &potGrossPsn, &baseFolResp, lai, ctx->clim->tair[ctx->step], ctx->clim->vpd[ctx->step], ctx->clim->par[ctx->step], ctx->clim->day[ctx->step]);
+  updateStateFromPsn(ctx, lai, potGrossPsn, baseFolResp);
 }
 
 
 // initialize phenology tracker structure, based on day of year of first climate record
 // (have the leaves come on yet this year? have they fallen off yet this year?)
-void initPhenologyTrackers() {
+void initPhenologyTrackers(SipnetContext *ctx) {
 
-  phenologyTrackers.didLeafGrowth = pastLeafGrowth(); // first year: have we passed growing season start date?
-  phenologyTrackers.didLeafFall = pastLeafFall(); // first year: have we passed growing season end date?
+  ctx->phenologyTrackers.didLeafGrowth = pastLeafGrowth(ctx); // first year: have we passed growing season start date?
+  ctx->phenologyTrackers.didLeafFall = pastLeafFall(ctx); // first year: have we passed growing season end date?
 
   /* if we think we've done leaf fall this year but not leaf growth, something's wrong
      this could happen if, e.g. we're using soil temp-based leaf growth,
@@ -2360,54 +3352,56 @@ void initPhenologyTrackers() {
      in this case we could accidentally grow the leaves again once the temp. rises past the threshold again.
      Also, we'll have problems with GDD-based growth if first day of simulation is not Jan. 1.)
   */
-  if (phenologyTrackers.didLeafFall && !phenologyTrackers.didLeafGrowth)
-    phenologyTrackers.didLeafGrowth = 1;
-  // printf("stuff: %8d %8d \n",phenologyTrackers.lastYear, climate->year);
-  phenologyTrackers.lastYear = climate->year; // set the year of the previous (non-existent) time step to be this year
+  if (ctx->phenologyTrackers.didLeafFall && !ctx->phenologyTrackers.didLeafGrowth)
+    ctx->phenologyTrackers.didLeafGrowth = 1;
+  // printf("stuff: %8d %8d \n",ctx->phenologyTrackers.lastYear, ctx->clim->year[ctx->step]);
+  ctx->phenologyTrackers.lastYear = ctx->clim->year[ctx->step]; // set the year of the previous (non-existent) time step to be this year
 }
 
 
-// Setup model to run at given location (0-indexing: if only one location, loc should be 0)
-void setupModel(SpatialParams *spatialParams, int loc) {
+// Setup ctx to run at given location (0-indexing: if only one location, loc should be 0)
+// spatialParams is only read, so many contexts can be set up from the same spatialParams
+void setupModel(SipnetContext *ctx, SpatialParams *spatialParams, int loc) {
 
-  // load parameters into global param structure: spatialParams was told where to put values in readParamData
-  loadSpatialParams(spatialParams, loc);
+  // load parameters into this context's param structure:
+  // spatialParams was told where each parameter lives (relative to paramLayout) in readParamData
+  loadSpatialParamsInto(spatialParams, loc, (double *)&paramLayout, (double *)&(ctx->params));
 
   // a test: use constant (measured) soil respiration:
   // make it so soil resp. is 5.2 g C m-2 day-1 at 10 degrees C, moisture-saturated soil, and soil C = init. soil C
-  // params.baseSoilResp = ((5.2 * 365.0)/params.soilInit)/params.soilRespQ10;
+  // ctx->params.baseSoilResp = ((5.2 * 365.0)/ctx->params.soilInit)/ctx->params.soilRespQ10;
 
 
 // ensure that all the allocation parameters sum up to something less than one:
   #if ROOTS
-  	ensureAllocation();
+  	ensureAllocation(ctx);
   #endif
 
 // If we aren't explicitly modeling microbe pool, then do not have a pulse to microbes,
 // exudates go directly to the soil
 #if !MICROBES
-	params.microbePulseEff=0;
+	ctx->params.microbePulseEff=0;
 #endif
 
   // change units of parameters:
-  params.baseVegResp /= 365.0; // change from per-year to per-day rate
-  params.litterBreakdownRate /= 365.0;
-  params.baseSoilResp /= 365.0;
-  params.baseSoilRespCold /= 365.0;
-  params.woodTurnoverRate /= 365.0;
-  params.leafTurnoverRate /= 365.0;
+  ctx->params.baseVegResp /= 365.0; // change from per-year to per-day rate
+  ctx->params.litterBreakdownRate /= 365.0;
+  ctx->params.baseSoilResp /= 365.0;
+  ctx->params.baseSoilRespCold /= 365.0;
+  ctx->params.woodTurnoverRate /= 365.0;
+  ctx->params.leafTurnoverRate /= 365.0;
 
   // calculate additional parameters:
-  params.psnTMax = params.psnTOpt + (params.psnTOpt - params.psnTMin); // assumed symmetrical
+  ctx->params.psnTMax = ctx->params.psnTOpt + (ctx->params.psnTOpt - ctx->params.psnTMin); // assumed symmetrical
 
  #if ROOTS
-  envi.plantWoodC = (1-params.coarseRootFrac-params.fineRootFrac)*params.plantWoodInit;
+  ctx->envi.plantWoodC = (1-ctx->params.coarseRootFrac-ctx->params.fineRootFrac)*ctx->params.plantWoodInit;
  #else
- 	envi.plantWoodC = params.plantWoodInit;
+ 	ctx->envi.plantWoodC = ctx->params.plantWoodInit;
  #endif
 
-  envi.plantLeafC = params.laiInit * params.leafCSpWt;
-  envi.litter = params.litterInit;
+  ctx->envi.plantLeafC = ctx->params.laiInit * ctx->params.leafCSpWt;
+  ctx->envi.litter = ctx->params.litterInit;
 
 
 // If SOIL_QUALITY, split initial soilCarbon equally among all the pools
@@ -2416,111 +3410,285 @@ void setupModel(SpatialParams *spatialParams, int loc) {
 
 		for( counter=0; counter <NUMBER_SOIL_CARBON_POOLS; counter++) {
 
-			envi.soil[counter]=params.soilInit/NUMBER_SOIL_CARBON_POOLS;
+			ctx->envi.soil[counter]=ctx->params.soilInit/NUMBER_SOIL_CARBON_POOLS;
 
 		}
-		trackers.totSoilC=params.soilInit;
+		ctx->trackers.totSoilC=ctx->params.soilInit;
 	#else
-  		envi.soil = params.soilInit;
+  		ctx->envi.soil = ctx->params.soilInit;
 
 	#endif
 
 	#if SOIL_QUALITY
-		params.maxIngestionRate = params.maxIngestionRate*24*params.microbeInit/1000;
+		ctx->params.maxIngestionRate = ctx->params.maxIngestionRate*24*ctx->params.microbeInit/1000;
 			// change from per hour to per day rate, and then multiply by microbial concentration (mg C / g soil).
 
 	#else
-		params.maxIngestionRate = params.maxIngestionRate*24;	// change from per hour to per day rate
+		ctx->params.maxIngestionRate = ctx->params.maxIngestionRate*24;	// change from per hour to per day rate
 	#endif
 
 
 
-  envi.microbeC = params.microbeInit*params.soilInit/1000;		// convert to gC m-2
+  ctx->envi.microbeC = ctx->params.microbeInit*ctx->params.soilInit/1000;		// convert to gC m-2
 
 
-  params.totNitrogen = params.totNitrogen*params.soilInit;	// convert to gC m-2
+  ctx->params.totNitrogen = ctx->params.totNitrogen*ctx->params.soilInit;	// convert to gC m-2
 
-  params.fineRootTurnoverRate /= 365.0;
-  params.coarseRootTurnoverRate /= 365.0;
+  ctx->params.fineRootTurnoverRate /= 365.0;
+  ctx->params.coarseRootTurnoverRate /= 365.0;
 
-  params.baseCoarseRootResp /= 365.0;
-  params.baseFineRootResp /= 365.0;
-  params.baseMicrobeResp = params.baseMicrobeResp*24;		// change from per hour to per day rate
+  ctx->params.baseCoarseRootResp /= 365.0;
+  ctx->params.baseFineRootResp /= 365.0;
+  ctx->params.baseMicrobeResp = ctx->params.baseMicrobeResp*24;		// change from per hour to per day rate
 
 
-  envi.coarseRootC = params.coarseRootFrac*params.plantWoodInit;
-  envi.fineRootC = params.fineRootFrac*params.plantWoodInit;
+  ctx->envi.coarseRootC = ctx->params.coarseRootFrac*ctx->params.plantWoodInit;
+  ctx->envi.fineRootC = ctx->params.fineRootFrac*ctx->params.plantWoodInit;
 
 
 
 
-  envi.litterWater = params.litterWFracInit * params.litterWHC;
-  if (envi.litterWater < 0)
-    envi.litterWater = 0;
-  else if (envi.litterWater > params.litterWHC)
-    envi.litterWater = params.litterWHC;
+  ctx->envi.litterWater = ctx->params.litterWFracInit * ctx->params.litterWHC;
+  if (ctx->envi.litterWater < 0)
+    ctx->envi.litterWater = 0;
+  else if (ctx->envi.litterWater > ctx->params.litterWHC)
+    ctx->envi.litterWater = ctx->params.litterWHC;
 
-  envi.soilWater = params.soilWFracInit * params.soilWHC;
-  if (envi.soilWater < 0)
-    envi.soilWater = 0;
-  else if (envi.soilWater > params.soilWHC)
-    envi.soilWater = params.soilWHC;
+  ctx->envi.soilWater = ctx->params.soilWFracInit * ctx->params.soilWHC;
+  if (ctx->envi.soilWater < 0)
+    ctx->envi.soilWater = 0;
+  else if (ctx->envi.soilWater > ctx->params.soilWHC)
+    ctx->envi.soilWater = ctx->params.soilWHC;
 
-  envi.snow = params.snowInit;
+  ctx->envi.snow = ctx->params.snowInit;
 
-  if (firstClimates[loc] != NULL)
-    climate = firstClimates[loc]; // set climate ptr to point to first climate record in this location
-  else // no climate data for this location
-    climate = firstClimates[0]; // use climate data from location 0
-  initTrackers();
-  initPhenologyTrackers();
-  resetMeanTracker(meanNPP, 0); // initialize with mean NPP (over last MEAN_NPP_DAYS) of 0
-  resetMeanTracker(meanGPP, 0); // initialize with mean NPP (over last MEAN_GPP_DAYS) of 0
-  resetMeanTracker(meanFPAR, 0); // initialize with mean FPAR (over last MEAN_FPAR_DAYS) of 0
+  ctx->clim = getClimate(loc); // climate arrays for this location (or location 0's, if there is no climate data for this location)
+  ctx->step = 0; // start at first climate record
+  initTrackers(ctx);
+  initPhenologyTrackers(ctx);
+  resetMeanTracker(ctx->meanNPP, 0); // initialize with mean NPP (over last MEAN_NPP_DAYS) of 0
+  resetMeanTracker(ctx->meanGPP, 0); // initialize with mean NPP (over last MEAN_GPP_DAYS) of 0
+  resetMeanTracker(ctx->meanFPAR, 0); // initialize with mean FPAR (over last MEAN_FPAR_DAYS) of 0
 }
 
 
-/* Do one run of the model using parameter values in spatialParams
-   If out != NULL, output results to out
-    If printHeader = 1, print a header for the output file, if 0 don't
-   If outputItems != NULL, do additional outputting as given by this structure (1 variable per file)
-    If loc == -1, then print currLoc as first item on each line
-   Run at spatial location given by loc (0-indexing) - or run everywhere if loc = -1
-   Note: number of locations given in spatialParams
+/* Move ctx on to the next climate record (i.e. the next time step)
+   Return 1 if there is another time step, 0 if we have reached the end of the climate data for this location
 */
-void runModelOutput(FILE *out, OutputItems *outputItems, int printHeader, SpatialParams *spatialParams, int loc) {
-  int firstLoc, lastLoc, currLoc;
+int nextClimate(SipnetContext *ctx) {
+  ctx->step++;
+  return (ctx->step < ctx->clim->numSteps);
+}
+
+
+// a record passed to the output writer thread by runModelOutputAsync (see writeOutputRecord)
+typedef struct OutputRecordStruct {
+  int type; // OUTPUT_RECORD_STEP, etc.
+  int loc, year, day; // (for OUTPUT_RECORD_STEP)
+  double time; // (for OUTPUT_RECORD_STEP)
+  char label[64]; // (for OUTPUT_RECORD_LABEL)
+  double values[]; // (for OUTPUT_RECORD_STEP) NUM_OUTPUT_STATE_VALUES values for out, then one value for each output item
+} OutputRecord;
+
+// where the output writer thread writes to
+typedef struct OutputDestStruct {
+  FILE *out;
+  OutputItems *outputItems;
+} OutputDest;
+
+
+// write one record (an OutputRecord) to the files in outputDest (an OutputDest): called on the output writer thread
+void writeOutputRecord(void *outputRecord, void *outputDest) {
+  OutputRecord *record = (OutputRecord *)outputRecord;
+  OutputDest *dest = (OutputDest *)outputDest;
+
+  if (record->type == OUTPUT_RECORD_STEP) {
+    if (dest->out != NULL)
+      writeOutputStateValues(dest->out, record->loc, record->year, record->day, record->time, record->values);
+    if (dest->outputItems != NULL)
+      writeOutputItemValuesFrom(dest->outputItems, record->values + NUM_OUTPUT_STATE_VALUES);
+  }
+  else if (record->type == OUTPUT_RECORD_LABEL)
+    writeOutputItemLabels(dest->outputItems, record->label);
+  else // OUTPUT_RECORD_END_LINE
+    terminateOutputItemLines(dest->outputItems);
+}
+
+
+/* Write the output of the current time step of ctx at location loc to out and outputItems (either of which may be NULL):
+   directly, or if asyncOut isn't NULL, by passing the values to its writer thread
+   If binOut isn't NULL, also add the output to it (as a row of 4 + NUM_OUTPUT_STATE_VALUES values: see getOutputColumns)
+*/
+void outputStep(SipnetContext *ctx, AsyncOutput *asyncOut, BinaryOutput *binOut, FILE *out, OutputItems *outputItems, int loc) {
+  OutputRecord *record;
+  double row[4 + NUM_OUTPUT_STATE_VALUES];
+
+  if (binOut != NULL) {
+    row[0] = loc;
+    row[1] = ctx->clim->year[ctx->step];
+    row[2] = ctx->clim->day[ctx->step];
+    row[3] = ctx->clim->time[ctx->step];
+    getOutputStateValues(ctx, row + 4);
+    addBinaryOutputRow(binOut, row);
+  }
+
+  if (asyncOut == NULL) {
+    if (out != NULL)
+      outputState(ctx, out, loc, ctx->clim->year[ctx->step], ctx->clim->day[ctx->step], ctx->clim->time[ctx->step]);
+    if (outputItems != NULL)
+      writeOutputItemValues(outputItems);
+  }
+  else {
+    record = (OutputRecord *)nextAsyncOutputRecord(asyncOut);
+    record->type = OUTPUT_RECORD_STEP;
+    record->loc = loc;
+    record->year = ctx->clim->year[ctx->step];
+    record->day = ctx->clim->day[ctx->step];
+    record->time = ctx->clim->time[ctx->step];
+    if (out != NULL)
+      getOutputStateValues(ctx, record->values);
+    if (outputItems != NULL)
+      getOutputItemValues(outputItems, record->values + NUM_OUTPUT_STATE_VALUES);
+    pushAsyncOutput(asyncOut);
+  }
+}
+
+
+/* Write label at the start of each output item's line (if label isn't NULL) or end each output item's line (if label is NULL):
+   directly, or if asyncOut isn't NULL, through its writer thread
+*/
+void outputItemLine(AsyncOutput *asyncOut, OutputItems *outputItems, char *label) {
+  OutputRecord *record;
+
+  if (asyncOut == NULL) {
+    if (label != NULL)
+      writeOutputItemLabels(outputItems, label);
+    else
+      terminateOutputItemLines(outputItems);
+  }
+  else {
+    record = (OutputRecord *)nextAsyncOutputRecord(asyncOut);
+    if (label != NULL) {
+      record->type = OUTPUT_RECORD_LABEL;
+      strcpy(record->label, label);
+    }
+    else
+      record->type = OUTPUT_RECORD_END_LINE;
+    pushAsyncOutput(asyncOut);
+  }
+}
+
+
+/* Do one run of the model, as described for runModelOutputCtx below
+   If asyncOut isn't NULL, output is passed to its writer thread (set up to write to out and outputItems) rather than written here
+   If binOut isn't NULL, the main output is also added to it
+*/
+void runModelOutputTo(SipnetContext *ctx, AsyncOutput *asyncOut, BinaryOutput *binOut, FILE *out, OutputItems *outputItems, int printHeader, SpatialParams *spatialParams, int loc) {
+  int numLocs, *locs, locIndex, currLoc;
   char label[64];
+  ClimatePrefetch *prefetch;
 
-  if ((out != NULL) && printHeader) {
-    outputHeader(out);
+  if ((out != NULL) && printHeader) { // (this is written before anything is passed to asyncOut, so it comes first)
+    outputHeader(ctx, out);
   }
 
-  if (loc == -1) { // run everywhere
-    firstLoc = 0;
-    lastLoc = spatialParams->numLocs - 1;
+  if (loc == -1) // run everywhere (i.e. at every location, or those set by setRunLocations)
+    numLocs = getRunLocations(spatialParams, &locs);
+  else { // just run at one point
+    numLocs = 1;
+    locs = &loc;
   }
-  else // just run at one point
-    firstLoc = lastLoc = loc;
 
-  for (currLoc = firstLoc; currLoc <= lastLoc; currLoc++) {
-    setupModel(spatialParams, currLoc);
+  /* if climate is loaded lazily and we're running everywhere, read the next location's climate in the background
+     while we run each one (so with the releases below, we hold at most CLIMATE_PREFETCH_SLOTS locations' climate at once) */
+  prefetch = (loc == -1) ? startClimatePrefetch(numLocs, locs) : NULL;
+
+  for (locIndex = 0; locIndex < numLocs; locIndex++) {
+    currLoc = locs[locIndex];
+    prefetchMoveTo(prefetch, locIndex);
+    setupModel(ctx, spatialParams, currLoc);
     if ((loc == -1) && (outputItems != NULL))  {  // print the current location at the start of the line
       sprintf(label, "%d", currLoc);
-      writeOutputItemLabels(outputItems, label);
+      outputItemLine(asyncOut, outputItems, label);
     }
 
-    while (climate != NULL) {
-      updateState();
-      if (out != NULL)
-	outputState(out, currLoc, climate->year, climate->day, climate->time);
-      if (outputItems != NULL)
-	writeOutputItemValues(outputItems);
-      climate = climate->nextClim;
+    while (ctx->step < ctx->clim->numSteps) {
+      updateState(ctx);
+      if (out != NULL || outputItems != NULL || binOut != NULL)
+	outputStep(ctx, asyncOut, binOut, out, outputItems, currLoc);
+      ctx->step++;
     }
     if (outputItems != NULL)
-      terminateOutputItemLines(outputItems);
+      outputItemLine(asyncOut, outputItems, NULL);
+    if (loc == -1) // running everywhere: we're done with this location's climate
+      prefetchRelease(prefetch, currLoc);
   }
+
+  finishClimatePrefetch(prefetch);
+  if (loc == -1)
+    free(locs);
+}
+
+
+/* Do one run of the model using parameter values in spatialParams, using (and overwriting) the state in ctx
+   If out != NULL, output results to out
+    If printHeader = 1, print a header for the output file, if 0 don't
+   If outputItems != NULL, do additional outputting as given by this structure (1 variable per file)
+    (outputItems should have been set up with setupOutputItemsCtx on this same ctx)
+    If loc == -1, then print currLoc as first item on each line
+   Run at spatial location given by loc (0-indexing) - or run everywhere if loc = -1
+    (i.e. at every location, or only at those set by setRunLocations)
+   Note: number of locations given in spatialParams
+*/
+void runModelOutputCtx(SipnetContext *ctx, FILE *out, OutputItems *outputItems, int printHeader, SpatialParams *spatialParams, int loc) {
+  runModelOutputTo(ctx, NULL, NULL, out, outputItems, printHeader, spatialParams, loc);
+}
+
+
+// same as runModelOutputCtx, using the default context
+void runModelOutput(FILE *out, OutputItems *outputItems, int printHeader, SpatialParams *spatialParams, int loc) {
+  runModelOutputCtx(getDefaultContext(), out, outputItems, printHeader, spatialParams, loc);
+}
+
+
+/* Same as runModelOutput, but the output is formatted and written by a separate writer thread,
+   while this thread goes on running the model (the output files are exactly the same)
+   bufferSteps (>= 1) is the number of time steps of output that can be waiting to be written:
+   if the writer gets this far behind, the model waits for it
+*/
+void runModelOutputAsync(FILE *out, OutputItems *outputItems, int printHeader, SpatialParams *spatialParams, int loc, int bufferSteps) {
+  OutputDest dest;
+  AsyncOutput *asyncOut;
+  int numValues;
+
+  dest.out = out;
+  dest.outputItems = outputItems;
+  numValues = NUM_OUTPUT_STATE_VALUES + ((outputItems != NULL) ? outputItems->count : 0);
+  asyncOut = newAsyncOutput(sizeof(OutputRecord) + numValues * sizeof(double), bufferSteps, writeOutputRecord, &dest);
+
+  runModelOutputTo(getDefaultContext(), asyncOut, NULL, out, outputItems, printHeader, spatialParams, loc);
+
+  finishAsyncOutput(asyncOut);
+}
+
+
+/* Same as runModelOutput, but the main output is written to binOutFile in binary (see binaryOutput.h), with each value
+   as a float (if valueSize = 4) or a double (if valueSize = 8); outbintotxt converts this to the usual text output
+   (printHeader is recorded in the file, so the converted file has a header if printHeader = 1)
+   binOutFile must be open for binary writing, with nothing written to it yet
+*/
+void runModelOutputBinary(FILE *binOutFile, int valueSize, OutputItems *outputItems, int printHeader, SpatialParams *spatialParams, int loc) {
+  BinaryOutput *binOut;
+  char *names[4 + NUM_OUTPUT_STATE_VALUES], *units[4 + NUM_OUTPUT_STATE_VALUES];
+  int numColumns;
+
+  numColumns = getOutputColumns(names, units);
+  binOut = newBinaryOutput(binOutFile, numColumns, names, units, valueSize, BINARY_OUTPUT_CHUNK_STEPS,
+			   printHeader ? BINARY_OUTPUT_PRINT_HEADER : 0);
+
+  runModelOutputTo(getDefaultContext(), NULL, binOut, NULL, outputItems, 0, spatialParams, loc);
+
+  finishBinaryOutput(binOut);
 }
 
 
@@ -2528,30 +3696,216 @@ void runModelOutput(FILE *out, OutputItems *outputItems, int printHeader, Spatia
 /* pre: outArray has dimensions of at least (# model steps) x numDataTypes
    dataTypeIndices[0..numDataTypes-1] gives indices of data types to use (see DATA_TYPES array in sipnet.h)
 
-   run model with parameter values in spatialParams, don't output to file
+   run model with parameter values in spatialParams, using (and overwriting) the state in ctx; don't output to file
    instead, output some variables at each step into an array
    Run at spatial location given by loc (0-indexing)
-   Note: can only run at one location: to run at all locations, must put runModelNoOut call in a loop
+   Note: can only run at one location: to run at all locations, must put runModelNoOutCtx call in a loop
 */
-void runModelNoOut(double **outArray, int numDataTypes, int dataTypeIndices[], SpatialParams *spatialParams, int loc) {
+void runModelNoOutCtx(SipnetContext *ctx, double **outArray, int numDataTypes, int dataTypeIndices[], SpatialParams *spatialParams, int loc) {
   int step = 0;
   int outputNum;
 
-  setupModel(spatialParams, loc);
+  setupModel(ctx, spatialParams, loc);
 
   // loop through every step of the model:
-  while (climate != NULL) {
-    updateState();
+  while (ctx->step < ctx->clim->numSteps) {
+    updateState(ctx);
 
     // loop through all desired outputs, putting each into outArray:
     for (outputNum = 0; outputNum < numDataTypes; outputNum++)
-      outArray[step][outputNum] = *(outputPtrs[dataTypeIndices[outputNum]]);
+      outArray[step][outputNum] = *(ctx->outputPtrs[dataTypeIndices[outputNum]]);
+
+    step++;
+    ctx->step++;
+  }
+}
+
+
+// same as runModelNoOutCtx, using the default context
+void runModelNoOut(double **outArray, int numDataTypes, int dataTypeIndices[], SpatialParams *spatialParams, int loc) {
+  runModelNoOutCtx(getDefaultContext(), outArray, numDataTypes, dataTypeIndices, spatialParams, loc);
+}
+
+
+/* Return a new ensemble, which can run up to maxMembers model runs together (maxMembers must be >= 1)
+   Set each member up with setupEnsembleMember, then run them with runEnsembleNoOut
+   (like a context, an ensemble can be set up and run many times)
+*/
+SipnetEnsemble *newSipnetEnsemble(int maxMembers) {
+  SipnetEnsemble *ens;
+  int member;
+
+  if (maxMembers < 1) {
+    printf("Error in newSipnetEnsemble: maxMembers = %d, must be >= 1\n", maxMembers);
+    exit(1);
+  }
+
+  ens = (SipnetEnsemble *)malloc(sizeof(SipnetEnsemble));
+  ens->maxMembers = maxMembers;
+  ens->members = (SipnetContext **)malloc(maxMembers * sizeof(SipnetContext *));
+  for (member = 0; member < maxMembers; member++)
+    ens->members[member] = newSipnetContext();
+  ens->psnParams = newPsnParamArrays(maxMembers);
+  ens->lai = makeArray(maxMembers);
+  ens->potGrossPsn = makeArray(maxMembers);
+  ens->baseFolResp = makeArray(maxMembers);
+  ens->fAPAR = makeArray(maxMembers);
+
+  return ens;
+}
+
+
+// free all space used by ens
+void deleteSipnetEnsemble(SipnetEnsemble *ens) {
+  int member;
+
+  for (member = 0; member < ens->maxMembers; member++)
+    deleteSipnetContext(ens->members[member]);
+  free(ens->members);
+  deletePsnParamArrays(ens->psnParams);
+  free(ens->lai);
+  free(ens->potGrossPsn);
+  free(ens->baseFolResp);
+  free(ens->fAPAR);
+  free(ens);
+}
+
+
+/* Setup member number member (0..maxMembers-1) of ens to run at given location, with the parameter values now in spatialParams
+   (as setupModel: spatialParams is only read, and can be changed for the next member as soon as this returns)
+*/
+void setupEnsembleMember(SipnetEnsemble *ens, int member, SpatialParams *spatialParams, int loc) {
+  PsnParamArrays *p = ens->psnParams;
+  Params *params;
+
+  if (member < 0 || member >= ens->maxMembers) {
+    printf("Error in setupEnsembleMember: member = %d, but ensemble only has %d members\n", member, ens->maxMembers);
+    exit(1);
+  }
+
+  setupModel(ens->members[member], spatialParams, loc);
+
+  // fill this member's photosynthesis parameters, computing the parts that don't change from step to step
+  // exactly as potPsn does, so ensemblePotPsn gets the same values as potPsn:
+  params = &(ens->members[member]->params);
+  p->respPerGram[member] = params->baseFolRespFrac * params->aMax;
+  p->grossAMax[member] = params->aMax * params->aMaxFrac + p->respPerGram[member];
+  p->psnTMin[member] = params->psnTMin;
+  p->psnTMax[member] = params->psnTMax;
+  p->tempDenom[member] = pow((params->psnTMax - params->psnTMin)/2.0, 2);
+  p->dVpdSlope[member] = params->dVpdSlope;
+  p->dVpdExp[member] = params->dVpdExp;
+  p->attenuation[member] = params->attenuation;
+  p->halfSatPar[member] = params->halfSatPar;
+  p->conversionPerLai[member] = C_WEIGHT * (1.0/TEN_9) * (params->leafCSpWt/params->cFracLeaf);
+}
+
+
+/* pre: members 0..numMembers-1 of ens have each been set up with setupEnsembleMember, all at the same location
+    (typically each with different parameter values)
+   outArrays[m] has dimensions of at least (# model steps) x numDataTypes, for each member m
+   dataTypeIndices[0..numDataTypes-1] gives indices of data types to use (see DATA_TYPES array in sipnet.h)
+
+   run all members forward together, one time step at a time: each step's climate is read once for the whole batch,
+   and the photosynthesis (the most expensive part of a step) is done for all members at once by ensemblePotPsn;
+   the rest of each member's step is then done as in updateState
+   output some variables at each step into outArrays[m], as in runModelNoOutCtx
+   In the default build each member's output is identical to running it on its own with runModelNoOutCtx;
+   with make ENSEMBLE_SIMD=1, it agrees to within the tolerance given in the README
+*/
+void runEnsembleNoOut(SipnetEnsemble *ens, int numMembers, double **outArrays[], int numDataTypes, int dataTypeIndices[]) {
+  SipnetContext *ctx;
+  ClimateArrays *clim;
+  int step, firstStep;
+  int member, outputNum;
+  double par;
+
+  if (numMembers <= 0)
+    return;
+  if (numMembers > ens->maxMembers) {
+    printf("Error in runEnsembleNoOut: numMembers = %d, but ensemble only has %d members\n", numMembers, ens->maxMembers);
+    exit(1);
+  }
+
+  clim = ens->members[0]->clim;
+  firstStep = ens->members[0]->step;
+  for (member = 1; member < numMembers; member++) {
+    if (ens->members[member]->clim != clim || ens->members[member]->step != firstStep) {
+      printf("Error in runEnsembleNoOut: all members must be set up at the same location\n");
+      exit(1);
+    }
+  }
+
+  for (step = firstStep; step < clim->numSteps; step++) {
+    par = clim->par[step];
+    for (member = 0; member < numMembers; member++) {
+      ctx = ens->members[member];
+      ens->lai[member] = ctx->envi.plantLeafC / ctx->params.leafCSpWt; // current lai
+    }
+
+    ensemblePotPsn(ens->psnParams, numMembers, ens->lai, clim->tair[step], clim->vpd[step], par, SEC_PER_DAY,
+		   ens->potGrossPsn, ens->baseFolResp, ens->fAPAR);
+
+    for (member = 0; member < numMembers; member++) {
+      ctx = ens->members[member];
+      if (ens->lai[member] > 0 && par > 0) // as in calcLightEff3
+	addFPAR(ctx, ens->fAPAR[member]);
+      updateStateFromPsn(ctx, ens->lai[member], ens->potGrossPsn[member], ens->baseFolResp[member]);
+
+      // loop through all desired outputs, putting each into this member's outArray:
+      for (outputNum = 0; outputNum < numDataTypes; outputNum++)
+	outArrays[member][step - firstStep][outputNum] = *(ctx->outputPtrs[dataTypeIndices[outputNum]]);
+
+      ctx->step++;
+    }
+  }
+}
+
+
+/* pre: outArray has dimensions of at least (# model steps) x numDataTypes
+   dataTypeIndices[0..numDataTypes-1] gives indices of data types to use (see DATA_TYPES array in sipnet.h)
+
+   same as runModelNoOutCtx, but after each step, call keepGoing(outArray[step], step, checkInfo)
+   (step is 0-indexed); if this returns 0, stop the run there, leaving later rows of outArray unset
+   outArray can be NULL (if keepGoing does all that's needed with each step's output):
+    then we just keep the current step's output, in a single array that is passed to keepGoing
+   return the number of steps that were skipped as a result (0 if we ran to the end)
+*/
+int runModelNoOutCheckedCtx(SipnetContext *ctx, double **outArray, int numDataTypes, int dataTypeIndices[], SpatialParams *spatialParams, int loc,
+			    int (*keepGoing)(double *, int, void *), void *checkInfo) {
+  int step = 0;
+  int outputNum;
+  double stepOutput[MAX_DATA_TYPES]; // holds output of current step if outArray is NULL
+  double *thisStep;
+
+  setupModel(ctx, spatialParams, loc);
+
+  // loop through every step of the model, until keepGoing tells us to stop:
+  while (ctx->step < ctx->clim->numSteps) {
+    updateState(ctx);
+
+    // loop through all desired outputs, putting each into outArray (or stepOutput):
+    thisStep = (outArray != NULL) ? outArray[step] : stepOutput;
+    for (outputNum = 0; outputNum < numDataTypes; outputNum++)
+      thisStep[outputNum] = *(ctx->outputPtrs[dataTypeIndices[outputNum]]);
 
+    ctx->step++;
+    if (!(*keepGoing)(thisStep, step, checkInfo))
+      break;
     step++;
-    climate = climate->nextClim;
   }
+
+  return ctx->clim->numSteps - ctx->step;
+}
+
+
+// same as runModelNoOutCheckedCtx, using the default context
+int runModelNoOutChecked(double **outArray, int numDataTypes, int dataTypeIndices[], SpatialParams *spatialParams, int loc,
+			 int (*keepGoing)(double *, int, void *), void *checkInfo) {
+  return runModelNoOutCheckedCtx(getDefaultContext(), outArray, numDataTypes, dataTypeIndices, spatialParams, loc, keepGoing, checkInfo);
 }
 
+
 /* Do a sensitivity test on paramNum, varying from low to high, doing a total of numRuns runs
    Run only at a single location (given by loc)
    If out != NULL, output results to out
@@ -2685,59 +4039,101 @@ char **getDataTypeNames() {
 
 
 // set outputPtrs array to point to appropriate values
-void setupOutputPointers(void) {
+void setupOutputPointers(SipnetContext *ctx) {
   int i; // keep track of current index into array
 
   i = 0;
   // we post-increment i every time we assign an array element
-	outputPtrs[i++] = &(trackers.evapotranspiration);
-	outputPtrs[i++] = &(trackers.nee);
-	outputPtrs[i++] = &(trackers.soilWetnessFrac);
-	//outputPtrs[i++] = &(trackers.rSoil);
-	//outputPtrs[i++] = &(trackers.yearlyLitter);
-	//outputPtrs[i++] = &(trackers.LAI);
-	//outputPtrs[i++] = &(trackers.plantWoodC);
-	outputPtrs[i++] = &(trackers.fpar);
-	outputPtrs[i++] = &(trackers.yearlyNee);
+	ctx->outputPtrs[i++] = &(ctx->trackers.evapotranspiration);
+	ctx->outputPtrs[i++] = &(ctx->trackers.nee);
+	ctx->outputPtrs[i++] = &(ctx->trackers.soilWetnessFrac);
+	//ctx->outputPtrs[i++] = &(ctx->trackers.rSoil);
+	//ctx->outputPtrs[i++] = &(ctx->trackers.yearlyLitter);
+	//ctx->outputPtrs[i++] = &(ctx->trackers.LAI);
+	//ctx->outputPtrs[i++] = &(ctx->trackers.plantWoodC);
+	ctx->outputPtrs[i++] = &(ctx->trackers.fpar);
+	ctx->outputPtrs[i++] = &(ctx->trackers.yearlyNee);
 #if EXTRA_DATA_TYPES
 
 
-  //outputPtrs[i++] = &(trackers.fpar);
+  //ctx->outputPtrs[i++] = &(ctx->trackers.fpar);
 
 
-  outputPtrs[i++] = &(trackers.gpp);
-  outputPtrs[i++] = &(trackers.rtot);
-  outputPtrs[i++] = &(trackers.ra);
-  outputPtrs[i++] = &(trackers.rh);
-  outputPtrs[i++] = &(trackers.npp);
+  ctx->outputPtrs[i++] = &(ctx->trackers.gpp);
+  ctx->outputPtrs[i++] = &(ctx->trackers.rtot);
+  ctx->outputPtrs[i++] = &(ctx->trackers.ra);
+  ctx->outputPtrs[i++] = &(ctx->trackers.rh);
+  ctx->outputPtrs[i++] = &(ctx->trackers.npp);
 
-  outputPtrs[i++] = &(trackers.yearlyGpp);
-  outputPtrs[i++] = &(trackers.yearlyRtot);
-  outputPtrs[i++] = &(trackers.yearlyRa);
-  outputPtrs[i++] = &(trackers.yearlyRh);
-  outputPtrs[i++] = &(trackers.yearlyNpp);
-  //outputPtrs[i++] = &(trackers.yearlyNee);
+  ctx->outputPtrs[i++] = &(ctx->trackers.yearlyGpp);
+  ctx->outputPtrs[i++] = &(ctx->trackers.yearlyRtot);
+  ctx->outputPtrs[i++] = &(ctx->trackers.yearlyRa);
+  ctx->outputPtrs[i++] = &(ctx->trackers.yearlyRh);
+  ctx->outputPtrs[i++] = &(ctx->trackers.yearlyNpp);
+  //ctx->outputPtrs[i++] = &(ctx->trackers.yearlyNee);
 
-  outputPtrs[i++] = &(trackers.totGpp);
-  outputPtrs[i++] = &(trackers.totRtot);
-  outputPtrs[i++] = &(trackers.totRa);
-  outputPtrs[i++] = &(trackers.totRh);
-  outputPtrs[i++] = &(trackers.totNpp);
-  outputPtrs[i++] = &(trackers.totNee);
+  ctx->outputPtrs[i++] = &(ctx->trackers.totGpp);
+  ctx->outputPtrs[i++] = &(ctx->trackers.totRtot);
+  ctx->outputPtrs[i++] = &(ctx->trackers.totRa);
+  ctx->outputPtrs[i++] = &(ctx->trackers.totRh);
+  ctx->outputPtrs[i++] = &(ctx->trackers.totNpp);
+  ctx->outputPtrs[i++] = &(ctx->trackers.totNee);
 #endif
 }
 
 
 /* PRE: outputItems has been created with newOutputItems
 
-   Setup outputItems structure
+   Setup outputItems structure, pointing to the trackers in ctx
    Each variable added will be output in a separate file ('*.varName')
  */
+void setupOutputItemsCtx(SipnetContext *ctx, OutputItems *outputItems)  {
+  addOutputItem(outputItems, "NEE", &(ctx->trackers.nee));
+  addOutputItem(outputItems, "NEE_cum", &(ctx->trackers.totNee));
+  addOutputItem(outputItems, "GPP", &(ctx->trackers.gpp));
+  addOutputItem(outputItems, "GPP_cum", &(ctx->trackers.totGpp));
+}
+
+
+// same as setupOutputItemsCtx, using the default context
 void setupOutputItems(OutputItems *outputItems)  {
-  addOutputItem(outputItems, "NEE", &(trackers.nee));
-  addOutputItem(outputItems, "NEE_cum", &(trackers.totNee));
-  addOutputItem(outputItems, "GPP", &(trackers.gpp));
-  addOutputItem(outputItems, "GPP_cum", &(trackers.totGpp));
+  setupOutputItemsCtx(getDefaultContext(), outputItems);
+}
+
+
+/* Allocate and return a new model context, which holds all of the state of a single model run
+   Any number of contexts can exist at once; runs using different contexts don't interfere with each other
+   (but all share the climate data and parameter layout read in initModel, so initModel must be called before running)
+*/
+SipnetContext *newSipnetContext(void) {
+  SipnetContext *ctx;
+
+  ctx = (SipnetContext *)malloc(sizeof(SipnetContext));
+  if (ctx == NULL) {
+    printf("Error allocating space for a new SipnetContext\n");
+    exit(1);
+  }
+
+  setupOutputPointers(ctx);
+
+  ctx->meanNPP = newMeanTracker(0, MEAN_NPP_DAYS, MEAN_NPP_MAX_ENTRIES);
+  ctx->meanGPP = newMeanTracker(0, MEAN_GPP_SOIL_DAYS, MEAN_GPP_SOIL_MAX_ENTRIES);
+  ctx->meanFPAR = newMeanTracker(0, MEAN_FPAR_DAYS, MEAN_FPAR_MAX_ENTRIES);
+
+  ctx->clim = NULL;
+  ctx->step = 0;
+  ctx->lastYear = -1;
+
+  return ctx;
+}
+
+
+// free all space used by ctx
+void deleteSipnetContext(SipnetContext *ctx) {
+  deallocateMeanTracker(ctx->meanNPP);
+  deallocateMeanTracker(ctx->meanGPP);
+  deallocateMeanTracker(ctx->meanFPAR);
+  free(ctx);
 }
 
 
@@ -2748,8 +4144,10 @@ void setupOutputItems(OutputItems *outputItems)  {
    number of time steps in each location gets stored in steps vector, which gets dynamically allocated with malloc
    (steps must be a pointer to a pointer so it can be malloc'ed)
 
-   also set up pointers to different output data types
-   and setup meanNPP tracker
+   also create the default context used by runModelOutput, runModelNoOut, etc.
+   (which sets up pointers to different output data types and the meanNPP tracker)
+   each thread gets its own default context (other threads' are created the first time they need one),
+   so these functions can be called from several threads at once
 
    initModel returns number of spatial locations
 
@@ -2758,32 +4156,87 @@ void setupOutputItems(OutputItems *outputItems)  {
    climFile is climate data file
 */
 int initModel(SpatialParams **spatialParams, int **steps, char *paramFile, char *climFile) {
+  return initModelLocs(spatialParams, steps, paramFile, climFile, -1, NULL);
+}
+
+
+/* Same as initModel, but only read the climate data that's needed (see sipnet.h)
+   numWanted = -1 means read all locations' climate now (as initModel)
+*/
+int initModelLocs(SpatialParams **spatialParams, int **steps, char *paramFile, char *climFile, int numWanted, int locs[]) {
   char spatialParamFile[256];
   int numLocs;
+  int i, j;
 
   strcpy(spatialParamFile, paramFile);
   strcat(spatialParamFile, "-spatial");
 
   numLocs = readParamData(spatialParams, paramFile, spatialParamFile);
+  for (i = 0; i < numWanted; i++) {
+    if (locs[i] < 0 || locs[i] >= numLocs) {
+      printf("Error in initModelLocs: location %d doesn't exist (numLocs = %d)\n", locs[i], numLocs);
+      exit(1);
+    }
+    for (j = 0; j < i; j++) {
+      if (locs[j] == locs[i]) {
+	printf("Error in initModelLocs: location %d is listed more than once\n", locs[i]);
+	exit(1);
+      }
+    }
+  }
   //printf("ERROR: input filename %s ", climFile);
-  *steps = readClimData(climFile, numLocs);
+  if (numWanted == -1)
+    *steps = loadClimData(climFile, numLocs);
+  else
+    *steps = loadClimDataLocs(climFile, numLocs, numWanted, locs);
+
+  pthread_key_create(&defaultContextKey, deleteDefaultContext);
+  getDefaultContext(); // create the default context for this thread
+
+  return numLocs;
+}
 
-  setupOutputPointers();
 
-  meanNPP = newMeanTracker(0, MEAN_NPP_DAYS, MEAN_NPP_MAX_ENTRIES);
-  meanGPP = newMeanTracker(0, MEAN_GPP_SOIL_DAYS, MEAN_GPP_SOIL_MAX_ENTRIES);
-  meanFPAR = newMeanTracker(0, MEAN_FPAR_DAYS, MEAN_FPAR_MAX_ENTRIES);
+/* From now on, make runs everywhere (runModelOutput etc. with loc = -1, and runModelOutputParallel) run only at locations
+   locs[0..numLocs-1], in that order, rather than at every location (numLocs = 0 goes back to running at every location)
+   PRE: each of locs is a location of the model, listed only once (as initModelLocs checks)
+*/
+void setRunLocations(int numLocs, int locs[]) {
+  free(runLocs);
+  runLocs = NULL;
+  numRunLocs = numLocs;
+  if (numLocs > 0) {
+    runLocs = (int *)malloc(numLocs * sizeof(int));
+    memcpy(runLocs, locs, numLocs * sizeof(int));
+  }
+}
+
+
+/* Put the locations that a run everywhere goes through, in order, in a new array (allocated with malloc) in *locs,
+   and return how many there are: the locations set by setRunLocations, or if there are none, every location in spatialParams
+*/
+int getRunLocations(SpatialParams *spatialParams, int **locs) {
+  int numLocs, i;
+
+  numLocs = (numRunLocs > 0) ? numRunLocs : spatialParams->numLocs;
+  *locs = (int *)malloc(numLocs * sizeof(int));
+  for (i = 0; i < numLocs; i++)
+    (*locs)[i] = (numRunLocs > 0) ? runLocs[i] : i;
+
   return numLocs;
 }
 
 
 
 // call this when done running model:
-// de-allocates space for climate linked list
+// de-allocates space for climate arrays and the calling thread's default context
+// (other threads' default contexts are freed when those threads exit)
 // (needs to know number of locations)
+// any other contexts should be deleted with deleteSipnetContext
 void cleanupModel(int numLocs) {
-	freeClimateList(numLocs);
-  deallocateMeanTracker(meanNPP);
-  deallocateMeanTracker(meanGPP);
-  deallocateMeanTracker(meanFPAR);
+	freeClimateArrays(numLocs);
+  setRunLocations(0, NULL);
+  deleteSipnetContext(getDefaultContext());
+  pthread_setspecific(defaultContextKey, NULL);
+  pthread_key_delete(defaultContextKey);
 }
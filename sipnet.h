@@ -21,6 +21,19 @@
 #define MAX_DATA_TYPES 5
 #endif
 
+#define MAX_OUTPUT_COLUMNS 64 // at least the number of columns of the main output (see getOutputColumns)
+
+
+// all of the state of a single model run (parameters, environment, fluxes, trackers, current climate, etc.)
+// contents are private to sipnet.c
+// each context can be used for one run at a time; runs using different contexts are independent,
+// so several can go at once (e.g. in different threads), sharing the climate data and spatialParams
+typedef struct SipnetContextStruct SipnetContext;
+
+// a batch of model runs (e.g. with different parameter values) that go through the same location's climate together,
+// one time step at a time (see runEnsembleNoOut); contents are private to sipnet.c
+typedef struct SipnetEnsembleStruct SipnetEnsemble;
+
 
 // write to file which model components are turned on
 // (i.e. the value of the #DEFINE's at the top of file)
@@ -40,8 +53,10 @@ char **getDataTypeNames();
    number of time steps in each location gets stored in steps vector, which gets dynamically allocated with malloc
    (steps must be a pointer to a pointer so it can be malloc'ed)
 
-   also set up pointers to different output data types
-   and setup meanNPP tracker
+   also create the default context used by runModelOutput, runModelNoOut, etc.
+   (which sets up pointers to different output data types and the meanNPP tracker)
+   each thread gets its own default context (other threads' are created the first time they need one),
+   so these functions can be called from several threads at once
 
    initModel returns number of spatial locations
 
@@ -52,12 +67,81 @@ char **getDataTypeNames();
 int initModel(SpatialParams **spatialParams, int **steps, char *paramFile, char *climFile);
 
 
+/* Same as initModel, but rather than reading the whole climate file up front, only read the climate that the run needs:
+   the climate of locations locs[0..numWanted-1] is read now, and that of any other location the first time it is run
+   (so a run at a single location reads only that location's climate, and with numWanted = 0 nothing is read until it's run)
+   Climate is found in the file through an index of where each location starts (saved in climFile + "idx" for later runs);
+   if there is an up-to-date binary climate cache (climFile + "bin"), it's used instead
+   When runModelOutput runs everywhere (loc = -1), it streams through the locations: the next location's climate is read
+   on a background thread while the current location runs, and each location's climate is freed after it is run,
+   so at most two locations' climate (plus location 0's) is held at once, however many locations there are (see releaseClimate)
+   Each of locs must be a location of the model, listed only once (otherwise we exit with an error)
+*/
+int initModelLocs(SpatialParams **spatialParams, int **steps, char *paramFile, char *climFile, int numWanted, int locs[]);
+
+
+/* If climate was loaded lazily (by initModelLocs), free the climate of location loc, which will be read again if it's needed again
+   (does nothing otherwise, or for location 0, whose climate is also used by locations with no climate data of their own)
+   PRE: no run is going on at location loc
+*/
+void releaseClimate(int loc);
+
+
+/* From now on, make runs everywhere (runModelOutput etc. with loc = -1, and runModelOutputParallel) run only at locations
+   locs[0..numLocs-1], in that order, rather than at every location (numLocs = 0 goes back to running at every location)
+   PRE: each of locs is a location of the model, listed only once (as initModelLocs checks)
+*/
+void setRunLocations(int numLocs, int locs[]);
+
+
+/* Put the locations that a run everywhere goes through, in order, in a new array (allocated with malloc) in *locs,
+   and return how many there are: the locations set by setRunLocations, or if there are none, every location in spatialParams
+*/
+int getRunLocations(SpatialParams *spatialParams, int **locs);
+
+
 // call this when done running model:
-// de-allocates space for climate linked list
+// de-allocates space for climate arrays and the calling thread's default context
+// (other threads' default contexts are freed when those threads exit)
 // (needs to know number of locations)
+// any other contexts should be deleted with deleteSipnetContext
 void cleanupModel(int numLocs);
 
 
+/* Allocate and return a new model context, which holds all of the state of a single model run
+   Any number of contexts can exist at once; runs using different contexts don't interfere with each other
+   (but all share the climate data and parameter layout read in initModel, so initModel must be called before running)
+*/
+SipnetContext *newSipnetContext(void);
+
+
+// free all space used by ctx
+void deleteSipnetContext(SipnetContext *ctx);
+
+
+/* return the calling thread's default context (the one used by runModelOutput, runModelNoOut, etc.),
+   creating it if this thread doesn't have one yet
+   (so a thread can set its context up before it starts running the model, rather than on its first run)
+*/
+SipnetContext *getDefaultContext(void);
+
+
+// Setup ctx to run at given location (0-indexing: if only one location, loc should be 0)
+// spatialParams is only read, so many contexts can be set up from the same spatialParams
+void setupModel(SipnetContext *ctx, SpatialParams *spatialParams, int loc);
+
+
+// calculate all fluxes and update state of ctx for its current time step
+// (does not move on to the next time step: use nextClimate for that)
+void updateState(SipnetContext *ctx);
+
+
+/* Move ctx on to the next climate record (i.e. the next time step)
+   Return 1 if there is another time step, 0 if we have reached the end of the climate data for this location
+*/
+int nextClimate(SipnetContext *ctx);
+
+
 /* pre: outArray has dimensions of at least (# model steps) x numDataTypes
    dataTypeIndices[0..numDataTypes-1] gives indices of data types to use (see DATA_TYPES array in sipnet.h)
 
@@ -65,21 +149,111 @@ void cleanupModel(int numLocs);
    instead, output some variables at each step into an array
    Run at spatial location given by loc (0-indexing)
    Note: can only run at one location: to run at all locations, must put runModelNoOut call in a loop
+   Uses the default context: see runModelNoOutCtx
 */
 void runModelNoOut(double **outArray, int numDataTypes, int dataTypeIndices[], SpatialParams *spatialParams, int loc);
 
 
+// same as runModelNoOut, but using (and overwriting) the state in ctx
+void runModelNoOutCtx(SipnetContext *ctx, double **outArray, int numDataTypes, int dataTypeIndices[], SpatialParams *spatialParams, int loc);
+
+
+// return a new ensemble, which can run up to maxMembers model runs together (maxMembers must be >= 1)
+SipnetEnsemble *newSipnetEnsemble(int maxMembers);
+
+
+// free all space used by ens
+void deleteSipnetEnsemble(SipnetEnsemble *ens);
+
+
+/* Setup member number member (0..maxMembers-1) of ens to run at given location, with the parameter values now in spatialParams
+   (as setupModel: spatialParams is only read, and can be changed for the next member as soon as this returns)
+*/
+void setupEnsembleMember(SipnetEnsemble *ens, int member, SpatialParams *spatialParams, int loc);
+
+
+/* pre: members 0..numMembers-1 of ens have each been set up with setupEnsembleMember, all at the same location
+   outArrays[m] has dimensions of at least (# model steps) x numDataTypes, for each member m
+
+   run all members forward together, one time step at a time, without outputting to file
+   instead, output some variables at each step into outArrays[m], as in runModelNoOut
+   Each step's climate is read once for the whole batch, and the photosynthesis is done for all members at once
+   (see ensembleKernel.c): in the default build, results for each member are identical to running it on its own;
+   with make ENSEMBLE_SIMD=1 they agree to within the tolerance given in the README
+*/
+void runEnsembleNoOut(SipnetEnsemble *ens, int numMembers, double **outArrays[], int numDataTypes, int dataTypeIndices[]);
+
+
+/* Same as runModelNoOut, but stop the run early if asked to:
+   after each step, call keepGoing(outArray[step], step, checkInfo) (step is 0-indexed);
+   if this returns 0, stop the run there, leaving later rows of outArray unset
+   outArray can be NULL: then only the current step's output is kept (and passed to keepGoing)
+   Return the number of steps that were skipped as a result (0 if we ran to the end)
+   Uses the default context: see runModelNoOutCheckedCtx
+*/
+int runModelNoOutChecked(double **outArray, int numDataTypes, int dataTypeIndices[], SpatialParams *spatialParams, int loc,
+			 int (*keepGoing)(double *, int, void *), void *checkInfo);
+
+
+// same as runModelNoOutChecked, but using (and overwriting) the state in ctx
+int runModelNoOutCheckedCtx(SipnetContext *ctx, double **outArray, int numDataTypes, int dataTypeIndices[], SpatialParams *spatialParams, int loc,
+			    int (*keepGoing)(double *, int, void *), void *checkInfo);
+
+
 /* Do one run of the model using parameter values in spatialParams
    If out != NULL, output results to out
     If printHeader = 1, print a header for the output file, if 0 don't
    If outputItems != NULL, do additional outputting as given by this structure (1 variable per file)
     If loc == -1, then print currLoc as first item on each line
    Run at spatial location given by loc (0-indexing) - or run everywhere if loc = -1
+    (i.e. at every location, or only at those set by setRunLocations)
    Note: number of locations given in spatialParams
+   Uses the default context: see runModelOutputCtx
 */
 void runModelOutput(FILE *out, OutputItems *outputItems, int printHeader, SpatialParams *spatialParams, int loc);
 
 
+/* Same as runModelOutput, but the output is formatted and written by a separate writer thread,
+   while this thread goes on running the model (the output files are exactly the same)
+   Each time step's values are passed to the writer through a queue with room for bufferSteps (>= 1) time steps:
+   if the writer gets this far behind, the model waits for it (so bufferSteps also bounds the memory used)
+   Nothing else may write to out or outputItems' files until this returns
+*/
+void runModelOutputAsync(FILE *out, OutputItems *outputItems, int printHeader, SpatialParams *spatialParams, int loc, int bufferSteps);
+
+
+/* Same as runModelOutput, but the main output is written to binOutFile in binary (see binaryOutput.h):
+   column names and units, then chunks of time steps, holding each column's values contiguously,
+   as floats (if valueSize = 4) or doubles (if valueSize = 8)
+   outbintotxt converts this to the usual text output (exactly, if valueSize = 8)
+   (printHeader is recorded in the file, so the converted file has a header if printHeader = 1)
+   binOutFile must be open for binary writing, with nothing written to it yet
+*/
+void runModelOutputBinary(FILE *binOutFile, int valueSize, OutputItems *outputItems, int printHeader, SpatialParams *spatialParams, int loc);
+
+
+/* Put the name and units of each column of the main output (loc, year, day, time, then the model's state and fluxes)
+   in names[i] and units[i] (pointers to strings that mustn't be changed); names and units need room for MAX_OUTPUT_COLUMNS columns
+   return the number of columns
+*/
+int getOutputColumns(char *names[], char *units[]);
+
+
+// write the header of the main text output (as written by runModelOutput with printHeader = 1) to out
+void outputHeader(SipnetContext *ctx, FILE *out);
+
+
+/* write one line of the main text output to out, for the given loc, year, day and time,
+   with values[0..(number of columns - 5)] giving the values of the remaining columns (see getOutputColumns)
+*/
+void writeOutputStateValues(FILE *out, int loc, int year, int day, double time, double values[]);
+
+
+// same as runModelOutput, but using (and overwriting) the state in ctx
+// (outputItems should have been set up with setupOutputItemsCtx on this same ctx)
+void runModelOutputCtx(SipnetContext *ctx, FILE *out, OutputItems *outputItems, int printHeader, SpatialParams *spatialParams, int loc);
+
+
 /* Do a sensitivity test on paramNum, varying from low to high, doing a total of numRuns runs
    Run only at a single location (given by loc)
    If out != NULL, output results to out
@@ -99,4 +273,8 @@ void sensTest(FILE *out, OutputItems *outputItems, int paramNum, double low, dou
 void setupOutputItems(OutputItems *outputItems);
 
 
+// same as setupOutputItems, but output items point to the trackers in ctx rather than in the default context
+void setupOutputItemsCtx(SipnetContext *ctx, OutputItems *outputItems);
+
+
 #endif
@@ -511,12 +511,13 @@ void setAllSpatialParamBests(SpatialParams *spatialParams, int loc) {
 
 
 /* Return the index (into spatialParams->parameters) of a randomly-chosen spatial parameter that is changeable 
-   PRE: random number generator has been seeded
+   (using random numbers from rng)
+   PRE: rng has been seeded
 */
-int randomChangeableSpatialParam(SpatialParams *spatialParams) {
+int randomChangeableSpatialParam(SpatialParams *spatialParams, RandStream *rng) {
   int rnd; 
 
-  rnd = (int) floor(spatialParams->numChangeableParams * (rand()*1.0/(RAND_MAX + 1.0))); // 0 <= rnd < spatialParams->numChangeableParams
+  rnd = (int) floor(spatialParams->numChangeableParams * randStreamUniform(rng)); // 0 <= rnd < spatialParams->numChangeableParams
 
   return spatialParams->changeableParamIndices[rnd]; 
 }
@@ -545,15 +546,38 @@ void loadSpatialParams(SpatialParams *spatialParams, int loc) {
 }
 
 
+/* Same as loadSpatialParams, but rather than writing each value to its externalLoc,
+   treat externalLoc as a position relative to layoutBase, and write the value to the same position relative to target
+   (e.g. if externalLoc pointers point into some structure, layoutBase points to the start of that structure
+    and target points to the start of another structure of the same type)
+   This only reads from spatialParams, so it can be used to load the same spatialParams into many different places
+
+   PRE: same as for loadSpatialParams
+	all externalLoc pointers point into the array of doubles starting at layoutBase
+*/
+void loadSpatialParamsInto(SpatialParams *spatialParams, int loc, double *layoutBase, double *target) {
+  int i, numParams;
+  double value;
+
+  numParams = spatialParams->numParameters;
+  for (i = 0; i < numParams; i++) {
+    if (valueSet(spatialParams, i) && spatialParams->parameters[i].externalLoc != NULL) { 
+      value = getSpatialParam(spatialParams, i, loc);
+      target[spatialParams->parameters[i].externalLoc - layoutBase] = value; // copy value into the corresponding place in target
+    }
+  }
+}
+
+
 /* If randomReset = 0, set values of all parameters to be equal to guess values
    If randomReset non-zero, set parameter values to be somewhere (chosen uniform randomly) between min and max
     - Note that non-changeable parameters will still be set to their guess values, though
     (Note: ignores parameters that were never read in)
-   (If randomReset non-zero, random number generator must have been seeded)
+   (If randomReset non-zero, random numbers come from rng, which must have been seeded)
    Set best values of all parameters to be equal to current values
    Set knobs of all parameters to be equal to knob argument
 */
-void resetSpatialParams(SpatialParams *spatialParams, double knob, int randomReset) {
+void resetSpatialParams(SpatialParams *spatialParams, double knob, int randomReset, RandStream *rng) {
   int numParams, numLocs;
   int i, loc;
   double value;
@@ -569,7 +593,7 @@ void resetSpatialParams(SpatialParams *spatialParams, double knob, int randomRes
 	    value = getSpatialParamGuess(spatialParams, i, loc);
 	  else // random: set parameter value to be somewhere between min and max
 	    value = getSpatialParamMin(spatialParams, i) + (getSpatialParamMax(spatialParams, i) - getSpatialParamMin(spatialParams, i)) 
-	      * ((float)rand()/RAND_MAX);
+	      * randStreamUniform(rng);
 	  setSpatialParam(spatialParams, i, loc, value);
 	  setSpatialParamBest(spatialParams, i, loc, value);
 	  setSpatialParamKnob(spatialParams, i, loc, knob);
@@ -580,7 +604,7 @@ void resetSpatialParams(SpatialParams *spatialParams, double knob, int randomRes
 	  value = getSpatialParamGuess(spatialParams, i, 0);
 	else // random: set parameter value to be somewhere between min and max
 	  value = getSpatialParamMin(spatialParams, i) + (getSpatialParamMax(spatialParams, i) - getSpatialParamMin(spatialParams, i))
-	    * ((float)rand()/RAND_MAX);
+	    * randStreamUniform(rng);
 	setSpatialParam(spatialParams, i, 0, value);
 	setSpatialParamBest(spatialParams, i, 0, value);
 	setSpatialParamKnob(spatialParams, i, 0, knob);
@@ -671,6 +695,65 @@ void writeChangeableParamInfo(SpatialParams *spatialParams, int loc, FILE *outF)
 }
 
 
+/* Allocate and return a new spatialParams structure that is a copy of spatialParams:
+   same parameters, with the same values, guesses, bests, knobs, etc.
+   (and externalLoc pointers pointing to the same places)
+   Changes to the copy don't affect the original (e.g. so several chains can each work on their own copy)
+*/
+SpatialParams *copySpatialParams(SpatialParams *spatialParams) {
+  SpatialParams *copy;
+  OneSpatialParam *param, *paramCopy;
+  int i, length;
+
+  copy = newSpatialParams(spatialParams->maxParameters, spatialParams->numLocs);
+  copy->numParameters = spatialParams->numParameters;
+  copy->numParamsRead = spatialParams->numParamsRead;
+  copy->numChangeableParams = spatialParams->numChangeableParams;
+  memcpy(copy->readIndices, spatialParams->readIndices, spatialParams->numParamsRead * sizeof(int));
+  memcpy(copy->changeableParamIndices, spatialParams->changeableParamIndices, spatialParams->numChangeableParams * sizeof(int));
+
+  for (i = 0; i < spatialParams->numParameters; i++) {
+    param = &(spatialParams->parameters[i]);
+    paramCopy = &(copy->parameters[i]);
+    *paramCopy = *param; // copy all the non-pointer fields (and externalLoc)
+
+    if (param->value != NULL) { // this parameter has been read in: copy its vectors
+      length = (param->numLocs > 0) ? param->numLocs : 1;
+      paramCopy->value = (double *)malloc(length * sizeof(double));
+      paramCopy->guess = (double *)malloc(length * sizeof(double));
+      paramCopy->best = (double *)malloc(length * sizeof(double));
+      paramCopy->knob = (double *)malloc(length * sizeof(double));
+      memcpy(paramCopy->value, param->value, length * sizeof(double));
+      memcpy(paramCopy->guess, param->guess, length * sizeof(double));
+      memcpy(paramCopy->best, param->best, length * sizeof(double));
+      memcpy(paramCopy->knob, param->knob, length * sizeof(double));
+    }
+  }
+
+  return copy;
+}
+
+
+/* Set the value, best and knob of each parameter in to equal those in from, at all locations
+   PRE: to is a copy of from (made with copySpatialParams), or vice versa
+*/
+void copySpatialParamValues(SpatialParams *to, SpatialParams *from) {
+  OneSpatialParam *fromParam, *toParam;
+  int i, length;
+
+  for (i = 0; i < from->numParameters; i++) {
+    fromParam = &(from->parameters[i]);
+    toParam = &(to->parameters[i]);
+    if (fromParam->value != NULL) { // ignore parameters that were never read in
+      length = (fromParam->numLocs > 0) ? fromParam->numLocs : 1;
+      memcpy(toParam->value, fromParam->value, length * sizeof(double));
+      memcpy(toParam->best, fromParam->best, length * sizeof(double));
+      memcpy(toParam->knob, fromParam->knob, length * sizeof(double));
+    }
+  }
+}
+
+
 // Clean up: deallocate spatialParams and any other dynamically-allocated pointers that need deallocating
 void deleteSpatialParams(SpatialParams *spatialParams) {
   int numParameters, i;
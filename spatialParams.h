@@ -4,6 +4,8 @@
 #ifndef SPATIAL_PARAMS_H
 #define SPATIAL_PARAMS_H
 
+#include "util.h"
+
 #define PARAM_MAXNAME 64
 
 // struct to hold a single (possibly) spatially-varying param
@@ -193,9 +195,10 @@ void setAllSpatialParamBests(SpatialParams *spatialParams, int loc);
 
 
 /* Return the index (into spatialParams->parameters) of a randomly-chosen spatial parameter that is changeable 
-   PRE: random number generator has been seeded
+   (using random numbers from rng)
+   PRE: rng has been seeded
 */
-int randomChangeableSpatialParam(SpatialParams *spatialParams);
+int randomChangeableSpatialParam(SpatialParams *spatialParams, RandStream *rng);
 
 
 /* Load spatial parameters into memory locations pointed to by paramPtrs
@@ -209,15 +212,27 @@ int randomChangeableSpatialParam(SpatialParams *spatialParams);
 void loadSpatialParams(SpatialParams *spatialParams, int loc);
 
 
+/* Same as loadSpatialParams, but rather than writing each value to its externalLoc,
+   treat externalLoc as a position relative to layoutBase, and write the value to the same position relative to target
+   (e.g. if externalLoc pointers point into some structure, layoutBase points to the start of that structure
+    and target points to the start of another structure of the same type)
+   This only reads from spatialParams, so it can be used to load the same spatialParams into many different places
+
+   PRE: same as for loadSpatialParams
+	all externalLoc pointers point into the array of doubles starting at layoutBase
+*/
+void loadSpatialParamsInto(SpatialParams *spatialParams, int loc, double *layoutBase, double *target);
+
+
 /* If randomReset = 0, set values of all parameters to be equal to guess values
    If randomReset non-zero, set parameter values to be somewhere (chosen uniform randomly) between min and max
     - Note that non-changeable parameters will still be set to their guess values, though
     (Note: ignores parameters that were never read in)
-   (If randomReset non-zero, random number generator must have been seeded)
+   (If randomReset non-zero, random numbers come from rng, which must have been seeded)
    Set best values of all parameters to be equal to current values
    Set knobs of all parameters to be equal to knob argument
 */
-void resetSpatialParams(SpatialParams *spatialParams, double knob, int randomReset);
+void resetSpatialParams(SpatialParams *spatialParams, double knob, int randomReset, RandStream *rng);
 
 
 /* Write best parameter values, and other parameter info, to files
@@ -236,6 +251,20 @@ void writeBestSpatialParams(SpatialParams *spatialParams, char *paramFile, char
 void writeChangeableParamInfo(SpatialParams *spatialParams, int loc, FILE *outF);
 
 
+/* Allocate and return a new spatialParams structure that is a copy of spatialParams:
+   same parameters, with the same values, guesses, bests, knobs, etc.
+   (and externalLoc pointers pointing to the same places)
+   Changes to the copy don't affect the original (e.g. so several chains can each work on their own copy)
+*/
+SpatialParams *copySpatialParams(SpatialParams *spatialParams);
+
+
+/* Set the value, best and knob of each parameter in to equal those in from, at all locations
+   PRE: to is a copy of from (made with copySpatialParams), or vice versa
+*/
+void copySpatialParamValues(SpatialParams *to, SpatialParams *from);
+
+
 // Clean up: deallocate spatialParams and any other dynamically-allocated pointers that need deallocating
 void deleteSpatialParams(SpatialParams *spatialParams);
 
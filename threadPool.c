@@ -0,0 +1,227 @@
+/* threadPool: a fixed set of worker threads that can be handed a batch of independent tasks to run
+
+   The threads are created once, in newThreadPool, and then wait for work, so handing out a batch of tasks
+   (e.g. one model run per location, for every point of a chain) doesn't pay for creating threads each time
+
+   Creation date: 10/18/26
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include "threadPool.h"
+
+
+struct ThreadPoolStruct {
+  int numWorkers; // number of worker threads (not counting the thread that calls runTasks)
+  pthread_t *workers;
+
+  pthread_mutex_t lock; // protects everything below
+  pthread_cond_t workReady; // signalled when a new batch is started (or when we're quitting)
+  pthread_cond_t workDone; // signalled when the last task of a batch finishes
+
+  // the current batch:
+  void (*task)(int, void *);
+  void *taskInfo;
+  int numTasks;
+  int nextTask; // next task number to hand out
+  int numDone; // number of tasks finished so far
+  long batch; // incremented for each new batch, so workers can tell a new batch from the one they've just done
+
+  int quit; // set when the pool is being deleted
+};
+
+
+/* PRE: pool->lock is held
+   take tasks from the current batch and run them (releasing the lock while each runs) until there are none left to take
+   signal workDone when the last task of the batch finishes
+*/
+void doTasks(ThreadPool *pool) {
+  void (*task)(int, void *);
+  void *taskInfo;
+  int taskNum;
+
+  while (pool->nextTask < pool->numTasks) {
+    taskNum = pool->nextTask++;
+    task = pool->task;
+    taskInfo = pool->taskInfo;
+
+    pthread_mutex_unlock(&(pool->lock));
+    (*task)(taskNum, taskInfo);
+    pthread_mutex_lock(&(pool->lock));
+
+    pool->numDone++;
+    if (pool->numDone == pool->numTasks)
+      pthread_cond_broadcast(&(pool->workDone));
+  }
+}
+
+
+// main loop of each worker thread: wait for a new batch, help run it, repeat until told to quit
+void *workerMain(void *arg) {
+  ThreadPool *pool;
+  long lastBatch;
+
+  pool = (ThreadPool *)arg;
+  pthread_mutex_lock(&(pool->lock));
+  lastBatch = pool->batch;
+  while (1) {
+    while (pool->batch == lastBatch && !pool->quit)
+      pthread_cond_wait(&(pool->workReady), &(pool->lock));
+    if (pool->quit)
+      break;
+
+    lastBatch = pool->batch;
+    doTasks(pool);
+  }
+  pthread_mutex_unlock(&(pool->lock));
+
+  return NULL;
+}
+
+
+/* PRE: numThreads >= 1
+   allocate and return a new pool that runs tasks on numThreads threads in total:
+   the calling thread (which works on tasks while it waits in runTasks) plus (numThreads - 1) worker threads
+   With numThreads = 1, no threads are created, and runTasks just runs the tasks in order
+*/
+ThreadPool *newThreadPool(int numThreads) {
+  ThreadPool *pool;
+  int i;
+
+  if (numThreads < 1) {
+    printf("Error in newThreadPool: numThreads = %d, must be >= 1\n", numThreads);
+    exit(1);
+  }
+
+  pool = (ThreadPool *)malloc(sizeof(ThreadPool));
+  pool->numWorkers = numThreads - 1;
+  pool->workers = (pthread_t *)malloc(numThreads * sizeof(pthread_t)); // numThreads rather than numWorkers so we never malloc 0
+
+  pthread_mutex_init(&(pool->lock), NULL);
+  pthread_cond_init(&(pool->workReady), NULL);
+  pthread_cond_init(&(pool->workDone), NULL);
+
+  pool->task = NULL;
+  pool->taskInfo = NULL;
+  pool->numTasks = pool->nextTask = pool->numDone = 0;
+  pool->batch = 0;
+  pool->quit = 0;
+
+  for (i = 0; i < pool->numWorkers; i++) {
+    if (pthread_create(&(pool->workers[i]), NULL, workerMain, pool) != 0) {
+      printf("Error in newThreadPool: couldn't create thread %d of %d\n", i + 1, pool->numWorkers);
+      exit(1);
+    }
+  }
+
+  return pool;
+}
+
+
+/* Call task(taskNum, taskInfo) once for each taskNum from 0 to numTasks-1, spreading the calls over the pool's threads,
+   and return once all have finished
+   Tasks may run in any order, and several at once, so they must not write to anything shared:
+   typically each task writes its results into its own element of an array in taskInfo, which the caller
+   then goes through in order (so that results don't depend on the number of threads)
+*/
+void runTasks(ThreadPool *pool, int numTasks, void (*task)(int, void *), void *taskInfo) {
+  int taskNum;
+
+  if (pool->numWorkers == 0 || numTasks == 1) { // nothing to share out: just run the tasks here
+    for (taskNum = 0; taskNum < numTasks; taskNum++)
+      (*task)(taskNum, taskInfo);
+    return;
+  }
+
+  pthread_mutex_lock(&(pool->lock));
+  pool->task = task;
+  pool->taskInfo = taskInfo;
+  pool->numTasks = numTasks;
+  pool->nextTask = 0;
+  pool->numDone = 0;
+  pool->batch++;
+  pthread_cond_broadcast(&(pool->workReady));
+
+  doTasks(pool); // work on the batch ourselves, too
+  while (pool->numDone < pool->numTasks)
+    pthread_cond_wait(&(pool->workDone), &(pool->lock));
+  pthread_mutex_unlock(&(pool->lock));
+}
+
+
+// for runOnEachThread: the task to run on each thread, and a count of the threads that have started it
+typedef struct EachThreadInfoStruct {
+  void (*task)(void *);
+  void *taskInfo;
+  int numThreads;
+  int numStarted;
+  pthread_mutex_t lock; // protects numStarted
+  pthread_cond_t allStarted; // signalled when numStarted reaches numThreads
+} EachThreadInfo;
+
+
+/* one of the tasks handed out by runOnEachThread: wait until there's a thread running each of the numThreads tasks,
+   then run the task
+   (since no thread can take a second task while it's waiting in its first, each thread gets exactly one)
+*/
+void eachThreadTask(int taskNum, void *eachThreadInfo) {
+  EachThreadInfo *info = (EachThreadInfo *)eachThreadInfo;
+
+  pthread_mutex_lock(&(info->lock));
+  info->numStarted++;
+  if (info->numStarted == info->numThreads)
+    pthread_cond_broadcast(&(info->allStarted));
+  while (info->numStarted < info->numThreads)
+    pthread_cond_wait(&(info->allStarted), &(info->lock));
+  pthread_mutex_unlock(&(info->lock));
+
+  (*(info->task))(info->taskInfo);
+}
+
+
+/* Call task(taskInfo) exactly once on each of the pool's threads (including the calling thread),
+   and return once all have finished
+   (e.g. to set up each thread's own scratch space before the threads are given real work)
+*/
+void runOnEachThread(ThreadPool *pool, void (*task)(void *), void *taskInfo) {
+  EachThreadInfo info;
+
+  info.task = task;
+  info.taskInfo = taskInfo;
+  info.numThreads = getNumThreads(pool);
+  info.numStarted = 0;
+  pthread_mutex_init(&(info.lock), NULL);
+  pthread_cond_init(&(info.allStarted), NULL);
+
+  runTasks(pool, info.numThreads, eachThreadTask, &info);
+
+  pthread_mutex_destroy(&(info.lock));
+  pthread_cond_destroy(&(info.allStarted));
+}
+
+
+// return the total number of threads that run tasks in pool (including the calling thread)
+int getNumThreads(ThreadPool *pool) {
+  return pool->numWorkers + 1;
+}
+
+
+// stop all the pool's worker threads and free all space used by pool
+void deleteThreadPool(ThreadPool *pool) {
+  int i;
+
+  pthread_mutex_lock(&(pool->lock));
+  pool->quit = 1;
+  pthread_cond_broadcast(&(pool->workReady));
+  pthread_mutex_unlock(&(pool->lock));
+
+  for (i = 0; i < pool->numWorkers; i++)
+    pthread_join(pool->workers[i], NULL);
+
+  pthread_mutex_destroy(&(pool->lock));
+  pthread_cond_destroy(&(pool->workReady));
+  pthread_cond_destroy(&(pool->workDone));
+  free(pool->workers);
+  free(pool);
+}
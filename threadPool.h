@@ -0,0 +1,42 @@
+// header file for threadPool.c
+// a fixed set of worker threads that can be handed a batch of independent tasks to run
+
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+// contents are private to threadPool.c
+typedef struct ThreadPoolStruct ThreadPool;
+
+
+/* PRE: numThreads >= 1
+   allocate and return a new pool that runs tasks on numThreads threads in total:
+   the calling thread (which works on tasks while it waits in runTasks) plus (numThreads - 1) worker threads
+   With numThreads = 1, no threads are created, and runTasks just runs the tasks in order
+*/
+ThreadPool *newThreadPool(int numThreads);
+
+
+/* Call task(taskNum, taskInfo) once for each taskNum from 0 to numTasks-1, spreading the calls over the pool's threads,
+   and return once all have finished
+   Tasks may run in any order, and several at once, so they must not write to anything shared:
+   typically each task writes its results into its own element of an array in taskInfo, which the caller
+   then goes through in order (so that results don't depend on the number of threads)
+*/
+void runTasks(ThreadPool *pool, int numTasks, void (*task)(int, void *), void *taskInfo);
+
+
+/* Call task(taskInfo) exactly once on each of the pool's threads (including the calling thread),
+   and return once all have finished
+   (e.g. to set up each thread's own scratch space before the threads are given real work)
+*/
+void runOnEachThread(ThreadPool *pool, void (*task)(void *), void *taskInfo);
+
+
+// return the total number of threads that run tasks in pool (including the calling thread)
+int getNumThreads(ThreadPool *pool);
+
+
+// stop all the pool's worker threads and free all space used by pool
+void deleteThreadPool(ThreadPool *pool);
+
+#endif
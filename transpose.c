@@ -156,6 +156,10 @@ int main(int argc, char *argv[])  {
   f = openFile(filename, "r");
 
   nl = numlines(f, &longestLine);
+  if (nl < 1)  {
+    printf("Error: %s is empty: nothing to transpose\n", filename);
+    exit(1);
+  }
   rewind(f);
 
   // Allocate space to hold the file, line by line:
@@ -11,8 +11,13 @@
 #include <math.h>
 #include <string.h>
 #include <ctype.h>
+#include <stdint.h>
 #include "util.h"
 
+#define ALIGNMENT 64 // makeAlignedArray arrays start on a boundary of this many bytes (a cache line)
+#define SUM_BLOCK 32 /* sumWeightedSquares adds up blocks of at most this many terms directly, and splits anything longer in two
+			(must be a multiple of 4) */
+
 
 // set filename = <base>.<ext>
 // assumes filename has been allocated and is large enough to hold result
@@ -80,6 +85,127 @@ double randm() {
   return log(val);
 }
 
+
+/* Random number streams: xoshiro256++ (Blackman & Vigna), which has a period of 2^256 - 1
+   and a jump function that moves a stream on by 2^128 (or, with the long jump, 2^192) numbers
+   Streams and substreams are found by jumping from the base stream, so they never overlap in practice */
+
+static const uint64_t RAND_STREAM_JUMP[4] = {0x180ec6d33cfd0abaULL, 0xd5a61266f0c9392cULL,
+					    0xa9582618e03fc9aaULL, 0x39abdc4529b1661cULL};
+static const uint64_t RAND_STREAM_LONG_JUMP[4] = {0x76e15d3efefdcbbfULL, 0xc5004e441c522fb3ULL,
+						 0x77710069854ee241ULL, 0x39109bb02acbe635ULL};
+
+
+static uint64_t rotl64(uint64_t x, int k) {
+  return (x << k) | (x >> (64 - k));
+}
+
+
+// return the next value of the splitmix64 generator with given state (used to fill in a stream's state from a seed)
+static uint64_t splitmix64(uint64_t *state) {
+  uint64_t z;
+
+  z = (*state += 0x9e3779b97f4a7c15ULL);
+  z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+  return z ^ (z >> 31);
+}
+
+
+// return the next 64 random bits in stream
+static uint64_t nextRandStream(RandStream *stream) {
+  uint64_t *s = stream->s;
+  uint64_t result, t;
+
+  result = rotl64(s[0] + s[3], 23) + s[0];
+  t = s[1] << 17;
+  s[2] ^= s[0];
+  s[3] ^= s[1];
+  s[1] ^= s[2];
+  s[0] ^= s[3];
+  s[2] ^= t;
+  s[3] = rotl64(s[3], 45);
+
+  return result;
+}
+
+
+// move stream on by the number of steps given by the jump polynomial jump[0..3]
+static void jumpRandStreamBy(RandStream *stream, const uint64_t jump[4]) {
+  uint64_t s[4] = {0, 0, 0, 0};
+  int i, b;
+
+  for (i = 0; i < 4; i++) {
+    for (b = 0; b < 64; b++) {
+      if (jump[i] & ((uint64_t)1 << b)) {
+	s[0] ^= stream->s[0];
+	s[1] ^= stream->s[1];
+	s[2] ^= stream->s[2];
+	s[3] ^= stream->s[3];
+      }
+      nextRandStream(stream);
+    }
+  }
+
+  for (i = 0; i < 4; i++)
+    stream->s[i] = s[i];
+}
+
+
+// start stream at the beginning of the base stream given by seed
+void seedRandStream(RandStream *stream, unsigned int seed) {
+  uint64_t state;
+  int i;
+
+  state = seed;
+  for (i = 0; i < 4; i++)
+    stream->s[i] = splitmix64(&state); // splitmix64 never gives all zeros here, so the state is valid
+}
+
+
+/* set substream to stream number streamNum, substream number substreamNum of base
+   (i.e. base moved on by streamNum * 2^192 + substreamNum * 2^128 numbers)
+   base is not changed
+*/
+void getRandSubstream(RandStream *substream, const RandStream *base, int streamNum, int substreamNum) {
+  int i;
+
+  *substream = *base;
+  for (i = 0; i < streamNum; i++)
+    jumpRandStreamBy(substream, RAND_STREAM_LONG_JUMP);
+  for (i = 0; i < substreamNum; i++)
+    jumpRandStreamBy(substream, RAND_STREAM_JUMP);
+}
+
+
+// return the next random number in stream, uniformly distributed in [0, 1)
+double randStreamUniform(RandStream *stream) {
+  return (nextRandStream(stream) >> 11) * (1.0/9007199254740992.0); // top 53 bits, divided by 2^53
+}
+
+
+// same as randm, but using the given stream rather than rand()
+double randmStream(RandStream *stream) {
+  double val;
+
+  do {
+    val = randStreamUniform(stream);
+  } while (val <= 0.0); // val should be <= 0.0 once in a blue moon
+  return log(val);
+}
+
+// return the next random number in stream from a standard normal distribution (mean 0, s.d. 1)
+// uses the Box-Muller transform, throwing away the second number it gives so that stream is the only state
+double randStreamNormal(RandStream *stream) {
+  double u1, u2;
+
+  do {
+    u1 = randStreamUniform(stream);
+  } while (u1 <= 0.0);
+  u2 = randStreamUniform(stream);
+  return sqrt(-2.0 * log(u1)) * cos(2.0 * M_PI * u2);
+}
+
 // allocate space for an array of doubles of given size,
 // return pointer to start of array
 double *makeArray(int size) {
@@ -89,6 +215,19 @@ double *makeArray(int size) {
 }
 
 
+/* allocate space for an array of doubles of given size, starting on an ALIGNMENT-byte boundary
+   (so that vectorized loops over it start at the beginning of a cache line)
+   return pointer to start of array (NULL if we couldn't allocate it); free it with free()
+*/
+double *makeAlignedArray(int size) {
+  void *ptr;
+
+  if (posix_memalign(&ptr, ALIGNMENT, ((size > 0) ? size : 1) * sizeof(double)) != 0) // (size 1 so we never allocate 0)
+    return NULL;
+  return (double *)ptr;
+}
+
+
 /* Dynamically allocate space for a 2-d array of doubles of given size,
    return pointer to start of array
    
@@ -155,6 +294,90 @@ double sumArray(double *array, int length) {
 }
 
 
+/* PRE: n <= SUM_BLOCK
+   return the sum of w[i] * (x[i] - y[i])^2 over i = 0..n-1 (or of (x[i] - y[i])^2 if w is NULL)
+   Term i goes into partial sum (i % 4), and the partial sums are added as (s0 + s1) + (s2 + s3):
+   the four partial sums don't depend on each other, so the compiler can keep them in SIMD registers
+   and do several terms at once - while the order of the additions (and so the result) stays fixed
+*/
+static double blockWeightedSquares(const double *x, const double *y, const double *w, int n) {
+  double s[4] = {0.0, 0.0, 0.0, 0.0};
+  double err;
+  int i, lane;
+
+  // the weight check is outside the loops, so there are no branches inside them:
+  if (w == NULL) {
+    for (i = 0; i + 4 <= n; i += 4) {
+      for (lane = 0; lane < 4; lane++) {
+	err = x[i + lane] - y[i + lane];
+	s[lane] += err * err;
+      }
+    }
+    for (lane = 0; i + lane < n; lane++) { // the last (n % 4) terms
+      err = x[i + lane] - y[i + lane];
+      s[lane] += err * err;
+    }
+  }
+  else {
+    for (i = 0; i + 4 <= n; i += 4) {
+      for (lane = 0; lane < 4; lane++) {
+	err = x[i + lane] - y[i + lane];
+	s[lane] += w[i + lane] * err * err;
+      }
+    }
+    for (lane = 0; i + lane < n; lane++) {
+      err = x[i + lane] - y[i + lane];
+      s[lane] += w[i + lane] * err * err;
+    }
+  }
+
+  return (s[0] + s[1]) + (s[2] + s[3]);
+}
+
+
+/* return the sum of w[i] * (x[i] - y[i])^2 over i = 0..n-1 (or of (x[i] - y[i])^2 if w is NULL)
+   Uses pairwise summation: split the terms in two (the first part a whole number of SUM_BLOCK blocks),
+   sum each part the same way, and add the two sums - down to blocks of SUM_BLOCK terms, which are summed directly
+   (see blockWeightedSquares)
+   So the rounding error grows with log(n) rather than n, and the result depends only on the values and n
+   (not on the vector instructions used, or the number of threads)
+   This also relies on each multiply and add being rounded separately: the Makefile builds this file with -ffp-contract=off,
+   since otherwise some compilers fuse them into multiply-adds on machines that have them (e.g. gcc on aarch64)
+*/
+double sumWeightedSquares(const double *x, const double *y, const double *w, int n) {
+  int half;
+
+  if (n <= SUM_BLOCK)
+    return blockWeightedSquares(x, y, w, n);
+
+  // the smallest whole number of blocks covering at least half the terms (always < n, since n > SUM_BLOCK):
+  half = ((n + 1)/2 + SUM_BLOCK - 1)/SUM_BLOCK * SUM_BLOCK;
+  return sumWeightedSquares(x, y, w, half)
+    + sumWeightedSquares(x + half, y + half, (w == NULL) ? NULL : w + half, n - half);
+}
+
+
+/* PRE: L[0..n-1][0..n-1] is the lower-triangular Cholesky factor of a positive-definite matrix A (A = L L^T)
+   update L in place so that it is the Cholesky factor of A + v v^T (a rank-one update, in O(n^2) time)
+   v[0..n-1] is used as workspace, and is destroyed
+*/
+void choleskyUpdate(double **L, double *v, int n) {
+  double r, c, s;
+  int i, k;
+
+  for (k = 0; k < n; k++) {
+    r = sqrt(L[k][k]*L[k][k] + v[k]*v[k]);
+    c = r/L[k][k];
+    s = v[k]/L[k][k];
+    L[k][k] = r;
+    for (i = k + 1; i < n; i++) {
+      L[i][k] = (L[i][k] + s*v[i])/c;
+      v[i] = c*v[i] - s*L[i][k];
+    }
+  }
+}
+
+
 // do an strcmp on s1 and s2, ignoring case
 // (convert both to lower case before comparing)
 // return value is the same as for strcmp
@@ -201,3 +424,35 @@ int stripComment(char *line, const char *commentChars)  {
   return (lenTrim == 0);
 }
   
+
+
+// Read a comma-separated list of integers from s (e.g. "3,17,42") into a new array (allocated with malloc), *list
+// Return the number of integers in the list (0, with *list = NULL, if s is empty)
+// If an item isn't an integer, print an error message (which calls the list name) and exit
+int parseIntList(const char *s, const char *name, int **list)  {
+  const char *item;
+  char *errc;
+  int num, i;
+
+  *list = NULL;
+  if (strlen(s) == 0)
+    return 0;
+
+  num = 1;
+  for (i = 0; s[i] != '\0'; i++)
+    if (s[i] == ',')
+      num++;
+
+  *list = (int *)malloc(num * sizeof(int));
+  item = s;
+  for (i = 0; i < num; i++)  {
+    (*list)[i] = strtol(item, &errc, 0);
+    if (errc == item || (*errc != ',' && *errc != '\0'))  {  // empty item, or invalid character(s) in it
+      printf("ERROR: Invalid %s: %s (must be a comma-separated list of integers, with no spaces)\n", name, s);
+      exit(1);
+    }
+    item = errc + 1;  // (just past the comma)
+  }
+
+  return num;
+}
@@ -9,6 +9,7 @@
 #define UTIL_H
 
 #include <stdio.h>
+#include <stdint.h>
 
 // set filename = <base>.<ext>
 // assumes filename has been allocated and is large enough to hold result
@@ -27,11 +28,47 @@ void seedRand(unsigned int seed, FILE *outF);
 // returns an exponentially-distributed negative random number 
 double randm();
 
+/* a stream of random numbers with its own state, independent of rand() and of other streams
+   (so that, e.g., chains running at the same time in different threads each get a reproducible sequence)
+   Uses xoshiro256++, which can jump ahead, so one seed gives a whole family of non-overlapping streams:
+   seed a base stream with seedRandStream, then use getRandSubstream to get a separate stream
+   for each chain (streamNum), and within that for each location or ensemble member (substreamNum)
+   Results then depend only on the seed, not on the order in which the streams are used
+*/
+typedef struct RandStreamStruct {
+  uint64_t s[4];
+} RandStream;
+
+// start stream at the beginning of the base stream given by seed
+void seedRandStream(RandStream *stream, unsigned int seed);
+
+/* set substream to stream number streamNum, substream number substreamNum of base
+   (i.e. base moved on by streamNum * 2^192 + substreamNum * 2^128 numbers)
+   base is not changed
+*/
+void getRandSubstream(RandStream *substream, const RandStream *base, int streamNum, int substreamNum);
+
+// return the next random number in stream, uniformly distributed in [0, 1)
+double randStreamUniform(RandStream *stream);
+
+// same as randm, but using the given stream rather than rand()
+double randmStream(RandStream *stream);
+
+// return the next random number in stream from a standard normal distribution (mean 0, s.d. 1)
+double randStreamNormal(RandStream *stream);
+
 // allocate space for an array of doubles of given size,
 // return pointer to start of array
 double *makeArray(int size);
 
 
+/* allocate space for an array of doubles of given size, starting on a cache-line boundary
+   (so that vectorized loops over it start at the beginning of a cache line)
+   return pointer to start of array (NULL if we couldn't allocate it); free it with free()
+*/
+double *makeAlignedArray(int size);
+
+
 /* Dynamically allocate space for a 2-d array of doubles of given size,
    return pointer to start of array
    
@@ -59,6 +96,21 @@ void assignArray(double *out, double *in, int n);
 double sumArray(double *array, int length);
 
 
+/* return the sum of w[i] * (x[i] - y[i])^2 over i = 0..n-1 (or of (x[i] - y[i])^2 if w is NULL)
+   Written so the compiler can vectorize it, but with a fixed (pairwise) summation order,
+   so the result depends only on the values and n (and rounding error grows with log(n) rather than n),
+   as long as util.c is built without floating-point contraction (see Makefile)
+*/
+double sumWeightedSquares(const double *x, const double *y, const double *w, int n);
+
+
+/* PRE: L[0..n-1][0..n-1] is the lower-triangular Cholesky factor of a positive-definite matrix A (A = L L^T)
+   update L in place so that it is the Cholesky factor of A + v v^T (a rank-one update, in O(n^2) time)
+   v[0..n-1] is used as workspace, and is destroyed
+*/
+void choleskyUpdate(double **L, double *v, int n);
+
+
 // do an strcmp on s1 and s2, ignoring case
 // (convert both to lower case before comparing)
 // return value is the same as for strcmp
@@ -69,4 +121,9 @@ int strcmpIgnoreCase(const char *s1, const char *s2);
 // Return 1 if line contains only a comment (or only blanks), 0 otherwise
 int stripComment(char *line, const char *commentChars);
 
+// Read a comma-separated list of integers from s (e.g. "3,17,42") into a new array (allocated with malloc), *list
+// Return the number of integers in the list (0, with *list = NULL, if s is empty)
+// If an item isn't an integer, print an error message (which calls the list name) and exit
+int parseIntList(const char *s, const char *name, int **list);
+
 #endif